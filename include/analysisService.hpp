@@ -0,0 +1,200 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the asynchronous analysis service, which queries Stockfish in the background and caches the results.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "chessAnalysis.hpp"
+
+/**
+ * Options for the analysis service.
+*/
+struct AnalysisServiceOptions {
+    int timeoutMs = ANALYSIS_TIMEOUT_MS;    // longest a single request can take
+    int maxRetries = 2;                     // number of times a failed request is tried again
+    int retryDelayMs = 500;                 // wait before the first retry, doubled for each one after it
+    int numWorkers = 2;                     // number of requests that can be in flight at once, each with its own connection
+    size_t cacheSize = 256;                 // number of analysed positions kept
+};
+
+/**
+ * Gets the key a position is cached under. Only the placement, side to move, castling and en passant fields of the
+ *   fen are used, so the same position reached by a different move order (or with different clocks) shares a key.
+ * @param fen       string of the 'fen' representation of the board's pieces
+ * @param depth     int for the search depth requested from the engine
+ *
+ * @returns a string for the cache key
+*/
+std::string getAnalysisCacheKey(const std::string &fen, int depth);
+
+/**
+ * Analyses positions with the analysis backend on background threads, so the caller never waits on the network.
+ *   Each worker keeps its own cpr::Session, so connections are reused between requests. Successful results are kept
+ *   in an LRU cache, and a position that is already being analysed shares the request in flight.
+*/
+class AnalysisService {
+public:
+    /**
+     * Starts the worker threads of the service.
+     * @param options   AnalysisServiceOptions for the timeouts, retries, workers and cache
+    */
+    AnalysisService(const AnalysisServiceOptions &options=AnalysisServiceOptions());
+
+    /**
+     * Stops the workers after their current request. Requests still queued finish unsuccessfully.
+    */
+    ~AnalysisService();
+
+    AnalysisService(const AnalysisService &) = delete;
+    AnalysisService &operator=(const AnalysisService &) = delete;
+
+    /**
+     * Requests the analysis of a position, returning straight away.
+     * @param fen       string of the 'fen' representation of the board's pieces
+     * @param depth     int for the search depth requested from the engine
+     *
+     * @returns a future for the ChessAnalysisResult, which is already ready if the position was cached
+    */
+    std::shared_future<ChessAnalysisResult> requestAnalysis(const std::string &fen, int depth=10);
+
+    /**
+     * Gets the analysis of a position if it is in the cache, without making a request.
+     * @param fen       string of the 'fen' representation of the board's pieces
+     * @param depth     int for the search depth requested from the engine
+     * @param result    the resulting ChessAnalysisResult
+     *
+     * @returns true if the position was cached
+    */
+    bool getCachedAnalysis(const std::string &fen, int depth, ChessAnalysisResult &result);
+
+    /**
+     * Removes every position from the cache.
+    */
+    void clearCache();
+
+private:
+    struct PendingRequest {
+        std::string key;
+        std::string fen;
+        int depth;
+        std::promise<ChessAnalysisResult> promise;
+    };
+
+    void runWorker();
+    bool findInCache(const std::string &key, ChessAnalysisResult &result);
+    void addToCache(const std::string &key, const ChessAnalysisResult &result);
+
+    AnalysisServiceOptions options;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+    std::deque<PendingRequest> queue;
+    std::unordered_map<std::string, std::shared_future<ChessAnalysisResult>> inFlight;
+
+    // most recently used first, with the map pointing at each position's entry in the list
+    std::list<std::pair<std::string, ChessAnalysisResult>> cacheOrder;
+    std::unordered_map<std::string, std::list<std::pair<std::string, ChessAnalysisResult>>::iterator> cacheEntries;
+
+    std::vector<std::thread> workers;
+};
+
+/**
+ * Gets the process-wide analysis service, starting it on first use with the current analysis backend.
+ *
+ * @returns a reference to the shared AnalysisService
+*/
+AnalysisService &getAnalysisService();
+
+// the Stockfish API doesn't search deeper than this
+const int STOCKFISH_API_MAX_DEPTH = 15;
+
+/**
+ * Options for progressive analysis, set from the command line.
+*/
+struct ProgressiveAnalysisOptions {
+    bool enabled = false;   // if the live displays analyse progressively instead of waiting for one full search
+    int firstDepth = 6;     // shallowest depth that is shown, which the engine gets to almost straight away
+    int maxDepth = 24;      // deepest the search goes while the board stays the same
+    int multiPv = 1;        // number of principal variations searched by the local engine, each adding a move
+};
+
+/**
+ * Sets the options of progressive analysis. Must be called before the first ProgressiveAnalysis is made.
+ * @param options   ProgressiveAnalysisOptions for the analysis
+*/
+void setProgressiveAnalysisOptions(const ProgressiveAnalysisOptions &options);
+
+/**
+ * @returns the options of progressive analysis
+*/
+const ProgressiveAnalysisOptions &getProgressiveAnalysisOptions();
+
+/**
+ * Keeps deepening the analysis of one position on a background thread, so a shallow result can be shown almost at
+ *   once and replaced by deeper ones as each depth finishes. Setting a new position stops the search of the old one
+ *   straight away. The local UCI backend reports every depth (and several principal variations) from one search on
+ *   its own engine; the Stockfish API only answers whole searches, so it is asked for firstDepth and then maxDepth.
+*/
+class ProgressiveAnalysis {
+public:
+    /**
+     * Starts the background thread, which waits for a position.
+     * @param options   ProgressiveAnalysisOptions for the depths and principal variations
+    */
+    ProgressiveAnalysis(const ProgressiveAnalysisOptions &options=getProgressiveAnalysisOptions());
+
+    /**
+     * Stops the search and the background thread.
+    */
+    ~ProgressiveAnalysis();
+
+    ProgressiveAnalysis(const ProgressiveAnalysis &) = delete;
+    ProgressiveAnalysis &operator=(const ProgressiveAnalysis &) = delete;
+
+    /**
+     * Starts analysing a position, stopping the search of the previous one. Setting the same position again keeps
+     *   its search going.
+     * @param fen   string of the 'fen' representation of the board's pieces, empty to only stop
+    */
+    void setPosition(const std::string &fen);
+
+    /**
+     * Stops the search, the same as setting an empty position.
+    */
+    void stop();
+
+    /**
+     * Gets the deepest result of the current position, if it has changed since the last call.
+     * @param result    the resulting ChessAnalysisResult
+     *
+     * @returns true if there was a new result
+    */
+    bool getUpdate(ChessAnalysisResult &result);
+
+private:
+    void runWorker();
+
+    ProgressiveAnalysisOptions options;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+    std::string fen;
+    uint64_t generation;        // counts the positions set, so a search can tell it is out of date
+    ChessAnalysisResult latest;
+    bool hasUpdate;
+    std::thread worker;
+};
@@ -0,0 +1,82 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the auto-labeling mode, which grows the feature files from photos whose fens are already known instead
+  of asking for two key presses per square.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "chessBoard.hpp"
+#include "featureStore.hpp"
+#include "pieceDetectionOps.hpp"
+
+// bins for each side of the histograms written to the feature files, the same as addLabelFeatures
+const int AUTO_LABEL_BINS = 16;
+
+/**
+ * Options for an auto-labeling run, set from the command line.
+*/
+struct AutoLabelOptions {
+    std::string truthPath;                      // file of "image,fen" lines, the same format as images/ground_truth.csv
+    std::string imageDir;                       // directory the image names are in, the truth file's directory by default
+    int numThreads = 0;                         // number of worker threads, 0 for one per core
+    bool rectified = false;                     // if the squares are taken from the rectified top-down board
+    int maxMismatches = 4;                      // most squares whose occupancy can disagree with the fen, -1 for no check
+    std::string lightPath = CSV_LIGHT_FILE_PATH;    // feature csv file the light squares are appended to
+    std::string darkPath = CSV_DARK_FILE_PATH;      // feature csv file the dark squares are appended to
+};
+
+/**
+ * Parses the auto-labeling options from the command line arguments after "autolabel".
+ *   Usage: autolabel <ground_truth.csv> [--images DIR] [--threads N] [--rectified] [--max-mismatch N]
+ *                    [--light light_features.csv] [--dark dark_features.csv]
+ * @param argc      int for the number of arguments
+ * @param argv      array of the argument strings
+ * @param first     int for the index of the first argument after "autolabel"
+ * @param options   the resulting AutoLabelOptions
+ *
+ * @returns 0 if the arguments were valid, non-zero otherwise
+*/
+int parseAutoLabelOptions(int argc, char *argv[], int first, AutoLabelOptions &options);
+
+/**
+ * Reads the ground truth file, where each line is an image's file name and the fen of its board.
+ *   Blank lines and lines starting with '#' are skipped, and only the placement field of the fen is kept.
+ * @param truthPath     string for the path of the ground truth file
+ * @param truth         the resulting map from each image's file name to its placement
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int readGroundTruth(const std::string &truthPath, std::map<std::string, std::string> &truth);
+
+/**
+ * Finds the board in a photo and adds the features of all 64 squares, labeled from the known board, to the light or
+ *   dark feature file of each square. The squares are the ones the pieces are classified from, so the new rows are
+ *   compared like for like. A board whose occupancy disagrees with the fen on more than maxMismatches squares is taken
+ *   to have been found wrongly and adds nothing.
+ * @param imgPath       string for the path of the image
+ * @param truth         Board the photo is known to show
+ * @param options       AutoLabelOptions for the run
+ * @param lightWriter   FeatureWriter for the light squares
+ * @param darkWriter    FeatureWriter for the dark squares
+ * @param mismatches    the resulting number of squares whose occupancy disagreed with the fen
+ *
+ * @returns 0 if the squares were added, 1 if the image couldn't be read, 2 if the board wasn't found and 3 if it was
+ *          skipped for disagreeing with the fen
+*/
+int autoLabelImage(const std::string &imgPath, const Board &truth, const AutoLabelOptions &options,
+                   FeatureWriter &lightWriter, FeatureWriter &darkWriter, int &mismatches);
+
+/**
+ * Auto-labels every photo of the ground truth file across a pool of worker threads, writing the features through one
+ *   buffered FeatureWriter per feature file (and its binary feature file, if there is one). Never uses HighGUI or stdin.
+ * @param options   AutoLabelOptions for the run
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int runAutoLabel(const AutoLabelOptions &options);
@@ -0,0 +1,123 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the headless batch mode, which processes many images to fen across a pool of worker threads.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "boardImage.hpp"
+#include "chessAnalysis.hpp"
+
+/**
+ * Options for a batch run, set from the command line.
+*/
+struct BatchOptions {
+    std::string inputPath;                      // directory of images, or a text file with one image path per line
+    std::string turn = "w";                     // side to move for every image, "w" or "b"
+    int numThreads = 0;                         // number of worker threads, 0 for one per core
+    std::string outputPath = "results.jsonl";   // file the JSON lines are written to
+    bool eval = false;                          // if the position should also be analysed by Stockfish
+    bool rectified = false;                     // if the pieces are classified from the rectified top-down board
+    bool useClassifier = false;                 // if the occupied squares are classified by the neural network
+    int numDecodeThreads = 1;                   // number of threads reading and decoding images ahead of the workers
+    int queueSize = 8;                          // images each stage can get ahead of the next
+};
+
+/**
+ * Parses the batch options from the command line arguments after "batch".
+ *   Usage: batch <dir or list file> [--turn w|b] [--threads N] [--out results.jsonl] [--eval] [--rectified] [--nn]
+ *                [--decode-threads N] [--queue N]
+ * @param argc      int for the number of arguments
+ * @param argv      array of the argument strings
+ * @param first     int for the index of the first argument after "batch"
+ * @param options   the resulting BatchOptions
+ *
+ * @returns 0 if the arguments were valid, non-zero otherwise
+*/
+int parseBatchOptions(int argc, char *argv[], int first, BatchOptions &options);
+
+/**
+ * Collects the image paths for a batch, from either a directory of images or a text file listing them.
+ * @param inputPath     string for the directory or list file
+ * @param imagePaths    the resulting vector of image paths, sorted if they came from a directory
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int collectImagePaths(const std::string &inputPath, std::vector<std::string> &imagePaths);
+
+/**
+ * Gets the most memory the process has had resident at once.
+ *
+ * @returns the peak resident set size in bytes
+*/
+size_t getPeakRssBytes();
+
+/**
+ * Runs the whole pipeline on one image of the batch, timing each stage.
+ * @param imgPath   string for the path of the image
+ * @param options   BatchOptions for the run
+ *
+ * @returns the JSON object for the image's line of output, with "error" set if it could not be processed
+*/
+nlohmann::json processBatchImage(const std::string &imgPath, const BatchOptions &options);
+
+/**
+ * Runs the whole pipeline on an image that is already loaded, such as an upload, timing each stage.
+ * @param image     BoardImage for the photo of the board
+ * @param options   BatchOptions for the run
+ *
+ * @returns the JSON object for the image, with "error" set if it could not be processed
+*/
+nlohmann::json processBatchImage(std::shared_ptr<BoardImage> image, const BatchOptions &options);
+
+/**
+ * Reads an image of the batch and decodes it at both of the resolutions the pipeline uses, timing each step.
+ *   This is the I/O stage of the batch, kept apart so the next image can be decoded while this one is processed.
+ * @param imgPath   string for the path of the image
+ * @param image     the resulting BoardImage, decoded for the geometry and the classification
+ * @param timings   the resulting JSON object of the milliseconds spent reading and decoding
+ *
+ * @returns 0 if the function returns successfully, 1 if the image could not be read and 2 if it could not be decoded
+*/
+int loadBatchImage(const std::string &imgPath, std::shared_ptr<BoardImage> &image, nlohmann::json &timings);
+
+/**
+ * Runs the pipeline on an image loaded by loadBatchImage, putting the read and decode times in with the stages.
+ * @param imgPath       string for the path of the image
+ * @param image         BoardImage from loadBatchImage, null if it couldn't be read
+ * @param loadResult    int returned by loadBatchImage
+ * @param loadTimings   JSON object of the timings from loadBatchImage
+ * @param options       BatchOptions for the run
+ *
+ * @returns the JSON object for the image's line of output, with "error" set if it could not be processed
+*/
+nlohmann::json processLoadedBatchImage(const std::string &imgPath, std::shared_ptr<BoardImage> image, int loadResult,
+                                       const nlohmann::json &loadTimings, const BatchOptions &options);
+
+/**
+ * Adds the eval, mate and best move of an analysis to the JSON of its image, leaving out what the analysis didn't find.
+ * @param analysis  ChessAnalysisResult of the image's fen
+ * @param result    JSON object for the image
+*/
+void addAnalysisToResult(const ChessAnalysisResult &analysis, nlohmann::json &result);
+
+/**
+ * Processes every image of the batch as a pipeline of three stages joined by bounded queues, writing one JSON line per
+ *   image with its path, fen, labels, optional eval and the time spent in each stage. The I/O stage reads and decodes
+ *   the images, the vision workers find the board and label the pieces, and the analysis stage waits for the engine
+ *   and writes the lines. Image N+1 is decoded while N is labeled and N-1 is analysed, so the batch runs at the speed
+ *   of its slowest stage. Never uses HighGUI or stdin.
+ * @param options   BatchOptions for the run
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int runBatch(const BatchOptions &options);
@@ -0,0 +1,159 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the board result cache, which reuses the labels of a board that has already been classified when a
+  photo of it looks the same square for square.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "chessBoard.hpp"
+
+// smallest difference in gray level between neighbouring cells of a tile for it to set a bit of the hash
+const int TILE_HASH_MIN_GRADIENT = 8;
+
+/**
+ * Options for the board result cache.
+*/
+struct BoardCacheOptions {
+    size_t maxBytes = 0;                    // memory the cached boards can take, 0 (the default) turns the cache off
+    int maxSquareDistance = 6;              // most bits of a square's hash that can differ for the square to match
+};
+
+/**
+ * The perceptual hash of each of the 64 squares of a board, in the order of the rectangles they were taken from.
+*/
+typedef std::array<uint64_t, 64> BoardFingerprint;
+
+/**
+ * A classified board held by the cache. The mode separates labels found in different ways (such as by the
+ *   classifier instead of the histograms), which never match each other.
+*/
+struct BoardCacheEntry {
+    BoardFingerprint fingerprint;
+    int mode = 0;
+    Board board;
+    std::vector<double> occupancyScores;
+    std::vector<float> confidences;
+};
+
+/**
+ * Gets the difference hash of a tile: it is shrunk to 9x8 gray cells and each bit says if a cell is brighter than the
+ *   one to its left. Differences smaller than TILE_HASH_MIN_GRADIENT don't set a bit, so a flat empty square hashes
+ *   to (nearly) 0 instead of to its noise.
+ * @param tile      cv::Mat of the tile, gray or BGR
+ *
+ * @returns the 64 bit hash of the tile
+*/
+uint64_t getTileHash(const cv::Mat &tile);
+
+/**
+ * @returns the number of bits that differ between two hashes
+*/
+int getHashDistance(uint64_t first, uint64_t second);
+
+/**
+ * Hashes every square of the board. The edges of each square are left out, so the lines of the board and small
+ *   shifts of the grid between photos don't change the hash.
+ * @param src           cv::Mat of the image the squares are in
+ * @param squares       vector of the 64 cv::Rect's for the squares
+ * @param fingerprint   the resulting BoardFingerprint
+ *
+ * @returns 0 if every square was hashed, non-zero if there weren't 64 squares inside the image
+*/
+int getBoardFingerprint(const cv::Mat &src, const std::vector<cv::Rect> &squares, BoardFingerprint &fingerprint);
+
+/**
+ * Classified boards kept by their fingerprint, so a board photographed again (a camera that hasn't moved, or the same
+ *   position in an archive) skips the classifier. A fingerprint matches an entry when every square is within
+ *   maxSquareDistance bits of it; a moved piece changes its two squares by far more than that. The least recently
+ *   used boards are dropped once the entries take more than maxBytes. Safe to use from several threads.
+*/
+class BoardCache {
+public:
+    /**
+     * Creates an empty cache.
+     * @param options   BoardCacheOptions for the memory cap and matching tolerance
+    */
+    explicit BoardCache(const BoardCacheOptions &options=BoardCacheOptions());
+
+    BoardCache(const BoardCache &) = delete;
+    BoardCache &operator=(const BoardCache &) = delete;
+
+    /**
+     * Looks for a board matching the fingerprint, marking it as the most recently used.
+     * @param fingerprint   BoardFingerprint of the board being classified
+     * @param mode          int for how the labels are found
+     * @param entry         the resulting BoardCacheEntry
+     *
+     * @returns true if a matching board was cached
+    */
+    bool find(const BoardFingerprint &fingerprint, int mode, BoardCacheEntry &entry);
+
+    /**
+     * Adds a classified board, dropping the least recently used ones until the cache fits its memory cap again.
+     * @param entry     BoardCacheEntry to add
+    */
+    void add(const BoardCacheEntry &entry);
+
+    /**
+     * Removes every board from the cache.
+    */
+    void clear();
+
+    /**
+     * @returns the number of boards in the cache
+    */
+    size_t size();
+
+    /**
+     * @returns the memory taken by the boards in the cache
+    */
+    size_t getNumBytes();
+
+private:
+    BoardCacheOptions options;
+    std::mutex mutex;
+    std::list<BoardCacheEntry> entries;
+    size_t numBytes;
+};
+
+/**
+ * Sets the options of the board result cache. Must be called before the first board is classified.
+ * @param options   BoardCacheOptions for the cache
+*/
+void setBoardCacheOptions(const BoardCacheOptions &options);
+
+/**
+ * @returns the options of the board result cache
+*/
+const BoardCacheOptions &getBoardCacheOptions();
+
+/**
+ * @returns the board result cache shared by every pipeline, created with the options set on first use
+*/
+BoardCache &getBoardCache();
+
+/**
+ * Looks for the board in the shared cache. A low contrast piece can hash close to an empty square, so a matching
+ *   board is only accepted if the occupancy scores of the squares agree with it on which squares are empty.
+ * @param src           cv::Mat of the image the squares are in
+ * @param squares       vector of the 64 cv::Rect's for the squares
+ * @param imageScale    float for the size of the squares relative to the full resolution photos, passed to isEmptyOccupancyScore
+ * @param entry         BoardCacheEntry with the mode the labels are found in, which gets the fingerprint of the board and,
+ *                      if it was found, the cached labels with the occupancy scores of this image at full resolution
+ *
+ * @returns 0 if the board was found, 1 if it wasn't (so the classified board can be added with the fingerprint) and
+ *          -1 if the cache is off or the squares couldn't be hashed
+*/
+int findCachedBoard(const cv::Mat &src, const std::vector<cv::Rect> &squares, float imageScale, BoardCacheEntry &entry);
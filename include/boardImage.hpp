@@ -0,0 +1,105 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the board image loader, which decodes a photo only at the resolutions the pipeline actually uses.
+*/
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+// smallest the copy the pieces are classified from can be, so the squares keep enough detail for the histograms
+const cv::Size CLASSIFICATION_MIN_SIZE(1400, 1400);
+
+/**
+ * Reads the width and height of a JPEG or PNG from its header, without decoding it.
+ *   The size is before any EXIF rotation, so callers should only rely on the shorter and longer sides.
+ * @param encoded   vector of the bytes of the encoded image
+ * @param size      the resulting cv::Size
+ *
+ * @returns 0 if the function returns successfully, non-zero if the format isn't recognized
+*/
+int readEncodedImageSize(const std::vector<uchar> &encoded, cv::Size &size);
+
+/**
+ * Gets the largest factor (1, 2, 4 or 8) the image can be reduced by while decoding and still cover the minimum size.
+ * @param fullSize      cv::Size of the full resolution image
+ * @param minimumSize   cv::Size the reduced image has to cover, in either orientation
+ *
+ * @returns the reduction factor
+*/
+int getReducedDecodeFactor(const cv::Size &fullSize, const cv::Size &minimumSize);
+
+/**
+ * A photo of the board, kept encoded and decoded lazily at a reduced scale for each use.
+ *   The geometry is found on a heavily reduced decode, the pieces are classified from a single mid-resolution copy,
+ *   and the full resolution is only decoded if it is asked for. JPEGs are reduced while they are decoded, so the
+ *   smaller copies never cost a full resolution decode or its memory.
+*/
+class BoardImage {
+public:
+    BoardImage();
+
+    /**
+     * Wraps an image that is already decoded, which is then used at every resolution.
+     * @param image     cv::Mat storing the image (the pixels are shared, not copied)
+    */
+    explicit BoardImage(const cv::Mat &image);
+
+    /**
+     * Reads the encoded image and its size from the header. Nothing is decoded yet for JPEGs and PNGs.
+     * @param imgPath   string for the path of the image
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int load(const std::string &imgPath);
+
+    /**
+     * Takes the bytes of an encoded image, such as an upload, and reads its size from the header.
+     * @param encodedImage  vector of the bytes of the encoded image, moved into the BoardImage
+     * @param name          string naming the image in messages
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int loadEncoded(std::vector<uchar> encodedImage, const std::string &name="image");
+
+    /**
+     * @returns true if no image has been loaded
+    */
+    bool empty() const;
+
+    /**
+     * Gets the image decoded as small as possible while still covering the working size of the geometry.
+     * @param workingSize   cv::Size that the geometry is found at
+     *
+     * @returns the reduced image, empty if it could not be decoded
+    */
+    const cv::Mat &getGeometryImage(const cv::Size &workingSize);
+
+    /**
+     * @returns the mid-resolution copy the pieces are classified from, empty if it could not be decoded
+    */
+    const cv::Mat &getClassificationImage();
+
+    /**
+     * @returns the size of the classification image relative to the full resolution, such as 0.5
+    */
+    float getClassificationScale() const;
+
+    /**
+     * @returns the image at full resolution, empty if it could not be decoded
+    */
+    const cv::Mat &getFullImage();
+
+private:
+    const cv::Mat &getDecoded(int factor);
+
+    std::vector<uchar> encoded;
+    cv::Size fullSize;
+    int classificationFactor;
+    // the image decoded at a factor of 1, 2, 4 and 8, each only once it is needed
+    cv::Mat decoded[4];
+};
@@ -0,0 +1,95 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for fitting the 9x9 lattice of the board to the intersections, and rectifying the board to a top-down image.
+*/
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+// side of each square in the rectified top-down image of the board, in pixels
+const int RECTIFIED_SQUARE_SIZE = 96;
+// fewest lattice points that have to be matched to an intersection for the fit to be trusted
+const int MIN_LATTICE_INLIERS = 24;
+// how far (in pixels of the resized image the lattice was fit on) each lattice point is searched around for its corner
+const float CORNER_SEARCH_RADIUS = 2.5f;
+// gray level deviation a corner's window needs, below it the window is too flat (or too covered) to find the corner in
+const double CORNER_MIN_CONTRAST = 10.0;
+
+/**
+ * The board's 9x9 lattice, found by fitting a homography to the intersections.
+*/
+struct BoardLattice {
+    cv::Mat homography;                 // CV_64F 3x3 map from board coordinates (column and row, 0 to 8) to image pixels
+    std::vector<cv::Point2f> points;    // the 81 lattice points in the image, row by row from the top left
+    int numInliers = 0;                 // number of lattice points matched to an intersection
+};
+
+/**
+ * Fits the 9x9 lattice of the board to the intersections, so missing or extra intersections don't break the grid.
+ *      The outer corners are guessed from the most extreme intersections, then the homography is refit with RANSAC
+ *      on every intersection that lands near a lattice point until the matches stop improving.
+ * @param intersections     vector of cv::Point2f's representing the intersections between the Hough lines
+ * @param lattice           the resulting BoardLattice
+ * @param inlierDistance    float for how close (in pixels) an intersection has to be to its lattice point to match it
+ *
+ * @returns 0 if the function returns successfully, 1 if no lattice fits enough of the intersections
+*/
+int fitBoardLattice(const std::vector<cv::Point2f> &intersections, BoardLattice &lattice, float inlierDistance=10.0);
+
+/**
+ * Finds the corners of the lattice again at the resolution of a bigger image of the board, since the lattice fit on the
+ *      resized image is only as exact as its pixels. cornerSubPix is run in a small window of the image around each
+ *      point, so it costs 81 small windows instead of finding the lines again at the higher resolution. The homography
+ *      is refit with RANSAC on the corners that were found, and any corner it doesn't agree with (like one covered by a
+ *      piece) is put back on the refit lattice.
+ * @param src           cv::Mat for the image of the board, gray or BGR
+ * @param lattice       BoardLattice in the coordinates of src, refined in place
+ * @param searchRadius  float for how far (in pixels of src) each corner can be from its lattice point
+ *
+ * @returns 0 if the function returns successfully, 1 if too few corners were found and the lattice was left as it was
+*/
+int refineBoardLattice(const cv::Mat &src, BoardLattice &lattice, float searchRadius);
+
+/**
+ * Sets if the lattice's corners are refined at the resolution the pieces are classified at, on by default.
+ * @param refine    bool for if the corners should be refined
+*/
+void setRefineLatticeCorners(bool refine);
+
+/**
+ * @returns true if the lattice's corners are refined at the resolution the pieces are classified at
+*/
+bool getRefineLatticeCorners();
+
+/**
+ * Scales a homography into image pixels to the same image at another size.
+ * @param homography    CV_64F 3x3 cv::Mat for the homography into the first image
+ * @param fromSize      cv::Size of the image the homography maps into
+ * @param toSize        cv::Size of the image it should map into instead
+ *
+ * @returns the scaled homography
+*/
+cv::Mat scaleHomography(const cv::Mat &homography, const cv::Size &fromSize, const cv::Size &toSize);
+
+/**
+ * Warps the board to a top-down image where every square is the same size, in one pass over the image.
+ * @param src           cv::Mat for the image of the board
+ * @param homography    CV_64F 3x3 cv::Mat from board coordinates to the pixels of src
+ * @param board         cv::Mat for the resulting top-down image of the board
+ * @param squareSize    int for the side of each square in the top-down image
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int rectifyBoard(const cv::Mat &src, const cv::Mat &homography, cv::Mat &board, int squareSize=RECTIFIED_SQUARE_SIZE);
+
+/**
+ * Gets the rectangles of the squares in the top-down image of the board from rectifyBoard.
+ * @param squareSize    int for the side of each square in the top-down image
+ *
+ * @returns a vector of the 64 cv::Rect's, row by row from the top left
+*/
+std::vector<cv::Rect> getRectifiedSquares(int squareSize=RECTIFIED_SQUARE_SIZE);
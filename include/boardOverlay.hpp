@@ -0,0 +1,53 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the overlay renderer, which draws the results of the pipeline onto one output image only when it is
+  displayed, so the stages that compute them never draw on (or copy) the frames they read.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "chessBoard.hpp"
+#include "chessAnalysis.hpp"
+#include "boardPipeline.hpp"
+
+/**
+ * What to draw over an image of the board, as plain results in the coordinates of that image.
+*/
+struct BoardOverlay {
+    std::vector<cv::Vec4i> lines;       // hough lines
+    std::vector<cv::Point2f> points;    // grid points, drawn as numbered circles
+    std::vector<cv::Rect> squares;      // the squares the labels and best move are placed in
+    bool showSquares = false;           // if the squares are outlined
+    Board labels;                       // piece on each square
+    bool showLabels = false;            // if the labels are drawn
+    ChessAnalysisResult analysis;       // evaluation and best move, drawn if it succeeded
+
+    /**
+     * @returns true if there is nothing to draw
+    */
+    bool empty() const;
+};
+
+/**
+ * Gets the overlay for one of the displays of the image workflow from the pipeline's cached stages. 'x' and 'a'
+ *   request the analysis, which is only in the overlay once it has arrived.
+ * @param pipeline  BoardPipeline for the image
+ * @param display   char for the display, such as 's' for the squares or 'a' for every step
+ *
+ * @returns the BoardOverlay for the display, in the coordinates of the resized image for 'h' and of the source otherwise
+*/
+BoardOverlay getBoardOverlay(BoardPipeline &pipeline, char display);
+
+/**
+ * Draws an overlay over an image. The image is copied into dst once and everything is drawn onto that copy.
+ * @param base      cv::Mat for the image to draw over, which is only read
+ * @param overlay   BoardOverlay to draw
+ * @param dst       cv::Mat for the resulting image
+*/
+void renderBoardOverlay(const cv::Mat &base, const BoardOverlay &overlay, cv::Mat &dst);
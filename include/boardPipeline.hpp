@@ -0,0 +1,196 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the per-image pipeline context, which computes each stage of the board workflow once and caches it.
+*/
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chessAnalysis.hpp"
+#include "boardLattice.hpp"
+#include "boardImage.hpp"
+
+/**
+ * Per-image context for the chess board workflow.
+ *   Each stage (hough lines, intersections, lattice, scaled points, rectangles, labels, fen, analysis) is computed
+ *   lazily the first time it is requested, and the cached result is returned from then on.
+*/
+class BoardPipeline {
+public:
+    /**
+     * Creates the pipeline for the given source image. Nothing is computed until a stage is requested.
+     * @param src           cv::Mat storing the source image (the pixels are shared, not copied)
+     * @param workingSize   cv::Size that the image is resized to for finding the board geometry
+    */
+    BoardPipeline(const cv::Mat &src, cv::Size workingSize=cv::Size(428, 524));
+
+    /**
+     * Creates the pipeline for a loaded photo, which is only decoded at the resolutions the stages ask for.
+     * @param image         BoardImage for the photo of the board
+     * @param workingSize   cv::Size that the image is resized to for finding the board geometry
+    */
+    BoardPipeline(std::shared_ptr<BoardImage> image, cv::Size workingSize=cv::Size(428, 524));
+
+    /**
+     * Sets whose turn it is, so getFen doesn't have to ask the user.
+     * @param turn  string for the side to move, "w" for white or "b" for black
+    */
+    void setTurn(const std::string &turn);
+
+    /**
+     * Sets if the pieces are classified from the squares of the rectified top-down board instead of the source image.
+     * @param useRectified  bool for if the rectified squares should be used
+    */
+    void setUseRectifiedSquares(bool useRectified);
+
+    /**
+     * Sets if the occupied squares are classified by the neural network piece classifier instead of the histograms.
+     * @param useClassifier     bool for if the piece classifier should be used
+    */
+    void setUseClassifier(bool useClassifier);
+
+    /**
+     * @returns the source image the pieces are classified from, the mid-resolution copy for a loaded photo
+    */
+    const cv::Mat &getSource();
+
+    /**
+     * @returns the source image resized to the working size
+    */
+    const cv::Mat &getResized();
+
+    /**
+     * @returns the Canny edges of the resized image that the hough lines were found from
+    */
+    const cv::Mat &getEdges();
+
+    /**
+     * @returns the hough lines found on the resized image
+    */
+    const std::vector<cv::Vec4i> &getLines();
+
+    /**
+     * @returns the sorted intersections of the hough lines, in the coordinates of the resized image
+    */
+    const std::vector<cv::Point2f> &getIntersections();
+
+    /**
+     * @returns the board's 9x9 lattice fit to the intersections, with no points if it couldn't be fit
+    */
+    const BoardLattice &getLattice();
+
+    /**
+     * @returns the 81 points of the lattice in the coordinates of the resized image, or the intersections if it couldn't be fit
+    */
+    const std::vector<cv::Point2f> &getGridPoints();
+
+    /**
+     * @returns the grid points scaled back to the coordinates of the source image
+    */
+    const std::vector<cv::Point2f> &getOriginalPoints();
+
+    /**
+     * @returns the homography from board coordinates (0 to 8) to the source image, empty if the lattice couldn't be fit
+    */
+    const cv::Mat &getHomography();
+
+    /**
+     * @returns the top-down image of the board with every square the same size, empty if the lattice couldn't be fit
+    */
+    const cv::Mat &getRectifiedBoard();
+
+    /**
+     * @returns the rectangles for each square of the board, in the coordinates of the source image
+    */
+    const std::vector<cv::Rect> &getRectangles();
+
+    /**
+     * Gets the image and squares the pieces are classified from: the source image and its rectangles, or the
+     *   rectified board and its uniform squares if they were asked for and the lattice was fit.
+     * @param source        the resulting image the squares are in
+     * @param squares       the resulting rectangle of each square in the source
+     * @param imageScale    the resulting size of the squares relative to the full resolution photos the thresholds were tuned on
+     *
+     * @returns true if the squares come from the rectified board
+    */
+    bool getClassificationSquares(cv::Mat &source, std::vector<cv::Rect> &squares, float &imageScale);
+
+    /**
+     * @returns the piece labels for each square of the board
+    */
+    const Board &getSquareLabels();
+
+    /**
+     * @returns the occupancy score of each square the labels were found with, scaled to full resolution like the thresholds
+    */
+    const std::vector<double> &getOccupancyScores();
+
+    /**
+     * @returns the piece classifier's confidence in each square's label, empty if the histograms were used
+    */
+    const std::vector<float> &getSquareConfidences();
+
+    /**
+     * @returns the fen for the labels of the board (asks the user whose turn it is the first time, unless it was set)
+    */
+    const std::string &getFen();
+
+    /**
+     * Starts the Stockfish analysis of the board's fen in the background, if it hasn't been started already.
+    */
+    void requestAnalysis();
+
+    /**
+     * @returns true if the analysis has been requested and has arrived (or there was no fen to analyse), so getAnalysis won't wait
+    */
+    bool isAnalysisReady();
+
+    /**
+     * @returns the Stockfish analysis of the board's fen, waiting for it to arrive if it has to
+    */
+    const ChessAnalysisResult &getAnalysis();
+
+private:
+    std::shared_ptr<BoardImage> image;
+    cv::Size workingSize;
+    std::string turn;
+    bool useRectifiedSquares;
+    bool useClassifier;
+
+    cv::Mat resized;
+    cv::Mat edges;
+    cv::UMat resizedDevice;
+    cv::UMat edgesDevice;
+    std::vector<cv::Vec4i> lines;
+    std::vector<cv::Point2f> intersections;
+    BoardLattice lattice;
+    std::vector<cv::Point2f> gridPoints;
+    std::vector<cv::Point2f> originalPoints;
+    cv::Mat homography;
+    cv::Mat rectifiedBoard;
+    std::vector<cv::Rect> rectangles;
+    Board squareLabels;
+    std::vector<double> occupancyScores;
+    std::vector<float> squareConfidences;
+    std::string fen;
+    ChessAnalysisResult analysis;
+    std::shared_future<ChessAnalysisResult> pendingAnalysis;
+
+    bool hasLines;
+    bool hasIntersections;
+    bool hasLattice;
+    bool hasOriginalPoints;
+    bool hasRectifiedBoard;
+    bool hasRectangles;
+    bool hasSquareLabels;
+    bool hasFen;
+    bool hasRequestedAnalysis;
+    bool hasAnalysis;
+};
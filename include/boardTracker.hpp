@@ -0,0 +1,83 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for tracking the board geometry from frame to frame in a video.
+*/
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+/**
+ * Tracks the chess board's grid across the frames of a video.
+ *   The grid is found once through the full hough pipeline, and from then on only the four outer corners of the
+ *   board are followed with optical flow. The full detection is only run again when tracking is lost or the
+ *   corners move too far from where they were found (the camera moved).
+*/
+class BoardTracker {
+public:
+    /**
+     * Creates a tracker that hasn't found the board yet.
+     * @param workingSize       cv::Size the frames are resized to for detection and tracking
+     * @param maxCornerMotion   float for how far (in working size pixels) a corner may drift from where it was
+     *                          detected before the board is detected again
+    */
+    BoardTracker(cv::Size workingSize=cv::Size(428, 524), float maxCornerMotion=25.0);
+
+    /**
+     * Updates the board geometry for the next frame, tracking it if possible and detecting it otherwise.
+     * @param frame     cv::Mat of the current video frame
+     *
+     * @returns true if the board geometry is known for this frame
+    */
+    bool update(const cv::Mat &frame);
+
+    /**
+     * Forgets the current board so it is detected again on the next frame.
+    */
+    void reset();
+
+    /**
+     * @returns true if the board geometry is known for the last frame
+    */
+    bool isTracking() const;
+
+    /**
+     * @returns true if the last update ran the full detection rather than tracking
+    */
+    bool wasRedetected() const;
+
+    /**
+     * @returns the 81 grid points of the board in the last frame, in the frame's coordinates
+    */
+    const std::vector<cv::Point2f> &getPoints() const;
+
+    /**
+     * @returns the 64 rectangles for each square of the board in the last frame
+    */
+    const std::vector<cv::Rect> &getRectangles() const;
+
+private:
+    bool detect(const cv::Mat &frame);
+    bool track(const cv::Mat &frame);
+    void setGeometry(const std::vector<cv::Point2f> &points, const cv::Size &frameSize);
+
+    cv::Size workingSize;
+    float maxCornerMotion;
+
+    bool tracking;
+    bool redetected;
+
+    // grayscale working size copy of the previous frame, for optical flow
+    cv::Mat prevGray;
+    // grid and outer corners found by the last detection, in working size coordinates
+    std::vector<cv::Point2f> detectedPoints;
+    std::vector<cv::Point2f> detectedCorners;
+    // outer corners in the previous frame, in working size coordinates
+    std::vector<cv::Point2f> corners;
+
+    std::vector<cv::Point2f> points;
+    std::vector<cv::Rect> rectangles;
+};
@@ -0,0 +1,114 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  A bounded queue for handing work between the stages of the batch and serve pipelines.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/**
+ * A fixed capacity, multi-producer multi-consumer FIFO queue. push() waits while the queue is full, so a fast stage
+ *   can only run its capacity ahead of a slow one, and pop() waits while it is empty. Once closed, pushes fail and
+ *   pops drain what is left before failing.
+*/
+template <typename T>
+class BoundedQueue {
+public:
+    /**
+     * Creates an empty queue.
+     * @param capacity  size_t for the most items the queue holds at once, at least 1
+    */
+    explicit BoundedQueue(size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false) {}
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /**
+     * Adds an item to the back of the queue, waiting for room if it is full.
+     * @param item  T to add, moved into the queue
+     *
+     * @returns true if the item was added, false if the queue was closed
+    */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]() { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Adds an item to the back of the queue only if there is room for it now.
+     * @param item  T to add, moved into the queue if there was room
+     *
+     * @returns true if the item was added, false if the queue was full or closed
+    */
+    bool tryPush(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (closed || items.size() >= capacity) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Takes the item at the front of the queue, waiting for one if it is empty.
+     * @param item  the resulting T
+     *
+     * @returns true if an item was taken, false if the queue is closed and empty
+    */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this]() { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Closes the queue, waking every waiting producer and consumer.
+    */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    /**
+     * @returns the number of items in the queue
+    */
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+private:
+    size_t capacity;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<T> items;
+};
@@ -9,24 +9,120 @@
 #include <iostream>
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <cpr/cpr.h>
 #include <nlohmann/json.hpp>
 #include <opencv2/opencv.hpp>
 
+#include "chessBoard.hpp"
+
+const char STOCKFISH_API_URL[] = "https://stockfish.online/api/s/v2.php";
+// longest we wait for the whole Stockfish API request, in milliseconds
+const int ANALYSIS_TIMEOUT_MS = 10000;
+
+/**
+ * Where positions are sent to be analysed.
+*/
+enum AnalysisBackend {
+    ANALYSIS_BACKEND_HTTP,  // the stockfish.online API
+    ANALYSIS_BACKEND_UCI    // a local UCI engine binary, kept running between positions
+};
+
+/**
+ * Options for the analysis backend, set once at startup before anything is analysed.
+*/
+struct AnalysisBackendOptions {
+    AnalysisBackend backend = ANALYSIS_BACKEND_HTTP;
+    std::string enginePath = "stockfish";   // engine binary for the UCI backend
+    int numEngines = 1;                     // number of engine processes for the UCI backend
+    int movetimeMs = 0;                     // milliseconds the UCI engine searches for instead of a depth, 0 to use the depth
+};
+
+/**
+ * Result of analysing a position with the Stockfish chess engine.
+*/
+struct ChessAnalysisResult {
+    bool success = false;           // true if the engine returned a response we could parse
+    bool hasEval = false;           // true if eval holds the engine's evaluation
+    float eval = 0.0f;              // evaluation of the position in pawns, from white's point of view
+    bool hasMate = false;           // true if the engine found a forced mate instead of an evaluation
+    int mate = 0;                   // moves until mate, positive if white mates and negative if black does
+    std::string bestMoveString;     // full 'bestmove' value returned by the engine
+    std::pair<int, int> bestMove = std::pair<int, int>(0, 0);  // square indices of the best move, equal if there is none
+    int depth = 0;                  // depth the engine searched to, 0 if it didn't say
+    std::vector<std::pair<int, int>> otherMoves;    // first moves of the other principal variations with multi-PV, best first
+};
+
+/**
+ * Sets where positions are sent to be analysed. Must be called before the first analysis.
+ * @param options   AnalysisBackendOptions for the backend
+*/
+void setAnalysisBackend(const AnalysisBackendOptions &options);
+
+/**
+ * @returns the options of the current analysis backend
+*/
+const AnalysisBackendOptions &getAnalysisBackend();
+
 /**
- * Makes an API call to StockFish chess engine based on the fen, and displays the evaluation and best move if obtained.
- * @param dst       cv::Mat representing the image
+ * Gets the name of a square (such as "e4") from its index, where index 0 is a8 and index 63 is h1.
+ * @param index     int for the index of the square
+ * 
+ * @returns the name of the square from SQUARE_NAMES, or an empty string if the index is out of range
+*/
+const char *getSquareName(int index);
+
+/**
+ * Gets the indices for the squares of the best move by parsing the StockFish API response.
+ * @param fullString    the full string of the 'bestmove' json value from the stockfish API
+ * 
+ * @returns a pair of ints, where the first index is the current piece position and the second index is where it should be moved to
+*/
+std::pair<int, int> getBestMove(const std::string &fullString);
+
+/**
+ * Makes an API call to the Stockfish chess engine over the given session, so its connection is reused between calls.
+ * @param session   cpr::Session to make the request with
  * @param fen       string of the 'fen' representation of the board's pieces
- * @param squares   vector of cv::Rect's representing the squares so the best move can be displayed.
+ * @param result    the resulting ChessAnalysisResult holding the evaluation and best move
+ * @param depth     int for the search depth requested from the engine
+ * @param timeoutMs int for the milliseconds to wait for the whole request before giving up
  * 
- * @returns 0 if the function returns successfully
+ * @returns 0 if the function returns successfully, 1 if the request failed and is worth retrying, 2 otherwise
 */
-int getChessAnalysis(cv::Mat image, std::string fen, std::vector<cv::Rect> squares);
+int fetchChessAnalysis(cpr::Session &session, const std::string &fen, ChessAnalysisResult &result, int depth, int timeoutMs);
+
+/**
+ * Analyses the position with the local UCI engines of the analysis backend, starting them on first use.
+ * @param fen       string of the 'fen' representation of the board's pieces
+ * @param result    the resulting ChessAnalysisResult holding the evaluation and best move
+ * @param depth     int for the search depth, unless the backend has a movetime set
+ * 
+ * @returns 0 if the function returns successfully, 1 if the engine failed and is worth retrying
+*/
+int fetchEngineAnalysis(const std::string &fen, ChessAnalysisResult &result, int depth=10);
+
+/**
+ * Displays the evaluation and best move from an analysis on the given image.
+ * @param image     cv::Mat representing the image
+ * @param result    ChessAnalysisResult to display
+ * @param squares   vector of cv::Rect's representing the squares so the best move can be displayed.
+*/
+void drawChessAnalysis(cv::Mat &image, const ChessAnalysisResult &result, const std::vector<cv::Rect> &squares);
 
 /**
  * Converts the labels of the chessboard to the chess "fen" format, a format that an API related to chess can read
- * @param squareLabels  vector of strings representing the labels for each square on the board
+ * @param board     Board holding the piece on each square
+ * 
+ * @returns a string in the "fen" format, or an empty string if a square couldn't be labeled
+*/
+std::string getFenFromLabels(const Board &board);
+
+/**
+ * Converts the labels of the chessboard to the chess "fen" format without asking whose turn it is.
+ * @param board     Board holding the piece on each square
+ * @param turn      string for the side to move, "w" for white or "b" for black
  * 
- * @returns a string in the "fen" format
+ * @returns a string in the "fen" format, or an empty string if a square couldn't be labeled or the turn is invalid
 */
-std::string getFenFromLabels(std::vector<std::string> squareLabels);
\ No newline at end of file
+std::string getFenFromLabels(const Board &board, const std::string &turn);
@@ -0,0 +1,198 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the compact board representation: a one byte piece per square, and constexpr tables between the pieces,
+  their labels and fen characters, and the square names and indices.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * What is on a square, stored in one byte. PIECE_UNKNOWN is a square that couldn't be labeled.
+*/
+enum Piece : uint8_t {
+    PIECE_EMPTY,
+    PIECE_WHITE_PAWN,
+    PIECE_WHITE_KNIGHT,
+    PIECE_WHITE_BISHOP,
+    PIECE_WHITE_ROOK,
+    PIECE_WHITE_QUEEN,
+    PIECE_WHITE_KING,
+    PIECE_BLACK_PAWN,
+    PIECE_BLACK_KNIGHT,
+    PIECE_BLACK_BISHOP,
+    PIECE_BLACK_ROOK,
+    PIECE_BLACK_QUEEN,
+    PIECE_BLACK_KING,
+    PIECE_UNKNOWN,
+    NUM_PIECES
+};
+
+// label of each piece, the colour ('w', 'b' or 'e') then the piece ('p', 'n', 'b', 'r', 'q', 'k' or 'e')
+constexpr const char *PIECE_LABELS[NUM_PIECES] = {
+    "ee", "wp", "wn", "wb", "wr", "wq", "wk", "bp", "bn", "bb", "br", "bq", "bk", ""};
+
+// fen character of each piece, where '?' can't appear in a fen
+constexpr char PIECE_FEN_CHARS[NUM_PIECES] = {'1', 'P', 'N', 'B', 'R', 'Q', 'K', 'p', 'n', 'b', 'r', 'q', 'k', '?'};
+
+// name of each square, where index 0 is a8 and index 63 is h1
+constexpr char SQUARE_NAMES[64][3] = {
+    "a8", "b8", "c8", "d8", "e8", "f8", "g8", "h8",
+    "a7", "b7", "c7", "d7", "e7", "f7", "g7", "h7",
+    "a6", "b6", "c6", "d6", "e6", "f6", "g6", "h6",
+    "a5", "b5", "c5", "d5", "e5", "f5", "g5", "h5",
+    "a4", "b4", "c4", "d4", "e4", "f4", "g4", "h4",
+    "a3", "b3", "c3", "d3", "e3", "f3", "g3", "h3",
+    "a2", "b2", "c2", "d2", "e2", "f2", "g2", "h2",
+    "a1", "b1", "c1", "d1", "e1", "f1", "g1", "h1"};
+
+/**
+ * Gets the piece for a label, such as 'w' and 'p' for a white pawn or 'e' and 'e' for an empty square.
+ * @param color     char for the colour of the piece ('w', 'b' or 'e')
+ * @param type      char for the piece ('p', 'n', 'b', 'r', 'q', 'k' or 'e')
+ *
+ * @returns the Piece, or PIECE_UNKNOWN if the label isn't one
+*/
+constexpr Piece getPieceFromLabel(char color, char type) {
+    for (int piece = PIECE_EMPTY; piece < PIECE_UNKNOWN; piece++) {
+        if (PIECE_LABELS[piece][0] == color && PIECE_LABELS[piece][1] == type) {
+            return static_cast<Piece>(piece);
+        }
+    }
+    return PIECE_UNKNOWN;
+}
+
+/**
+ * Gets the piece for a two character label, such as "wp" or "ee".
+ * @param label     string for the label
+ *
+ * @returns the Piece, or PIECE_UNKNOWN if the label isn't one
+*/
+inline Piece getPieceFromLabel(const std::string &label) {
+    return label.size() == 2 ? getPieceFromLabel(label[0], label[1]) : PIECE_UNKNOWN;
+}
+
+/**
+ * Gets the piece for a fen character, such as 'P' for a white pawn.
+ * @param c     char from the placement field of a fen
+ *
+ * @returns the Piece, or PIECE_UNKNOWN if the character isn't a piece
+*/
+constexpr Piece getPieceFromFenChar(char c) {
+    for (int piece = PIECE_WHITE_PAWN; piece < PIECE_UNKNOWN; piece++) {
+        if (PIECE_FEN_CHARS[piece] == c) {
+            return static_cast<Piece>(piece);
+        }
+    }
+    return PIECE_UNKNOWN;
+}
+
+/**
+ * @returns the letter of the piece without its colour ('p', 'n', 'b', 'r', 'q', 'k', or 'e' for an empty square)
+*/
+constexpr char getPieceType(Piece piece) {
+    return piece < PIECE_UNKNOWN ? PIECE_LABELS[piece][1] : '\0';
+}
+
+/**
+ * Gets the index of a square from its file and rank, where index 0 is a8 and index 63 is h1.
+ * @param file  char for the file, 'a' to 'h'
+ * @param rank  char for the rank, '1' to '8'
+ *
+ * @returns the index of the square, or -1 if it isn't on the board
+*/
+constexpr int getSquareIndex(char file, char rank) {
+    return file >= 'a' && file <= 'h' && rank >= '1' && rank <= '8' ? ('8' - rank) * 8 + (file - 'a') : -1;
+}
+
+static_assert(getSquareIndex('a', '8') == 0 && getSquareIndex('h', '1') == 63, "square indices start at a8");
+static_assert(getPieceFromLabel('b', 'k') == PIECE_BLACK_KING && getPieceFromFenChar('N') == PIECE_WHITE_KNIGHT,
+              "the piece tables are out of order");
+
+/**
+ * The piece on each of the 64 squares, row by row from a8, in 64 bytes so boards are cheap to copy, compare and hash.
+*/
+struct Board {
+    std::array<Piece, 64> squares;
+
+    /**
+     * Creates a board with every square set to the piece, empty by default.
+    */
+    explicit Board(Piece piece=PIECE_EMPTY) { squares.fill(piece); }
+
+    Piece &operator[](int index) { return squares[index]; }
+    Piece operator[](int index) const { return squares[index]; }
+
+    bool operator==(const Board &other) const { return squares == other.squares; }
+    bool operator!=(const Board &other) const { return squares != other.squares; }
+
+    /**
+     * @returns true if every square has a known piece (or is empty)
+    */
+    bool isComplete() const {
+        for (Piece piece : squares) {
+            if (piece == PIECE_UNKNOWN) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+static_assert(sizeof(Board) == 64, "a board should be one byte per square");
+
+/**
+ * Hashes a board with FNV-1a over its 64 bytes, for boards as keys of unordered containers.
+*/
+struct BoardHash {
+    size_t operator()(const Board &board) const {
+        uint64_t hash = 14695981039346656037ULL;
+        for (Piece piece : board.squares) {
+            hash = (hash ^ piece) * 1099511628211ULL;
+        }
+        return static_cast<size_t>(hash);
+    }
+};
+
+/**
+ * Reads a board from the placement field of a fen (anything after the first space is ignored).
+ * @param fen       string for the fen, such as "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+ * @param board     the resulting Board
+ *
+ * @returns 0 if the placement has exactly 8 rows of 8 squares, non-zero otherwise
+*/
+inline int getBoardFromFen(const std::string &fen, Board &board) {
+    board = Board();
+    int square = 0;
+    int rowLength = 0;
+    for (char c : fen.substr(0, fen.find(' '))) {
+        if (c == '/') {
+            if (rowLength != 8) {
+                return 1;
+            }
+            rowLength = 0;
+        }
+        else if (c >= '1' && c <= '8') {
+            rowLength += c - '0';
+            square += c - '0';
+        }
+        else {
+            Piece piece = getPieceFromFenChar(c);
+            if (piece == PIECE_UNKNOWN || square >= 64) {
+                return 1;
+            }
+            board[square++] = piece;
+            rowLength++;
+        }
+        if (rowLength > 8) {
+            return 1;
+        }
+    }
+    return square == 64 && rowLength == 8 ? 0 : 1;
+}
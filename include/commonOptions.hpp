@@ -0,0 +1,58 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the options that every mode of chessCV (and bench) takes, such as the analysis backend, the classifier
+  and the instrumentation. They are parsed from one table, so each flag is only defined once.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "chessAnalysis.hpp"
+#include "analysisService.hpp"
+#include "pieceDetectionOps.hpp"
+#include "featureIndex.hpp"
+#include "boardCache.hpp"
+#include "instrumentation.hpp"
+
+/**
+ * The options shared by every mode, set from the command line. The defaults are the ones of each module, and a main
+ *   can change them before the command line is parsed.
+*/
+struct CommonOptions {
+    AnalysisBackendOptions backend;         // --engine, --engines, --movetime
+    ProgressiveAnalysisOptions progressive; // --progressive, --first-depth, --max-depth, --multipv
+    OccupancyThresholds thresholds;         // --empty-light, --empty-dark
+    ClassifierOptions classifier;           // --model, --model-size, --dnn-backend, --model-normalize
+    FeatureIndexOptions featureIndex;       // --prototypes, --prototype-labels
+    BoardCacheOptions boardCache;           // --board-cache-mb, --board-cache-distance
+    LogLevel logLevel = LOG_INFO;           // --log-level
+    std::string reportPath;                 // --report, no report if empty
+    bool useOpenCL = false;                 // --opencl
+    bool refineCorners = true;              // --no-refine
+};
+
+/**
+ * Takes the options shared by every mode out of the command line arguments, wherever they are, leaving the mode and
+ *   its own options for it to parse.
+ * @param argc      int for the number of arguments, updated to the number left
+ * @param argv      array of the argument strings, updated to the ones left
+ * @param options   CommonOptions the options are stored in, which keeps its values for the ones not given
+ *
+ * @returns 0 if the options were valid, non-zero otherwise
+*/
+int extractCommonOptions(int &argc, char *argv[], CommonOptions &options);
+
+/**
+ * Sets the options of each module from the common options. The log level is set first, so the device picked for
+ *   --opencl is reported at the level asked for.
+ * @param options   CommonOptions to set
+*/
+void applyCommonOptions(const CommonOptions &options);
+
+/**
+ * @returns the usage of the common options, such as "[--engine PATH] [--engines N] ..."
+*/
+std::string getCommonOptionsUsage();
@@ -12,6 +12,10 @@
 
 #include <vector>
 #include <map>
+#include <string>
+#include <unordered_map>
+
+#include "chessBoard.hpp"
 
 /*
   Given a filename, and feature label name, and the image features, by
@@ -28,20 +32,21 @@
 int append_image_data_csv( const char *filename, char label_name, char pieceColor, std::vector<float> &image_data, int reset_file );
 
 /*
-  Given a file with the format of a string as the first column and
-  floating point numbers as the remaining columns, this function
-  returns the labels as a std::vector of character arrays, and the
+  Given a file with the format of a piece and its colour as the first
+  two columns and floating point numbers as the remaining columns,
+  this function returns the pieces as a std::vector of Piece, and the
   remaining data as a 2D std::vector<float>.
 
-  labels will contain all of the image segment label names.
+  labels will contain the piece of each row.
   data will contain the features calculated from each image.
+  Rows whose first two columns aren't a piece are skipped.
 
   If echo_file is true, it prints out the contents of the file as read
   into memory.
 
   The function returns a non-zero value if something goes wrong.
  */
-int read_image_data_csv( const char *filename, std::vector<std::string> &labels, std::vector<std::vector<float>> &data, int echo_file );
+int read_image_data_csv( const char *filename, std::vector<Piece> &labels, std::vector<std::vector<float>> &data, int echo_file );
 
 /**
  * Function to read image data into features, but reads into a hashMap-style structure
@@ -0,0 +1,202 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the in-memory index of the labeled histogram features used by the classical piece classifier.
+*/
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chessBoard.hpp"
+#include "featureStore.hpp"
+
+/**
+ * A histogram in the index and its histogram intersection difference from a query.
+*/
+struct FeatureMatch {
+    int row;
+    float distance;
+};
+
+/**
+ * Options for pruning the nearest neighbour search with prototypes, set from the command line.
+*/
+struct FeatureIndexOptions {
+    int prototypesPerLabel = 0;     // k-means prototypes of each label's histograms, 0 to always search every histogram
+    int searchedLabels = 3;         // labels whose histograms are searched, the ones with the closest prototypes
+};
+
+/**
+ * Sets the prototype options of the feature indices. Must be called before the first square is classified.
+ * @param options   FeatureIndexOptions for the indices
+*/
+void setFeatureIndexOptions(const FeatureIndexOptions &options);
+
+/**
+ * @returns the prototype options of the feature indices
+*/
+const FeatureIndexOptions &getFeatureIndexOptions();
+
+/**
+ * Computes the histogram intersection difference (1 - sum of the minimums) with SIMD instructions where available.
+ * @param h1        pointer to the floats of the first histogram
+ * @param h2        pointer to the floats of the second histogram
+ * @param length    int for the number of values in each histogram
+ *
+ * @returns a float representing the difference
+*/
+float histogramIntersectionDifference(const float *h1, const float *h2, int length);
+
+/**
+ * All of the labeled histograms from one feature file, loaded once and kept for the lifetime of the process.
+ *   The histograms are stored as the rows of one float cv::Mat, with a parallel column of compact label ids, so the
+ *   nearest neighbour scan is a linear walk over memory. A float32 binary feature file is used in place through
+ *   its mapping, so loading it costs the same however many rows it has.
+*/
+class FeatureIndex {
+public:
+    FeatureIndex();
+
+    /**
+     * Loads the labeled features from the given binary or csv feature file, replacing anything already in the index.
+     * @param filename  the name of the feature file
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int load(const std::string &filename);
+
+    /**
+     * @returns the number of labeled histograms in the index
+    */
+    int size() const;
+
+    /**
+     * @returns the number of values in each histogram
+    */
+    int dims() const;
+
+    /**
+     * @returns the histograms, one per row, as a CV_32F cv::Mat (with padded rows if it came from a binary file)
+    */
+    const cv::Mat &getFeatures() const;
+
+    /**
+     * @param row   int for the index of the histogram
+     *
+     * @returns a pointer to the dims() values of the histogram
+    */
+    const float *getRow(int row) const;
+
+    /**
+     * @param row   int for the index of the histogram
+     *
+     * @returns the compact label id of the histogram
+    */
+    int getLabelId(int row) const;
+
+    /**
+     * @param row   int for the index of the histogram
+     *
+     * @returns the piece of the histogram's label, PIECE_UNKNOWN if the label isn't a piece
+    */
+    Piece getLabel(int row) const;
+
+    /**
+     * @returns the piece of each label id in the index
+    */
+    const std::vector<Piece> &getLabelPieces() const;
+
+    /**
+     * Scores the query against every histogram in the index in one call.
+     * @param query         pointer to the dims() floats of the query histogram
+     * @param distances     the resulting histogram intersection difference for each row
+    */
+    void computeDistances(const float *query, std::vector<float> &distances) const;
+
+    /**
+     * Finds the k histograms in the index closest to the query.
+     * @param query     pointer to the dims() floats of the query histogram
+     * @param k         int for the number of matches to find
+     * @param matches   the resulting matches, closest first
+    */
+    void queryTopK(const float *query, int k, std::vector<FeatureMatch> &matches) const;
+
+    /**
+     * Classifies the query by a vote of its k nearest neighbours, so k=1 is the plain nearest neighbour.
+     *   Ties in the vote go to the label whose matches are closest in total.
+     * @param query     pointer to the dims() floats of the query histogram
+     * @param k         int for the number of neighbours that vote
+     *
+     * @returns the winning Piece, or PIECE_UNKNOWN if the index is empty
+    */
+    Piece classifyKNN(const float *query, int k=1) const;
+
+    /**
+     * Clusters the histograms of each label into prototypes with k-means, so a query can rule out most labels by
+     *   scoring a few prototypes instead of every histogram. A label with fewer histograms keeps them all as prototypes.
+     *   The clustering is seeded, so the same feature file always gives the same prototypes.
+     * @param prototypesPerLabel    int for the number of prototypes of each label, 0 to remove them
+     * @param searchedLabels        int for the number of labels with the closest prototypes that are searched exactly
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int buildPrototypes(int prototypesPerLabel, int searchedLabels);
+
+    /**
+     * @returns the number of prototypes, 0 if they haven't been built
+    */
+    int getNumPrototypes() const;
+
+    /**
+     * Classifies the query like classifyKNN, but only searches the histograms of the searchedLabels labels whose
+     *   prototypes are closest to it. Without prototypes it searches every histogram.
+     * @param query             pointer to the dims() floats of the query histogram
+     * @param k                 int for the number of neighbours that vote
+     * @param numComparisons    int for the resulting number of histograms and prototypes the query was scored against
+     *
+     * @returns the winning Piece, or PIECE_UNKNOWN if the index is empty
+    */
+    Piece classify(const float *query, int k, int &numComparisons) const;
+
+private:
+    /**
+     * Votes on the label of the matches, closest first, the same way as classifyKNN.
+     * @param matches   vector of the FeatureMatch's that vote
+     *
+     * @returns the winning Piece, or PIECE_UNKNOWN if there are no matches
+    */
+    Piece voteMatches(const std::vector<FeatureMatch> &matches) const;
+
+    /**
+     * Loads the labeled features from a binary feature file, using float32 rows straight from the mapping.
+     * @param filename  the name of the binary feature file
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int loadBinary(const std::string &filename);
+
+    cv::Mat features;
+    cv::Mat labelIds;
+    std::vector<Piece> labelPieces;
+    std::shared_ptr<MappedFeatureFile> mappedFile;
+
+    cv::Mat prototypes;
+    std::vector<int> prototypeLabelIds;
+    std::vector<std::vector<int>> labelRows;
+    int searchedLabels;
+};
+
+/**
+ * Gets the process-wide feature index for light or dark squares, loading it on first use.
+ *   The binary feature file is used if there is one, otherwise the csv file. The prototypes of the options are built
+ *   when it is loaded.
+ * @param isDarkSquare  bool for if the index for dark squares (true) or light squares (false) is wanted
+ *
+ * @returns a reference to the shared FeatureIndex
+*/
+const FeatureIndex &getFeatureIndex(bool isDarkSquare);
@@ -0,0 +1,226 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the binary feature file, a compact and memory-mappable replacement for the feature csv files.
+*/
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "chessBoard.hpp"
+
+const char FEATURE_FILE_MAGIC[8] = {'C', 'H', 'S', 'F', 'E', 'A', 'T', '\0'};
+const uint32_t FEATURE_FILE_VERSION = 1;
+const int FEATURE_FILE_MAX_LABELS = 32;
+// the rows start here, so the header can be rewritten in place when a row or label is appended
+const uint32_t FEATURE_FILE_DATA_OFFSET = 512;
+
+enum FeatureDataType : uint32_t {
+    FEATURE_FLOAT32 = 0,
+    FEATURE_FLOAT16 = 1
+};
+
+/**
+ * The header at the start of a binary feature file, stored in native (little-endian) byte order.
+ *   It is followed by numRows records of recordSize bytes starting at dataOffset. Each record is the uint32 label id,
+ *   12 reserved bytes, then the dims float32 or float16 values, padded so every row starts on a 16 byte boundary.
+*/
+struct FeatureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dataType;
+    uint32_t numBins;
+    uint32_t dims;
+    uint64_t numRows;
+    uint32_t recordSize;
+    uint32_t dataOffset;
+    uint32_t numLabels;
+    uint32_t reserved;
+    char labelNames[FEATURE_FILE_MAX_LABELS][8];
+};
+
+/**
+ * A binary feature file opened with mmap, so the rows are used straight from the page cache without being parsed.
+*/
+class MappedFeatureFile {
+public:
+    MappedFeatureFile();
+    ~MappedFeatureFile();
+
+    MappedFeatureFile(const MappedFeatureFile &) = delete;
+    MappedFeatureFile &operator=(const MappedFeatureFile &) = delete;
+
+    /**
+     * Maps the given binary feature file, closing anything already mapped.
+     * @param filename  the name of the binary feature file
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int open(const std::string &filename);
+
+    /**
+     * Unmaps the file. Any cv::Mat returned by getValues or getLabelIds is invalid afterwards.
+    */
+    void close();
+
+    /**
+     * @returns true if a file is currently mapped
+    */
+    bool isOpen() const;
+
+    /**
+     * @returns the header of the mapped file
+    */
+    const FeatureFileHeader &getHeader() const;
+
+    /**
+     * @returns the labels in the file's label table, indexed by label id
+    */
+    std::vector<std::string> getLabelNames() const;
+
+    /**
+     * @returns a cv::Mat of the feature values (CV_32F or CV_16F) that points into the mapping, one row per record
+    */
+    cv::Mat getValues() const;
+
+    /**
+     * @returns a CV_32S column cv::Mat of the label ids that points into the mapping, one row per record
+    */
+    cv::Mat getLabelIds() const;
+
+private:
+    FeatureFileHeader header;
+    void *mapping;
+    size_t mappingSize;
+};
+
+/**
+ * Checks if the file at the given path starts with the binary feature file magic.
+ * @param filename  the name of the file
+ *
+ * @returns true if the file is a binary feature file
+*/
+bool isFeatureFile(const std::string &filename);
+
+/**
+ * Writes a whole binary feature file, replacing the file if it already exists.
+ * @param filename  the name of the binary feature file
+ * @param labels    vector of the piece of each row, stored in the label table by its label such as "wp"
+ * @param data      2D vector of floats for the features of each row
+ * @param numBins   int for the number of bins for each side of the histograms
+ * @param dataType  FeatureDataType the values are stored as
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int writeFeatureFile(const std::string &filename, const std::vector<Piece> &labels,
+                     const std::vector<std::vector<float>> &data, int numBins, FeatureDataType dataType=FEATURE_FLOAT32);
+
+/**
+ * Appends one labeled row to a binary feature file, creating a float32 file if it doesn't exist yet.
+ * @param filename  the name of the binary feature file
+ * @param label     Piece of the row
+ * @param features  vector of floats for the features of the row
+ * @param numBins   int for the number of bins for each side of the histogram
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int appendFeatureRecord(const std::string &filename, Piece label, const std::vector<float> &features, int numBins);
+
+/**
+ * Appends labeled rows to a binary feature file in one pass, creating a float32 file if it doesn't exist yet.
+ *   The header is only rewritten once, after every row has been written.
+ * @param filename  the name of the binary feature file
+ * @param labels    vector of the piece of each row
+ * @param data      2D vector of floats for the features of each row
+ * @param numBins   int for the number of bins for each side of the histograms
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int appendFeatureRecords(const std::string &filename, const std::vector<Piece> &labels,
+                         const std::vector<std::vector<float>> &data, int numBins);
+
+/**
+ * Appends a labeled row to a buffer in the format of the feature csv files, such as "p,w,0.0123,...". The values are
+ *   written with 4 decimals like append_image_data_csv, without going through printf for each one.
+ * @param buffer    string the row is appended to, with its newline
+ * @param label     Piece of the row
+ * @param features  vector of floats for the features of the row
+*/
+void appendFeatureCsvRow(std::string &buffer, Piece label, const std::vector<float> &features);
+
+/**
+ * Collects labeled rows for a feature csv file and its binary feature file (if there is one), writing them in large
+ *   blocks instead of opening the files for every row. Rows can be added from several threads.
+*/
+class FeatureWriter {
+public:
+    /**
+     * Creates the writer. The binary feature file is only kept in step if it already exists, like addLabelFeatures.
+     * @param csvFilename   the name of the feature csv file, appended to
+     * @param binFilename   the name of the binary feature file, appended to if it exists
+     * @param numBins       int for the number of bins for each side of the histograms
+     * @param bufferRows    size_t for the number of rows held before they are written
+    */
+    FeatureWriter(const std::string &csvFilename, const std::string &binFilename, int numBins, size_t bufferRows=4096);
+
+    /**
+     * Writes the rows that are still buffered.
+    */
+    ~FeatureWriter();
+
+    FeatureWriter(const FeatureWriter &) = delete;
+    FeatureWriter &operator=(const FeatureWriter &) = delete;
+
+    /**
+     * Adds a labeled row, writing the buffer out if it is full.
+     * @param label     Piece of the row
+     * @param features  vector of floats for the features of the row
+     *
+     * @returns 0 if the function returns successfully, non-zero if the buffer couldn't be written
+    */
+    int add(Piece label, const std::vector<float> &features);
+
+    /**
+     * Writes out every buffered row.
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int flush();
+
+    /**
+     * @returns the number of rows added so far
+    */
+    size_t getNumRows();
+
+private:
+    int flushBuffered();
+
+    std::string csvFilename;
+    std::string binFilename;
+    int numBins;
+    size_t bufferRows;
+    bool writeBinary;
+
+    std::mutex mutex;
+    std::string csvBuffer;
+    std::vector<Piece> bufferedLabels;
+    std::vector<std::vector<float>> bufferedData;
+    size_t numRows;
+};
+
+/**
+ * Converts a feature csv file to a binary feature file.
+ * @param csvFilename   the name of the feature csv file
+ * @param binFilename   the name of the binary feature file to write
+ * @param dataType      FeatureDataType the values are stored as
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int convertFeatureFile(const std::string &csvFilename, const std::string &binFilename, FeatureDataType dataType=FEATURE_FLOAT32);
@@ -0,0 +1,99 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for labeling the board incrementally, only re-classifying the squares that changed between frames.
+*/
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+#include "chessBoard.hpp"
+
+/**
+ * A move inferred from the change in labels between two boards, as square indices (0 is a8, 63 is h1).
+*/
+struct BoardMove {
+    int from = -1;
+    int to = -1;
+
+    /**
+     * @returns true if a move was found
+    */
+    bool isValid() const { return from >= 0 && to >= 0; }
+};
+
+/**
+ * Keeps the square tiles and labels from the previous frame so only the squares that changed are classified again.
+ *   Each square's change score is the mean absolute difference between a small grayscale copy of the square and the
+ *   copy it was last classified from. A square is only re-classified once it has changed and settled (stopped
+ *   changing from one frame to the next), so a hand moving over the board doesn't get classified.
+*/
+class IncrementalLabeler {
+public:
+    /**
+     * Creates a labeler with no board yet, so the first update classifies every square.
+     * @param changeThreshold   float for the mean absolute difference (0-255) above which a square has changed
+     * @param useNN             bool for if the neural network should be used instead of the histograms
+     * @param tileSize          cv::Size of the grayscale tiles kept for each square
+    */
+    IncrementalLabeler(float changeThreshold=12.0, bool useNN=false, cv::Size tileSize=cv::Size(16, 16));
+
+    /**
+     * Updates the labels for the new frame, re-classifying only the squares that changed.
+     * @param frame         cv::Mat of the current frame
+     * @param rectangles    vector of the 64 cv::Rect's for the squares of the board in the frame
+     * @param squareLabels  the resulting Board of labels for each square
+     * @param move          the resulting move, if the changed squares amount to a move
+     *
+     * @returns the number of squares that were classified, or -1 if the rectangles aren't a full board
+    */
+    int update(const cv::Mat &frame, const std::vector<cv::Rect> &rectangles, Board &squareLabels,
+               BoardMove &move);
+
+    /**
+     * Forgets the previous board, so the next update classifies every square again.
+    */
+    void reset();
+
+    /**
+     * @returns the change score of each square from the last update
+    */
+    const std::vector<float> &getChangeScores() const;
+
+    /**
+     * @returns the indices of the squares that were classified in the last update
+    */
+    const std::vector<int> &getChangedSquares() const;
+
+private:
+    int classifySquares(const cv::Mat &frame, const std::vector<cv::Rect> &rectangles, const std::vector<int> &indices,
+                        float imageScale);
+
+    float changeThreshold;
+    bool useNN;
+    cv::Size tileSize;
+    bool initialized;
+
+    // tiles each square was last classified from, and the tiles from the previous frame
+    std::vector<cv::Mat> referenceTiles;
+    std::vector<cv::Mat> previousTiles;
+    Board labels;
+    // labels as of the last move that was found
+    Board labelsBeforeMove;
+    std::vector<float> changeScores;
+    std::vector<int> changedSquares;
+};
+
+/**
+ * Infers the move that was played from the labels of the board before and after it.
+ *   Handles normal moves, captures, promotions, castling (the king's move is returned) and en passant.
+ * @param before    Board of the labels before the move
+ * @param after     Board of the labels after the move
+ *
+ * @returns the inferred BoardMove, which is not valid if the changes don't make up a single move
+*/
+BoardMove inferMove(const Board &before, const Board &after);
@@ -0,0 +1,161 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the instrumentation: a log level for the debug prints, and scoped timers and counters for each stage
+  that are collected into a per-run report.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * How much is printed, each level including the ones before it.
+*/
+enum LogLevel {
+    LOG_ERROR,
+    LOG_WARNING,
+    LOG_INFO,
+    LOG_DEBUG
+};
+
+/**
+ * Sets how much is printed.
+ * @param level     LogLevel for the most detailed messages that are printed
+*/
+void setLogLevel(LogLevel level);
+
+/**
+ * Parses a log level from its name.
+ * @param name      string for the level, "error", "warning", "info" or "debug"
+ * @param level     the resulting LogLevel
+ *
+ * @returns 0 if the name was valid, non-zero otherwise
+*/
+int parseLogLevel(const std::string &name, LogLevel &level);
+
+/**
+ * @returns true if messages at the level are printed, to skip building them otherwise
+*/
+bool isLogEnabled(LogLevel level);
+
+/**
+ * Prints a message the same way as printf, if the log level allows it.
+ * @param level     LogLevel of the message
+ * @param format    printf format string
+*/
+void logPrintf(LogLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Timings of one stage over a run.
+*/
+struct TimerStats {
+    uint64_t calls = 0;     // number of times the stage ran
+    double totalMs = 0;     // time spent in the stage in total
+    double maxMs = 0;       // longest time the stage took
+};
+
+/**
+ * The timers and counters recorded over a run (or while a MetricsCapture was alive).
+*/
+struct RunMetrics {
+    std::map<std::string, TimerStats> timers;
+    std::map<std::string, uint64_t> counters;
+};
+
+/**
+ * Records one run of a stage.
+ * @param name      string for the stage
+ * @param ms        double for the milliseconds it took
+*/
+void recordTimer(const std::string &name, double ms);
+
+/**
+ * Adds to a counter, such as the number of hough segments found.
+ * @param name      string for the counter
+ * @param amount    uint64_t to add to it
+*/
+void addCounter(const std::string &name, uint64_t amount=1);
+
+/**
+ * @returns a copy of everything recorded so far in the run
+*/
+RunMetrics getRunMetrics();
+
+/**
+ * Converts the metrics to JSON, with "timers" holding calls, total_ms, mean_ms and max_ms for each stage and
+ *   "counters" holding each count.
+ * @param metrics   RunMetrics to convert
+ *
+ * @returns the JSON object
+*/
+nlohmann::json getMetricsJson(const RunMetrics &metrics);
+
+/**
+ * Writes the run's metrics to a report, as CSV if the path ends in ".csv" and as JSON otherwise.
+ * @param reportPath    string for the path of the report
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int writeRunReport(const std::string &reportPath);
+
+/**
+ * Sets the report to write with writeRunReport when the program exits.
+ * @param reportPath    string for the path of the report
+*/
+void setRunReportPath(const std::string &reportPath);
+
+/**
+ * Times the scope it lives in, recording it under its name when it ends.
+*/
+class ScopedTimer {
+public:
+    /**
+     * Starts the timer.
+     * @param name      string for the stage being timed, which should outlive the timer (such as a literal)
+    */
+    explicit ScopedTimer(const char *name);
+
+    /**
+     * Records the time since the timer started.
+    */
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    const char *name;
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * Also collects everything recorded on the current thread while it is alive, such as the metrics of one image.
+ *   Captures can be nested, and every capture alive on the thread sees what is recorded.
+*/
+class MetricsCapture {
+public:
+    MetricsCapture();
+    ~MetricsCapture();
+
+    MetricsCapture(const MetricsCapture &) = delete;
+    MetricsCapture &operator=(const MetricsCapture &) = delete;
+
+    /**
+     * @returns what has been recorded on this thread since the capture started
+    */
+    const RunMetrics &getMetrics() const;
+
+private:
+    friend void recordTimer(const std::string &name, double ms);
+    friend void addCounter(const std::string &name, uint64_t amount);
+
+    RunMetrics metrics;
+    MetricsCapture *previous;
+};
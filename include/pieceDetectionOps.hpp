@@ -11,71 +11,322 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/dnn.hpp>
 #include <iostream>
+#include <mutex>
 #include <vector>
 
+#include "chessBoard.hpp"
 #include "processingOps.hpp"
+#include "featureIndex.hpp"
 
 const char CSV_LIGHT_FILE_PATH[] = "light_features.csv";
 const char CSV_DARK_FILE_PATH[] = "dark_features.csv";
+// binary versions of the feature files (see the convert mode), used instead of the csv files when they exist
+const char FEATURE_LIGHT_FILE_PATH[] = "light_features.bin";
+const char FEATURE_DARK_FILE_PATH[] = "dark_features.bin";
 
 const char PIECE_CLASSIFIER_FILE_PATH[] = "chess_piece_classifier_vgg16.onnx";
 
-const std::string PIECE_VALUES[12] = {"bb", "bk", "bn", "bp", "bq", "br", "wb", "wk", "wn", "wp", "wq", "wr"};
+// number of nearest neighbours that vote on the label of a square, 1 for the plain nearest neighbour
+const int HISTOGRAM_NEIGHBOURS = 1;
 
+// Canny edge sums over a square's inner window below which the square is empty, tuned on full resolution photos
+const double EMPTY_LIGHT_SQUARE_THRESHOLD = 7000;
+const double EMPTY_DARK_SQUARE_THRESHOLD = 7000;
+// side of a square in those full resolution (3024x4032) photos, with the board across the short side
+const float FULL_RESOLUTION_SQUARE_SIZE = 3024.0f / 8;
+
+// piece of each of the network's output classes, in the order it was trained with
+constexpr Piece CLASSIFIER_PIECES[12] = {
+    PIECE_BLACK_BISHOP, PIECE_BLACK_KING, PIECE_BLACK_KNIGHT, PIECE_BLACK_PAWN, PIECE_BLACK_QUEEN, PIECE_BLACK_ROOK,
+    PIECE_WHITE_BISHOP, PIECE_WHITE_KING, PIECE_WHITE_KNIGHT, PIECE_WHITE_PAWN, PIECE_WHITE_QUEEN, PIECE_WHITE_ROOK};
+
+
+/**
+ * Where the piece classifier's forward pass runs, each a cv::dnn backend and target pair.
+*/
+enum ClassifierBackend {
+    CLASSIFIER_BACKEND_CPU,             // OpenCV's own CPU implementation
+    CLASSIFIER_BACKEND_OPENCL,          // OpenCV on an OpenCL device
+    CLASSIFIER_BACKEND_OPENCL_FP16,     // OpenCV on an OpenCL device, in half precision
+    CLASSIFIER_BACKEND_CUDA,            // CUDA, if OpenCV was built with it
+    CLASSIFIER_BACKEND_CUDA_FP16,       // CUDA in half precision
+    CLASSIFIER_BACKEND_OPENVINO         // OpenVINO on the CPU, if OpenCV was built with it
+};
+
+/**
+ * Which model the piece classifier loads, how squares are prepared for it and where it runs.
+*/
+struct ClassifierOptions {
+    std::string modelPath = PIECE_CLASSIFIER_FILE_PATH;     // ONNX model, which can be a float16 or int8 quantized export
+    cv::Size inputSize = cv::Size(224, 224);                // size each square is resized to
+    ClassifierBackend backend = CLASSIFIER_BACKEND_CPU;
+    bool normalize = false;                                 // if the ImageNet mean and std the models are trained with are applied
+};
+
+/**
+ * Parses a classifier backend name: cpu, opencl, opencl-fp16, cuda, cuda-fp16 or openvino.
+ * @param name      string for the name of the backend
+ * @param backend   the resulting ClassifierBackend
+ *
+ * @returns 0 if the name is a backend, non-zero otherwise
+*/
+int parseClassifierBackend(const std::string &name, ClassifierBackend &backend);
+
+/**
+ * @returns the name of the backend, as parseClassifierBackend takes it
+*/
+const char *getClassifierBackendName(ClassifierBackend backend);
+
+/**
+ * Parses the input size of a classifier, either one number for a square input such as "128" or "WIDTHxHEIGHT".
+ * @param text      string for the size
+ * @param size      the resulting cv::Size
+ *
+ * @returns 0 if the text is a positive size, non-zero otherwise
+*/
+int parseClassifierInputSize(const std::string &text, cv::Size &size);
+
+/**
+ * Sets the model and backend of the process-wide piece classifier. Must be called before its first use.
+ * @param options   ClassifierOptions for the classifier
+*/
+void setClassifierOptions(const ClassifierOptions &options);
+
+/**
+ * @returns the options of the process-wide piece classifier
+*/
+const ClassifierOptions &getClassifierOptions();
+
+/**
+ * Holds the ONNX piece classifier so the network is only parsed once per process.
+ *   All of the squares given to classify() are run through the network in a single batched forward pass.
+*/
+class PieceClassifier {
+public:
+    /**
+     * Loads the network from the model file of the options and moves it to their backend, falling back to the CPU
+     *   if the backend isn't available in this build of OpenCV.
+     * @param options   ClassifierOptions for the model, its input and backend
+    */
+    explicit PieceClassifier(const ClassifierOptions &options=ClassifierOptions());
+
+    /**
+     * @returns true if the network was loaded successfully
+    */
+    bool isLoaded() const;
+
+    /**
+     * Classifies each of the given square images with one forward pass of the network.
+     * @param squares       vector of cv::Mat's of the square images to classify
+     * @param labels        the resulting vector of pieces, one for each square
+     * @param confidences   the resulting vector of softmax confidences for each label
+     * 
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int classify(const std::vector<cv::Mat> &squares, std::vector<Piece> &labels, std::vector<float> &confidences);
+
+    /**
+     * @returns the backend the network runs on, which is the CPU if the requested one wasn't available
+    */
+    ClassifierBackend getBackend() const;
+
+private:
+    cv::Mat getInputBlob(const std::vector<cv::Mat> &squares) const;
+
+    cv::dnn::Net net;
+    cv::Size inputSize;
+    ClassifierBackend backend;
+    bool normalize;
+    bool loaded;
+    // cv::dnn::Net is not safe to run from several threads at once
+    std::mutex netMutex;
+};
+
+/**
+ * Gets the process-wide piece classifier, loading it with the options from setClassifierOptions on first use.
+ * 
+ * @returns a reference to the shared PieceClassifier
+*/
+PieceClassifier &getPieceClassifier();
+
+
+/**
+ * Checks if the square at the given index is a dark square, with index 0 being the top left (light) square.
+ * @param squareIndex   int for the index of the square, in the same order as the rectangles
+ * 
+ * @returns true if the square is a dark square, false if it is a light square
+*/
+bool isDarkSquareIndex(int squareIndex);
+
+/**
+ * Thresholds on the occupancy scores, kept apart for light and dark squares so each can be calibrated on its own.
+*/
+struct OccupancyThresholds {
+    double light = EMPTY_LIGHT_SQUARE_THRESHOLD;    // highest score of an empty light square, at full resolution
+    double dark = EMPTY_DARK_SQUARE_THRESHOLD;      // highest score of an empty dark square, at full resolution
+};
+
+/**
+ * Sets the thresholds the empty squares are found with.
+ * @param thresholds    OccupancyThresholds for the light and dark squares
+*/
+void setOccupancyThresholds(const OccupancyThresholds &thresholds);
+
+/**
+ * @returns the thresholds the empty squares are found with
+*/
+const OccupancyThresholds &getOccupancyThresholds();
+
+/**
+ * Computes the occupancy score of each square, the sum of the Canny edges in the inner 60% of the square.
+ *   The grayscale conversion and Canny are done once over the part of the image the squares cover, and every
+ *   square's sum is then read from a single integral image. With the transparent API on, the cv::UMat version runs instead.
+ * @param image         cv::Mat representing the image of the chessboard
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ * @param scores        the resulting score of each square, in the same order as the rectangles
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int computeOccupancyScores(const cv::Mat &image, const std::vector<cv::Rect> &rectangles, std::vector<double> &scores);
+
+/**
+ * Computes the occupancy score of each square on a cv::UMat, so the grayscale conversion and Canny can run on an OpenCL
+ *   device. Each square's edges are counted on the device too, so only the 64 sums are downloaded.
+ * @param image         cv::UMat representing the image of the chessboard
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ * @param scores        the resulting score of each square, in the same order as the rectangles
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int computeOccupancyScores(const cv::UMat &image, const std::vector<cv::Rect> &rectangles, std::vector<double> &scores);
+
+/**
+ * Checks if a square's occupancy score is low enough for it to be empty.
+ * @param score         double for the score of the square from computeOccupancyScores
+ * @param isDarkSquare  bool representing if the square is a dark square (true) or a light square (false)
+ * @param imageScale    float for the size of the image relative to the full resolution photos the thresholds were tuned on
+ *
+ * @returns true if the space is identified to be empty, false otherwise
+*/
+bool isEmptyOccupancyScore(double score, bool isDarkSquare, float imageScale=1.0f);
+
+/**
+ * Gets the scale of the squares relative to the full resolution photos the thresholds were tuned on, from their mean
+ *   width. For images that aren't a scaled down full resolution photo, such as the frames of a camera.
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ *
+ * @returns the scale to pass to isEmptyOccupancyScore, or 1 if there are no rectangles
+*/
+float getSquareImageScale(const std::vector<cv::Rect> &rectangles);
 
 /**
  * Check to see if the chessboard square specified is empty or not.
+ *   To check every square of a board, computeOccupancyScores does the filtering once instead of once per square.
  * @param image         cv::Mat representing the image of the chessboard
  * @param currentRect   cv::Rect representing the area of the square in the image
  * @param isDarkSquare  bool representing if the square is a dark square (true) or a light square (false)
+ * @param imageScale    float for the size of the image relative to the full resolution photos the threshold was tuned on
  * 
  * @returns true if the space is identified to be empty, false otherwise
 */
-bool isEmptySpace(cv::Mat &image, cv::Rect &currentRect, bool isDarkSquare);
+bool isEmptySpace(cv::Mat &image, cv::Rect &currentRect, bool isDarkSquare, float imageScale=1.0f);
 
 /**
  * Uses the neural network to get the predicted piece label for the location.
  * @param image         cv::Mat representing the image of the chessboard
  * @param currentRect   cv::Rect representing the square of interest
  * 
- * @returns a std::string containing the piece prediction
+ * @returns the predicted Piece, or PIECE_UNKNOWN if the network couldn't classify it
+*/
+Piece getNNPieceLabel(const cv::Mat &image, const cv::Rect &currentRect);
+
+/**
+ * Find the predicted piece labels for each square on the board.
+ *   Squares past the rectangles (or that couldn't be classified) are left as PIECE_UNKNOWN.
+ * @param src           cv::Mat represeting the image, which is only read
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ * @param board         the resulting Board holding the piece on each square
+ * @param imageScale    float for the size of src relative to the full resolution photos, passed to isEmptyOccupancyScore
+ * 
+ * @returns 0 if the function returns successfully
 */
-std::string getNNPieceLabel(cv::Mat &image, cv::Rect &currentRect);
+int getPieceLabels(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board, float imageScale=1.0f);
 
 /**
  * Find the predicted piece labels for each square on the board.
- *   "ee" for empty, and "b" or "w" for black and white followed by the letter for the piece.
- * @param dst           cv::Mat represeting the image
+ *   Squares past the rectangles (or that couldn't be classified) are left as PIECE_UNKNOWN.
+ *   The occupancy scores the empty squares were found with are kept, so the thresholds can be calibrated from them.
+ *   The occupied squares are classified in parallel with cv::parallel_for_, so it follows cv::setNumThreads.
+ * @param src           cv::Mat represeting the image, which is only read
  * @param rectangles    vector of cv::Rect's representing each square on the chess board
- * @param squareLabels  the resulting vector of strings containing the labels for each square
- * @param showLabels    boolean representing if we want to show the labels on dst
+ * @param board         the resulting Board holding the piece on each square
+ * @param occupancyScores   the resulting occupancy score of each square from computeOccupancyScores
+ * @param imageScale    float for the size of src relative to the full resolution photos, passed to isEmptyOccupancyScore
  * 
  * @returns 0 if the function returns successfully
 */
-int getPieceLabels(cv::Mat &dst, std::vector<cv::Rect> rectangles, std::vector<std::string> &squareLabels, bool showLabels=false);
+int getPieceLabels(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board,
+                   std::vector<double> &occupancyScores, float imageScale=1.0f);
 
 
 /**
  * Find the predicted piece labels for each square on the board using the neural network.
- *   "ee" for empty, and "b" or "w" for black and white followed by the letter for the piece.
- * @param dst           cv::Mat represeting the image
+ *   Squares past the rectangles are left as PIECE_UNKNOWN.
+ * @param src           cv::Mat represeting the image, which is only read
  * @param rectangles    vector of cv::Rect's representing each square on the chess board
- * @param squareLabels  the resulting vector of strings containing the labels for each square
- * @param showLabels    boolean representing if we want to show the labels on dst
+ * @param board         the resulting Board holding the piece on each square
+ * 
+ * @returns 0 if the function returns successfully
+*/
+int getPieceLabelsNN(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board);
+
+/**
+ * Find the predicted piece labels and their confidences for each square on the board using the neural network.
+ *   Every occupied square is classified together in one batched forward pass. Empty squares have a confidence of 1.
+ * @param src                   cv::Mat represeting the image, which is only read
+ * @param rectangles            vector of cv::Rect's representing each square on the chess board
+ * @param board                 the resulting Board holding the piece on each square
+ * @param squareConfidences     the resulting vector of floats containing the confidence of each label
  * 
  * @returns 0 if the function returns successfully
 */
-int getPieceLabelsNN(cv::Mat &dst, std::vector<cv::Rect> rectangles, std::vector<std::string> &squareLabels, bool showLabels=false);
+int getPieceLabelsNN(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board,
+                     std::vector<float> &squareConfidences);
+
+/**
+ * Find the predicted piece labels and their confidences for each square on the board using the neural network,
+ *   keeping the occupancy scores the empty squares were found with.
+ * @param src                   cv::Mat represeting the image, which is only read
+ * @param rectangles            vector of cv::Rect's representing each square on the chess board
+ * @param board                 the resulting Board holding the piece on each square
+ * @param squareConfidences     the resulting vector of floats containing the confidence of each label
+ * @param occupancyScores       the resulting occupancy score of each square from computeOccupancyScores
+ * @param imageScale            float for the size of src relative to the full resolution photos, passed to isEmptyOccupancyScore
+ * 
+ * @returns 0 if the function returns successfully
+*/
+int getPieceLabelsNN(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board, std::vector<float> &squareConfidences,
+                     std::vector<double> &occupancyScores, float imageScale=1.0f);
+
+/**
+ * Display the piece labels in each of the squares on the given destination image.
+ * @param dst           cv::Mat representing the destination image
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ * @param board         Board holding the piece on each square, drawn as labels such as "wp"
+*/
+void displayLabels(cv::Mat &dst, const std::vector<cv::Rect> &rectangles, const Board &board);
 
 /**
  * Computes the 2D histogram for an image based on the image's r and g values
  * @param image      the cv::Mat image to find the histogram for
  * @param numBins    the number of bins for each side of the histogram
+ * @param stride     the step between the sampled rows and columns, 1 to use every pixel
  * 
  * @returns a cv::Mat for the 2D histogram, where the rows are normalized r values and the columns are normalized g values
 */
-cv::Mat getHistogramFeature(cv::Mat &image, int numBins);
+cv::Mat getHistogramFeature(const cv::Mat &image, int numBins, int stride=1);
 
 /**
  * Convert the given Mat of the histogram to a vector of floats.
@@ -91,30 +342,54 @@ void convertMatToVec(cv::Mat &histogram, std::vector<float> &result);
  * 
  * @returns a float representing the difference
 */
-float computeHistogramIntersectionDifference(std::vector<float> h1, std::vector<float> h2);
+float computeHistogramIntersectionDifference(const std::vector<float> &h1, const std::vector<float> &h2);
+
+/**
+ * Computes the histogram intersection difference between the given histograms
+ * @param h1        pointer to the floats of the first histogram
+ * @param h2        pointer to the floats of the second histogram
+ * @param length    int for the number of values in each histogram
+ * 
+ * @returns a float representing the difference
+*/
+float computeHistogramIntersectionDifference(const float *h1, const float *h2, int length);
 
 /**
  * Computes the histogram differences between the image of the square and other square images and returns the best label
  * @param image         a cv::Mat storing the relevant image
  * @param currentRect   a cv::Rect for the rectangle of the square of interest on the board
- * @param labels        a vector of strings representing the labels of the existing data
+ * @param labels        a vector of the pieces of the existing data
  * @param featureData   a vector of vectors of histogram features from the existing data
  * @param nBins         an int that states how many bins the histograms will be split into
  * 
- * @returns a string representing the best label
+ * @returns the Piece of the best match, or PIECE_UNKNOWN if there is no data
+*/
+Piece computeHistogramDiffs(const cv::Mat &image, cv::Rect currentRect, const std::vector<Piece> &labels, const std::vector<std::vector<float>> &featureData, int nBins=16);
+
+/**
+ * Computes the histogram differences between the image of the square and the histograms in the feature index and returns the best label
+ * @param image         a cv::Mat storing the relevant image
+ * @param currentRect   a cv::Rect for the rectangle of the square of interest on the board
+ * @param index         a FeatureIndex holding the labeled histograms to compare against
+ * @param nBins         an int that states how many bins the histograms will be split into
+ * @param k             an int for how many nearest neighbours vote on the label
+ * @param numComparisons    the resulting number of histograms the square was scored against, if not null
+ * 
+ * @returns the Piece of the best label, or PIECE_UNKNOWN if the index has no matching features
 */
-std::string computeHistogramDiffs(cv::Mat &image, cv::Rect currentRect, std::vector<std::string> &labels, std::vector<std::vector<float>> featureData, int nBins=16);
+Piece computeHistogramDiffs(const cv::Mat &image, cv::Rect currentRect, const FeatureIndex &index, int nBins=16, int k=HISTOGRAM_NEIGHBOURS,
+                            int *numComparisons=nullptr);
 
 
 /**
- * Adds a label and the relevant features to the relevant features.csv file.
+ * Adds a label and the relevant features to the relevant features.csv file (and binary feature file, if there is one).
  * @param src           cv::Mat representing the source image
  * @param rectangle     cv::Rect representing the box for the square of interest
  * @param label         char representing the label of the square ('e', 'p', 'n', 'b', 'r', 'q', 'k')
  * @param pieceColor    char representing the piece color ('b', 'w', 'e')
  * @param isDarkSquare  bool for if the square is dark (true) or light (false)
 */
-void addLabelFeatures(cv::Mat src, cv::Rect rectangle, char label, char pieceColor, bool isDarkSquare);
+void addLabelFeatures(const cv::Mat &src, cv::Rect rectangle, char label, char pieceColor, bool isDarkSquare);
 
 /**
  * Allow the user to label images based on the show squares
@@ -52,6 +52,16 @@ bool checkIntersection(cv::Vec4i &line1, cv::Vec4i &line2, cv::Size imageSize, c
 bool arePointsNearby(const cv::Point2f& point, const std::vector<cv::Point2f>& points, float distance=10.0);
 
 
+/**
+ * Splits the lines into the near-horizontal and near-vertical families by their angle, so only lines from different
+ *      families have to be intersected.
+ * @param lines         vector of cv::Vec4i's representing the hough lines
+ * @param horizontal    the resulting indices of the lines within 45 degrees of horizontal, in increasing order
+ * @param vertical      the resulting indices of the other lines, in increasing order
+*/
+void splitLineFamilies(const std::vector<cv::Vec4i> &lines, std::vector<int> &horizontal, std::vector<int> &vertical);
+
+
 /**
  * Calculates the Hough lines for the source image
  *      First resizes and converts to grayscale, applies gaussian blur, and applies Canny.
@@ -65,6 +75,45 @@ bool arePointsNearby(const cv::Point2f& point, const std::vector<cv::Point2f>& p
 */
 int calcHoughLines(cv::Mat &src, cv::Mat &resized, cv::Size newSize, std::vector<cv::Vec4i> &lines, bool showCanny=false);
 
+/**
+ * Calculates the Hough lines for the source image, also returning the Canny edges the lines were found from.
+ * @param src       cv::Mat representing the source image
+ * @param resized   cv::Mat representing the the resized image, to be used for its size
+ * @param newSize   cv::Size representing the size of the resized image
+ * @param lines     vector of cv::Vec4i's representing the resulting hough lines calculated
+ * @param edges     cv::Mat for the resulting Canny edges of the resized image
+ * 
+ * @returns 0 if the function returns successfully.
+*/
+int calcHoughLines(cv::Mat &src, cv::Mat &resized, cv::Size newSize, std::vector<cv::Vec4i> &lines, cv::Mat &edges);
+
+/**
+ * Calculates the Hough lines for the source image on cv::UMat's, so OpenCV's transparent API can run every step on an
+ *   OpenCL device. The images stay on the device between the steps, and only the line segments are downloaded.
+ * @param src       cv::UMat representing the source image
+ * @param resized   cv::UMat for the resulting resized image, left on the device
+ * @param newSize   cv::Size representing the size of the resized image
+ * @param lines     vector of cv::Vec4i's representing the resulting hough lines calculated
+ * @param edges     cv::UMat for the resulting Canny edges of the resized image, left on the device
+ * 
+ * @returns 0 if the function returns successfully.
+*/
+int calcHoughLines(const cv::UMat &src, cv::UMat &resized, cv::Size newSize, std::vector<cv::Vec4i> &lines, cv::UMat &edges);
+
+/**
+ * Sets if the geometry front end and the occupancy scores run on cv::UMat through OpenCV's transparent API, so they are
+ *   offloaded to an OpenCL device. Stays on the CPU if this build of OpenCV or the machine has no OpenCL.
+ * @param use   bool for if the transparent API should be used
+ *
+ * @returns 0 if the setting was applied, non-zero if OpenCL was asked for but isn't available
+*/
+int setUseTransparentApi(bool use);
+
+/**
+ * @returns true if the geometry front end and the occupancy scores run on cv::UMat
+*/
+bool getUseTransparentApi();
+
 /**
  * Calculates the intersections of the lines provided, and draws circles on the destination image.
  * @param dst               cv::Mat representing the destination image
@@ -99,7 +148,7 @@ std::vector<cv::Point2f> scalePointsToOriginal(cv::Mat &image, std::vector<cv::P
  * @param rectangles        vector of cv::Rect's representing the rectangles for each space on the board
  * @param showRectangles    bool flag to represent if the output image should include rectangles numbered and highlighted
  * 
- * @returns 0 if the function returns successfully.
+ * @returns 0 if the function returns successfully, 1 if there aren't exactly 81 intersections.
 */
 int setRectangles(cv::Mat &dst, std::vector<cv::Point2f> &intersections, std::vector<cv::Rect> &rectangles, bool showRectangles=false);
 
@@ -108,5 +157,19 @@ int setRectangles(cv::Mat &dst, std::vector<cv::Point2f> &intersections, std::ve
  * @param dst   a cv::Mat of the destination to display the lines
  * @param lines a vector of cv::Vec4i's representing the existing lines from Hough.
 */
-void displayLines(cv::Mat &dst, std::vector<cv::Vec4i> &lines);
+void displayLines(cv::Mat &dst, const std::vector<cv::Vec4i> &lines);
+
+/**
+ * Display the points, numbered in order, on the given (full size) destination image.
+ * @param dst       a cv::Mat of the destination to display the points
+ * @param points    a vector of cv::Point2f's representing the points to display
+*/
+void displayPoints(cv::Mat &dst, const std::vector<cv::Point2f> &points);
+
+/**
+ * Display the rectangles, numbered in order, on the given destination image.
+ * @param dst           a cv::Mat of the destination to display the rectangles
+ * @param rectangles    a vector of cv::Rect's representing the squares of the board
+*/
+void displayRectangles(cv::Mat &dst, const std::vector<cv::Rect> &rectangles);
 
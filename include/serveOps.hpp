@@ -0,0 +1,86 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the serve mode, a long-running HTTP server that keeps the feature data, classifier and engine warm and
+  turns uploaded photos into fens.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "batchOps.hpp"
+
+/**
+ * Options for the server, set from the command line.
+*/
+struct ServeOptions {
+    std::string host = "127.0.0.1";                 // address the server listens on, 0.0.0.0 for every interface
+    int port = 8080;                                // port the server listens on
+    int numThreads = 0;                             // number of requests processed at once, 0 for one per core
+    int queueSize = 16;                             // connections waiting for a worker before new ones are turned away
+    size_t maxUploadBytes = 32 * 1024 * 1024;       // largest request body that is read
+    int timeoutMs = 10000;                          // longest a client can take to send its request
+    BatchOptions defaults;                          // turn, eval, rectified and classifier for requests that don't set them
+};
+
+/**
+ * An HTTP request read from a client. Header names are lower case.
+*/
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> query;
+    std::map<std::string, std::string> headers;
+    std::string body;
+};
+
+/**
+ * Parses the server options from the command line arguments after "serve".
+ *   Usage: serve [--host ADDRESS] [--port N] [--threads N] [--queue N] [--max-upload-mb N] [--turn w|b] [--eval]
+ *                [--rectified] [--nn]
+ * @param argc      int for the number of arguments
+ * @param argv      array of the argument strings
+ * @param first     int for the index of the first argument after "serve"
+ * @param options   the resulting ServeOptions
+ *
+ * @returns 0 if the arguments were valid, non-zero otherwise
+*/
+int parseServeOptions(int argc, char *argv[], int first, ServeOptions &options);
+
+/**
+ * Reads one HTTP request from the socket, up to the end of its body.
+ * @param fd                int for the connected socket
+ * @param maxBodyBytes      size_t for the largest body that is read
+ * @param request           the resulting HttpRequest
+ *
+ * @returns 0 if the request was read, otherwise the HTTP status to answer with (400, 408, 411 or 413)
+*/
+int readHttpRequest(int fd, size_t maxBodyBytes, HttpRequest &request);
+
+/**
+ * Gets the uploaded image from a request, either the whole body or the first file of a multipart/form-data body.
+ * @param request   HttpRequest holding the upload
+ * @param image     the resulting bytes of the encoded image
+ *
+ * @returns 0 if an image was found, non-zero otherwise
+*/
+int getUploadedImage(const HttpRequest &request, std::vector<uchar> &image);
+
+/**
+ * Runs the server until it is interrupted. The feature data, classifier and analysis backend are loaded before the
+ *   first connection is accepted. Accepted connections wait in a bounded queue for a worker, and once it is full new
+ *   ones are answered with 503 straight away, so a burst of uploads can't build an unbounded backlog.
+ *   POST /analyze takes a photo (raw or multipart) with optional ?turn=w|b&eval=0|1&nn=0|1&rectified=0|1 and answers
+ *   with the JSON of the batch mode, and GET /health reports the queue.
+ * @param options   ServeOptions for the server
+ *
+ * @returns 0 if the server stopped cleanly, non-zero if it couldn't start
+*/
+int runServer(const ServeOptions &options);
@@ -0,0 +1,153 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for the tile export mode, which cuts the labeled squares of many photos into training tiles for
+  train_chess_nn.py, as ImageFolder class directories and optionally as one packed tensor file.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "chessBoard.hpp"
+
+const char TILE_FILE_MAGIC[8] = {'C', 'H', 'S', 'T', 'I', 'L', 'E', '\0'};
+const uint32_t TILE_FILE_VERSION = 1;
+// the records start here, after the header
+const uint32_t TILE_FILE_DATA_OFFSET = 128;
+// bytes before the pixels of each record: the Piece of the tile, then reserved bytes
+const uint32_t TILE_RECORD_LABEL_BYTES = 16;
+
+/**
+ * Options for a tile export, set from the command line.
+*/
+struct TileExportOptions {
+    std::string truthPath;                  // file of "image,fen" lines, the same format as images/ground_truth.csv
+    std::string imageDir;                   // directory the image names are in, the truth file's directory by default
+    std::string outputDir = "tiles";        // the tiles go in a directory per class, such as tiles/wp
+    std::string packedPath;                 // packed tensor file of every tile, none if empty
+    int tileSize = 224;                     // side of each tile, the input size of the classifier
+    std::string extension = ".png";         // format the tiles are encoded in, ".png" or ".jpg"
+    bool rectified = true;                  // if the tiles are cut from the rectified top-down board
+    bool includeEmpty = false;              // if the empty squares are exported too, as the "ee" class
+    bool writeImages = true;                // if the tiles are written as image files
+    int numThreads = 0;                     // number of threads cutting and encoding tiles, 0 for one per core
+    int numWriters = 2;                     // number of threads writing the tiles to disk
+    int queueSize = 256;                    // tiles waiting to be written before the cutting threads wait
+};
+
+/**
+ * The header at the start of a packed tile file, stored in native (little-endian) byte order. It is followed by
+ *   numTiles records of recordSize bytes starting at dataOffset. Each record is the uint8 Piece of the tile,
+ *   TILE_RECORD_LABEL_BYTES - 1 reserved bytes, then tileHeight x tileWidth x channels uint8 pixels in RGB order.
+ *   The label of each Piece is in labelNames, so the file can be read without this header.
+*/
+struct TileFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tileWidth;
+    uint32_t tileHeight;
+    uint32_t channels;
+    uint64_t numTiles;
+    uint32_t recordSize;
+    uint32_t dataOffset;
+    char labelNames[NUM_PIECES][3];
+};
+
+static_assert(sizeof(TileFileHeader) <= TILE_FILE_DATA_OFFSET, "the tile file header should fit before the records");
+
+/**
+ * Writes the tiles of an export into one packed tensor file, which the training script can map straight into an array
+ *   instead of decoding an image per tile. Tiles can be added from several threads.
+*/
+class PackedTileWriter {
+public:
+    PackedTileWriter();
+
+    /**
+     * Finishes the file if it is still open.
+    */
+    ~PackedTileWriter();
+
+    PackedTileWriter(const PackedTileWriter &) = delete;
+    PackedTileWriter &operator=(const PackedTileWriter &) = delete;
+
+    /**
+     * Creates the file, replacing it if it exists.
+     * @param filename  the name of the packed tile file
+     * @param tileSize  int for the side of each tile
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int open(const std::string &filename, int tileSize);
+
+    /**
+     * Appends a tile.
+     * @param label     Piece of the tile
+     * @param rgb       bytes of the tile's pixels, tileSize x tileSize x 3 in RGB order
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int add(Piece label, const std::vector<uchar> &rgb);
+
+    /**
+     * Writes the number of tiles into the header and closes the file.
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int close();
+
+    /**
+     * @returns the number of tiles added so far
+    */
+    uint64_t getNumTiles();
+
+private:
+    std::mutex mutex;
+    FILE *fp;
+    TileFileHeader header;
+    bool ok;
+};
+
+/**
+ * Parses the tile export options from the command line arguments after "export".
+ *   Usage: export <ground_truth.csv> [--images DIR] [--out DIR] [--packed tiles.bin] [--size N] [--jpg] [--raw]
+ *                 [--empty] [--no-images] [--threads N] [--writers N] [--queue N]
+ * @param argc      int for the number of arguments
+ * @param argv      array of the argument strings
+ * @param first     int for the index of the first argument after "export"
+ * @param options   the resulting TileExportOptions
+ *
+ * @returns 0 if the arguments were valid, non-zero otherwise
+*/
+int parseTileExportOptions(int argc, char *argv[], int first, TileExportOptions &options);
+
+/**
+ * Cuts the 64 tiles of a board out of a photo, each tileSize x tileSize. With rectified the board is warped straight to
+ *   the tile size, so no tile is resized twice; otherwise (or if the lattice couldn't be fit) each square's rectangle is
+ *   cropped and resized.
+ * @param imgPath   string for the path of the image
+ * @param options   TileExportOptions for the export
+ * @param tiles     the resulting 64 BGR tiles, row by row from a8
+ *
+ * @returns 0 if the function returns successfully, 1 if the image couldn't be read and 2 if the board wasn't found
+*/
+int cutBoardTiles(const std::string &imgPath, const TileExportOptions &options, std::vector<cv::Mat> &tiles);
+
+/**
+ * Exports the tiles of every photo in the ground truth file, labeled from its fen. The cutting, resizing and encoding
+ *   is spread over numThreads workers, which hand the encoded tiles to numWriters writer threads through a bounded
+ *   queue, so the disk is written while the next boards are cut. Never uses HighGUI or stdin.
+ * @param options   TileExportOptions for the export
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int runTileExport(const TileExportOptions &options);
@@ -0,0 +1,154 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Headers for running a local UCI chess engine (such as Stockfish) as a persistent subprocess.
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "chessAnalysis.hpp"
+
+// longest we wait for the engine to start up or to finish a search before giving up on it, in milliseconds
+const int UCI_ENGINE_TIMEOUT_MS = 30000;
+
+/**
+ * Limits for one search of the engine. The depth is used unless a movetime is given.
+*/
+struct UciSearchLimits {
+    int depth = 10;         // search depth in plies
+    int movetimeMs = 0;     // milliseconds to search for instead of a depth, 0 to search to the depth
+    int multiPv = 1;        // number of principal variations searched by analyseProgressive
+};
+
+// how often a progressive search checks if it should stop, in milliseconds
+const int UCI_STOP_POLL_MS = 20;
+
+/**
+ * One local UCI engine process, started once and kept running, talking to it over its stdin and stdout.
+ *   Not thread safe, so each thread should use its own engine (or a UciEnginePool).
+*/
+class UciEngine {
+public:
+    UciEngine();
+    ~UciEngine();
+
+    UciEngine(const UciEngine &) = delete;
+    UciEngine &operator=(const UciEngine &) = delete;
+
+    /**
+     * Launches the engine and waits for it to be ready, stopping any engine already running.
+     * @param enginePath    string for the engine binary, looked up on the PATH if it has no '/'
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int start(const std::string &enginePath);
+
+    /**
+     * Asks the engine to quit and waits for the process to exit.
+    */
+    void stop();
+
+    /**
+     * @returns true if the engine process is running
+    */
+    bool isRunning() const;
+
+    /**
+     * Analyses the position, filling in the evaluation and best move the same way as the Stockfish API.
+     * @param fen       string of the 'fen' representation of the board's pieces
+     * @param limits    UciSearchLimits for how long to search
+     * @param result    the resulting ChessAnalysisResult
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int analyse(const std::string &fen, const UciSearchLimits &limits, ChessAnalysisResult &result);
+
+    /**
+     * Analyses the position with iterative deepening, handing over the result of every depth as soon as the engine has
+     *   finished it instead of only the last one. With limits.multiPv above 1 each result also has the first moves of
+     *   the other principal variations. The search is stopped as soon as shouldStop returns true.
+     * @param fen           string of the 'fen' representation of the board's pieces
+     * @param limits        UciSearchLimits for the deepest search and the number of principal variations
+     * @param minDepth      int for the shallowest depth that is handed over
+     * @param onDepth       function called with the result of each finished depth, on the calling thread
+     * @param shouldStop    function checked every UCI_STOP_POLL_MS while the engine searches
+     *
+     * @returns 0 if the search finished or was stopped, non-zero if the engine failed
+    */
+    int analyseProgressive(const std::string &fen, const UciSearchLimits &limits, int minDepth,
+                           const std::function<void(const ChessAnalysisResult &)> &onDepth,
+                           const std::function<bool()> &shouldStop);
+
+private:
+    int sendCommand(const std::string &command);
+    int readLine(std::string &line, int timeoutMs);
+    int waitFor(const std::string &expected, int timeoutMs);
+
+    pid_t pid;
+    int toEngine;
+    int fromEngine;
+    std::string readBuffer;
+};
+
+/**
+ * A fixed number of engines shared between threads, so several positions can be analysed at once.
+*/
+class UciEnginePool {
+public:
+    /**
+     * Launches the engines of the pool.
+     * @param enginePath    string for the engine binary
+     * @param numEngines    int for the number of engine processes
+    */
+    UciEnginePool(const std::string &enginePath, int numEngines);
+
+    /**
+     * @returns the number of engines that started successfully
+    */
+    int size() const;
+
+    /**
+     * Analyses the position with the next free engine, waiting for one if they are all busy.
+     * @param fen       string of the 'fen' representation of the board's pieces
+     * @param limits    UciSearchLimits for how long to search
+     * @param result    the resulting ChessAnalysisResult
+     *
+     * @returns 0 if the function returns successfully, non-zero otherwise
+    */
+    int analyse(const std::string &fen, const UciSearchLimits &limits, ChessAnalysisResult &result);
+
+private:
+    std::string enginePath;
+    std::vector<std::unique_ptr<UciEngine>> engines;
+    std::vector<UciEngine *> freeEngines;
+    std::mutex mutex;
+    std::condition_variable engineFreed;
+};
+
+/**
+ * Parses one 'info' line from a UCI engine into the evaluation of the result, from white's point of view.
+ * @param line          string for the line the engine printed
+ * @param whiteToMove   bool for if it is white's turn in the position being analysed
+ * @param result        the ChessAnalysisResult to update, left alone if the line has no score
+*/
+void parseUciInfoLine(const std::string &line, bool whiteToMove, ChessAnalysisResult &result);
+
+/**
+ * Parses the depth, principal variation number and first move of one 'info' line from a UCI engine.
+ * @param line      string for the line the engine printed
+ * @param depth     the resulting depth of the line
+ * @param multiPv   the resulting number of its principal variation, 1 for the best
+ * @param move      the resulting first move of the principal variation, such as "e2e4"
+ *
+ * @returns true if the line finishes a principal variation with an exact score, false for every other line
+*/
+bool parseUciPvLine(const std::string &line, int &depth, int &multiPv, std::string &move);
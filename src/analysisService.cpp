@@ -0,0 +1,389 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the asynchronous analysis service, which queries Stockfish in the background and caches the results.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include "analysisService.hpp"
+#include "uciEngine.hpp"
+#include "instrumentation.hpp"
+
+ProgressiveAnalysisOptions progressiveOptions;
+
+
+/**
+ * Gets the key a position is cached under. Only the placement, side to move, castling and en passant fields of the
+ *   fen are used, so the same position reached by a different move order (or with different clocks) shares a key.
+ * @param fen       string of the 'fen' representation of the board's pieces
+ * @param depth     int for the search depth requested from the engine
+ *
+ * @returns a string for the cache key
+*/
+std::string getAnalysisCacheKey(const std::string &fen, int depth) {
+    std::istringstream fields(fen);
+    std::string field;
+    std::string key;
+
+    for (int i = 0; i < 4 && fields >> field; i++) {
+        key += field + " ";
+    }
+
+    // a local engine searching for a fixed time gives a different answer than one searching to the depth
+    const AnalysisBackendOptions &backend = getAnalysisBackend();
+    if (backend.backend == ANALYSIS_BACKEND_UCI && backend.movetimeMs > 0) {
+        return key + "movetime " + std::to_string(backend.movetimeMs);
+    }
+    return key + "depth " + std::to_string(depth);
+}
+
+
+/**
+ * Starts the worker threads of the service.
+ * @param options   AnalysisServiceOptions for the timeouts, retries, workers and cache
+*/
+AnalysisService::AnalysisService(const AnalysisServiceOptions &options) : options(options), stopping(false) {
+    for (int i = 0; i < std::max(1, options.numWorkers); i++) {
+        workers.emplace_back(&AnalysisService::runWorker, this);
+    }
+}
+
+/**
+ * Stops the workers after their current request. Requests still queued finish unsuccessfully.
+*/
+AnalysisService::~AnalysisService() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    for (PendingRequest &request : queue) {
+        request.promise.set_value(ChessAnalysisResult());
+    }
+}
+
+/**
+ * Requests the analysis of a position, returning straight away.
+ * @param fen       string of the 'fen' representation of the board's pieces
+ * @param depth     int for the search depth requested from the engine
+ *
+ * @returns a future for the ChessAnalysisResult, which is already ready if the position was cached
+*/
+std::shared_future<ChessAnalysisResult> AnalysisService::requestAnalysis(const std::string &fen, int depth) {
+    std::string key = getAnalysisCacheKey(fen, depth);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    ChessAnalysisResult cached;
+    if (findInCache(key, cached)) {
+        addCounter("analysisCacheHits");
+        std::promise<ChessAnalysisResult> promise;
+        promise.set_value(cached);
+        return promise.get_future().share();
+    }
+
+    // the same position asked for again before it came back shares the request already made
+    auto pending = inFlight.find(key);
+    if (pending != inFlight.end()) {
+        addCounter("analysisSharedRequests");
+        return pending->second;
+    }
+
+    PendingRequest request;
+    request.key = key;
+    request.fen = fen;
+    request.depth = depth;
+    std::shared_future<ChessAnalysisResult> future = request.promise.get_future().share();
+
+    inFlight[key] = future;
+    queue.push_back(std::move(request));
+    condition.notify_one();
+
+    return future;
+}
+
+/**
+ * Gets the analysis of a position if it is in the cache, without making a request.
+ * @param fen       string of the 'fen' representation of the board's pieces
+ * @param depth     int for the search depth requested from the engine
+ * @param result    the resulting ChessAnalysisResult
+ *
+ * @returns true if the position was cached
+*/
+bool AnalysisService::getCachedAnalysis(const std::string &fen, int depth, ChessAnalysisResult &result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return findInCache(getAnalysisCacheKey(fen, depth), result);
+}
+
+/**
+ * Removes every position from the cache.
+*/
+void AnalysisService::clearCache() {
+    std::lock_guard<std::mutex> lock(mutex);
+    cacheOrder.clear();
+    cacheEntries.clear();
+}
+
+/**
+ * Takes requests off the queue and makes them until the service stops, retrying the ones that fail along the way.
+*/
+void AnalysisService::runWorker() {
+    // one session per worker, so its connection stays open from request to request
+    cpr::Session session;
+
+    for (;;) {
+        PendingRequest request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            request = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        ChessAnalysisResult result;
+        auto fetch = [&]() {
+            if (getAnalysisBackend().backend == ANALYSIS_BACKEND_UCI) {
+                return fetchEngineAnalysis(request.fen, result, request.depth);
+            }
+            return fetchChessAnalysis(session, request.fen, result, request.depth, options.timeoutMs);
+        };
+
+        int delayMs = options.retryDelayMs;
+        int ret = fetch();
+        for (int attempt = 0; ret == 1 && attempt < options.maxRetries; attempt++) {
+            logPrintf(LOG_WARNING, "Retrying Stockfish request in %d ms\n", delayMs);
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+            delayMs *= 2;
+            ret = fetch();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // failures aren't cached, so asking again makes a new request
+            if (ret == 0) {
+                addToCache(request.key, result);
+            }
+            inFlight.erase(request.key);
+        }
+        request.promise.set_value(result);
+    }
+}
+
+/**
+ * Looks a position up in the cache, marking it as the most recently used. Must be called with the mutex held.
+ * @param key       string for the cache key of the position
+ * @param result    the resulting ChessAnalysisResult
+ *
+ * @returns true if the position was cached
+*/
+bool AnalysisService::findInCache(const std::string &key, ChessAnalysisResult &result) {
+    auto entry = cacheEntries.find(key);
+    if (entry == cacheEntries.end()) {
+        return false;
+    }
+
+    cacheOrder.splice(cacheOrder.begin(), cacheOrder, entry->second);
+    result = entry->second->second;
+    return true;
+}
+
+/**
+ * Adds a position to the cache, dropping the least recently used one if it is full. Must be called with the mutex held.
+ * @param key       string for the cache key of the position
+ * @param result    ChessAnalysisResult for the position
+*/
+void AnalysisService::addToCache(const std::string &key, const ChessAnalysisResult &result) {
+    if (options.cacheSize == 0) {
+        return;
+    }
+
+    auto entry = cacheEntries.find(key);
+    if (entry != cacheEntries.end()) {
+        entry->second->second = result;
+        cacheOrder.splice(cacheOrder.begin(), cacheOrder, entry->second);
+        return;
+    }
+
+    cacheOrder.emplace_front(key, result);
+    cacheEntries[key] = cacheOrder.begin();
+
+    if (cacheOrder.size() > options.cacheSize) {
+        cacheEntries.erase(cacheOrder.back().first);
+        cacheOrder.pop_back();
+    }
+}
+
+
+/**
+ * Gets the process-wide analysis service, starting it on first use with the current analysis backend.
+ *
+ * @returns a reference to the shared AnalysisService
+*/
+AnalysisService &getAnalysisService() {
+    static AnalysisService service([]() {
+        // enough workers to keep every local engine busy
+        AnalysisServiceOptions options;
+        if (getAnalysisBackend().backend == ANALYSIS_BACKEND_UCI) {
+            options.numWorkers = std::max(options.numWorkers, getAnalysisBackend().numEngines);
+        }
+        return options;
+    }());
+    return service;
+}
+
+
+/**
+ * Sets the options of progressive analysis. Must be called before the first ProgressiveAnalysis is made.
+ * @param options   ProgressiveAnalysisOptions for the analysis
+*/
+void setProgressiveAnalysisOptions(const ProgressiveAnalysisOptions &options) {
+    progressiveOptions = options;
+}
+
+/**
+ * @returns the options of progressive analysis
+*/
+const ProgressiveAnalysisOptions &getProgressiveAnalysisOptions() {
+    return progressiveOptions;
+}
+
+/**
+ * Starts the background thread, which waits for a position.
+ * @param options   ProgressiveAnalysisOptions for the depths and principal variations
+*/
+ProgressiveAnalysis::ProgressiveAnalysis(const ProgressiveAnalysisOptions &options)
+    : options(options), stopping(false), generation(0), hasUpdate(false) {
+    worker = std::thread(&ProgressiveAnalysis::runWorker, this);
+}
+
+/**
+ * Stops the search and the background thread.
+*/
+ProgressiveAnalysis::~ProgressiveAnalysis() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    worker.join();
+}
+
+/**
+ * Starts analysing a position, stopping the search of the previous one. Setting the same position again keeps
+ *   its search going.
+ * @param fen   string of the 'fen' representation of the board's pieces, empty to only stop
+*/
+void ProgressiveAnalysis::setPosition(const std::string &fen) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fen == this->fen) {
+            return;
+        }
+        this->fen = fen;
+        generation++;
+        latest = ChessAnalysisResult();
+        hasUpdate = false;
+    }
+    condition.notify_all();
+}
+
+/**
+ * Stops the search, the same as setting an empty position.
+*/
+void ProgressiveAnalysis::stop() {
+    setPosition("");
+}
+
+/**
+ * Gets the deepest result of the current position, if it has changed since the last call.
+ * @param result    the resulting ChessAnalysisResult
+ *
+ * @returns true if there was a new result
+*/
+bool ProgressiveAnalysis::getUpdate(ChessAnalysisResult &result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!hasUpdate) {
+        return false;
+    }
+    result = latest;
+    hasUpdate = false;
+    return true;
+}
+
+/**
+ * Waits for positions and deepens their analysis until the position changes or the search is as deep as it goes.
+*/
+void ProgressiveAnalysis::runWorker() {
+    // its own engine, so a long search never holds up the engines of the analysis service
+    UciEngine engine;
+    cpr::Session session;
+    uint64_t searched = 0;
+
+    for (;;) {
+        std::string searchFen;
+        uint64_t searchGeneration;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&]() { return stopping || generation != searched; });
+            if (stopping) {
+                return;
+            }
+            searchFen = fen;
+            searchGeneration = generation;
+            searched = generation;
+        }
+        if (searchFen.empty()) {
+            continue;
+        }
+
+        auto isOutOfDate = [&]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stopping || generation != searchGeneration;
+        };
+        auto publish = [&](const ChessAnalysisResult &result) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (generation == searchGeneration) {
+                latest = result;
+                hasUpdate = true;
+            }
+        };
+
+        const AnalysisBackendOptions &backend = getAnalysisBackend();
+        if (backend.backend == ANALYSIS_BACKEND_UCI) {
+            if (!engine.isRunning() && engine.start(backend.enginePath) != 0) {
+                logPrintf(LOG_WARNING, "Could not start %s for progressive analysis\n", backend.enginePath.c_str());
+                continue;
+            }
+            UciSearchLimits limits;
+            limits.depth = std::max(options.firstDepth, options.maxDepth);
+            limits.multiPv = options.multiPv;
+            engine.analyseProgressive(searchFen, limits, options.firstDepth, publish, isOutOfDate);
+        }
+        else {
+            // the API only answers whole searches, so a shallow one is asked for before the deep one
+            int deepest = std::min(std::max(options.firstDepth, options.maxDepth), STOCKFISH_API_MAX_DEPTH);
+            for (int depth : {std::min(options.firstDepth, deepest), deepest}) {
+                ChessAnalysisResult result;
+                if (isOutOfDate() || fetchChessAnalysis(session, searchFen, result, depth, ANALYSIS_TIMEOUT_MS) != 0) {
+                    break;
+                }
+                result.depth = depth;
+                publish(result);
+                if (depth == deepest) {
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,264 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the auto-labeling mode, which grows the feature files from photos whose fens are already known
+  instead of asking for two key presses per square.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "autoLabelOps.hpp"
+#include "boardImage.hpp"
+#include "boardPipeline.hpp"
+#include "instrumentation.hpp"
+
+/**
+ * Parses the auto-labeling options from the command line arguments after "autolabel".
+ *   Usage: autolabel <ground_truth.csv> [--images DIR] [--threads N] [--rectified] [--max-mismatch N]
+ *                    [--light light_features.csv] [--dark dark_features.csv]
+ * @param argc      int for the number of arguments
+ * @param argv      array of the argument strings
+ * @param first     int for the index of the first argument after "autolabel"
+ * @param options   the resulting AutoLabelOptions
+ *
+ * @returns 0 if the arguments were valid, non-zero otherwise
+*/
+int parseAutoLabelOptions(int argc, char *argv[], int first, AutoLabelOptions &options) {
+    if (first >= argc) {
+        return 1;
+    }
+    options.truthPath = argv[first];
+    options.imageDir = std::filesystem::path(options.truthPath).parent_path().string();
+
+    for (int i = first + 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--images" && hasValue) {
+            options.imageDir = argv[++i];
+        }
+        else if (arg == "--threads" && hasValue) {
+            options.numThreads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--rectified") {
+            options.rectified = true;
+        }
+        else if (arg == "--max-mismatch" && hasValue) {
+            options.maxMismatches = std::atoi(argv[++i]);
+        }
+        else if (arg == "--light" && hasValue) {
+            options.lightPath = argv[++i];
+        }
+        else if (arg == "--dark" && hasValue) {
+            options.darkPath = argv[++i];
+        }
+        else {
+            printf("Unknown autolabel option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the ground truth file, where each line is an image's file name and the fen of its board.
+ *   Blank lines and lines starting with '#' are skipped, and only the placement field of the fen is kept.
+ * @param truthPath     string for the path of the ground truth file
+ * @param truth         the resulting map from each image's file name to its placement
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int readGroundTruth(const std::string &truthPath, std::map<std::string, std::string> &truth) {
+    std::ifstream truthFile(truthPath);
+    if (!truthFile) {
+        printf("Unable to open ground truth file %s\n", truthPath.c_str());
+        return 1;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(truthFile, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        size_t comma = line.find(',');
+        if (comma == std::string::npos) {
+            printf("Line %d of %s should be image,fen: %s\n", lineNumber, truthPath.c_str(), line.c_str());
+            return 1;
+        }
+        std::string fen = line.substr(comma + 1);
+        truth[line.substr(0, comma)] = fen.substr(0, fen.find(' '));
+    }
+
+    return 0;
+}
+
+/**
+ * Finds the board in a photo and adds the features of all 64 squares, labeled from the known board, to the light or
+ *   dark feature file of each square. The squares are the ones the pieces are classified from, so the new rows are
+ *   compared like for like. A board whose occupancy disagrees with the fen on more than maxMismatches squares is taken
+ *   to have been found wrongly and adds nothing.
+ * @param imgPath       string for the path of the image
+ * @param truth         Board the photo is known to show
+ * @param options       AutoLabelOptions for the run
+ * @param lightWriter   FeatureWriter for the light squares
+ * @param darkWriter    FeatureWriter for the dark squares
+ * @param mismatches    the resulting number of squares whose occupancy disagreed with the fen
+ *
+ * @returns 0 if the squares were added, 1 if the image couldn't be read, 2 if the board wasn't found and 3 if it was
+ *          skipped for disagreeing with the fen
+*/
+int autoLabelImage(const std::string &imgPath, const Board &truth, const AutoLabelOptions &options,
+                   FeatureWriter &lightWriter, FeatureWriter &darkWriter, int &mismatches) {
+    ScopedTimer timer("autoLabelImage");
+    mismatches = 0;
+
+    std::shared_ptr<BoardImage> image = std::make_shared<BoardImage>();
+    if (image->load(imgPath) != 0 || image->getClassificationImage().empty()) {
+        return 1;
+    }
+
+    BoardPipeline pipeline(image);
+    pipeline.setUseRectifiedSquares(options.rectified);
+    cv::Mat source;
+    std::vector<cv::Rect> squares;
+    float imageScale;
+    pipeline.getClassificationSquares(source, squares, imageScale);
+    if (squares.size() != 64) {
+        return 2;
+    }
+
+    // a wrongly found grid would put pieces into the empty squares' rows and the other way around
+    if (options.maxMismatches >= 0) {
+        std::vector<double> scores;
+        computeOccupancyScores(source, squares, scores);
+        for (int i = 0; i < 64; i++) {
+            bool isEmpty = isEmptyOccupancyScore(scores[i], isDarkSquareIndex(i), imageScale);
+            mismatches += isEmpty != (truth[i] == PIECE_EMPTY) ? 1 : 0;
+        }
+        if (mismatches > options.maxMismatches) {
+            return 3;
+        }
+    }
+
+    for (int i = 0; i < 64; i++) {
+        cv::Mat square = source(squares[i]);
+        cv::Mat histogram = getHistogramFeature(square, AUTO_LABEL_BINS);
+        std::vector<float> features;
+        convertMatToVec(histogram, features);
+
+        FeatureWriter &writer = isDarkSquareIndex(i) ? darkWriter : lightWriter;
+        if (writer.add(truth[i], features) != 0) {
+            return 1;
+        }
+    }
+    addCounter("autoLabeledSquares", 64);
+
+    return 0;
+}
+
+/**
+ * Auto-labels every photo of the ground truth file across a pool of worker threads, writing the features through one
+ *   buffered FeatureWriter per feature file (and its binary feature file, if there is one). Never uses HighGUI or stdin.
+ * @param options   AutoLabelOptions for the run
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int runAutoLabel(const AutoLabelOptions &options) {
+    std::map<std::string, std::string> truth;
+    if (readGroundTruth(options.truthPath, truth) != 0) {
+        return 1;
+    }
+
+    std::vector<std::string> imagePaths;
+    std::vector<Board> boards;
+    for (const auto &entry : truth) {
+        Board board;
+        if (getBoardFromFen(entry.second, board) != 0) {
+            printf("Skipping %s, its fen isn't a valid placement: %s\n", entry.first.c_str(), entry.second.c_str());
+            continue;
+        }
+        imagePaths.push_back((std::filesystem::path(options.imageDir) / entry.first).string());
+        boards.push_back(board);
+    }
+    if (imagePaths.empty()) {
+        printf("No images to label in %s\n", options.truthPath.c_str());
+        return 1;
+    }
+
+    // the binary feature files only follow the default csv files, the same as when labeling by hand
+    FeatureWriter lightWriter(options.lightPath, options.lightPath == CSV_LIGHT_FILE_PATH ? FEATURE_LIGHT_FILE_PATH : "",
+                              AUTO_LABEL_BINS);
+    FeatureWriter darkWriter(options.darkPath, options.darkPath == CSV_DARK_FILE_PATH ? FEATURE_DARK_FILE_PATH : "",
+                             AUTO_LABEL_BINS);
+
+    int numThreads = options.numThreads > 0 ? options.numThreads : static_cast<int>(std::thread::hardware_concurrency());
+    numThreads = std::max(1, std::min(numThreads, static_cast<int>(imagePaths.size())));
+    // the images are already spread over the threads, so OpenCV's own threads would only compete with them
+    if (numThreads > 1) {
+        cv::setNumThreads(1);
+    }
+
+    std::atomic<size_t> nextImage(0);
+    std::atomic<int> numLabeled(0), numUnreadable(0), numNotFound(0), numMismatched(0);
+    int64 start = cv::getTickCount();
+
+    auto worker = [&]() {
+        for (size_t i = nextImage++; i < imagePaths.size(); i = nextImage++) {
+            int mismatches = 0;
+            int ret = autoLabelImage(imagePaths[i], boards[i], options, lightWriter, darkWriter, mismatches);
+            if (ret == 0) {
+                numLabeled++;
+            }
+            else if (ret == 1) {
+                numUnreadable++;
+                logPrintf(LOG_WARNING, "Could not read %s\n", imagePaths[i].c_str());
+            }
+            else if (ret == 2) {
+                numNotFound++;
+                logPrintf(LOG_WARNING, "Could not find the board in %s\n", imagePaths[i].c_str());
+            }
+            else {
+                numMismatched++;
+                logPrintf(LOG_WARNING, "Skipping %s, the occupancy of %d squares disagrees with its fen\n",
+                          imagePaths[i].c_str(), mismatches);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; i++) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+
+    int ret = lightWriter.flush() | darkWriter.flush();
+    double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    printf("Labeled %d of %zu images with %d threads in %.2f s (%d unreadable, %d without a board, %d disagreeing with their fen)\n",
+           numLabeled.load(), imagePaths.size(), numThreads, seconds, numUnreadable.load(), numNotFound.load(),
+           numMismatched.load());
+    printf("Added %zu rows to %s and %zu rows to %s\n", lightWriter.getNumRows(), options.lightPath.c_str(),
+           darkWriter.getNumRows(), options.darkPath.c_str());
+
+    return ret;
+}
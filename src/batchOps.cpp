@@ -0,0 +1,489 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the headless batch mode, which processes many images to fen across a pool of worker threads.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <future>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <sys/resource.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <nlohmann/json.hpp>
+
+#include "batchOps.hpp"
+#include "boundedQueue.hpp"
+#include "analysisService.hpp"
+#include "boardPipeline.hpp"
+#include "boardImage.hpp"
+#include "chessAnalysis.hpp"
+#include "instrumentation.hpp"
+
+// size the board geometry is found at
+const cv::Size BATCH_WORKING_SIZE(428, 524);
+
+/**
+ * Parses the batch options from the command line arguments after "batch".
+ *   Usage: batch <dir or list file> [--turn w|b] [--threads N] [--out results.jsonl] [--eval] [--rectified] [--nn]
+ *                [--decode-threads N] [--queue N]
+ * @param argc      int for the number of arguments
+ * @param argv      array of the argument strings
+ * @param first     int for the index of the first argument after "batch"
+ * @param options   the resulting BatchOptions
+ *
+ * @returns 0 if the arguments were valid, non-zero otherwise
+*/
+int parseBatchOptions(int argc, char *argv[], int first, BatchOptions &options) {
+    if (first >= argc) {
+        return 1;
+    }
+    options.inputPath = argv[first];
+
+    for (int i = first + 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--turn" && hasValue) {
+            options.turn = argv[++i];
+        }
+        else if (arg == "--threads" && hasValue) {
+            options.numThreads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--out" && hasValue) {
+            options.outputPath = argv[++i];
+        }
+        else if (arg == "--eval") {
+            options.eval = true;
+        }
+        else if (arg == "--rectified") {
+            options.rectified = true;
+        }
+        else if (arg == "--nn") {
+            options.useClassifier = true;
+        }
+        else if (arg == "--decode-threads" && hasValue) {
+            options.numDecodeThreads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--queue" && hasValue) {
+            options.queueSize = std::atoi(argv[++i]);
+        }
+        else {
+            printf("Unknown batch option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if (options.turn != "w" && options.turn != "b") {
+        printf("Turn must be 'w' or 'b', not: %s\n", options.turn.c_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Checks if the path has one of the image extensions we can read.
+ * @param path  std::filesystem::path of the file
+ *
+ * @returns true if the file looks like an image
+*/
+bool isImagePath(const std::filesystem::path &path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".png";
+}
+
+/**
+ * Collects the image paths for a batch, from either a directory of images or a text file listing them.
+ * @param inputPath     string for the directory or list file
+ * @param imagePaths    the resulting vector of image paths, sorted if they came from a directory
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int collectImagePaths(const std::string &inputPath, std::vector<std::string> &imagePaths) {
+    std::error_code error;
+    if (std::filesystem::is_directory(inputPath, error)) {
+        for (const auto &entry : std::filesystem::directory_iterator(inputPath, error)) {
+            if (entry.is_regular_file() && isImagePath(entry.path())) {
+                imagePaths.push_back(entry.path().string());
+            }
+        }
+        std::sort(imagePaths.begin(), imagePaths.end());
+        return error ? 1 : 0;
+    }
+
+    // otherwise it is a list of images, one per line
+    std::ifstream listFile(inputPath);
+    if (!listFile) {
+        printf("Unable to open batch input %s\n", inputPath.c_str());
+        return 1;
+    }
+
+    std::string line;
+    while (std::getline(listFile, line)) {
+        // allow for windows line endings and blank lines
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            imagePaths.push_back(line);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Gets the most memory the process has had resident at once.
+ *
+ * @returns the peak resident set size in bytes
+*/
+size_t getPeakRssBytes() {
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    // macOS reports it in bytes, linux in kilobytes
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/**
+ * Adds the eval, mate and best move of an analysis to the JSON of its image, leaving out what the analysis didn't find.
+ * @param analysis  ChessAnalysisResult of the image's fen
+ * @param result    JSON object for the image
+*/
+void addAnalysisToResult(const ChessAnalysisResult &analysis, nlohmann::json &result) {
+    if (analysis.hasEval) {
+        result["eval"] = analysis.eval;
+    }
+    if (analysis.hasMate) {
+        result["mate"] = analysis.mate;
+    }
+    if (!analysis.bestMoveString.empty()) {
+        result["bestmove"] = analysis.bestMoveString;
+    }
+}
+
+/**
+ * Gets the milliseconds since the given tick count.
+ * @param start     int64 tick count from cv::getTickCount
+ *
+ * @returns the elapsed milliseconds
+*/
+double elapsedMs(int64 start) {
+    return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+}
+
+/**
+ * Reads an image of the batch and decodes it at both of the resolutions the pipeline uses, timing each step.
+ *   This is the I/O stage of the batch, kept apart so the next image can be decoded while this one is processed.
+ * @param imgPath   string for the path of the image
+ * @param image     the resulting BoardImage, decoded for the geometry and the classification
+ * @param timings   the resulting JSON object of the milliseconds spent reading and decoding
+ *
+ * @returns 0 if the function returns successfully, 1 if the image could not be read and 2 if it could not be decoded
+*/
+int loadBatchImage(const std::string &imgPath, std::shared_ptr<BoardImage> &image, nlohmann::json &timings) {
+    int64 start = cv::getTickCount();
+    image = std::make_shared<BoardImage>();
+    int loadResult = image->load(imgPath);
+    timings["readFile"] = elapsedMs(start);
+    if (loadResult != 0) {
+        return 1;
+    }
+
+    start = cv::getTickCount();
+    if (image->getGeometryImage(BATCH_WORKING_SIZE).empty()) {
+        return 2;
+    }
+    timings["decodeGeometry"] = elapsedMs(start);
+
+    start = cv::getTickCount();
+    if (image->getClassificationImage().empty()) {
+        return 2;
+    }
+    timings["decodeClassification"] = elapsedMs(start);
+    return 0;
+}
+
+/**
+ * Runs the pipeline on an image loaded by loadBatchImage, putting the read and decode times in with the stages.
+ * @param imgPath       string for the path of the image
+ * @param image         BoardImage from loadBatchImage, null if it couldn't be read
+ * @param loadResult    int returned by loadBatchImage
+ * @param loadTimings   JSON object of the timings from loadBatchImage
+ * @param options       BatchOptions for the run
+ *
+ * @returns the JSON object for the image's line of output, with "error" set if it could not be processed
+*/
+nlohmann::json processLoadedBatchImage(const std::string &imgPath, std::shared_ptr<BoardImage> image, int loadResult,
+                                       const nlohmann::json &loadTimings, const BatchOptions &options) {
+    nlohmann::json result;
+    if (loadResult != 0) {
+        result["error"] = loadResult == 1 ? "could not read image" : "could not decode image";
+        result["timings_ms"] = loadTimings;
+    }
+    else {
+        // the decodes were already done, so the pipeline's own (cached) decode times are replaced with the real ones
+        result = processBatchImage(image, options);
+        double loadMs = 0;
+        for (const auto &timing : loadTimings.items()) {
+            result["timings_ms"][timing.key()] = timing.value();
+            loadMs += timing.value().get<double>();
+        }
+        if (result["timings_ms"].contains("total")) {
+            result["timings_ms"]["total"] = result["timings_ms"]["total"].get<double>() + loadMs;
+        }
+    }
+    result["path"] = imgPath;
+    return result;
+}
+
+/**
+ * Runs the whole pipeline on one image of the batch, timing each stage.
+ * @param imgPath   string for the path of the image
+ * @param options   BatchOptions for the run
+ *
+ * @returns the JSON object for the image's line of output, with "error" set if it could not be processed
+*/
+nlohmann::json processBatchImage(const std::string &imgPath, const BatchOptions &options) {
+    std::shared_ptr<BoardImage> image;
+    nlohmann::json loadTimings;
+    int loadResult = loadBatchImage(imgPath, image, loadTimings);
+    return processLoadedBatchImage(imgPath, image, loadResult, loadTimings, options);
+}
+
+/**
+ * Runs the whole pipeline on an image that is already loaded, such as an upload, timing each stage.
+ * @param image     BoardImage for the photo of the board
+ * @param options   BatchOptions for the run
+ *
+ * @returns the JSON object for the image, with "error" set if it could not be processed
+*/
+nlohmann::json processBatchImage(std::shared_ptr<BoardImage> image, const BatchOptions &options) {
+    const cv::Size workingSize = BATCH_WORKING_SIZE;
+    // the counts of this image only, such as its hough segments and nearest neighbour comparisons
+    MetricsCapture capture;
+    nlohmann::json result;
+    nlohmann::json timings;
+    int64 totalStart = cv::getTickCount();
+    int64 start;
+
+    BoardPipeline pipeline(image, workingSize);
+    pipeline.setTurn(options.turn);
+    pipeline.setUseRectifiedSquares(options.rectified);
+    pipeline.setUseClassifier(options.useClassifier);
+
+    // the decodes are timed apart from the stages that trigger them, and the full resolution is never decoded
+    start = cv::getTickCount();
+    if (image->getGeometryImage(workingSize).empty()) {
+        result["error"] = "could not decode image";
+        result["timings_ms"] = timings;
+        return result;
+    }
+    timings["decodeGeometry"] = elapsedMs(start);
+
+    // each stage is requested in order so it can be timed on its own
+    start = cv::getTickCount();
+    pipeline.getLines();
+    timings["calcHoughLines"] = elapsedMs(start);
+
+    start = cv::getTickCount();
+    pipeline.getIntersections();
+    timings["getIntersections"] = elapsedMs(start);
+
+    start = cv::getTickCount();
+    pipeline.getLattice();
+    timings["fitBoardLattice"] = elapsedMs(start);
+
+    start = cv::getTickCount();
+    pipeline.getOriginalPoints();
+    timings["scalePointsToOriginal"] = elapsedMs(start);
+
+    start = cv::getTickCount();
+    const std::vector<cv::Rect> &rectangles = pipeline.getRectangles();
+    timings["setRectangles"] = elapsedMs(start);
+
+    if (rectangles.size() != 64) {
+        result["error"] = "board not found";
+        result["intersections"] = pipeline.getIntersections().size();
+        timings["total"] = elapsedMs(totalStart);
+        result["timings_ms"] = timings;
+        return result;
+    }
+
+    start = cv::getTickCount();
+    pipeline.getSource();
+    timings["decodeClassification"] = elapsedMs(start);
+
+    start = cv::getTickCount();
+    const Board &board = pipeline.getSquareLabels();
+    timings["getPieceLabels"] = elapsedMs(start);
+    std::vector<std::string> labels;
+    for (Piece piece : board.squares) {
+        labels.push_back(PIECE_LABELS[piece]);
+    }
+    result["labels"] = labels;
+    result["occupancy"] = pipeline.getOccupancyScores();
+    if (options.useClassifier) {
+        result["confidences"] = pipeline.getSquareConfidences();
+    }
+
+    result["fen"] = pipeline.getFen();
+    if (pipeline.getFen().empty()) {
+        result["error"] = "invalid labels";
+    }
+    else if (options.eval) {
+        start = cv::getTickCount();
+        const ChessAnalysisResult &analysis = pipeline.getAnalysis();
+        timings["getChessAnalysis"] = elapsedMs(start);
+        addAnalysisToResult(analysis, result);
+    }
+
+    timings["total"] = elapsedMs(totalStart);
+    result["timings_ms"] = timings;
+    result["counters"] = capture.getMetrics().counters;
+    result["peak_rss_mb"] = getPeakRssBytes() / (1024.0 * 1024.0);
+    return result;
+}
+
+/**
+ * An image moving through the stages of the batch.
+*/
+struct BatchItem {
+    std::string path;
+    std::shared_ptr<BoardImage> image;
+    int loadResult = 0;
+    nlohmann::json loadTimings;
+    nlohmann::json result;
+    std::shared_future<ChessAnalysisResult> analysis;
+    int64 analysisStart = 0;
+};
+
+/**
+ * Processes every image of the batch as a pipeline of three stages joined by bounded queues, writing one JSON line per
+ *   image with its path, fen, labels, optional eval and the time spent in each stage. The I/O stage reads and decodes
+ *   the images, the vision workers find the board and label the pieces, and the analysis stage waits for the engine
+ *   and writes the lines. Image N+1 is decoded while N is labeled and N-1 is analysed, so the batch runs at the speed
+ *   of its slowest stage. Never uses HighGUI or stdin.
+ * @param options   BatchOptions for the run
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int runBatch(const BatchOptions &options) {
+    std::vector<std::string> imagePaths;
+    if (collectImagePaths(options.inputPath, imagePaths) != 0) {
+        return 1;
+    }
+
+    FILE *output = fopen(options.outputPath.c_str(), "w");
+    if (!output) {
+        printf("Unable to open output file %s\n", options.outputPath.c_str());
+        return 1;
+    }
+
+    int numThreads = options.numThreads > 0 ? options.numThreads : static_cast<int>(std::thread::hardware_concurrency());
+    numThreads = std::max(1, std::min(numThreads, static_cast<int>(imagePaths.size())));
+    int numDecodeThreads = std::max(1, std::min(options.numDecodeThreads, static_cast<int>(imagePaths.size())));
+    // the images are what run in parallel, so OpenCV's own threads would only oversubscribe the cores
+    if (numThreads > 1) {
+        cv::setNumThreads(1);
+    }
+    printf("Processing %zu images with %d threads (%d decoding)\n", imagePaths.size(), numThreads, numDecodeThreads);
+
+    // each queue holds a couple of images per worker, so the decoded images in memory stay bounded
+    size_t queueSize = static_cast<size_t>(std::max(options.queueSize, 1));
+    BoundedQueue<BatchItem> decodedImages(queueSize);
+    BoundedQueue<BatchItem> labeledImages(queueSize);
+    std::atomic<size_t> nextImage(0);
+    std::atomic<int> decodersLeft(numDecodeThreads);
+    std::atomic<int> labelersLeft(numThreads);
+    std::atomic<int> numFailed(0);
+    int64 start = cv::getTickCount();
+
+    // I/O stage: each decoder takes the next unread image until there are none left
+    auto decoder = [&]() {
+        for (size_t i = nextImage++; i < imagePaths.size(); i = nextImage++) {
+            BatchItem item;
+            item.path = imagePaths[i];
+            item.loadResult = loadBatchImage(item.path, item.image, item.loadTimings);
+            decodedImages.push(std::move(item));
+        }
+        if (--decodersLeft == 0) {
+            decodedImages.close();
+        }
+    };
+
+    // vision stage: the board and labels, with the analysis only requested so the worker can move on to the next image
+    BatchOptions labelOptions = options;
+    labelOptions.eval = false;
+    auto labeler = [&]() {
+        BatchItem item;
+        while (decodedImages.pop(item)) {
+            item.result = processLoadedBatchImage(item.path, item.image, item.loadResult, item.loadTimings, labelOptions);
+            // the decoded pixels aren't needed by the analysis, so they are freed now
+            item.image.reset();
+            if (options.eval && !item.result.contains("error")) {
+                item.analysisStart = cv::getTickCount();
+                item.analysis = getAnalysisService().requestAnalysis(item.result["fen"].get<std::string>());
+            }
+            labeledImages.push(std::move(item));
+        }
+        if (--labelersLeft == 0) {
+            labeledImages.close();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numDecodeThreads; i++) {
+        workers.emplace_back(decoder);
+    }
+    for (int i = 0; i < numThreads; i++) {
+        workers.emplace_back(labeler);
+    }
+
+    // analysis stage, on this thread: waits for each image's analysis and writes its line
+    BatchItem item;
+    while (labeledImages.pop(item)) {
+        if (item.analysis.valid()) {
+            addAnalysisToResult(item.analysis.get(), item.result);
+            double analysisMs = elapsedMs(item.analysisStart);
+            item.result["timings_ms"]["getChessAnalysis"] = analysisMs;
+            item.result["timings_ms"]["total"] = item.result["timings_ms"]["total"].get<double>() + analysisMs;
+        }
+        if (item.result.contains("error")) {
+            numFailed++;
+        }
+
+        std::string line = item.result.dump() + "\n";
+        fwrite(line.c_str(), sizeof(char), line.size(), output);
+        fflush(output);
+    }
+
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+    fclose(output);
+
+    double seconds = elapsedMs(start) / 1000.0;
+    printf("Processed %zu images (%d failed) in %.2f s, %.2f images/s. Results in %s\n", imagePaths.size(),
+           numFailed.load(), seconds, imagePaths.size() / std::max(seconds, 1e-9), options.outputPath.c_str());
+    printf("Peak RSS: %.1f MB\n", getPeakRssBytes() / (1024.0 * 1024.0));
+
+    return 0;
+}
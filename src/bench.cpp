@@ -0,0 +1,636 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Benchmark and accuracy regression harness. Runs the whole pipeline headlessly over a corpus of images (images/ by
+  default) for a number of iterations, and reports the p50/p95/p99 latency of each stage, the images per second and the
+  peak memory, along with how many squares match the fens of a ground truth file. With --compare-models it instead
+  times and scores each piece classifier model on the occupied squares of the ground truth, and with --compare-pruning it
+  does the same for each number of prototypes of the histogram classifier against its exhaustive search.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <nlohmann/json.hpp>
+
+#include "autoLabelOps.hpp"
+#include "batchOps.hpp"
+#include "boardPipeline.hpp"
+#include "boardCache.hpp"
+#include "pieceDetectionOps.hpp"
+#include "instrumentation.hpp"
+#include "commonOptions.hpp"
+
+
+/**
+ * Options for a benchmark run, set from the command line.
+*/
+struct BenchOptions {
+    std::string inputPath = "images";                       // directory of images, or a text file with one image path per line
+    std::string truthPath = "images/ground_truth.csv";      // file of "image,fen" lines the fens are checked against
+    int iterations = 3;                                     // number of timed passes over the images
+    int warmup = 1;                                         // number of untimed passes first, which load the features
+    int numThreads = 1;                                     // number of worker threads, 1 so the stages don't compete for cores
+    bool rectified = false;                                 // if the pieces are classified from the rectified top-down board
+    std::string outputPath;                                 // file the JSON summary is written to, if any
+    double minAccuracy = 0;                                 // square accuracy below which the run fails, 0 for no check
+    std::vector<std::string> compareModels;                 // model files to compare instead of running the pipeline
+    std::vector<int> comparePruning;                        // prototypes per label to compare instead, 0 for exhaustive
+    CommonOptions common;                                   // the options of every mode, the classifier's for the models
+};
+
+/**
+ * The squares compared against the ground truth, for one image or the whole run.
+*/
+struct AccuracyStats {
+    int boards = 0;             // number of boards compared
+    int exactBoards = 0;        // number of boards with every square right
+    int squares = 0;            // number of squares compared
+    int correctSquares = 0;     // number of squares with the right piece (or correctly empty)
+    int correctOccupancy = 0;   // number of squares that were correctly found empty or occupied
+};
+
+/**
+ * Parses the benchmark options from the command line, along with the options of every mode.
+ *   Usage: bench [dir or list file] [--truth ground_truth.csv] [--iterations N] [--warmup N] [--threads N] [--rectified]
+ *                [--out bench.json] [--min-accuracy FRACTION] [--compare-models a.onnx,b.onnx]
+ *                [--compare-pruning 0,2,4,8] [common options]
+ * @param argc      int for the number of arguments
+ * @param argv      array of the argument strings
+ * @param options   the resulting BenchOptions
+ *
+ * @returns 0 if the arguments were valid, non-zero otherwise
+*/
+int parseBenchOptions(int argc, char *argv[], BenchOptions &options) {
+    // the per-image fens are printed at info, which would bury the report
+    options.common.logLevel = LOG_WARNING;
+    if (extractCommonOptions(argc, argv, options.common) != 0) {
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--truth" && hasValue) {
+            options.truthPath = argv[++i];
+        }
+        else if (arg == "--iterations" && hasValue) {
+            options.iterations = std::atoi(argv[++i]);
+        }
+        else if (arg == "--warmup" && hasValue) {
+            options.warmup = std::atoi(argv[++i]);
+        }
+        else if (arg == "--threads" && hasValue) {
+            options.numThreads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--rectified") {
+            options.rectified = true;
+        }
+        else if (arg == "--out" && hasValue) {
+            options.outputPath = argv[++i];
+        }
+        else if (arg == "--min-accuracy" && hasValue) {
+            options.minAccuracy = std::atof(argv[++i]);
+        }
+        else if (arg == "--compare-models" && hasValue) {
+            std::stringstream models(argv[++i]);
+            std::string model;
+            while (std::getline(models, model, ',')) {
+                if (!model.empty()) {
+                    options.compareModels.push_back(model);
+                }
+            }
+        }
+        else if (arg == "--compare-pruning" && hasValue) {
+            std::stringstream levels(argv[++i]);
+            std::string level;
+            while (std::getline(levels, level, ',')) {
+                if (!level.empty()) {
+                    options.comparePruning.push_back(std::max(0, std::atoi(level.c_str())));
+                }
+            }
+        }
+        else if (arg.rfind("--", 0) != 0 && i == 1) {
+            options.inputPath = arg;
+        }
+        else {
+            printf("Unknown bench option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if (options.iterations < 1 || options.warmup < 0) {
+        printf("There has to be at least one iteration and no negative warmup\n");
+        return 1;
+    }
+
+    applyCommonOptions(options.common);
+    return 0;
+}
+
+/**
+ * Expands the placement field of a fen to one character per square, row by row from a8, with '.' for empty squares.
+ * @param fen       string for the fen, of which only the placement field is used
+ * @param squares   the resulting string of 64 characters
+ *
+ * @returns 0 if the placement has exactly 64 squares, non-zero otherwise
+*/
+int expandFenPlacement(const std::string &fen, std::string &squares) {
+    squares.clear();
+    for (char c : fen.substr(0, fen.find(' '))) {
+        if (c == '/') {
+            continue;
+        }
+        if (std::isdigit(static_cast<unsigned char>(c))) {
+            squares.append(c - '0', '.');
+        }
+        else {
+            squares += c;
+        }
+    }
+    return squares.size() == 64 ? 0 : 1;
+}
+
+/**
+ * Compares the fen produced for a board to its ground truth, square by square.
+ *   A board without a fen (it wasn't found, or had an invalid label) gets every square wrong.
+ * @param fen       string for the produced fen, empty if there wasn't one
+ * @param truth     string for the placement field of the ground truth
+ * @param stats     AccuracyStats to add the board to
+*/
+void addBoardAccuracy(const std::string &fen, const std::string &truth, AccuracyStats &stats) {
+    std::string truthSquares, squares;
+    if (expandFenPlacement(truth, truthSquares) != 0) {
+        return;
+    }
+    if (fen.empty() || expandFenPlacement(fen, squares) != 0) {
+        squares.clear();
+    }
+
+    int correct = 0;
+    for (int i = 0; i < 64 && !squares.empty(); i++) {
+        correct += squares[i] == truthSquares[i] ? 1 : 0;
+        stats.correctOccupancy += (squares[i] == '.') == (truthSquares[i] == '.') ? 1 : 0;
+    }
+
+    stats.boards++;
+    stats.exactBoards += correct == 64 ? 1 : 0;
+    stats.squares += 64;
+    stats.correctSquares += correct;
+}
+
+/**
+ * Gets a percentile of the samples with the nearest rank method.
+ * @param sorted        vector of the samples, sorted in ascending order
+ * @param percentile    double for the percentile, such as 95
+ *
+ * @returns the sample at the percentile, or 0 if there are none
+*/
+double getPercentile(const std::vector<double> &sorted, double percentile) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * sorted.size()));
+    return sorted[std::min(std::max(rank, static_cast<size_t>(1)), sorted.size()) - 1];
+}
+
+/**
+ * Gets the fraction of the count out of the total.
+ * @returns the fraction, or 0 if the total is 0
+*/
+double getFraction(int count, int total) {
+    return total > 0 ? static_cast<double>(count) / total : 0.0;
+}
+
+/**
+ * The occupied squares of a board with ground truth, cut out of the image the pieces are classified from.
+*/
+struct TruthSquares {
+    std::vector<cv::Mat> squares;   // image of each occupied square
+    std::vector<char> pieces;       // fen character of the piece on each of them
+    std::vector<int> indices;       // index of each of them on the board, row by row from a8
+};
+
+/**
+ * Finds the board in each image with ground truth and cuts out the squares that have a piece on them, so the models
+ *   are compared on the pieces alone rather than on how well the empty squares were found.
+ * @param imagePaths    vector of the image paths
+ * @param truth         map from each image's file name to its placement
+ * @param boards        the resulting squares of every board that was found
+*/
+void collectTruthSquares(const std::vector<std::string> &imagePaths, const std::map<std::string, std::string> &truth,
+                         std::vector<TruthSquares> &boards) {
+    for (const std::string &imgPath : imagePaths) {
+        auto found = truth.find(std::filesystem::path(imgPath).filename().string());
+        std::string truthSquares;
+        if (found == truth.end() || expandFenPlacement(found->second, truthSquares) != 0) {
+            continue;
+        }
+
+        std::shared_ptr<BoardImage> image = std::make_shared<BoardImage>();
+        if (image->load(imgPath) != 0) {
+            continue;
+        }
+        BoardPipeline pipeline(image);
+        const std::vector<cv::Rect> &rectangles = pipeline.getRectangles();
+        if (rectangles.size() != 64) {
+            printf("Board not found in %s, so it isn't compared\n", imgPath.c_str());
+            continue;
+        }
+
+        cv::Mat src = pipeline.getSource();
+        TruthSquares board;
+        for (int i = 0; i < 64; i++) {
+            if (truthSquares[i] != '.') {
+                board.squares.push_back(src(rectangles[i]).clone());
+                board.pieces.push_back(truthSquares[i]);
+                board.indices.push_back(i);
+            }
+        }
+        if (!board.squares.empty()) {
+            boards.push_back(board);
+        }
+    }
+}
+
+/**
+ * Compares the latency and accuracy of each model of the options, classifying the occupied squares of every board
+ *   with ground truth in one batch per board.
+ * @param options       BenchOptions with the models, their classifier options and the iterations
+ * @param imagePaths    vector of the image paths
+ * @param truth         map from each image's file name to its placement
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int compareModels(const BenchOptions &options, const std::vector<std::string> &imagePaths,
+                  const std::map<std::string, std::string> &truth) {
+    std::vector<TruthSquares> boards;
+    collectTruthSquares(imagePaths, truth, boards);
+    if (boards.empty()) {
+        printf("No boards with ground truth to compare the models on\n");
+        return -1;
+    }
+
+    nlohmann::json summary;
+    printf("%-40s %-12s %9s %10s %10s %12s %10s\n", "model", "backend", "input", "p50 ms", "p95 ms", "ms/square", "accuracy");
+    for (const std::string &model : options.compareModels) {
+        ClassifierOptions classifierOptions = options.common.classifier;
+        classifierOptions.modelPath = model;
+        PieceClassifier classifier(classifierOptions);
+        if (!classifier.isLoaded()) {
+            printf("%-40s could not be loaded\n", model.c_str());
+            continue;
+        }
+
+        std::vector<Piece> labels;
+        std::vector<float> confidences;
+        for (int iteration = 0; iteration < options.warmup; iteration++) {
+            for (const TruthSquares &board : boards) {
+                classifier.classify(board.squares, labels, confidences);
+            }
+        }
+
+        std::vector<double> samples;
+        int numSquares = 0, numCorrect = 0;
+        for (int iteration = 0; iteration < options.iterations; iteration++) {
+            for (const TruthSquares &board : boards) {
+                int64 start = cv::getTickCount();
+                classifier.classify(board.squares, labels, confidences);
+                samples.push_back((cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency());
+
+                for (size_t i = 0; i < board.pieces.size(); i++) {
+                    numCorrect += i < labels.size() && PIECE_FEN_CHARS[labels[i]] == board.pieces[i] ? 1 : 0;
+                }
+                numSquares += static_cast<int>(board.pieces.size());
+            }
+        }
+
+        std::sort(samples.begin(), samples.end());
+        double totalMs = std::accumulate(samples.begin(), samples.end(), 0.0);
+        double msPerSquare = totalMs / std::max(numSquares, 1);
+        double accuracy = getFraction(numCorrect, numSquares);
+        std::string input = std::to_string(classifierOptions.inputSize.width) + "x" + std::to_string(classifierOptions.inputSize.height);
+        const char *backend = getClassifierBackendName(classifier.getBackend());
+
+        printf("%-40s %-12s %9s %10.2f %10.2f %12.3f %9.1f%%\n", model.c_str(), backend, input.c_str(),
+               getPercentile(samples, 50), getPercentile(samples, 95), msPerSquare, 100 * accuracy);
+        summary["models"][model] = {
+            {"backend", backend},
+            {"input", input},
+            {"p50_ms", getPercentile(samples, 50)},
+            {"p95_ms", getPercentile(samples, 95)},
+            {"ms_per_square", msPerSquare},
+            {"squares", numSquares},
+            {"accuracy", accuracy}};
+    }
+    size_t numPieces = 0;
+    for (const TruthSquares &board : boards) {
+        numPieces += board.pieces.size();
+    }
+    printf("\nCompared on the %zu occupied squares of %zu boards, %d iterations\n", numPieces, boards.size(), options.iterations);
+
+    if (!options.outputPath.empty()) {
+        std::ofstream output(options.outputPath);
+        output << summary.dump(2) << "\n";
+        if (!output) {
+            printf("Unable to write the summary to %s\n", options.outputPath.c_str());
+            return -1;
+        }
+        printf("Wrote the summary to %s\n", options.outputPath.c_str());
+    }
+
+    return 0;
+}
+
+/**
+ * Compares the latency and accuracy of the histogram classifier with each number of prototypes per label of the options
+ *   against its exhaustive search, on the occupied squares of every board with ground truth. The histograms are computed
+ *   once, so only the search is timed, and every level searches the same number of labels.
+ * @param options       BenchOptions with the numbers of prototypes and the iterations
+ * @param imagePaths    vector of the image paths
+ * @param truth         map from each image's file name to its placement
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int comparePruning(const BenchOptions &options, const std::vector<std::string> &imagePaths,
+                   const std::map<std::string, std::string> &truth) {
+    std::vector<TruthSquares> boards;
+    collectTruthSquares(imagePaths, truth, boards);
+    if (boards.empty()) {
+        printf("No boards with ground truth to compare the pruning on\n");
+        return -1;
+    }
+
+    // copies, so each level builds its own prototypes over the same loaded rows
+    FeatureIndex lightIndex = getFeatureIndex(false);
+    FeatureIndex darkIndex = getFeatureIndex(true);
+    lightIndex.buildPrototypes(0, 0);
+    darkIndex.buildPrototypes(0, 0);
+
+    std::vector<cv::Mat> histograms;
+    std::vector<bool> isDark;
+    std::vector<char> pieces;
+    for (const TruthSquares &board : boards) {
+        for (size_t i = 0; i < board.squares.size(); i++) {
+            histograms.push_back(getHistogramFeature(board.squares[i], 16));
+            isDark.push_back(isDarkSquareIndex(board.indices[i]));
+            pieces.push_back(board.pieces[i]);
+        }
+    }
+    for (const cv::Mat &histogram : histograms) {
+        if (histogram.total() != static_cast<size_t>(lightIndex.dims()) || histogram.total() != static_cast<size_t>(darkIndex.dims())) {
+            printf("The feature files don't hold 16 bin histograms, so the pruning can't be compared\n");
+            return -1;
+        }
+    }
+
+    // what every level is compared against
+    std::vector<Piece> exhaustive(histograms.size());
+    for (size_t i = 0; i < histograms.size(); i++) {
+        exhaustive[i] = (isDark[i] ? darkIndex : lightIndex).classifyKNN(histograms[i].ptr<float>(0), HISTOGRAM_NEIGHBOURS);
+    }
+
+    int searchedLabels = options.common.featureIndex.searchedLabels;
+    nlohmann::json summary;
+    printf("%-12s %10s %10s %10s %10s %12s %10s %10s\n", "prototypes", "build ms", "count", "p50 us", "p95 us",
+           "compared", "agreement", "accuracy");
+    for (int level : options.comparePruning) {
+        int64 buildStart = cv::getTickCount();
+        lightIndex.buildPrototypes(level, searchedLabels);
+        darkIndex.buildPrototypes(level, searchedLabels);
+        double buildMs = (cv::getTickCount() - buildStart) * 1000.0 / cv::getTickFrequency();
+
+        int comparisons = 0;
+        for (int iteration = 0; iteration < options.warmup; iteration++) {
+            for (size_t i = 0; i < histograms.size(); i++) {
+                (isDark[i] ? darkIndex : lightIndex).classify(histograms[i].ptr<float>(0), HISTOGRAM_NEIGHBOURS, comparisons);
+            }
+        }
+
+        std::vector<double> samples;
+        uint64_t numComparisons = 0;
+        int numSquares = 0, numAgreeing = 0, numCorrect = 0;
+        for (int iteration = 0; iteration < options.iterations; iteration++) {
+            for (size_t i = 0; i < histograms.size(); i++) {
+                int64 start = cv::getTickCount();
+                Piece piece = (isDark[i] ? darkIndex : lightIndex).classify(histograms[i].ptr<float>(0), HISTOGRAM_NEIGHBOURS, comparisons);
+                samples.push_back((cv::getTickCount() - start) * 1e6 / cv::getTickFrequency());
+
+                numComparisons += comparisons;
+                numAgreeing += piece == exhaustive[i] ? 1 : 0;
+                numCorrect += PIECE_FEN_CHARS[piece] == pieces[i] ? 1 : 0;
+                numSquares++;
+            }
+        }
+
+        std::sort(samples.begin(), samples.end());
+        int numPrototypes = lightIndex.getNumPrototypes() + darkIndex.getNumPrototypes();
+        double comparedPerSquare = static_cast<double>(numComparisons) / std::max(numSquares, 1);
+        double agreement = getFraction(numAgreeing, numSquares);
+        double accuracy = getFraction(numCorrect, numSquares);
+        std::string name = level > 0 ? std::to_string(level) : "exhaustive";
+
+        printf("%-12s %10.2f %10d %10.2f %10.2f %12.1f %9.1f%% %9.1f%%\n", name.c_str(), buildMs, numPrototypes,
+               getPercentile(samples, 50), getPercentile(samples, 95), comparedPerSquare, 100 * agreement, 100 * accuracy);
+        summary["pruning"][name] = {
+            {"prototypes_per_label", level},
+            {"searched_labels", searchedLabels},
+            {"build_ms", buildMs},
+            {"prototypes", numPrototypes},
+            {"p50_us", getPercentile(samples, 50)},
+            {"p95_us", getPercentile(samples, 95)},
+            {"comparisons_per_square", comparedPerSquare},
+            {"squares", numSquares},
+            {"agreement", agreement},
+            {"accuracy", accuracy}};
+    }
+    printf("\nCompared on the %zu occupied squares of %zu boards against %d light and %d dark histograms, "
+           "searching the %d closest labels, %d iterations\n", histograms.size(), boards.size(), lightIndex.size(),
+           darkIndex.size(), searchedLabels, options.iterations);
+
+    if (!options.outputPath.empty()) {
+        std::ofstream output(options.outputPath);
+        output << summary.dump(2) << "\n";
+        if (!output) {
+            printf("Unable to write the summary to %s\n", options.outputPath.c_str());
+            return -1;
+        }
+        printf("Wrote the summary to %s\n", options.outputPath.c_str());
+    }
+
+    return 0;
+}
+
+/**
+ * Benchmarks the pipeline over the images, then reports the latency of each stage and the accuracy against the ground truth.
+ */
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    if (parseBenchOptions(argc, argv, options) != 0) {
+        printf("Usage: bench [dir or list file] [--truth ground_truth.csv] [--iterations N] [--warmup N] [--threads N] [--rectified] "
+               "[--out bench.json] [--min-accuracy FRACTION] [--compare-models a.onnx,b.onnx] [--compare-pruning 0,2,4,8] %s\n",
+               getCommonOptionsUsage().c_str());
+        return -1;
+    }
+
+    std::vector<std::string> imagePaths;
+    std::map<std::string, std::string> truth;
+    if (collectImagePaths(options.inputPath, imagePaths) != 0 || readGroundTruth(options.truthPath, truth) != 0) {
+        return -1;
+    }
+    if (imagePaths.empty()) {
+        printf("No images to benchmark in %s\n", options.inputPath.c_str());
+        return -1;
+    }
+
+    if (!options.compareModels.empty()) {
+        return compareModels(options, imagePaths, truth);
+    }
+    if (!options.comparePruning.empty()) {
+        return comparePruning(options, imagePaths, truth);
+    }
+
+    BatchOptions batchOptions;
+    batchOptions.rectified = options.rectified;
+
+    int numThreads = std::max(1, std::min(options.numThreads, static_cast<int>(imagePaths.size())));
+    if (numThreads > 1) {
+        cv::setNumThreads(1);
+    }
+
+    // the first passes load the features and warm the caches, so they aren't timed
+    for (int iteration = 0; iteration < options.warmup; iteration++) {
+        for (const std::string &imgPath : imagePaths) {
+            processBatchImage(imgPath, batchOptions);
+        }
+    }
+
+    std::map<std::string, std::vector<double>> stageSamples;
+    std::map<std::string, AccuracyStats> imageAccuracy;
+    std::atomic<int> numFailed(0);
+    std::mutex resultsMutex;
+    size_t numRuns = imagePaths.size() * options.iterations;
+    std::atomic<size_t> nextRun(0);
+    int64 start = cv::getTickCount();
+
+    // each worker takes the next unprocessed image of the next iteration until every run is done
+    auto worker = [&]() {
+        for (size_t i = nextRun++; i < numRuns; i = nextRun++) {
+            const std::string &imgPath = imagePaths[i % imagePaths.size()];
+            nlohmann::json result = processBatchImage(imgPath, batchOptions);
+            if (result.contains("error")) {
+                numFailed++;
+            }
+
+            std::string name = std::filesystem::path(imgPath).filename().string();
+            std::string fen = result.contains("fen") ? result["fen"].get<std::string>() : "";
+
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            for (const auto &timing : result["timings_ms"].items()) {
+                stageSamples[timing.key()].push_back(timing.value().get<double>());
+            }
+            auto found = truth.find(name);
+            if (found != truth.end()) {
+                addBoardAccuracy(fen, found->second, imageAccuracy[name]);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; i++) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+
+    double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+    double imagesPerSecond = numRuns / std::max(seconds, 1e-9);
+    double peakRssMb = getPeakRssBytes() / (1024.0 * 1024.0);
+    nlohmann::json summary;
+
+    printf("Benchmarked %zu images x %d iterations (%d failed) with %d threads in %.2f s, %.2f images/s\n",
+           imagePaths.size(), options.iterations, numFailed.load(), numThreads, seconds, imagesPerSecond);
+    printf("Peak RSS: %.1f MB\n\n", peakRssMb);
+    summary["images"] = imagePaths.size();
+    summary["iterations"] = options.iterations;
+    summary["threads"] = numThreads;
+    summary["failed"] = numFailed.load();
+    summary["seconds"] = seconds;
+    summary["images_per_sec"] = imagesPerSecond;
+    summary["peak_rss_mb"] = peakRssMb;
+
+    printf("%-24s %8s %10s %10s %10s\n", "stage", "runs", "p50 ms", "p95 ms", "p99 ms");
+    for (auto &stage : stageSamples) {
+        std::vector<double> &samples = stage.second;
+        std::sort(samples.begin(), samples.end());
+        double p50 = getPercentile(samples, 50), p95 = getPercentile(samples, 95), p99 = getPercentile(samples, 99);
+
+        printf("%-24s %8zu %10.2f %10.2f %10.2f\n", stage.first.c_str(), samples.size(), p50, p95, p99);
+        summary["stages"][stage.first] = {{"runs", samples.size()}, {"p50_ms", p50}, {"p95_ms", p95}, {"p99_ms", p99}};
+    }
+
+    // the images are compared once per iteration, so a flaky stage shows up as a fraction of a board
+    AccuracyStats total;
+    printf("\n");
+    for (const auto &image : imageAccuracy) {
+        const AccuracyStats &stats = image.second;
+        total.boards += stats.boards;
+        total.exactBoards += stats.exactBoards;
+        total.squares += stats.squares;
+        total.correctSquares += stats.correctSquares;
+        total.correctOccupancy += stats.correctOccupancy;
+
+        printf("%-24s %5.1f%% of squares, %5.1f%% occupancy\n", image.first.c_str(),
+               100 * getFraction(stats.correctSquares, stats.squares), 100 * getFraction(stats.correctOccupancy, stats.squares));
+        summary["per_image"][image.first] = {
+            {"square_accuracy", getFraction(stats.correctSquares, stats.squares)},
+            {"occupancy_accuracy", getFraction(stats.correctOccupancy, stats.squares)}};
+    }
+
+    double squareAccuracy = getFraction(total.correctSquares, total.squares);
+    printf("\nSquare accuracy: %d/%d (%.1f%%), occupancy: %.1f%%, exact boards: %d/%d (%zu images without ground truth)\n",
+           total.correctSquares, total.squares, 100 * squareAccuracy, 100 * getFraction(total.correctOccupancy, total.squares),
+           total.exactBoards, total.boards, imagePaths.size() - imageAccuracy.size());
+    summary["accuracy"] = {
+        {"squares", total.squares},
+        {"correct_squares", total.correctSquares},
+        {"square_accuracy", squareAccuracy},
+        {"occupancy_accuracy", getFraction(total.correctOccupancy, total.squares)},
+        {"boards", total.boards},
+        {"exact_boards", total.exactBoards}};
+
+    if (!options.outputPath.empty()) {
+        std::ofstream output(options.outputPath);
+        output << summary.dump(2) << "\n";
+        if (!output) {
+            printf("Unable to write the summary to %s\n", options.outputPath.c_str());
+            return -1;
+        }
+        printf("Wrote the summary to %s\n", options.outputPath.c_str());
+    }
+
+    if (options.minAccuracy > 0 && squareAccuracy < options.minAccuracy) {
+        printf("Square accuracy %.1f%% is below the minimum of %.1f%%\n", 100 * squareAccuracy, 100 * options.minAccuracy);
+        return 1;
+    }
+
+    return 0;
+}
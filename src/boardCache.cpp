@@ -0,0 +1,248 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the board result cache, which reuses the labels of a board that has already been classified when a
+  photo of it looks the same square for square.
+*/
+
+#include <bitset>
+
+#include <opencv2/imgproc.hpp>
+
+#include "boardCache.hpp"
+#include "pieceDetectionOps.hpp"
+#include "instrumentation.hpp"
+
+BoardCacheOptions boardCacheOptions;
+
+// fraction of each side of a square left out of its hash
+const float TILE_HASH_MARGIN = 0.15f;
+
+/**
+ * Gets the difference hash of a tile: it is shrunk to 9x8 gray cells and each bit says if a cell is brighter than the
+ *   one to its left. Differences smaller than TILE_HASH_MIN_GRADIENT don't set a bit, so a flat empty square hashes
+ *   to (nearly) 0 instead of to its noise.
+ * @param tile      cv::Mat of the tile, gray or BGR
+ *
+ * @returns the 64 bit hash of the tile
+*/
+uint64_t getTileHash(const cv::Mat &tile) {
+    // shrinking first means only the 72 cells are converted to gray
+    cv::Mat cells, gray;
+    cv::resize(tile, cells, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+    if (cells.channels() == 3) {
+        cv::cvtColor(cells, gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        gray = cells;
+    }
+
+    uint64_t hash = 0;
+    for (int row = 0; row < 8; row++) {
+        const uchar *cell = gray.ptr<uchar>(row);
+        for (int col = 0; col < 8; col++) {
+            hash <<= 1;
+            if (cell[col + 1] - cell[col] >= TILE_HASH_MIN_GRADIENT) {
+                hash |= 1;
+            }
+        }
+    }
+    return hash;
+}
+
+/**
+ * @returns the number of bits that differ between two hashes
+*/
+int getHashDistance(uint64_t first, uint64_t second) {
+    return static_cast<int>(std::bitset<64>(first ^ second).count());
+}
+
+/**
+ * Hashes every square of the board. The edges of each square are left out, so the lines of the board and small
+ *   shifts of the grid between photos don't change the hash.
+ * @param src           cv::Mat of the image the squares are in
+ * @param squares       vector of the 64 cv::Rect's for the squares
+ * @param fingerprint   the resulting BoardFingerprint
+ *
+ * @returns 0 if every square was hashed, non-zero if there weren't 64 squares inside the image
+*/
+int getBoardFingerprint(const cv::Mat &src, const std::vector<cv::Rect> &squares, BoardFingerprint &fingerprint) {
+    ScopedTimer timer("getBoardFingerprint");
+    if (squares.size() != 64) {
+        return 1;
+    }
+
+    cv::Rect bounds(0, 0, src.cols, src.rows);
+    for (int i = 0; i < 64; i++) {
+        int marginX = static_cast<int>(squares[i].width * TILE_HASH_MARGIN);
+        int marginY = static_cast<int>(squares[i].height * TILE_HASH_MARGIN);
+        cv::Rect inner(squares[i].x + marginX, squares[i].y + marginY,
+                       squares[i].width - 2 * marginX, squares[i].height - 2 * marginY);
+        inner &= bounds;
+        if (inner.width < 9 || inner.height < 8) {
+            return 1;
+        }
+        fingerprint[i] = getTileHash(src(inner));
+    }
+    return 0;
+}
+
+/**
+ * @returns the memory an entry takes in the cache, counting its list node
+*/
+size_t getEntryBytes(const BoardCacheEntry &entry) {
+    return sizeof(BoardCacheEntry) + 2 * sizeof(void *)
+           + entry.occupancyScores.capacity() * sizeof(double)
+           + entry.confidences.capacity() * sizeof(float);
+}
+
+/**
+ * Creates an empty cache.
+ * @param options   BoardCacheOptions for the memory cap and matching tolerance
+*/
+BoardCache::BoardCache(const BoardCacheOptions &options) : options(options), numBytes(0) {}
+
+/**
+ * Looks for a board matching the fingerprint, marking it as the most recently used.
+ * @param fingerprint   BoardFingerprint of the board being classified
+ * @param mode          int for how the labels are found
+ * @param entry         the resulting BoardCacheEntry
+ *
+ * @returns true if a matching board was cached
+*/
+bool BoardCache::find(const BoardFingerprint &fingerprint, int mode, BoardCacheEntry &entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // most recently used first, since a camera sees the board it just saw; almost every other board fails on its first squares
+    for (auto cached = entries.begin(); cached != entries.end(); ++cached) {
+        if (cached->mode != mode) {
+            continue;
+        }
+
+        int i = 0;
+        while (i < 64 && getHashDistance(cached->fingerprint[i], fingerprint[i]) <= options.maxSquareDistance) {
+            i++;
+        }
+        if (i == 64) {
+            entries.splice(entries.begin(), entries, cached);
+            entry = *cached;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Adds a classified board, dropping the least recently used ones until the cache fits its memory cap again.
+ * @param entry     BoardCacheEntry to add
+*/
+void BoardCache::add(const BoardCacheEntry &entry) {
+    size_t entryBytes = getEntryBytes(entry);
+    if (entryBytes > options.maxBytes) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.push_front(entry);
+    numBytes += entryBytes;
+
+    while (numBytes > options.maxBytes) {
+        numBytes -= getEntryBytes(entries.back());
+        entries.pop_back();
+        addCounter("boardCacheEvictions");
+    }
+}
+
+/**
+ * Removes every board from the cache.
+*/
+void BoardCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    numBytes = 0;
+}
+
+/**
+ * @returns the number of boards in the cache
+*/
+size_t BoardCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+/**
+ * @returns the memory taken by the boards in the cache
+*/
+size_t BoardCache::getNumBytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return numBytes;
+}
+
+/**
+ * Sets the options of the board result cache. Must be called before the first board is classified.
+ * @param options   BoardCacheOptions for the cache
+*/
+void setBoardCacheOptions(const BoardCacheOptions &options) {
+    boardCacheOptions = options;
+}
+
+/**
+ * @returns the options of the board result cache
+*/
+const BoardCacheOptions &getBoardCacheOptions() {
+    return boardCacheOptions;
+}
+
+/**
+ * @returns the board result cache shared by every pipeline, created with the options set on first use
+*/
+BoardCache &getBoardCache() {
+    static BoardCache cache(boardCacheOptions);
+    return cache;
+}
+
+/**
+ * Looks for the board in the shared cache. A low contrast piece can hash close to an empty square, so a matching
+ *   board is only accepted if the occupancy scores of the squares agree with it on which squares are empty.
+ * @param src           cv::Mat of the image the squares are in
+ * @param squares       vector of the 64 cv::Rect's for the squares
+ * @param imageScale    float for the size of the squares relative to the full resolution photos, passed to isEmptyOccupancyScore
+ * @param entry         BoardCacheEntry with the mode the labels are found in, which gets the fingerprint of the board and,
+ *                      if it was found, the cached labels with the occupancy scores of this image at full resolution
+ *
+ * @returns 0 if the board was found, 1 if it wasn't (so the classified board can be added with the fingerprint) and
+ *          -1 if the cache is off or the squares couldn't be hashed
+*/
+int findCachedBoard(const cv::Mat &src, const std::vector<cv::Rect> &squares, float imageScale, BoardCacheEntry &entry) {
+    if (boardCacheOptions.maxBytes == 0 || getBoardFingerprint(src, squares, entry.fingerprint) != 0) {
+        return -1;
+    }
+
+    BoardCacheEntry found;
+    if (!getBoardCache().find(entry.fingerprint, entry.mode, found)) {
+        addCounter("boardCacheMisses");
+        return 1;
+    }
+
+    // the scores are only computed for a match, so a miss costs no more than the hashes
+    std::vector<double> scores;
+    computeOccupancyScores(src, squares, scores);
+    for (int i = 0; i < 64; i++) {
+        bool isEmpty = isEmptyOccupancyScore(scores[i], isDarkSquareIndex(i), imageScale);
+        if (isEmpty != (found.board[i] == PIECE_EMPTY)) {
+            addCounter("boardCacheRejects");
+            addCounter("boardCacheMisses");
+            return 1;
+        }
+    }
+
+    addCounter("boardCacheHits");
+    entry.board = found.board;
+    entry.confidences = found.confidences;
+    entry.occupancyScores = scores;
+    for (double &score : entry.occupancyScores) {
+        score /= imageScale;
+    }
+    return 0;
+}
@@ -0,0 +1,257 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the board image loader, which decodes a photo only at the resolutions the pipeline actually uses.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "boardImage.hpp"
+#include "instrumentation.hpp"
+
+
+/**
+ * Reads the width and height of a JPEG or PNG from its header, without decoding it.
+ *   The size is before any EXIF rotation, so callers should only rely on the shorter and longer sides.
+ * @param encoded   vector of the bytes of the encoded image
+ * @param size      the resulting cv::Size
+ *
+ * @returns 0 if the function returns successfully, non-zero if the format isn't recognized
+*/
+int readEncodedImageSize(const std::vector<uchar> &encoded, cv::Size &size) {
+    const size_t length = encoded.size();
+    auto readBigEndian16 = [&](size_t pos) { return (encoded[pos] << 8) | encoded[pos + 1]; };
+
+    // PNG: the IHDR chunk always comes first, with the width and height as big endian 32 bit ints
+    const uchar pngSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (length >= 24 && std::equal(pngSignature, pngSignature + 8, encoded.begin())) {
+        size.width = (readBigEndian16(16) << 16) | readBigEndian16(18);
+        size.height = (readBigEndian16(20) << 16) | readBigEndian16(22);
+        return size.width > 0 && size.height > 0 ? 0 : 1;
+    }
+
+    // JPEG: walk the markers until the start of frame, which has the height then the width
+    if (length < 4 || encoded[0] != 0xFF || encoded[1] != 0xD8) {
+        return 1;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= length) {
+        if (encoded[pos] != 0xFF) {
+            return 1;
+        }
+        uchar marker = encoded[pos + 1];
+        // padding before a marker
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        // markers without a length
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            pos += 2;
+            continue;
+        }
+
+        size_t segmentLength = readBigEndian16(pos + 2);
+        bool isStartOfFrame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (isStartOfFrame) {
+            if (pos + 9 > length) {
+                return 1;
+            }
+            size.height = readBigEndian16(pos + 5);
+            size.width = readBigEndian16(pos + 7);
+            return size.width > 0 && size.height > 0 ? 0 : 1;
+        }
+        // the image data starts without a frame, which isn't a JPEG we can read
+        if (marker == 0xDA || marker == 0xD9) {
+            return 1;
+        }
+        pos += 2 + segmentLength;
+    }
+
+    return 1;
+}
+
+/**
+ * Gets the largest factor (1, 2, 4 or 8) the image can be reduced by while decoding and still cover the minimum size.
+ * @param fullSize      cv::Size of the full resolution image
+ * @param minimumSize   cv::Size the reduced image has to cover, in either orientation
+ *
+ * @returns the reduction factor
+*/
+int getReducedDecodeFactor(const cv::Size &fullSize, const cv::Size &minimumSize) {
+    int shortSide = std::min(fullSize.width, fullSize.height);
+    int longSide = std::max(fullSize.width, fullSize.height);
+    int minShortSide = std::min(minimumSize.width, minimumSize.height);
+    int minLongSide = std::max(minimumSize.width, minimumSize.height);
+
+    for (int factor = 8; factor > 1; factor /= 2) {
+        // the reduced decode rounds up
+        if ((shortSide + factor - 1) / factor >= minShortSide && (longSide + factor - 1) / factor >= minLongSide) {
+            return factor;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Gets the index into the decoded images and the imread flag for a reduction factor.
+ * @param factor    int for the reduction factor, 1, 2, 4 or 8
+ * @param flag      the resulting imread flag
+ *
+ * @returns the index of the factor
+*/
+int getDecodeFactorIndex(int factor, int &flag) {
+    switch (factor) {
+        case 2:
+            flag = cv::IMREAD_REDUCED_COLOR_2;
+            return 1;
+        case 4:
+            flag = cv::IMREAD_REDUCED_COLOR_4;
+            return 2;
+        case 8:
+            flag = cv::IMREAD_REDUCED_COLOR_8;
+            return 3;
+        default:
+            flag = cv::IMREAD_COLOR;
+            return 0;
+    }
+}
+
+
+BoardImage::BoardImage() : classificationFactor(1) {}
+
+/**
+ * Wraps an image that is already decoded, which is then used at every resolution.
+ * @param image     cv::Mat storing the image (the pixels are shared, not copied)
+*/
+BoardImage::BoardImage(const cv::Mat &image) : fullSize(image.size()), classificationFactor(1) {
+    decoded[0] = image;
+}
+
+/**
+ * Reads the encoded image and its size from the header. Nothing is decoded yet for JPEGs and PNGs.
+ * @param imgPath   string for the path of the image
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int BoardImage::load(const std::string &imgPath) {
+    ScopedTimer timer("readImageFile");
+    *this = BoardImage();
+
+    std::ifstream file(imgPath, std::ios::binary);
+    if (!file) {
+        printf("Unable to open image %s\n", imgPath.c_str());
+        return 1;
+    }
+    std::vector<uchar> fileBytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return loadEncoded(std::move(fileBytes), imgPath);
+}
+
+/**
+ * Takes the bytes of an encoded image, such as an upload, and reads its size from the header.
+ * @param encodedImage  vector of the bytes of the encoded image, moved into the BoardImage
+ * @param name          string naming the image in messages
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int BoardImage::loadEncoded(std::vector<uchar> encodedImage, const std::string &name) {
+    *this = BoardImage();
+    encoded = std::move(encodedImage);
+    if (encoded.empty()) {
+        printf("Image %s is empty\n", name.c_str());
+        return 1;
+    }
+
+    // anything we can't size from the header is decoded once at full resolution and used for everything
+    if (readEncodedImageSize(encoded, fullSize) != 0) {
+        decoded[0] = cv::imdecode(encoded, cv::IMREAD_COLOR);
+        encoded.clear();
+        if (decoded[0].empty()) {
+            printf("Unable to decode image %s\n", name.c_str());
+            return 1;
+        }
+        fullSize = decoded[0].size();
+        return 0;
+    }
+
+    classificationFactor = getReducedDecodeFactor(fullSize, CLASSIFICATION_MIN_SIZE);
+    return 0;
+}
+
+/**
+ * @returns true if no image has been loaded
+*/
+bool BoardImage::empty() const {
+    return encoded.empty() && decoded[0].empty();
+}
+
+/**
+ * Gets the image decoded at a reduction factor, decoding it the first time.
+ * @param factor    int for the reduction factor, 1, 2, 4 or 8
+ *
+ * @returns the decoded image, empty if it could not be decoded
+*/
+const cv::Mat &BoardImage::getDecoded(int factor) {
+    int flag;
+    int index = getDecodeFactorIndex(factor, flag);
+
+    // an image that was handed to us already decoded is all there is
+    if (encoded.empty()) {
+        return decoded[0];
+    }
+    if (decoded[index].empty()) {
+        ScopedTimer timer("imdecode");
+        decoded[index] = cv::imdecode(encoded, flag);
+        addCounter("decodedPixels", decoded[index].total());
+    }
+    return decoded[index];
+}
+
+/**
+ * Gets the image decoded as small as possible while still covering the working size of the geometry.
+ * @param workingSize   cv::Size that the geometry is found at
+ *
+ * @returns the reduced image, empty if it could not be decoded
+*/
+const cv::Mat &BoardImage::getGeometryImage(const cv::Size &workingSize) {
+    int factor = getReducedDecodeFactor(fullSize, workingSize);
+
+    // a larger copy that is already decoded is resized for the geometry anyway, so it saves decoding another one
+    for (int decodedFactor = factor; decodedFactor >= 1; decodedFactor /= 2) {
+        int flag;
+        if (!decoded[getDecodeFactorIndex(decodedFactor, flag)].empty()) {
+            return getDecoded(decodedFactor);
+        }
+    }
+    return getDecoded(factor);
+}
+
+/**
+ * @returns the mid-resolution copy the pieces are classified from, empty if it could not be decoded
+*/
+const cv::Mat &BoardImage::getClassificationImage() {
+    return getDecoded(classificationFactor);
+}
+
+/**
+ * @returns the size of the classification image relative to the full resolution, such as 0.5
+*/
+float BoardImage::getClassificationScale() const {
+    return 1.0f / classificationFactor;
+}
+
+/**
+ * @returns the image at full resolution, empty if it could not be decoded
+*/
+const cv::Mat &BoardImage::getFullImage() {
+    return getDecoded(1);
+}
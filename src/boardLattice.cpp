@@ -0,0 +1,366 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of fitting the 9x9 lattice of the board to the intersections, and rectifying the board to a top-down image.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "boardLattice.hpp"
+#include "processingOps.hpp"
+#include "instrumentation.hpp"
+
+bool refineLatticeCorners = true;
+
+/**
+ * @returns the 81 lattice points in board coordinates, row by row from the top left
+*/
+std::vector<cv::Point2f> getLatticeCoordinates() {
+    std::vector<cv::Point2f> coordinates;
+    for (int row = 0; row <= 8; row++) {
+        for (int col = 0; col <= 8; col++) {
+            coordinates.push_back(cv::Point2f(col, row));
+        }
+    }
+    return coordinates;
+}
+
+/**
+ * Matches the intersections to the lattice points of the homography, keeping the closest intersection for each point.
+ * @param homography        CV_64F 3x3 cv::Mat from board coordinates to image pixels
+ * @param intersections     vector of cv::Point2f's representing the intersections
+ * @param inlierDistance    float for how close an intersection has to be to its lattice point to match it
+ * @param matches           the resulting index of the intersection matched to each of the 81 lattice points, or -1
+ *
+ * @returns the number of lattice points that were matched
+*/
+int matchLatticePoints(const cv::Mat &homography, const std::vector<cv::Point2f> &intersections, float inlierDistance,
+                       std::vector<int> &matches) {
+    matches.assign(81, -1);
+    std::vector<float> matchDistances(81, inlierDistance);
+
+    // every intersection is taken back to board coordinates to find the lattice point it is closest to
+    std::vector<cv::Point2f> boardCoordinates, latticePoints;
+    cv::perspectiveTransform(intersections, boardCoordinates, homography.inv());
+    cv::perspectiveTransform(getLatticeCoordinates(), latticePoints, homography);
+
+    int numMatched = 0;
+    for (size_t i = 0; i < intersections.size(); i++) {
+        int col = static_cast<int>(std::lround(boardCoordinates[i].x));
+        int row = static_cast<int>(std::lround(boardCoordinates[i].y));
+        if (col < 0 || col > 8 || row < 0 || row > 8) {
+            continue;
+        }
+
+        // the distance is checked in the image, where the threshold is in pixels
+        int index = row * 9 + col;
+        float dist = distMacro(intersections[i], latticePoints[index]);
+        if (dist < matchDistances[index]) {
+            numMatched += matches[index] < 0 ? 1 : 0;
+            matches[index] = static_cast<int>(i);
+            matchDistances[index] = dist;
+        }
+    }
+
+    return numMatched;
+}
+
+/**
+ * Gets the indices of the intersections that are the most extreme in a direction, as candidates for an outer corner.
+ * @param intersections     vector of cv::Point2f's representing the intersections
+ * @param direction         cv::Point2f for the direction, such as (-1, -1) for the top left
+ * @param numCandidates     int for how many candidates to return
+ *
+ * @returns the indices of the candidates, most extreme first
+*/
+std::vector<int> getCornerCandidates(const std::vector<cv::Point2f> &intersections, const cv::Point2f &direction, int numCandidates) {
+    std::vector<int> indices(intersections.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        indices[i] = static_cast<int>(i);
+    }
+
+    numCandidates = std::min(numCandidates, static_cast<int>(indices.size()));
+    std::partial_sort(indices.begin(), indices.begin() + numCandidates, indices.end(), [&](int a, int b) {
+        return intersections[a].dot(direction) > intersections[b].dot(direction);
+    });
+    indices.resize(numCandidates);
+
+    return indices;
+}
+
+/**
+ * Fits the 9x9 lattice of the board to the intersections, so missing or extra intersections don't break the grid.
+ *      The outer corners are guessed from the most extreme intersections, then the homography is refit with RANSAC
+ *      on every intersection that lands near a lattice point until the matches stop improving.
+ * @param intersections     vector of cv::Point2f's representing the intersections between the Hough lines
+ * @param lattice           the resulting BoardLattice
+ * @param inlierDistance    float for how close (in pixels) an intersection has to be to its lattice point to match it
+ *
+ * @returns 0 if the function returns successfully, 1 if no lattice fits enough of the intersections
+*/
+int fitBoardLattice(const std::vector<cv::Point2f> &intersections, BoardLattice &lattice, float inlierDistance) {
+    ScopedTimer timer("fitBoardLattice");
+    lattice = BoardLattice();
+    if (intersections.size() < 4) {
+        logPrintf(LOG_WARNING, "Not enough intersections to fit the board: %zu\n", intersections.size());
+        return 1;
+    }
+
+    // a stray intersection can be more extreme than the real corner, so a few candidates are tried for each corner
+    const int numCandidates = 3;
+    std::vector<int> topLeft = getCornerCandidates(intersections, cv::Point2f(-1, -1), numCandidates);
+    std::vector<int> topRight = getCornerCandidates(intersections, cv::Point2f(1, -1), numCandidates);
+    std::vector<int> bottomRight = getCornerCandidates(intersections, cv::Point2f(1, 1), numCandidates);
+    std::vector<int> bottomLeft = getCornerCandidates(intersections, cv::Point2f(-1, 1), numCandidates);
+    std::vector<cv::Point2f> boardCorners = {cv::Point2f(0, 0), cv::Point2f(8, 0), cv::Point2f(8, 8), cv::Point2f(0, 8)};
+
+    cv::Mat bestHomography;
+    std::vector<int> bestMatches;
+    int bestNumMatched = 0;
+
+    for (int tl : topLeft) {
+        for (int tr : topRight) {
+            for (int br : bottomRight) {
+                for (int bl : bottomLeft) {
+                    std::vector<cv::Point2f> imageCorners = {intersections[tl], intersections[tr], intersections[br], intersections[bl]};
+                    // corners that aren't a convex quadrilateral can't be the board
+                    if (!cv::isContourConvex(imageCorners) || std::abs(cv::contourArea(imageCorners)) < 1.0) {
+                        continue;
+                    }
+
+                    cv::Mat homography = cv::getPerspectiveTransform(boardCorners, imageCorners);
+                    std::vector<int> matches;
+                    int numMatched = matchLatticePoints(homography, intersections, inlierDistance, matches);
+                    if (numMatched > bestNumMatched) {
+                        bestHomography = homography;
+                        bestMatches = matches;
+                        bestNumMatched = numMatched;
+                    }
+                }
+            }
+        }
+    }
+
+    // refit to every matched intersection, which pulls the lattice onto the whole board instead of only its corners
+    for (int iteration = 0; iteration < 5 && bestNumMatched >= 4; iteration++) {
+        std::vector<cv::Point2f> latticeCoordinates = getLatticeCoordinates();
+        std::vector<cv::Point2f> boardPoints, imagePoints;
+        for (int index = 0; index < 81; index++) {
+            if (bestMatches[index] >= 0) {
+                boardPoints.push_back(latticeCoordinates[index]);
+                imagePoints.push_back(intersections[bestMatches[index]]);
+            }
+        }
+
+        cv::Mat homography = cv::findHomography(boardPoints, imagePoints, cv::RANSAC, inlierDistance);
+        if (homography.empty()) {
+            break;
+        }
+
+        std::vector<int> matches;
+        int numMatched = matchLatticePoints(homography, intersections, inlierDistance, matches);
+        if (numMatched < bestNumMatched) {
+            break;
+        }
+
+        bool improved = numMatched > bestNumMatched;
+        bestHomography = homography;
+        bestMatches = matches;
+        bestNumMatched = numMatched;
+        if (!improved) {
+            break;
+        }
+    }
+
+    if (bestNumMatched < MIN_LATTICE_INLIERS) {
+        logPrintf(LOG_WARNING, "Could not fit the board's lattice, only %d of 81 points matched\n", bestNumMatched);
+        return 1;
+    }
+
+    lattice.homography = bestHomography;
+    lattice.numInliers = bestNumMatched;
+    cv::perspectiveTransform(getLatticeCoordinates(), lattice.points, bestHomography);
+    addCounter("latticeInliers", bestNumMatched);
+    logPrintf(LOG_DEBUG, "Fit the board's lattice to %d of 81 points\n", bestNumMatched);
+
+    return 0;
+}
+
+/**
+ * Finds the corners of the lattice again at the resolution of a bigger image of the board, since the lattice fit on the
+ *      resized image is only as exact as its pixels. cornerSubPix is run in a small window of the image around each
+ *      point, so it costs 81 small windows instead of finding the lines again at the higher resolution. The homography
+ *      is refit with RANSAC on the corners that were found, and any corner it doesn't agree with (like one covered by a
+ *      piece) is put back on the refit lattice.
+ * @param src           cv::Mat for the image of the board, gray or BGR
+ * @param lattice       BoardLattice in the coordinates of src, refined in place
+ * @param searchRadius  float for how far (in pixels of src) each corner can be from its lattice point
+ *
+ * @returns 0 if the function returns successfully, 1 if too few corners were found and the lattice was left as it was
+*/
+int refineBoardLattice(const cv::Mat &src, BoardLattice &lattice, float searchRadius) {
+    ScopedTimer timer("refineBoardLattice");
+    if (src.empty() || lattice.homography.empty() || lattice.points.size() != 81) {
+        return 1;
+    }
+
+    // the window can't reach the neighbouring corners, however small the squares are
+    const std::vector<cv::Point2f> &points = lattice.points;
+    float squareSide = std::min({distMacro(points[0], points[8]), distMacro(points[72], points[80]),
+                                 distMacro(points[0], points[72]), distMacro(points[8], points[80])}) / 8.0f;
+    int halfWindow = std::min(static_cast<int>(std::lround(searchRadius)), static_cast<int>(squareSide * 0.3f));
+    if (halfWindow < 2) {
+        return 1;
+    }
+
+    // each corner can move up to halfWindow, and still have its whole window inside the patch around it
+    int reach = 2 * halfWindow + 1;
+    cv::Rect bounds(0, 0, src.cols, src.rows);
+    std::vector<cv::Point2f> latticeCoordinates = getLatticeCoordinates();
+    std::vector<cv::Point2f> boardPoints, imagePoints;
+    std::vector<int> indices;
+    cv::TermCriteria criteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 20, 0.05);
+
+    for (int i = 0; i < 81; i++) {
+        cv::Rect patch(static_cast<int>(std::lround(points[i].x)) - reach, static_cast<int>(std::lround(points[i].y)) - reach,
+                       2 * reach + 1, 2 * reach + 1);
+        if ((patch & bounds) != patch) {
+            continue;
+        }
+
+        // only the patch is converted to gray, not the whole image
+        cv::Mat gray;
+        if (src.channels() == 3) {
+            cv::cvtColor(src(patch), gray, cv::COLOR_BGR2GRAY);
+        }
+        else {
+            gray = src(patch);
+        }
+        cv::Scalar mean, deviation;
+        cv::meanStdDev(gray, mean, deviation);
+        if (deviation[0] < CORNER_MIN_CONTRAST) {
+            continue;
+        }
+
+        std::vector<cv::Point2f> corner = {points[i] - cv::Point2f(patch.tl())};
+        cv::cornerSubPix(gray, corner, cv::Size(halfWindow, halfWindow), cv::Size(-1, -1), criteria);
+        cv::Point2f refined = corner[0] + cv::Point2f(patch.tl());
+
+        // moving further than the window means it ran off to some other edge, like a piece's
+        if (distMacro(refined, points[i]) > halfWindow) {
+            continue;
+        }
+        boardPoints.push_back(latticeCoordinates[i]);
+        imagePoints.push_back(refined);
+        indices.push_back(i);
+    }
+
+    addCounter("refinedCorners", imagePoints.size());
+    if (static_cast<int>(imagePoints.size()) < MIN_LATTICE_INLIERS) {
+        logPrintf(LOG_DEBUG, "Only refined %zu of the lattice's 81 corners, keeping the coarse lattice\n", imagePoints.size());
+        return 1;
+    }
+
+    std::vector<uchar> inliers;
+    cv::Mat homography = cv::findHomography(boardPoints, imagePoints, cv::RANSAC, std::max(1.0, halfWindow * 0.5), inliers);
+    if (homography.empty()) {
+        return 1;
+    }
+
+    // the refined corners are kept where the homography agrees, since they also follow any bending of the lens it can't
+    lattice.homography = homography;
+    cv::perspectiveTransform(latticeCoordinates, lattice.points, homography);
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (inliers[i]) {
+            lattice.points[indices[i]] = imagePoints[i];
+        }
+    }
+    logPrintf(LOG_DEBUG, "Refined %zu of the lattice's 81 corners\n", imagePoints.size());
+
+    return 0;
+}
+
+/**
+ * Sets if the lattice's corners are refined at the resolution the pieces are classified at, on by default.
+ * @param refine    bool for if the corners should be refined
+*/
+void setRefineLatticeCorners(bool refine) {
+    refineLatticeCorners = refine;
+}
+
+/**
+ * @returns true if the lattice's corners are refined at the resolution the pieces are classified at
+*/
+bool getRefineLatticeCorners() {
+    return refineLatticeCorners;
+}
+
+/**
+ * Scales a homography into image pixels to the same image at another size.
+ * @param homography    CV_64F 3x3 cv::Mat for the homography into the first image
+ * @param fromSize      cv::Size of the image the homography maps into
+ * @param toSize        cv::Size of the image it should map into instead
+ *
+ * @returns the scaled homography
+*/
+cv::Mat scaleHomography(const cv::Mat &homography, const cv::Size &fromSize, const cv::Size &toSize) {
+    cv::Mat scaled = homography.clone();
+    double scaleX = static_cast<double>(toSize.width) / fromSize.width;
+    double scaleY = static_cast<double>(toSize.height) / fromSize.height;
+
+    // the same as multiplying by diag(scaleX, scaleY, 1) on the left
+    for (int col = 0; col < 3; col++) {
+        scaled.at<double>(0, col) *= scaleX;
+        scaled.at<double>(1, col) *= scaleY;
+    }
+
+    return scaled;
+}
+
+/**
+ * Warps the board to a top-down image where every square is the same size, in one pass over the image.
+ * @param src           cv::Mat for the image of the board
+ * @param homography    CV_64F 3x3 cv::Mat from board coordinates to the pixels of src
+ * @param board         cv::Mat for the resulting top-down image of the board
+ * @param squareSize    int for the side of each square in the top-down image
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int rectifyBoard(const cv::Mat &src, const cv::Mat &homography, cv::Mat &board, int squareSize) {
+    if (src.empty() || homography.empty() || squareSize <= 0) {
+        return 1;
+    }
+
+    // from pixels of the top-down image to src: scale down to board coordinates, then apply the homography
+    cv::Mat boardToSrc = homography.clone();
+    for (int row = 0; row < 3; row++) {
+        boardToSrc.at<double>(row, 0) /= squareSize;
+        boardToSrc.at<double>(row, 1) /= squareSize;
+    }
+
+    cv::warpPerspective(src, board, boardToSrc, cv::Size(8 * squareSize, 8 * squareSize), cv::INTER_LINEAR | cv::WARP_INVERSE_MAP);
+
+    return 0;
+}
+
+/**
+ * Gets the rectangles of the squares in the top-down image of the board from rectifyBoard.
+ * @param squareSize    int for the side of each square in the top-down image
+ *
+ * @returns a vector of the 64 cv::Rect's, row by row from the top left
+*/
+std::vector<cv::Rect> getRectifiedSquares(int squareSize) {
+    std::vector<cv::Rect> squares;
+    for (int row = 0; row < 8; row++) {
+        for (int col = 0; col < 8; col++) {
+            squares.push_back(cv::Rect(col * squareSize, row * squareSize, squareSize, squareSize));
+        }
+    }
+    return squares;
+}
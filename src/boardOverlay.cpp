@@ -0,0 +1,91 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the overlay renderer, which draws the results of the pipeline onto one output image only when it
+  is displayed, so the stages that compute them never draw on (or copy) the frames they read.
+*/
+
+#include "boardOverlay.hpp"
+#include "processingOps.hpp"
+#include "pieceDetectionOps.hpp"
+#include "instrumentation.hpp"
+
+/**
+ * @returns true if there is nothing to draw
+*/
+bool BoardOverlay::empty() const {
+    return lines.empty() && points.empty() && !(showSquares && !squares.empty()) && !(showLabels && !squares.empty())
+           && !analysis.success;
+}
+
+/**
+ * Gets the overlay for one of the displays of the image workflow from the pipeline's cached stages. 'x' and 'a'
+ *   request the analysis, which is only in the overlay once it has arrived.
+ * @param pipeline  BoardPipeline for the image
+ * @param display   char for the display, such as 's' for the squares or 'a' for every step
+ *
+ * @returns the BoardOverlay for the display, in the coordinates of the resized image for 'h' and of the source otherwise
+*/
+BoardOverlay getBoardOverlay(BoardPipeline &pipeline, char display) {
+    BoardOverlay overlay;
+
+    // show results of hough transform
+    if (display == 'h') {
+        overlay.lines = pipeline.getLines();
+        return overlay;
+    }
+
+    // shows intersections between hough lines
+    if (display == 'i' || display == 'a') {
+        overlay.points = pipeline.getOriginalPoints();
+    }
+    // show squares formed by intersections
+    if (display == 's' || display == 'a') {
+        overlay.squares = pipeline.getRectangles();
+        overlay.showSquares = true;
+    }
+    // show piece labelings
+    if (display == 'p' || display == 'a') {
+        overlay.squares = pipeline.getRectangles();
+        overlay.labels = pipeline.getSquareLabels();
+        overlay.showLabels = true;
+    }
+    // get the analysis, which is only drawn once it has arrived
+    if (display == 'x' || display == 'a') {
+        overlay.squares = pipeline.getRectangles();
+        pipeline.requestAnalysis();
+        if (pipeline.isAnalysisReady()) {
+            overlay.analysis = pipeline.getAnalysis();
+        }
+    }
+
+    return overlay;
+}
+
+/**
+ * Draws an overlay over an image. The image is copied into dst once and everything is drawn onto that copy.
+ * @param base      cv::Mat for the image to draw over, which is only read
+ * @param overlay   BoardOverlay to draw
+ * @param dst       cv::Mat for the resulting image
+*/
+void renderBoardOverlay(const cv::Mat &base, const BoardOverlay &overlay, cv::Mat &dst) {
+    ScopedTimer timer("renderBoardOverlay");
+    base.copyTo(dst);
+
+    if (!overlay.lines.empty()) {
+        displayLines(dst, overlay.lines);
+    }
+    if (!overlay.points.empty()) {
+        displayPoints(dst, overlay.points);
+    }
+    if (overlay.showSquares) {
+        displayRectangles(dst, overlay.squares);
+    }
+    if (overlay.showLabels) {
+        displayLabels(dst, overlay.squares, overlay.labels);
+    }
+    if (overlay.analysis.success) {
+        drawChessAnalysis(dst, overlay.analysis, overlay.squares);
+    }
+}
@@ -0,0 +1,357 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the per-image pipeline context, which computes each stage of the board workflow once and caches it.
+*/
+
+#include <chrono>
+#include <numeric>
+
+#include <opencv2/core.hpp>
+
+#include "boardPipeline.hpp"
+#include "processingOps.hpp"
+#include "pieceDetectionOps.hpp"
+#include "chessAnalysis.hpp"
+#include "analysisService.hpp"
+#include "boardCache.hpp"
+#include "instrumentation.hpp"
+
+
+/**
+ * Creates the pipeline for the given source image. Nothing is computed until a stage is requested.
+ * @param src           cv::Mat storing the source image (the pixels are shared, not copied)
+ * @param workingSize   cv::Size that the image is resized to for finding the board geometry
+*/
+BoardPipeline::BoardPipeline(const cv::Mat &src, cv::Size workingSize)
+    : BoardPipeline(std::make_shared<BoardImage>(src), workingSize) {}
+
+/**
+ * Creates the pipeline for a loaded photo, which is only decoded at the resolutions the stages ask for.
+ * @param image         BoardImage for the photo of the board
+ * @param workingSize   cv::Size that the image is resized to for finding the board geometry
+*/
+BoardPipeline::BoardPipeline(std::shared_ptr<BoardImage> image, cv::Size workingSize)
+    : image(image), workingSize(workingSize), useRectifiedSquares(false), useClassifier(false), hasLines(false), hasIntersections(false),
+      hasLattice(false), hasOriginalPoints(false), hasRectifiedBoard(false), hasRectangles(false), hasSquareLabels(false), hasFen(false), hasRequestedAnalysis(false), hasAnalysis(false) {}
+
+/**
+ * Sets whose turn it is, so getFen doesn't have to ask the user.
+ * @param turn  string for the side to move, "w" for white or "b" for black
+*/
+void BoardPipeline::setTurn(const std::string &turn) {
+    this->turn = turn;
+}
+
+/**
+ * Sets if the pieces are classified from the squares of the rectified top-down board instead of the source image.
+ * @param useRectified  bool for if the rectified squares should be used
+*/
+void BoardPipeline::setUseRectifiedSquares(bool useRectified) {
+    useRectifiedSquares = useRectified;
+}
+
+/**
+ * Sets if the occupied squares are classified by the neural network piece classifier instead of the histograms.
+ * @param useClassifier     bool for if the piece classifier should be used
+*/
+void BoardPipeline::setUseClassifier(bool useClassifier) {
+    this->useClassifier = useClassifier;
+}
+
+/**
+ * @returns the source image the pieces are classified from, the mid-resolution copy for a loaded photo
+*/
+const cv::Mat &BoardPipeline::getSource() {
+    return image->getClassificationImage();
+}
+
+/**
+ * @returns the source image resized to the working size
+*/
+const cv::Mat &BoardPipeline::getResized() {
+    getLines();
+    // only downloaded from the device when it is asked for, such as to draw on
+    if (resized.empty() && !resizedDevice.empty()) {
+        resizedDevice.copyTo(resized);
+    }
+    return resized;
+}
+
+/**
+ * @returns the Canny edges of the resized image that the hough lines were found from
+*/
+const cv::Mat &BoardPipeline::getEdges() {
+    getLines();
+    if (edges.empty() && !edgesDevice.empty()) {
+        edgesDevice.copyTo(edges);
+    }
+    return edges;
+}
+
+/**
+ * @returns the hough lines found on the resized image
+*/
+const std::vector<cv::Vec4i> &BoardPipeline::getLines() {
+    if (!hasLines) {
+        // calculates lines from hough transform, on the smallest decode that still covers the working size
+        cv::Mat geometry = image->getGeometryImage(workingSize);
+        if (getUseTransparentApi()) {
+            // uploaded once, and the resized image and edges are left on the device
+            cv::UMat geometryDevice;
+            geometry.copyTo(geometryDevice);
+            calcHoughLines(geometryDevice, resizedDevice, workingSize, lines, edgesDevice);
+        }
+        else {
+            calcHoughLines(geometry, resized, workingSize, lines, edges);
+        }
+        hasLines = true;
+    }
+    return lines;
+}
+
+/**
+ * @returns the sorted intersections of the hough lines, in the coordinates of the resized image
+*/
+const std::vector<cv::Point2f> &BoardPipeline::getIntersections() {
+    if (!hasIntersections) {
+        getLines();
+        // Find intersections between lines
+        // nothing is drawn, so the resized image can still be on the device (and empty here)
+        ::getIntersections(resized, lines, workingSize, intersections);
+        hasIntersections = true;
+    }
+    return intersections;
+}
+
+/**
+ * @returns the board's 9x9 lattice fit to the intersections, with no points if it couldn't be fit
+*/
+const BoardLattice &BoardPipeline::getLattice() {
+    if (!hasLattice) {
+        getIntersections();
+        // missing or extra intersections are fixed up by fitting the whole grid at once
+        if (fitBoardLattice(intersections, lattice) == 0) {
+            gridPoints = lattice.points;
+        }
+        else {
+            gridPoints = intersections;
+        }
+        hasLattice = true;
+    }
+    return lattice;
+}
+
+/**
+ * @returns the 81 points of the lattice in the coordinates of the resized image, or the intersections if it couldn't be fit
+*/
+const std::vector<cv::Point2f> &BoardPipeline::getGridPoints() {
+    getLattice();
+    return gridPoints;
+}
+
+/**
+ * @returns the grid points scaled back to the coordinates of the source image
+*/
+const std::vector<cv::Point2f> &BoardPipeline::getOriginalPoints() {
+    if (!hasOriginalPoints) {
+        getGridPoints();
+        // get back our normal size points
+        cv::Mat src = getSource();
+        originalPoints = scalePointsToOriginal(src, gridPoints, src.size(), workingSize);
+
+        if (!lattice.homography.empty()) {
+            BoardLattice sourceLattice = lattice;
+            sourceLattice.homography = scaleHomography(lattice.homography, workingSize, src.size());
+            sourceLattice.points = originalPoints;
+            // scaling up can't make the points more exact than the resized image, so the corners are found again in the source
+            if (getRefineLatticeCorners()) {
+                float scale = static_cast<float>(src.cols) / workingSize.width;
+                refineBoardLattice(src, sourceLattice, CORNER_SEARCH_RADIUS * scale);
+            }
+            originalPoints = sourceLattice.points;
+            homography = sourceLattice.homography;
+        }
+        hasOriginalPoints = true;
+    }
+    return originalPoints;
+}
+
+/**
+ * @returns the homography from board coordinates (0 to 8) to the source image, empty if the lattice couldn't be fit
+*/
+const cv::Mat &BoardPipeline::getHomography() {
+    // found with the source's points, so it is refined along with them
+    getOriginalPoints();
+    return homography;
+}
+
+/**
+ * @returns the top-down image of the board with every square the same size, empty if the lattice couldn't be fit
+*/
+const cv::Mat &BoardPipeline::getRectifiedBoard() {
+    if (!hasRectifiedBoard) {
+        if (!getHomography().empty()) {
+            rectifyBoard(getSource(), homography, rectifiedBoard);
+        }
+        hasRectifiedBoard = true;
+    }
+    return rectifiedBoard;
+}
+
+/**
+ * @returns the rectangles for each square of the board, in the coordinates of the source image
+*/
+const std::vector<cv::Rect> &BoardPipeline::getRectangles() {
+    if (!hasRectangles) {
+        getOriginalPoints();
+        // find rectangles based on the intersections
+        cv::Mat src = getSource();
+        setRectangles(src, originalPoints, rectangles);
+        hasRectangles = true;
+    }
+    return rectangles;
+}
+
+/**
+ * Gets the image and squares the pieces are classified from: the source image and its rectangles, or the
+ *   rectified board and its uniform squares if they were asked for and the lattice was fit.
+ * @param source        the resulting image the squares are in
+ * @param squares       the resulting rectangle of each square in the source
+ * @param imageScale    the resulting size of the squares relative to the full resolution photos the thresholds were tuned on
+ *
+ * @returns true if the squares come from the rectified board
+*/
+bool BoardPipeline::getClassificationSquares(cv::Mat &source, std::vector<cv::Rect> &squares, float &imageScale) {
+    getRectangles();
+    // the empty square threshold was tuned on full resolution photos, so it is told how much smaller the squares are
+    imageScale = image->getClassificationScale();
+    source = getSource();
+    squares = rectangles;
+
+    // the uniform top-down squares are used if asked and the lattice was fit
+    if (useRectifiedSquares && !getRectifiedBoard().empty() && !rectangles.empty()) {
+        int widthSum = std::accumulate(rectangles.begin(), rectangles.end(), 0,
+                                       [](int sum, const cv::Rect &rect) { return sum + rect.width; });
+        float fullSquareWidth = static_cast<float>(widthSum) / rectangles.size() / imageScale;
+        imageScale = RECTIFIED_SQUARE_SIZE / fullSquareWidth;
+        source = rectifiedBoard;
+        squares = getRectifiedSquares();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @returns the piece labels for each square of the board
+*/
+const Board &BoardPipeline::getSquareLabels() {
+    if (!hasSquareLabels) {
+        cv::Mat labelSource;
+        std::vector<cv::Rect> labelRectangles;
+        float imageScale;
+        bool rectified = getClassificationSquares(labelSource, labelRectangles, imageScale);
+
+        // a board that looks the same square for square as one already classified reuses its labels
+        BoardCacheEntry cached;
+        cached.mode = (useClassifier ? 1 : 0) | (rectified ? 2 : 0);
+        int cacheRet = findCachedBoard(labelSource, labelRectangles, imageScale, cached);
+        if (cacheRet == 0) {
+            squareLabels = cached.board;
+            occupancyScores = cached.occupancyScores;
+            squareConfidences = cached.confidences;
+            hasSquareLabels = true;
+            return squareLabels;
+        }
+
+        squareConfidences.clear();
+        if (useClassifier) {
+            getPieceLabelsNN(labelSource, labelRectangles, squareLabels, squareConfidences, occupancyScores, imageScale);
+        }
+        else {
+            getPieceLabels(labelSource, labelRectangles, squareLabels, occupancyScores, imageScale);
+        }
+
+        // brought to full resolution, where the thresholds are set
+        for (double &score : occupancyScores) {
+            score /= imageScale;
+        }
+        hasSquareLabels = true;
+
+        if (cacheRet == 1) {
+            cached.board = squareLabels;
+            cached.occupancyScores = occupancyScores;
+            cached.confidences = squareConfidences;
+            getBoardCache().add(cached);
+        }
+    }
+    return squareLabels;
+}
+
+/**
+ * @returns the occupancy score of each square the labels were found with, scaled to full resolution like the thresholds
+*/
+const std::vector<double> &BoardPipeline::getOccupancyScores() {
+    getSquareLabels();
+    return occupancyScores;
+}
+
+/**
+ * @returns the piece classifier's confidence in each square's label, empty if the histograms were used
+*/
+const std::vector<float> &BoardPipeline::getSquareConfidences() {
+    getSquareLabels();
+    return squareConfidences;
+}
+
+/**
+ * @returns the fen for the labels of the board (asks the user whose turn it is the first time, unless it was set)
+*/
+const std::string &BoardPipeline::getFen() {
+    if (!hasFen) {
+        fen = turn.empty() ? getFenFromLabels(getSquareLabels()) : getFenFromLabels(getSquareLabels(), turn);
+        hasFen = true;
+    }
+    return fen;
+}
+
+/**
+ * Starts the Stockfish analysis of the board's fen in the background, if it hasn't been started already.
+*/
+void BoardPipeline::requestAnalysis() {
+    if (!hasRequestedAnalysis) {
+        if (!getFen().empty()) {
+            pendingAnalysis = getAnalysisService().requestAnalysis(fen);
+        }
+        hasRequestedAnalysis = true;
+    }
+}
+
+/**
+ * @returns true if the analysis has been requested and has arrived (or there was no fen to analyse), so getAnalysis won't wait
+*/
+bool BoardPipeline::isAnalysisReady() {
+    if (hasAnalysis) {
+        return true;
+    }
+    if (!hasRequestedAnalysis) {
+        return false;
+    }
+
+    return !pendingAnalysis.valid() || pendingAnalysis.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+/**
+ * @returns the Stockfish analysis of the board's fen, waiting for it to arrive if it has to
+*/
+const ChessAnalysisResult &BoardPipeline::getAnalysis() {
+    if (!hasAnalysis) {
+        requestAnalysis();
+        if (pendingAnalysis.valid()) {
+            analysis = pendingAnalysis.get();
+        }
+        hasAnalysis = true;
+    }
+    return analysis;
+}
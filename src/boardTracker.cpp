@@ -0,0 +1,183 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of tracking the board geometry from frame to frame in a video.
+*/
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include "boardTracker.hpp"
+#include "boardPipeline.hpp"
+#include "processingOps.hpp"
+
+// indices of the top left, top right, bottom left and bottom right corners in the sorted 9x9 grid
+const int OUTER_CORNER_INDICES[4] = {0, 8, 72, 80};
+
+
+/**
+ * Creates a tracker that hasn't found the board yet.
+ * @param workingSize       cv::Size the frames are resized to for detection and tracking
+ * @param maxCornerMotion   float for how far (in working size pixels) a corner may drift from where it was
+ *                          detected before the board is detected again
+*/
+BoardTracker::BoardTracker(cv::Size workingSize, float maxCornerMotion)
+    : workingSize(workingSize), maxCornerMotion(maxCornerMotion), tracking(false), redetected(false) {}
+
+/**
+ * Updates the board geometry for the next frame, tracking it if possible and detecting it otherwise.
+ * @param frame     cv::Mat of the current video frame
+ *
+ * @returns true if the board geometry is known for this frame
+*/
+bool BoardTracker::update(const cv::Mat &frame) {
+    redetected = false;
+    if (tracking) {
+        tracking = track(frame);
+    }
+
+    if (!tracking) {
+        tracking = detect(frame);
+        redetected = true;
+    }
+
+    return tracking;
+}
+
+/**
+ * Forgets the current board so it is detected again on the next frame.
+*/
+void BoardTracker::reset() {
+    tracking = false;
+}
+
+/**
+ * @returns true if the board geometry is known for the last frame
+*/
+bool BoardTracker::isTracking() const {
+    return tracking;
+}
+
+/**
+ * @returns true if the last update ran the full detection rather than tracking
+*/
+bool BoardTracker::wasRedetected() const {
+    return redetected;
+}
+
+/**
+ * @returns the 81 grid points of the board in the last frame, in the frame's coordinates
+*/
+const std::vector<cv::Point2f> &BoardTracker::getPoints() const {
+    return points;
+}
+
+/**
+ * @returns the 64 rectangles for each square of the board in the last frame
+*/
+const std::vector<cv::Rect> &BoardTracker::getRectangles() const {
+    return rectangles;
+}
+
+/**
+ * Converts the frame to the grayscale working size image used for tracking.
+ * @param frame     cv::Mat of the video frame
+ * @param workingSize   cv::Size of the resulting image
+ * @param gray      the resulting grayscale cv::Mat
+*/
+void toWorkingGray(const cv::Mat &frame, cv::Size workingSize, cv::Mat &gray) {
+    cv::Mat resized;
+    cv::resize(frame, resized, workingSize, 0, 0, cv::INTER_AREA);
+    cv::cvtColor(resized, gray, cv::COLOR_BGR2GRAY);
+}
+
+/**
+ * Runs the full hough pipeline on the frame to find the board's grid.
+ * @param frame     cv::Mat of the current video frame
+ *
+ * @returns true if a full 9x9 grid was found
+*/
+bool BoardTracker::detect(const cv::Mat &frame) {
+    BoardPipeline pipeline(frame, workingSize);
+    const std::vector<cv::Point2f> &gridPoints = pipeline.getGridPoints();
+
+    // tracking relies on the sorted 9x9 grid, so anything else means we try again next frame
+    if (gridPoints.size() != 81) {
+        return false;
+    }
+
+    detectedPoints = gridPoints;
+    detectedCorners.clear();
+    for (int index : OUTER_CORNER_INDICES) {
+        detectedCorners.push_back(detectedPoints[index]);
+    }
+    corners = detectedCorners;
+
+    toWorkingGray(frame, workingSize, prevGray);
+    setGeometry(detectedPoints, frame.size());
+
+    return true;
+}
+
+/**
+ * Follows the board's outer corners into the new frame with optical flow and maps the detected grid onto them.
+ * @param frame     cv::Mat of the current video frame
+ *
+ * @returns true if all four corners were tracked reliably
+*/
+bool BoardTracker::track(const cv::Mat &frame) {
+    cv::Mat gray;
+    toWorkingGray(frame, workingSize, gray);
+
+    // track forwards and then backwards, a corner that doesn't come back to where it started was lost
+    std::vector<cv::Point2f> nextCorners, backCorners;
+    std::vector<uchar> status, backStatus;
+    std::vector<float> err, backErr;
+    cv::calcOpticalFlowPyrLK(prevGray, gray, corners, nextCorners, status, err);
+    cv::calcOpticalFlowPyrLK(gray, prevGray, nextCorners, backCorners, backStatus, backErr);
+
+    for (size_t i = 0; i < corners.size(); i++) {
+        if (!status[i] || !backStatus[i]) {
+            return false;
+        }
+        if (distMacro(corners[i], backCorners[i]) > 1.0) {
+            return false;
+        }
+        // if the board has moved too far from where it was found, the camera moved so find it again
+        if (distMacro(nextCorners[i], detectedCorners[i]) > maxCornerMotion) {
+            return false;
+        }
+    }
+
+    // move the whole detected grid with the corners
+    cv::Mat homography = cv::getPerspectiveTransform(detectedCorners, nextCorners);
+    std::vector<cv::Point2f> trackedPoints;
+    cv::perspectiveTransform(detectedPoints, trackedPoints, homography);
+
+    corners = nextCorners;
+    prevGray = gray;
+    setGeometry(trackedPoints, frame.size());
+
+    return true;
+}
+
+/**
+ * Scales the working size grid points to the frame and builds the square rectangles from them.
+ * @param workingPoints the 81 grid points in working size coordinates
+ * @param frameSize     cv::Size of the video frame
+*/
+void BoardTracker::setGeometry(const std::vector<cv::Point2f> &workingPoints, const cv::Size &frameSize) {
+    float scaleX = static_cast<float>(frameSize.width) / workingSize.width;
+    float scaleY = static_cast<float>(frameSize.height) / workingSize.height;
+
+    points.clear();
+    for (const cv::Point2f &point : workingPoints) {
+        points.push_back(cv::Point2f(point.x * scaleX, point.y * scaleY));
+    }
+
+    cv::Mat unused;
+    rectangles.clear();
+    setRectangles(unused, points, rectangles);
+}
@@ -6,33 +6,37 @@
 */
 
 #include "chessAnalysis.hpp"
+#include "uciEngine.hpp"
+#include "instrumentation.hpp"
+#include <algorithm>
 #include <opencv2/imgproc.hpp>
 
-std::unordered_map<std::string, std::string> pieceToFen = {
-    {"wp", "P"},
-    {"wn", "N"},
-    {"wb", "B"},
-    {"wr", "R"},
-    {"wq", "Q"},
-    {"wk", "K"},
-    {"bp", "p"},
-    {"bn", "n"},
-    {"bb", "b"},
-    {"br", "r"},
-    {"bq", "q"},
-    {"bk", "k"}
-};
-
-std::unordered_map<std::string, int> squareNameToIndex = {
-    {"a8", 0}, {"b8", 1}, {"c8", 2}, {"d8", 3}, {"e8", 4}, {"f8", 5}, {"g8", 6}, {"h8", 7},
-    {"a7", 8}, {"b7", 9}, {"c7", 10}, {"d7", 11}, {"e7", 12}, {"f7", 13}, {"g7", 14}, {"h7", 15},
-    {"a6", 16}, {"b6", 17}, {"c6", 18}, {"d6", 19}, {"e6", 20}, {"f6", 21}, {"g6", 22}, {"h6", 23},
-    {"a5", 24}, {"b5", 25}, {"c5", 26}, {"d5", 27}, {"e5", 28}, {"f5", 29}, {"g5", 30}, {"h5", 31},
-    {"a4", 32}, {"b4", 33}, {"c4", 34}, {"d4", 35}, {"e4", 36}, {"f4", 37}, {"g4", 38}, {"h4", 39},
-    {"a3", 40}, {"b3", 41}, {"c3", 42}, {"d3", 43}, {"e3", 44}, {"f3", 45}, {"g3", 46}, {"h3", 47},
-    {"a2", 48}, {"b2", 49}, {"c2", 50}, {"d2", 51}, {"e2", 52}, {"f2", 53}, {"g2", 54}, {"h2", 55},
-    {"a1", 56}, {"b1", 57}, {"c1", 58}, {"d1", 59}, {"e1", 60}, {"f1", 61}, {"g1", 62}, {"h1", 63}
-};
+AnalysisBackendOptions analysisBackend;
+
+/**
+ * Sets where positions are sent to be analysed. Must be called before the first analysis.
+ * @param options   AnalysisBackendOptions for the backend
+*/
+void setAnalysisBackend(const AnalysisBackendOptions &options) {
+    analysisBackend = options;
+}
+
+/**
+ * @returns the options of the current analysis backend
+*/
+const AnalysisBackendOptions &getAnalysisBackend() {
+    return analysisBackend;
+}
+
+/**
+ * Gets the name of a square (such as "e4") from its index, where index 0 is a8 and index 63 is h1.
+ * @param index     int for the index of the square
+ * 
+ * @returns the name of the square from SQUARE_NAMES, or an empty string if the index is out of range
+*/
+const char *getSquareName(int index) {
+    return index >= 0 && index < 64 ? SQUARE_NAMES[index] : "";
+}
 
 /**
  * Gets the indices for the squares of the best move by parsing the StockFish API response.
@@ -40,23 +44,16 @@ std::unordered_map<std::string, int> squareNameToIndex = {
  * 
  * @returns a pair of ints, where the first index is the current piece position and the second index is where it should be moved to
 */
-std::pair<int, int> getBestMove(std::string fullString) {
-    std::string bestMove = "";
-    std::string firstSquare, secondSquare;
-    int firstIndex, secondIndex;
-
-    // just check if string is what we expect, with bestmove followed by a space and 4 strings for the best move
+std::pair<int, int> getBestMove(const std::string &fullString) {
+    // just check if string is what we expect, with bestmove followed by a space and 4 characters for the best move
     if (fullString.rfind("bestmove", 0) == 0 && fullString.size() >= 13) {
-        // get the best move as a string
-        bestMove = fullString.substr(9, 4);
-        // printf("bestMove var: %s\n", bestMove.c_str());
-        firstSquare = bestMove.substr(0, 2);
-        secondSquare = bestMove.substr(2, 2);
-        printf("Best move: %s to %s\n", firstSquare.c_str(), secondSquare.c_str());
-        if (squareNameToIndex.find(firstSquare) != squareNameToIndex.end() && squareNameToIndex.find(secondSquare) != squareNameToIndex.end()) {
-            firstIndex = squareNameToIndex[firstSquare];
-            secondIndex = squareNameToIndex[secondSquare];
-            
+        // the squares are read straight from the characters, such as "e2e4"
+        const char *bestMove = fullString.c_str() + 9;
+        int firstIndex = getSquareIndex(bestMove[0], bestMove[1]);
+        int secondIndex = getSquareIndex(bestMove[2], bestMove[3]);
+        logPrintf(LOG_DEBUG, "Best move: %.2s to %.2s\n", bestMove, bestMove + 2);
+
+        if (firstIndex >= 0 && secondIndex >= 0) {
             return std::pair<int, int>(firstIndex, secondIndex);
         }
     }
@@ -66,38 +63,112 @@ std::pair<int, int> getBestMove(std::string fullString) {
 
 
 /**
- * Makes an API call to Stockfish chess engine based on the fen, and displays the evaluation and best move if obtained.
- * @param dst       cv::Mat representing the image
+ * Makes an API call to the Stockfish chess engine over the given session, so its connection is reused between calls.
+ * @param session   cpr::Session to make the request with
  * @param fen       string of the 'fen' representation of the board's pieces
- * @param squares   vector of cv::Rect's representing the squares so the best move can be displayed.
+ * @param result    the resulting ChessAnalysisResult holding the evaluation and best move
+ * @param depth     int for the search depth requested from the engine
+ * @param timeoutMs int for the milliseconds to wait for the whole request before giving up
  * 
- * @returns 0 if the function returns successfully
+ * @returns 0 if the function returns successfully, 1 if the request failed and is worth retrying, 2 otherwise
 */
-int getChessAnalysis(cv::Mat image, std::string fen, std::vector<cv::Rect> squares) {
-    std::string API_URL = "https://stockfish.online/api/s/v2.php";
+int fetchChessAnalysis(cpr::Session &session, const std::string &fen, ChessAnalysisResult &result, int depth, int timeoutMs) {
+    ScopedTimer timer("fetchChessAnalysis");
+    addCounter("stockfishApiRequests");
+    result = ChessAnalysisResult();
+
     // Make a GET request to the API endpoint
-    printf("Awaiting Stockfish server response...\n");
-    cpr::Response response = cpr::Get(cpr::Url{API_URL},
-                                      cpr::Parameters{{"fen", fen.c_str()}, {"depth", "10"}});
+    logPrintf(LOG_DEBUG, "Awaiting Stockfish server response...\n");
+    session.SetUrl(cpr::Url{STOCKFISH_API_URL});
+    session.SetParameters(cpr::Parameters{{"fen", fen}, {"depth", std::to_string(depth)}});
+    session.SetTimeout(cpr::Timeout{timeoutMs});
+    cpr::Response response = session.Get();
 
     // Check if the request was successful
     if (response.status_code == 200) {
         // Print the response body
-        std::cout << "API Response: " << response.text << std::endl;
+        logPrintf(LOG_DEBUG, "API Response: %s\n", response.text.c_str());
     } else {
         // Print an error message
         std::cerr << "Error: Failed to fetch API data. Status code: " << response.status_code << std::endl;
+        // no response at all (such as a timeout), rate limiting and server errors can all go away on their own
+        bool retryable = response.status_code == 0 || response.status_code == 429 || response.status_code >= 500;
+        return retryable ? 1 : 2;
+    }
+
+    nlohmann::json j = nlohmann::json::parse(response.text, nullptr, false);
+    if (j.is_discarded() || !j.is_object()) {
+        std::cerr << "Error: Could not parse API response" << std::endl;
+        return 2;
+    }
+    if (j.find("success") != j.end() && j["success"].is_boolean() && !j["success"].get<bool>()) {
+        std::cerr << "Error: Stockfish could not analyse the position" << std::endl;
+        return 2;
     }
 
-    nlohmann::json j = nlohmann::json::parse(response.text);
-    float eval;
-    std::string fullString;
-    std::pair<int, int> bestMove;
-    if (j.find("evaluation") != j.end()) {
-        eval = j["evaluation"];
-        printf("Eval: %f\n", eval);
+    if (j.find("evaluation") != j.end() && j["evaluation"].is_number()) {
+        result.eval = j["evaluation"];
+        result.hasEval = true;
+        logPrintf(LOG_INFO, "Eval: %f\n", result.eval);
+    }
+
+    if (j.find("mate") != j.end() && j["mate"].is_number_integer()) {
+        result.mate = j["mate"];
+        result.hasMate = true;
+        logPrintf(LOG_INFO, "Mate in %d\n", result.mate);
+    }
+
+    if (j.find("bestmove") != j.end() && j["bestmove"].is_string()) {
+        result.bestMoveString = j["bestmove"];
+        result.bestMove = getBestMove(result.bestMoveString);
+    }
+
+    result.success = true;
+    return 0;
+}
+
+/**
+ * Analyses the position with the local UCI engines of the analysis backend, starting them on first use.
+ * @param fen       string of the 'fen' representation of the board's pieces
+ * @param result    the resulting ChessAnalysisResult holding the evaluation and best move
+ * @param depth     int for the search depth, unless the backend has a movetime set
+ * 
+ * @returns 0 if the function returns successfully, 1 if the engine failed and is worth retrying
+*/
+int fetchEngineAnalysis(const std::string &fen, ChessAnalysisResult &result, int depth) {
+    // the engines are launched once and stay warm for every position after
+    static UciEnginePool engines(analysisBackend.enginePath, std::max(1, analysisBackend.numEngines));
+    ScopedTimer timer("fetchEngineAnalysis");
+    addCounter("engineSearches");
+
+    UciSearchLimits limits;
+    limits.depth = depth;
+    limits.movetimeMs = analysisBackend.movetimeMs;
+
+    return engines.analyse(fen, limits, result) == 0 ? 0 : 1;
+}
+
+/**
+ * Displays the evaluation and best move from an analysis on the given image.
+ * @param image     cv::Mat representing the image
+ * @param result    ChessAnalysisResult to display
+ * @param squares   vector of cv::Rect's representing the squares so the best move can be displayed.
+*/
+void drawChessAnalysis(cv::Mat &image, const ChessAnalysisResult &result, const std::vector<cv::Rect> &squares) {
+    // the depth is shown when it is known, so a progressive analysis can be seen deepening
+    std::string depthText = result.depth > 0 ? " (depth " + std::to_string(result.depth) + ")" : "";
+    if (result.hasEval) {
+        cv::putText(image, //target image
+                    "Eval: " + static_cast<std::string>((result.eval > 0 ? "+" : "")) + std::to_string(result.eval) + depthText,
+                    cv::Point(10, 90),
+                    cv::FONT_HERSHEY_DUPLEX,
+                    3.0,
+                    CV_RGB(65, 105, 225), //font color
+                    5);
+    }
+    else if (result.hasMate) {
         cv::putText(image, //target image
-                    "Eval: " + static_cast<std::string>((eval > 0 ? "+" : "")) + std::to_string(eval),
+                    "Mate: " + static_cast<std::string>((result.mate > 0 ? "+" : "")) + std::to_string(result.mate) + depthText,
                     cv::Point(10, 90),
                     cv::FONT_HERSHEY_DUPLEX,
                     3.0,
@@ -105,79 +176,105 @@ int getChessAnalysis(cv::Mat image, std::string fen, std::vector<cv::Rect> squar
                     5);
     }
 
-    if (j.find("bestmove") != j.end()) {
-        fullString = j["bestmove"];
-        bestMove = getBestMove(fullString);
-        // printf("bestMove: %d %d\n", bestMove.first, bestMove.second);
-        if (bestMove.first != bestMove.second) {
-            cv::Rect startSquare, endSquare;
-            startSquare = squares[bestMove.first];
-            endSquare = squares[bestMove.second];
+    // printf("bestMove: %d %d\n", result.bestMove.first, result.bestMove.second);
+    if (result.bestMove.first != result.bestMove.second && squares.size() == 64) {
+        cv::Rect startSquare, endSquare;
+        startSquare = squares[result.bestMove.first];
+        endSquare = squares[result.bestMove.second];
 
-            cv::Point2f start(startSquare.x + (0.5 * startSquare.width), startSquare.y + (0.5 * startSquare.height));
-            cv::Point2f end(endSquare.x + (0.5 * endSquare.width), endSquare.y + (0.5 * endSquare.height));
-            cv::arrowedLine(image, start, end, CV_RGB(255, 0, 255), 10);
+        cv::Point2f start(startSquare.x + (0.5 * startSquare.width), startSquare.y + (0.5 * startSquare.height));
+        cv::Point2f end(endSquare.x + (0.5 * endSquare.width), endSquare.y + (0.5 * endSquare.height));
+        cv::arrowedLine(image, start, end, CV_RGB(255, 0, 255), 10);
+    }
+
+    // the other principal variations are drawn thinner and fainter, so the best move still stands out
+    for (const std::pair<int, int> &move : result.otherMoves) {
+        if (move.first == move.second || squares.size() != 64) {
+            continue;
         }
+        const cv::Rect &startSquare = squares[move.first];
+        const cv::Rect &endSquare = squares[move.second];
+        cv::Point2f start(startSquare.x + (0.5 * startSquare.width), startSquare.y + (0.5 * startSquare.height));
+        cv::Point2f end(endSquare.x + (0.5 * endSquare.width), endSquare.y + (0.5 * endSquare.height));
+        cv::arrowedLine(image, start, end, CV_RGB(200, 140, 255), 4);
     }
-    
-    return 0;
 }
 
 /**
  * Converts the labels of the chessboard to the chess "fen" format, a format that an API related to chess can read
- * @param squareLabels  vector of strings representing the labels for each square on the board
+ * @param board     Board holding the piece on each square
  * 
- * @returns a string in the "fen" format
+ * @returns a string in the "fen" format, or an empty string if a square couldn't be labeled
 */
-std::string getFenFromLabels(std::vector<std::string> squareLabels) {
-    std::string fen = "";
+std::string getFenFromLabels(const Board &board) {
+    if (!board.isComplete()) {
+        printf("Not every square of the board could be labeled\n");
+        return "";
+    }
+
+    std::string turn = "";
+    while (turn != "w" && turn != "b") {
+        printf("Please enter 'w' if it's white's turn and 'b' if it's black's turn:\n");
+        std::cin >> turn;
+    }
 
-    if (squareLabels.size() != 64) {
-        printf("Improper size of labels parameter. Should be 64 squares. Size is: %zu\n", squareLabels.size());
+    return getFenFromLabels(board, turn);
+}
+
+/**
+ * Converts the labels of the chessboard to the chess "fen" format without asking whose turn it is.
+ * @param board     Board holding the piece on each square
+ * @param turn      string for the side to move, "w" for white or "b" for black
+ * 
+ * @returns a string in the "fen" format, or an empty string if a square couldn't be labeled or the turn is invalid
+*/
+std::string getFenFromLabels(const Board &board, const std::string &turn) {
+    if (turn != "w" && turn != "b") {
+        printf("Improper turn parameter. Should be 'w' or 'b'. Turn is: %s\n", turn.c_str());
         return "";
     }
 
+    // at most 64 pieces, 7 slashes and the fields after the placement
+    char fen[96];
+    int length = 0;
     int currentEmpty = 0;
 
-    for (int i = 0; i < squareLabels.size(); i++) {
+    for (int i = 0; i < 64; i++) {
 
         // first, we need to check if we are at a new row to add a '/'
         if (i % 8 == 0 && i != 0) {
             if (currentEmpty > 0) {
-                fen += std::to_string(currentEmpty);
+                fen[length++] = static_cast<char>('0' + currentEmpty);
                 currentEmpty = 0;
             }
-            fen += "/";
+            fen[length++] = '/';
         }
 
         // if there is an empty space, keep counting
-        if (squareLabels[i] == "ee") {
-                currentEmpty++;
+        if (board[i] == PIECE_EMPTY) {
+            currentEmpty++;
+        }
+        else if (board[i] == PIECE_UNKNOWN) {
+            printf("Unknown label for square %d\n", i);
+            return "";
         }
         else {
             // if we are currently counting empty spaces, but can stop now
             if (currentEmpty > 0) {
-                fen += std::to_string(currentEmpty);
+                fen[length++] = static_cast<char>('0' + currentEmpty);
                 currentEmpty = 0;
             }
 
-            fen += pieceToFen.at(squareLabels[i]);
+            fen[length++] = PIECE_FEN_CHARS[board[i]];
         }
     }
-    fen += " ";
-
-    std::string turn = "";
-    while (turn != "w" && turn != "b") {
-        printf("Please enter 'w' if it's white's turn and 'b' if it's black's turn:\n");
-        std::cin >> turn;
+    // the last row can end with empty spaces too
+    if (currentEmpty > 0) {
+        fen[length++] = static_cast<char>('0' + currentEmpty);
     }
+    length += snprintf(fen + length, sizeof(fen) - length, " %c - - 0 0", turn[0]);
 
-    fen += turn;
-    fen += " - - 0 0";
-
-    printf("Resulting fen: %s\n", fen.c_str());
+    logPrintf(LOG_INFO, "Resulting fen: %s\n", fen);
 
-    return fen;
+    return std::string(fen, length);
 }
-
-
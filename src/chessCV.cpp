@@ -11,8 +11,12 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
 //#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <csignal>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <unordered_set>
 
@@ -20,151 +24,41 @@
 #include "processingOps.hpp"
 #include "pieceDetectionOps.hpp"
 #include "chessAnalysis.hpp"
+#include "boardPipeline.hpp"
+#include "boardOverlay.hpp"
+#include "boardImage.hpp"
+#include "boardTracker.hpp"
+#include "incrementalLabeler.hpp"
+#include "autoLabelOps.hpp"
+#include "batchOps.hpp"
+#include "serveOps.hpp"
+#include "tileExportOps.hpp"
+#include "analysisService.hpp"
+#include "boardCache.hpp"
+#include "instrumentation.hpp"
+#include "commonOptions.hpp"
 
 
 
 /**
  * Function to handle the chess board computer vision workflow,
  *  including board square location, thresholding, and piece detection
- * @param src               a cv::Mat storing the source frame data
+ *  Each stage is computed once by the pipeline, so this only renders the requested display from its cached state,
+ *  copying the image once into dst and drawing on that copy.
+ * @param pipeline          a BoardPipeline for the source frame data
  * @param dst               a cv::Mat where the resulting frame is expected to be stored
  * @param currentDisplay    a char storing the value of the current display, indicating what to show
 */
-void handleBoardFlow(cv::Mat &src, cv::Mat &dst, char currentDisplay) {
+void handleBoardFlow(BoardPipeline &pipeline, cv::Mat &dst, char currentDisplay) {
+    BoardOverlay overlay = getBoardOverlay(pipeline, currentDisplay);
 
-    src.copyTo(dst);
-    cv::Size newSize(428, 524);
-
-    // show results of hough transform
+    // the hough lines are drawn over the resized image they were found on
     if (currentDisplay == 'h') {
-        cv::Mat resized;
-        // cv::Size newSize(src.size().width, src.size().height);
-        std::vector<cv::Vec4i> lines;
-        // calculates lines from hough transform
-        calcHoughLines(src, resized, newSize, lines, true);
-
-        resized.copyTo(dst);
-        displayLines(dst, lines);
-
-    }
-    // shows intersections between hough lines
-    else if (currentDisplay == 'i') {
-        cv::Mat resized;
-        std::vector<cv::Vec4i> lines;
-
-        // calculates lines from hough transform
-        calcHoughLines(src, resized, newSize, lines);
-        resized.copyTo(dst);
-
-        // Find intersections between lines
-        std::vector<cv::Point2f> intersections;
-        getIntersections(dst, lines, newSize, intersections);
-
-        // get back our normal size points
-        src.copyTo(dst);
-        std::vector<cv::Point2f> originalPoints = scalePointsToOriginal(dst, intersections, src.size(), newSize, true);
-    }
-    // show squares formed by intersections
-    else if (currentDisplay == 's') {
-        cv::Mat resized;
-        std::vector<cv::Vec4i> lines;
-
-        // calculates lines from hough transform
-        calcHoughLines(src, resized, newSize, lines);
-        resized.copyTo(dst);
-
-        // Find intersections between lines
-        std::vector<cv::Point2f> intersections;
-        getIntersections(dst, lines, newSize, intersections);
-
-        src.copyTo(dst);
-        std::vector<cv::Point2f> originalPoints = scalePointsToOriginal(dst, intersections, src.size(), newSize);
-
-        // find rectangles based on the intersections
-        std::vector<cv::Rect> rectangles;
-        setRectangles(dst, originalPoints, rectangles, true);
-
+        cv::imshow("Canny", pipeline.getEdges());
+        renderBoardOverlay(pipeline.getResized(), overlay, dst);
     }
-    // show piece labelings
-    else if (currentDisplay == 'p') {
-        cv::Mat resized;
-        std::vector<cv::Vec4i> lines;
-
-        // calculates lines from hough transform
-        calcHoughLines(src, resized, newSize, lines);
-        resized.copyTo(dst);
-
-        // Find intersections between lines
-        std::vector<cv::Point2f> intersections;
-        getIntersections(dst, lines, newSize, intersections);
-
-        src.copyTo(dst);
-        std::vector<cv::Point2f> originalPoints = scalePointsToOriginal(dst, intersections, src.size(), newSize);
-
-        // find rectangles based on the intersections
-        std::vector<cv::Rect> rectangles;
-        setRectangles(dst, originalPoints, rectangles);
-
-        // get all the labels for the pieces
-        std::vector<std::string> squareLabels;
-        getPieceLabels(dst, rectangles, squareLabels, true);
-
-    }
-    // get the analysis
-    else if (currentDisplay == 'x') {
-        cv::Mat resized;
-        std::vector<cv::Vec4i> lines;
-
-        // calculates lines from hough transform
-        calcHoughLines(src, resized, newSize, lines);
-        resized.copyTo(dst);
-
-        // Find intersections between lines
-        std::vector<cv::Point2f> intersections;
-        getIntersections(dst, lines, newSize, intersections);
-        
-        src.copyTo(dst);
-        std::vector<cv::Point2f> originalPoints = scalePointsToOriginal(dst, intersections, src.size(), newSize);
-
-        // find rectangles based on the intersections
-        std::vector<cv::Rect> rectangles;
-        setRectangles(dst, originalPoints, rectangles);
-
-        // get all the labels for the pieces
-        std::vector<std::string> squareLabels;
-        getPieceLabels(dst, rectangles, squareLabels);
-
-        std::string fen = getFenFromLabels(squareLabels);
-        getChessAnalysis(dst, fen, rectangles);
-
-    }
-    // show all current steps
-    else if (currentDisplay == 'a') {
-        cv::Mat resized;
-        std::vector<cv::Vec4i> lines;
-
-        // calculates lines from hough transform
-        calcHoughLines(src, resized, newSize, lines);
-        resized.copyTo(dst);
-
-        // Find intersections between lines
-        std::vector<cv::Point2f> intersections;
-        getIntersections(dst, lines, newSize, intersections);
-        
-        src.copyTo(dst);
-        std::vector<cv::Point2f> originalPoints = scalePointsToOriginal(dst, intersections, src.size(), newSize);
-
-        // find rectangles based on the intersections
-        std::vector<cv::Rect> rectangles;
-        setRectangles(dst, originalPoints, rectangles);
-
-        // get all the labels for the pieces
-        std::vector<std::string> squareLabels;
-        getPieceLabels(dst, rectangles, squareLabels);
-
-        std::string fen = getFenFromLabels(squareLabels);
-        getChessAnalysis(dst, fen, rectangles);
-
+    else {
+        renderBoardOverlay(pipeline.getSource(), overlay, dst);
     }
 
     return;
@@ -178,58 +72,218 @@ void handleBoardFlow(cv::Mat &src, cv::Mat &dst, char currentDisplay) {
  * @returns 0 if the function was successful
 */
 int handleImgDisplay(std::string imgPath, std::unordered_set<char> possibleButtons) {
-    cv::Mat src = imread(imgPath, cv::IMREAD_COLOR);
+    // the photo is only decoded at the reduced sizes the pipeline works at, never at full resolution
+    std::shared_ptr<BoardImage> image = std::make_shared<BoardImage>();
     cv::Mat dst;
 
     // checks if image is empty, returns 1 if so
-    if (src.empty() ) {
+    if (image->load(imgPath) != 0) {
         std::cout << "Could not read the following image: " << imgPath << ". Please try again!" << std::endl;
         return 1;
     }
 
-    cv::imshow("Original Image", src);
+    // every display is rendered from the same cached pipeline stages
+    BoardPipeline pipeline(image);
+
+    cv::imshow("Original Image", pipeline.getSource());
     int key = cv::waitKey(0);
+    // windows shown before their analysis arrived, which are drawn again when it does
+    std::unordered_set<char> waitingWindows;
 
     while (key != 'q') {
         // create a new window based on the requested image transformation
         if (possibleButtons.find(key) != possibleButtons.end() && key != 'n') {
-            handleBoardFlow(src, dst, key);
+            handleBoardFlow(pipeline, dst, key);
             cv::imshow(std::string(1, char(key)), dst);
+            if ((key == 'x' || key == 'a') && !pipeline.isAnalysisReady()) {
+                waitingWindows.insert(key);
+            }
+        }
+
+        if (!waitingWindows.empty() && pipeline.isAnalysisReady()) {
+            for (char window : waitingWindows) {
+                handleBoardFlow(pipeline, dst, window);
+                cv::imshow(std::string(1, window), dst);
+            }
+            waitingWindows.clear();
         }
 
-        key = cv::waitKey(0);
+        // keep the window responsive while an analysis is on its way
+        key = cv::waitKey(waitingWindows.empty() ? 0 : 50);
     }
     return 0;
 }
 
 
-int handleLabelDisplay(std::string imgPath) {
-
-    cv::Mat src = imread(imgPath, cv::IMREAD_COLOR);
+/**
+ * Function to handle live video (from a camera or a video file) and allow for the chess board workflow
+ *   The board is found once with the full hough pipeline and then tracked from frame to frame.
+ * @param videoSource       a string for the camera index or the path to a video file
+ * @param possibleButtons   a set of characters representing the buttons that correspond to actions
+ * 
+ * @returns 0 if the function was successful
+*/
+int handleVidDisplay(std::string videoSource, std::unordered_set<char> possibleButtons) {
+    cv::VideoCapture capture;
+    // a source made of only digits is a camera index
+    if (!videoSource.empty() && std::all_of(videoSource.begin(), videoSource.end(), ::isdigit)) {
+        capture.open(std::stoi(videoSource));
+    }
+    else {
+        capture.open(videoSource);
+    }
 
-    // checks if image is empty, returns 1 if so
-    if (src.empty() ) {
-        std::cout << "Could not read the following image: " << imgPath << ". Please try again!" << std::endl;
+    if (!capture.isOpened()) {
+        std::cout << "Could not open the following video source: " << videoSource << ". Please try again!" << std::endl;
         return 1;
     }
 
-    cv::imshow("Original Image", src);
-    int key = cv::waitKey(0);
+    printf("Press 'r' to find the board again, 'p' to label the pieces, 'x' for analysis, 'm' to follow the moves, 't' to change the side to "
+           "move and 'q' to quit\n");
+
+    BoardTracker tracker;
+    IncrementalLabeler labeler;
+    bool followMoves = false;
+    cv::Mat frame, dst;
+    char currentDisplay = 's';
+    Board squareLabels;
+    bool hasLabels = false;
+    ChessAnalysisResult analysis;
+    std::shared_future<ChessAnalysisResult> pendingAnalysis;
+    // with --progressive each deeper result replaces the one shown, until the board changes
+    std::unique_ptr<ProgressiveAnalysis> progressive;
+    if (getProgressiveAnalysisOptions().enabled) {
+        progressive.reset(new ProgressiveAnalysis());
+    }
+    std::string analysedFen;
+    // the frames keep coming, so the side to move is toggled with 't' (or follows the moves) instead of asked for on stdin
+    std::string turn = "w";
+    int key = 0;
 
-    printf("Shown is the initial image. Label each square as 'p' for pawn, 'b' for bishop, 'n' for knight, 'r' for rook, 'q' for queen, 'k' for king. Press any other key to skip\n");
-    printf("After that, enter 'b' for black or 'w' for white\n");
+    while (key != 'q') {
+        if (!capture.read(frame) || frame.empty()) {
+            break;
+        }
 
-    labelImages(src);
+        bool hasBoard = tracker.update(frame);
+
+        // the analysis is requested in the background, so the video keeps playing until it arrives
+        if (pendingAnalysis.valid() && pendingAnalysis.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            analysis = pendingAnalysis.get();
+            pendingAnalysis = std::shared_future<ChessAnalysisResult>();
+        }
+        ChessAnalysisResult deeper;
+        if (progressive && progressive->getUpdate(deeper)) {
+            analysis = deeper;
+        }
+
+        // only the squares that changed since the last frame get classified again
+        if (followMoves && hasBoard) {
+            if (tracker.wasRedetected()) {
+                labeler.reset();
+            }
+            BoardMove move;
+            hasLabels = labeler.update(frame, tracker.getRectangles(), squareLabels, move) >= 0 || hasLabels;
+            if (move.isValid()) {
+                printf("Move: %s to %s\n", getSquareName(move.from), getSquareName(move.to));
+
+                // the side that didn't just move is next, and the search of the old position stops for it
+                bool whiteMoved = PIECE_LABELS[squareLabels[move.to]][0] == 'w';
+                turn = whiteMoved ? "b" : "w";
+                if (progressive && !analysedFen.empty()) {
+                    analysedFen = getFenFromLabels(squareLabels, turn);
+                    analysis = ChessAnalysisResult();
+                    progressive->setPosition(analysedFen);
+                }
+            }
+        }
+
+        // the labeler and the key presses below read the frame, so anything drawn goes onto a copy of it
+        BoardOverlay overlay;
+        if (hasBoard && currentDisplay != 'n') {
+            overlay.squares = tracker.getRectangles();
+            if (currentDisplay == 'h' || currentDisplay == 'i') {
+                overlay.points = tracker.getPoints();
+            }
+            else {
+                overlay.showSquares = true;
+            }
+            overlay.labels = squareLabels;
+            overlay.showLabels = hasLabels;
+            overlay.analysis = analysis;
+        }
+        if (overlay.empty()) {
+            cv::imshow("Video", frame);
+        }
+        else {
+            renderBoardOverlay(frame, overlay, dst);
+            cv::imshow("Video", dst);
+        }
+
+        key = cv::waitKey(1);
+        if (key == 'r') {
+            tracker.reset();
+        }
+        else if (key == 't') {
+            turn = turn == "w" ? "b" : "w";
+            printf("%s to move\n", turn == "w" ? "White" : "Black");
+        }
+        else if (key == 'm') {
+            followMoves = !followMoves;
+            labeler.reset();
+            hasLabels = false;
+        }
+        else if (possibleButtons.find(key) != possibleButtons.end()) {
+            currentDisplay = key;
+            followMoves = false;
+            hasLabels = false;
+            analysis = ChessAnalysisResult();
+            pendingAnalysis = std::shared_future<ChessAnalysisResult>();
+            if (progressive) {
+                progressive->stop();
+                analysedFen.clear();
+            }
+
+            // labels and analysis are only found on request, for the frame the key was pressed on
+            if (hasBoard && (key == 'p' || key == 'x' || key == 'a')) {
+                std::vector<cv::Rect> rectangles = tracker.getRectangles();
+                float imageScale = getSquareImageScale(rectangles);
+
+                // a camera that hasn't moved shows the same board again, which reuses its labels
+                BoardCacheEntry cached;
+                int cacheRet = findCachedBoard(frame, rectangles, imageScale, cached);
+                if (cacheRet == 0) {
+                    squareLabels = cached.board;
+                }
+                else {
+                    getPieceLabels(frame, rectangles, squareLabels, cached.occupancyScores, imageScale);
+                }
+                if (cacheRet == 1) {
+                    cached.board = squareLabels;
+                    for (double &score : cached.occupancyScores) {
+                        score /= imageScale;
+                    }
+                    getBoardCache().add(cached);
+                }
+                hasLabels = true;
+                std::string fen = key != 'p' ? getFenFromLabels(squareLabels, turn) : "";
+                if (!fen.empty() && progressive) {
+                    analysedFen = fen;
+                    progressive->setPosition(fen);
+                }
+                else if (!fen.empty()) {
+                    pendingAnalysis = getAnalysisService().requestAnalysis(fen);
+                }
+            }
+        }
+    }
 
     return 0;
 }
 
-int handleSavingDisplay() {
-    std::string imgPath = "images/IMG_1248.jpg";
-    cv::Mat src, dst, resized, temp;
-    cv::Size newSize(428, 524);
+int handleLabelDisplay(std::string imgPath) {
 
-    src = cv::imread(imgPath, cv::IMREAD_COLOR);
+    cv::Mat src = imread(imgPath, cv::IMREAD_COLOR);
 
     // checks if image is empty, returns 1 if so
     if (src.empty() ) {
@@ -237,30 +291,14 @@ int handleSavingDisplay() {
         return 1;
     }
 
-    std::vector<cv::Vec4i> lines;
-
-    // calculates lines from hough transform
-    calcHoughLines(src, resized, newSize, lines);
-    resized.copyTo(dst);
+    cv::imshow("Original Image", src);
+    int key = cv::waitKey(0);
 
-    // Find intersections between lines
-    std::vector<cv::Point2f> intersections;
-    getIntersections(dst, lines, newSize, intersections);
+    printf("Shown is the initial image. Label each square as 'p' for pawn, 'b' for bishop, 'n' for knight, 'r' for rook, 'q' for queen, 'k' for king. Press any other key to skip\n");
+    printf("After that, enter 'b' for black or 'w' for white\n");
 
-    src.copyTo(dst);
-    std::vector<cv::Point2f> originalPoints = scalePointsToOriginal(dst, intersections, src.size(), newSize);
+    labelImages(src);
 
-    // find rectangles based on the intersections
-    std::vector<cv::Rect> rectangles;
-    setRectangles(dst, originalPoints, rectangles, true);
-    
-    int current = 0;
-    for (cv::Rect currentRect : rectangles) {
-        cv::Mat temp = src(currentRect);
-        cv::imwrite("im5_" + std::to_string(current) + ".jpg", temp);
-        current++;
-    }
-   
     return 0;
 }
 
@@ -273,9 +311,85 @@ int main(int argc, char *argv[])
     int ret;
     std::string imgPath;
 
+    // an engine that dies should show up as a failed write to its pipe, not end the program with SIGPIPE
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // the backend, classifier and instrumentation options can be given with every mode
+    CommonOptions commonOptions;
+    if (extractCommonOptions(argc, argv, commonOptions) != 0) {
+        return -1;
+    }
+    applyCommonOptions(commonOptions);
+
+    // headless batch mode has its own options, and never touches HighGUI or stdin
+    if (argc >= 2 && std::string(argv[1]) == "batch") {
+        BatchOptions options;
+        if (parseBatchOptions(argc, argv, 2, options) != 0) {
+            std::cout << "Usage: segmentation batch [dir or list file] [--turn w|b] [--threads N] [--out results.jsonl] [--eval] [--rectified] [--nn] "
+                         "[--decode-threads N] [--queue N]" << std::endl;
+            return -1;
+        }
+        return runBatch(options);
+    }
+
+    // long-running server that keeps everything loaded between uploads
+    if (argc >= 2 && std::string(argv[1]) == "serve") {
+        ServeOptions options;
+        if (parseServeOptions(argc, argv, 2, options) != 0) {
+            std::cout << "Usage: segmentation serve [--host ADDRESS] [--port N] [--threads N] [--queue N] [--max-upload-mb N] "
+                         "[--turn w|b] [--eval] [--rectified] [--nn]" << std::endl;
+            return -1;
+        }
+        return runServer(options);
+    }
+
+    // labels every square of photos whose fens are known, without any key presses
+    if (argc >= 2 && std::string(argv[1]) == "autolabel") {
+        AutoLabelOptions options;
+        if (parseAutoLabelOptions(argc, argv, 2, options) != 0) {
+            std::cout << "Usage: segmentation autolabel [ground_truth.csv] [--images DIR] [--threads N] [--rectified] [--max-mismatch N] "
+                         "[--light light_features.csv] [--dark dark_features.csv]" << std::endl;
+            return -1;
+        }
+        return runAutoLabel(options);
+    }
+
+    // cuts the labeled squares of many photos into training tiles for the piece classifier
+    if (argc >= 2 && std::string(argv[1]) == "export") {
+        TileExportOptions options;
+        if (parseTileExportOptions(argc, argv, 2, options) != 0) {
+            std::cout << "Usage: segmentation export [ground_truth.csv] [--images DIR] [--out DIR] [--packed tiles.bin] [--size N] [--jpg] "
+                         "[--raw] [--empty] [--no-images] [--threads N] [--writers N] [--queue N]" << std::endl;
+            return -1;
+        }
+        return runTileExport(options);
+    }
+
+    // converts the feature csv files to binary feature files, the default light and dark ones if none are given
+    if (argc >= 2 && std::string(argv[1]) == "convert") {
+        bool useFloat16 = argc >= 3 && std::string(argv[argc - 1]) == "--f16";
+        FeatureDataType dataType = useFloat16 ? FEATURE_FLOAT16 : FEATURE_FLOAT32;
+        int numPaths = argc - 2 - (useFloat16 ? 1 : 0);
+
+        if (numPaths == 0) {
+            ret = convertFeatureFile(CSV_LIGHT_FILE_PATH, FEATURE_LIGHT_FILE_PATH, dataType);
+            return ret != 0 ? ret : convertFeatureFile(CSV_DARK_FILE_PATH, FEATURE_DARK_FILE_PATH, dataType);
+        }
+        else if (numPaths == 2) {
+            return convertFeatureFile(argv[2], argv[3], dataType);
+        }
+        std::cout << "Usage: segmentation convert [features.csv features.bin] [--f16]" << std::endl;
+        return -1;
+    }
+
     if (argc == 1) {
         std::cout << "Must include an image path" << std::endl;
     }
+    // live video from the default camera
+    else if (argc == 2 && std::string(argv[1]) == "vid") {
+        displayType = "vid";
+        imgPath = "0";
+    }
     else if (argc == 2) {
         displayType = "img";
         imgPath = argv[1];
@@ -285,7 +399,8 @@ int main(int argc, char *argv[])
         imgPath = argv[2];
     }
     else {
-        std::cout << "Usage: segmentation [img or label or *NONE*] [imgPath]" << std::endl;
+        std::cout << "Usage: segmentation [img or vid or label or autolabel or export or batch or serve or convert or *NONE*] [imgPath or camera index or videoPath] "
+                  << getCommonOptionsUsage() << std::endl;
         return -1;
     }
 
@@ -293,18 +408,15 @@ int main(int argc, char *argv[])
     std::unordered_set<char> possibleButtons = {'n', 'h', 'i', 's', 'p', 'x', 'a'};
 
     // enters the related path for handling live video or an image;
-    // if (displayType == "vid") {
-    //     ret = handleVidDisplay(possibleButtons);
-    // }
-    if (displayType == "img") {
+    if (displayType == "vid") {
+        ret = handleVidDisplay(imgPath, possibleButtons);
+    }
+    else if (displayType == "img") {
         ret = handleImgDisplay(imgPath, possibleButtons);
     }
     else if (displayType == "label") {
         ret = handleLabelDisplay(imgPath);
     }
-    else if (displayType == "save") {
-        ret = handleSavingDisplay();
-    }
     else {
         std::cout << "Invalid display type: " <<  displayType << " - [img or vid]" << std::endl;
         ret = -1;
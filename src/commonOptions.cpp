@@ -0,0 +1,206 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the options that every mode of chessCV (and bench) takes, parsed from one table so each flag is
+  only defined once.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "commonOptions.hpp"
+#include "processingOps.hpp"
+#include "boardLattice.hpp"
+
+/**
+ * One of the common options: its flag, the value it takes and how the value is stored.
+*/
+struct CommonOption {
+    const char *name;                                       // flag, such as "--engine"
+    const char *value;                                      // value shown in the usage, nullptr for a switch
+    const char *expected;                                   // what the value must be, printed when it is invalid
+    bool (*store)(CommonOptions &options, const char *value);   // stores the value, false if it is invalid
+};
+
+const CommonOption COMMON_OPTIONS[] = {
+    // the analysis backend, which switches to the local UCI engine if one is named
+    {"--engine", "PATH", nullptr, [](CommonOptions &options, const char *value) {
+        options.backend.backend = ANALYSIS_BACKEND_UCI;
+        options.backend.enginePath = value;
+        return true;
+    }},
+    {"--engines", "N", nullptr, [](CommonOptions &options, const char *value) {
+        options.backend.numEngines = std::max(1, std::atoi(value));
+        return true;
+    }},
+    {"--movetime", "MS", nullptr, [](CommonOptions &options, const char *value) {
+        options.backend.movetimeMs = std::max(0, std::atoi(value));
+        return true;
+    }},
+
+    // the live displays show a shallow analysis almost at once and keep deepening it until the board changes
+    {"--progressive", nullptr, nullptr, [](CommonOptions &options, const char *) {
+        options.progressive.enabled = true;
+        return true;
+    }},
+    {"--first-depth", "N", nullptr, [](CommonOptions &options, const char *value) {
+        options.progressive.firstDepth = std::max(1, std::atoi(value));
+        return true;
+    }},
+    {"--max-depth", "N", nullptr, [](CommonOptions &options, const char *value) {
+        options.progressive.maxDepth = std::max(1, std::atoi(value));
+        return true;
+    }},
+    {"--multipv", "N", nullptr, [](CommonOptions &options, const char *value) {
+        options.progressive.multiPv = std::max(1, std::atoi(value));
+        return true;
+    }},
+
+    // thresholds calibrated from the occupancy scores of a batch run
+    {"--empty-light", "SCORE", nullptr, [](CommonOptions &options, const char *value) {
+        options.thresholds.light = std::atof(value);
+        return true;
+    }},
+    {"--empty-dark", "SCORE", nullptr, [](CommonOptions &options, const char *value) {
+        options.thresholds.dark = std::atof(value);
+        return true;
+    }},
+
+    // a lighter model or a GPU backend for the piece classifier
+    {"--model", "PATH", nullptr, [](CommonOptions &options, const char *value) {
+        options.classifier.modelPath = value;
+        return true;
+    }},
+    {"--model-size", "N", "N or WxH", [](CommonOptions &options, const char *value) {
+        return parseClassifierInputSize(value, options.classifier.inputSize) == 0;
+    }},
+    {"--dnn-backend", "NAME", "cpu, opencl, opencl-fp16, cuda, cuda-fp16 or openvino",
+     [](CommonOptions &options, const char *value) {
+        return parseClassifierBackend(value, options.classifier.backend) == 0;
+    }},
+    {"--model-normalize", nullptr, nullptr, [](CommonOptions &options, const char *) {
+        options.classifier.normalize = true;
+        return true;
+    }},
+
+    // the histogram classifier scores each label's prototypes first and only searches the closest labels
+    {"--prototypes", "N", nullptr, [](CommonOptions &options, const char *value) {
+        options.featureIndex.prototypesPerLabel = std::max(0, std::atoi(value));
+        return true;
+    }},
+    {"--prototype-labels", "N", nullptr, [](CommonOptions &options, const char *value) {
+        options.featureIndex.searchedLabels = std::max(1, std::atoi(value));
+        return true;
+    }},
+
+    // repeated boards can skip the classifier, which is off unless the cache is given a cap
+    {"--board-cache-mb", "N", nullptr, [](CommonOptions &options, const char *value) {
+        options.boardCache.maxBytes = static_cast<size_t>(std::max(0.0, std::atof(value)) * 1024 * 1024);
+        return true;
+    }},
+    {"--board-cache-distance", "BITS", nullptr, [](CommonOptions &options, const char *value) {
+        options.boardCache.maxSquareDistance = std::max(0, std::atoi(value));
+        return true;
+    }},
+
+    // the report of every stage's timings and counts is written on exit
+    {"--log-level", "LEVEL", "error, warning, info or debug", [](CommonOptions &options, const char *value) {
+        return parseLogLevel(value, options.logLevel) == 0;
+    }},
+    {"--report", "PATH", nullptr, [](CommonOptions &options, const char *value) {
+        options.reportPath = value;
+        return true;
+    }},
+
+    // the geometry front end and the occupancy scores run on an OpenCL device if there is one
+    {"--opencl", nullptr, nullptr, [](CommonOptions &options, const char *) {
+        options.useOpenCL = true;
+        return true;
+    }},
+    // the lattice's corners are left where the resized image put them
+    {"--no-refine", nullptr, nullptr, [](CommonOptions &options, const char *) {
+        options.refineCorners = false;
+        return true;
+    }},
+};
+
+/**
+ * Takes the options shared by every mode out of the command line arguments, wherever they are, leaving the mode and
+ *   its own options for it to parse.
+ * @param argc      int for the number of arguments, updated to the number left
+ * @param argv      array of the argument strings, updated to the ones left
+ * @param options   CommonOptions the options are stored in, which keeps its values for the ones not given
+ *
+ * @returns 0 if the options were valid, non-zero otherwise
+*/
+int extractCommonOptions(int &argc, char *argv[], CommonOptions &options) {
+    int numLeft = 1;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const CommonOption *option = std::find_if(std::begin(COMMON_OPTIONS), std::end(COMMON_OPTIONS),
+                                                  [&](const CommonOption &common) { return arg == common.name; });
+        if (option == std::end(COMMON_OPTIONS)) {
+            argv[numLeft++] = argv[i];
+            continue;
+        }
+
+        const char *value = "";
+        if (option->value != nullptr) {
+            if (i + 1 >= argc) {
+                printf("Missing value for %s\n", arg.c_str());
+                return 1;
+            }
+            value = argv[++i];
+        }
+        if (!option->store(options, value)) {
+            printf("%s must be %s, not: %s\n", arg.c_str(), option->expected != nullptr ? option->expected : "valid", value);
+            return 1;
+        }
+    }
+
+    argc = numLeft;
+    return 0;
+}
+
+/**
+ * Sets the options of each module from the common options. The log level is set first, so the device picked for
+ *   --opencl is reported at the level asked for.
+ * @param options   CommonOptions to set
+*/
+void applyCommonOptions(const CommonOptions &options) {
+    setLogLevel(options.logLevel);
+    if (!options.reportPath.empty()) {
+        setRunReportPath(options.reportPath);
+    }
+
+    setAnalysisBackend(options.backend);
+    setProgressiveAnalysisOptions(options.progressive);
+    setOccupancyThresholds(options.thresholds);
+    setClassifierOptions(options.classifier);
+    setFeatureIndexOptions(options.featureIndex);
+    setBoardCacheOptions(options.boardCache);
+    setRefineLatticeCorners(options.refineCorners);
+    if (options.useOpenCL) {
+        setUseTransparentApi(true);
+    }
+}
+
+/**
+ * @returns the usage of the common options, such as "[--engine PATH] [--engines N] ..."
+*/
+std::string getCommonOptionsUsage() {
+    std::string usage;
+    for (const CommonOption &option : COMMON_OPTIONS) {
+        usage += usage.empty() ? "[" : " [";
+        usage += option.name;
+        if (option.value != nullptr) {
+            usage += std::string(" ") + option.value;
+        }
+        usage += "]";
+    }
+    return usage;
+}
@@ -7,10 +7,13 @@
 
 #include <cstdio>
 #include <cstring>
+#include <string>
 #include <vector>
 #include "opencv2/opencv.hpp"
 #include <map>
 
+#include "csv_util.h"
+
 /*
   reads a string from a CSV file. the 0-terminated string is returned in the char array os.
 
@@ -144,20 +147,21 @@ int append_image_data_csv( const char *filename, char label_name, char pieceColo
 }
 
 /*
-  Given a file with the format of a string as the first column and
-  floating point numbers as the remaining columns, this function
-  returns the labels as a std::vector of character arrays, and the
+  Given a file with the format of a piece and its colour as the first
+  two columns and floating point numbers as the remaining columns,
+  this function returns the pieces as a std::vector of Piece, and the
   remaining data as a 2D std::vector<float>.
 
-  labels will contain all of the image segment label names.
+  labels will contain the piece of each row.
   data will contain the features calculated from each image.
+  Rows whose first two columns aren't a piece are skipped.
 
   If echo_file is true, it prints out the contents of the file as read
   into memory.
 
   The function returns a non-zero value if something goes wrong.
  */
-int read_image_data_csv( const char *filename, std::vector<std::string> &labels, 
+int read_image_data_csv( const char *filename, std::vector<Piece> &labels, 
                          std::vector<std::vector<float>> &data, int echo_file ) {
   FILE *fp;
   float fval;
@@ -194,12 +198,16 @@ int read_image_data_csv( const char *filename, std::vector<std::string> &labels,
     }
     // printf("read %lu features\n", dvec.size() );
 
+    // the piece is looked up from the two characters, so no string is made per row
+    Piece piece = strlen(label) == 1 && strlen(color) == 1 ? getPieceFromLabel(color[0], label[0]) : PIECE_UNKNOWN;
+    if( piece == PIECE_UNKNOWN ) {
+      printf("Skipping a row of %s with an unknown label: %s,%s\n", filename, label, color);
+      continue;
+    }
+
     data.push_back(dvec);
 
-    char *fname = new char[strlen(label)+strlen(color)+1];
-    strcpy(fname, color);
-    strcat(fname, label);
-    labels.push_back( fname );
+    labels.push_back( piece );
   }
   fclose(fp);
   //printf("Finished reading CSV file\n");
@@ -260,12 +268,8 @@ int read_image_data_csv2( char* filename, std::unordered_map<std::string, std::v
 
     //data.push_back(dvec);
 
-    char *fname = new char[strlen(label)+strlen(color)+1];
-    strcpy(fname, color);
-    strcat(fname, label);
-
     //filenames.push_back( fname );
-    dataMap[fname] = dvec;
+    dataMap[std::string(color) + label] = dvec;
   }
   fclose(fp);
   printf("Finished reading CSV file\n");
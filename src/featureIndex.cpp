@@ -0,0 +1,490 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the in-memory index of the labeled histogram features used by the classical piece classifier.
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <numeric>
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include "featureIndex.hpp"
+#include "pieceDetectionOps.hpp"
+#include "csv_util.h"
+#include "instrumentation.hpp"
+
+FeatureIndexOptions featureIndexOptions;
+// seed of the k-means clustering, so the prototypes are the same from run to run
+const uint64_t PROTOTYPE_SEED = 0x5eed;
+
+/**
+ * Computes the histogram intersection difference (1 - sum of the minimums) with SIMD instructions where available.
+ * @param h1        pointer to the floats of the first histogram
+ * @param h2        pointer to the floats of the second histogram
+ * @param length    int for the number of values in each histogram
+ *
+ * @returns a float representing the difference
+*/
+float histogramIntersectionDifference(const float *h1, const float *h2, int length) {
+    float intersection = 0.0f;
+    int i = 0;
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    // OpenCV's universal intrinsics pick SSE, AVX2 or NEON for the platform we're built for
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    cv::v_float32 sum = cv::vx_setzero_f32();
+    for (; i <= length - lanes; i += lanes) {
+        sum = cv::v_add(sum, cv::v_min(cv::vx_load(h1 + i), cv::vx_load(h2 + i)));
+    }
+    intersection = cv::v_reduce_sum(sum);
+#endif
+
+    for (; i < length; i++) {
+        intersection += std::min(h1[i], h2[i]);
+    }
+
+    return 1.0f - intersection;
+}
+
+
+/**
+ * Sets the prototype options of the feature indices. Must be called before the first square is classified.
+ * @param options   FeatureIndexOptions for the indices
+*/
+void setFeatureIndexOptions(const FeatureIndexOptions &options) {
+    featureIndexOptions = options;
+}
+
+/**
+ * @returns the prototype options of the feature indices
+*/
+const FeatureIndexOptions &getFeatureIndexOptions() {
+    return featureIndexOptions;
+}
+
+
+FeatureIndex::FeatureIndex() : searchedLabels(0) {}
+
+/**
+ * Loads the labeled features from the given binary or csv feature file, replacing anything already in the index.
+ * @param filename  the name of the feature file
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int FeatureIndex::load(const std::string &filename) {
+    features.release();
+    labelIds.release();
+    labelPieces.clear();
+    mappedFile.reset();
+    prototypes.release();
+    prototypeLabelIds.clear();
+    labelRows.clear();
+
+    if (isFeatureFile(filename)) {
+        return loadBinary(filename);
+    }
+
+    std::vector<Piece> labels;
+    std::vector<std::vector<float>> data;
+    if (read_image_data_csv(filename.c_str(), labels, data, 0) != 0) {
+        return 1;
+    }
+    if (data.empty()) {
+        return 0;
+    }
+
+    // pack every histogram into one contiguous block, with the piece of each row as its label id
+    for (int piece = 0; piece < NUM_PIECES; piece++) {
+        labelPieces.push_back(static_cast<Piece>(piece));
+    }
+    int numDims = static_cast<int>(data[0].size());
+    features.create(static_cast<int>(data.size()), numDims, CV_32FC1);
+    labelIds.create(static_cast<int>(data.size()), 1, CV_32SC1);
+    for (size_t i = 0; i < data.size(); i++) {
+        if (static_cast<int>(data[i].size()) != numDims) {
+            printf("Row %zu of %s has %zu features instead of %d\n", i, filename.c_str(), data[i].size(), numDims);
+            features.release();
+            labelIds.release();
+            labelPieces.clear();
+            return 1;
+        }
+        std::copy(data[i].begin(), data[i].end(), features.ptr<float>(static_cast<int>(i)));
+        labelIds.ptr<int>(static_cast<int>(i))[0] = labels[i];
+    }
+
+    return 0;
+}
+
+/**
+ * Loads the labeled features from a binary feature file, using float32 rows straight from the mapping.
+ * @param filename  the name of the binary feature file
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int FeatureIndex::loadBinary(const std::string &filename) {
+    std::shared_ptr<MappedFeatureFile> file = std::make_shared<MappedFeatureFile>();
+    if (file->open(filename) != 0) {
+        return 1;
+    }
+
+    // the file's label table is only read here, so classifying never touches the label strings
+    for (const std::string &labelName : file->getLabelNames()) {
+        labelPieces.push_back(getPieceFromLabel(labelName));
+    }
+    labelIds = file->getLabelIds();
+    for (int i = 0; i < labelIds.rows; i++) {
+        if (labelIds.ptr<int>(i)[0] < 0 || labelIds.ptr<int>(i)[0] >= static_cast<int>(labelPieces.size())) {
+            printf("Row %d of %s has an unknown label id\n", i, filename.c_str());
+            features.release();
+            labelIds.release();
+            labelPieces.clear();
+            return 1;
+        }
+    }
+
+    cv::Mat values = file->getValues();
+    if (values.depth() == CV_16F) {
+        // half floats are half the size on disk, but the kernel works on float32, so these are converted once
+        values.convertTo(features, CV_32F);
+        labelIds = labelIds.clone();
+    }
+    else {
+        features = values;
+        mappedFile = file;
+    }
+
+    return 0;
+}
+
+/**
+ * @returns the number of labeled histograms in the index
+*/
+int FeatureIndex::size() const {
+    return features.rows;
+}
+
+/**
+ * @returns the number of values in each histogram
+*/
+int FeatureIndex::dims() const {
+    return features.cols;
+}
+
+/**
+ * @returns the histograms, one per row, as a CV_32F cv::Mat (with padded rows if it came from a binary file)
+*/
+const cv::Mat &FeatureIndex::getFeatures() const {
+    return features;
+}
+
+/**
+ * @param row   int for the index of the histogram
+ *
+ * @returns a pointer to the dims() values of the histogram
+*/
+const float *FeatureIndex::getRow(int row) const {
+    return features.ptr<float>(row);
+}
+
+/**
+ * @param row   int for the index of the histogram
+ *
+ * @returns the compact label id of the histogram
+*/
+int FeatureIndex::getLabelId(int row) const {
+    return labelIds.ptr<int>(row)[0];
+}
+
+/**
+ * @param row   int for the index of the histogram
+ *
+ * @returns the piece of the histogram's label, PIECE_UNKNOWN if the label isn't a piece
+*/
+Piece FeatureIndex::getLabel(int row) const {
+    return labelPieces[getLabelId(row)];
+}
+
+/**
+ * @returns the piece of each label id in the index
+*/
+const std::vector<Piece> &FeatureIndex::getLabelPieces() const {
+    return labelPieces;
+}
+
+/**
+ * Scores the query against a set of histograms with histogram intersection.
+ * @param query         pointer to the numDims floats of the query histogram
+ * @param numRows       int for the number of histograms
+ * @param numDims       int for the number of floats in each histogram
+ * @param rowAt         function from the index of each histogram (0 to numRows - 1) to a pointer to its floats
+ * @param distances     pointer to the resulting numRows histogram intersection differences
+*/
+template <typename RowAt>
+void computeIntersectionDistances(const float *query, int numRows, int numDims, RowAt rowAt, float *distances) {
+    int row = 0;
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    // four rows at a time, so each chunk of the query is loaded once for all of them
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    for (; row <= numRows - 4; row += 4) {
+        const float *r0 = rowAt(row), *r1 = rowAt(row + 1), *r2 = rowAt(row + 2), *r3 = rowAt(row + 3);
+        cv::v_float32 s0 = cv::vx_setzero_f32(), s1 = cv::vx_setzero_f32();
+        cv::v_float32 s2 = cv::vx_setzero_f32(), s3 = cv::vx_setzero_f32();
+
+        int i = 0;
+        for (; i <= numDims - lanes; i += lanes) {
+            cv::v_float32 q = cv::vx_load(query + i);
+            s0 = cv::v_add(s0, cv::v_min(q, cv::vx_load(r0 + i)));
+            s1 = cv::v_add(s1, cv::v_min(q, cv::vx_load(r1 + i)));
+            s2 = cv::v_add(s2, cv::v_min(q, cv::vx_load(r2 + i)));
+            s3 = cv::v_add(s3, cv::v_min(q, cv::vx_load(r3 + i)));
+        }
+
+        float i0 = cv::v_reduce_sum(s0), i1 = cv::v_reduce_sum(s1), i2 = cv::v_reduce_sum(s2), i3 = cv::v_reduce_sum(s3);
+        for (; i < numDims; i++) {
+            i0 += std::min(query[i], r0[i]);
+            i1 += std::min(query[i], r1[i]);
+            i2 += std::min(query[i], r2[i]);
+            i3 += std::min(query[i], r3[i]);
+        }
+
+        distances[row] = 1.0f - i0;
+        distances[row + 1] = 1.0f - i1;
+        distances[row + 2] = 1.0f - i2;
+        distances[row + 3] = 1.0f - i3;
+    }
+#endif
+
+    for (; row < numRows; row++) {
+        distances[row] = histogramIntersectionDifference(query, rowAt(row), numDims);
+    }
+}
+
+/**
+ * Keeps the k closest matches, closest first. Ties keep the earlier row, like the original nearest neighbour loop.
+ * @param matches   vector of the FeatureMatch's, which is left with the k closest
+ * @param k         int for the number of matches to keep
+*/
+void keepClosestMatches(std::vector<FeatureMatch> &matches, int k) {
+    auto closer = [](const FeatureMatch &a, const FeatureMatch &b) {
+        return a.distance < b.distance || (a.distance == b.distance && a.row < b.row);
+    };
+    k = std::max(0, std::min(k, static_cast<int>(matches.size())));
+    std::partial_sort(matches.begin(), matches.begin() + k, matches.end(), closer);
+    matches.resize(k);
+}
+
+/**
+ * Scores the query against every histogram in the index in one call.
+ * @param query         pointer to the dims() floats of the query histogram
+ * @param distances     the resulting histogram intersection difference for each row
+*/
+void FeatureIndex::computeDistances(const float *query, std::vector<float> &distances) const {
+    distances.resize(size());
+    computeIntersectionDistances(query, size(), dims(), [this](int row) { return getRow(row); }, distances.data());
+}
+
+/**
+ * Finds the k histograms in the index closest to the query.
+ * @param query     pointer to the dims() floats of the query histogram
+ * @param k         int for the number of matches to find
+ * @param matches   the resulting matches, closest first
+*/
+void FeatureIndex::queryTopK(const float *query, int k, std::vector<FeatureMatch> &matches) const {
+    std::vector<float> distances;
+    computeDistances(query, distances);
+
+    matches.clear();
+    for (int row = 0; row < static_cast<int>(distances.size()); row++) {
+        matches.push_back(FeatureMatch{row, distances[row]});
+    }
+    keepClosestMatches(matches, k);
+}
+
+/**
+ * Classifies the query by a vote of its k nearest neighbours, so k=1 is the plain nearest neighbour.
+ *   Ties in the vote go to the label whose matches are closest in total.
+ * @param query     pointer to the dims() floats of the query histogram
+ * @param k         int for the number of neighbours that vote
+ *
+ * @returns the winning Piece, or PIECE_UNKNOWN if the index is empty
+*/
+Piece FeatureIndex::classifyKNN(const float *query, int k) const {
+    std::vector<FeatureMatch> matches;
+    queryTopK(query, k, matches);
+    return voteMatches(matches);
+}
+
+/**
+ * Votes on the label of the matches, closest first, the same way as classifyKNN.
+ * @param matches   vector of the FeatureMatch's that vote
+ *
+ * @returns the winning Piece, or PIECE_UNKNOWN if there are no matches
+*/
+Piece FeatureIndex::voteMatches(const std::vector<FeatureMatch> &matches) const {
+    if (matches.empty()) {
+        return PIECE_UNKNOWN;
+    }
+
+    std::vector<int> votes(labelPieces.size(), 0);
+    std::vector<float> totalDistance(labelPieces.size(), 0.0f);
+    for (const FeatureMatch &match : matches) {
+        votes[getLabelId(match.row)]++;
+        totalDistance[getLabelId(match.row)] += match.distance;
+    }
+
+    int best = getLabelId(matches[0].row);
+    for (int labelId = 0; labelId < static_cast<int>(votes.size()); labelId++) {
+        if (votes[labelId] > votes[best] || (votes[labelId] == votes[best] && totalDistance[labelId] < totalDistance[best])) {
+            best = labelId;
+        }
+    }
+
+    return labelPieces[best];
+}
+
+/**
+ * Clusters the histograms of each label into prototypes with k-means, so a query can rule out most labels by
+ *   scoring a few prototypes instead of every histogram. A label with fewer histograms keeps them all as prototypes.
+ *   The clustering is seeded, so the same feature file always gives the same prototypes.
+ * @param prototypesPerLabel    int for the number of prototypes of each label, 0 to remove them
+ * @param searchedLabels        int for the number of labels with the closest prototypes that are searched exactly
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int FeatureIndex::buildPrototypes(int prototypesPerLabel, int searchedLabels) {
+    ScopedTimer timer("buildPrototypes");
+    prototypes.release();
+    prototypeLabelIds.clear();
+    labelRows.assign(labelPieces.size(), std::vector<int>());
+    this->searchedLabels = std::max(1, searchedLabels);
+    if (prototypesPerLabel <= 0 || size() == 0) {
+        return 0;
+    }
+
+    for (int row = 0; row < size(); row++) {
+        labelRows[getLabelId(row)].push_back(row);
+    }
+
+    // k-means draws its starting centers from the thread's generator, which is put back afterwards
+    cv::RNG savedRng = cv::theRNG();
+    cv::theRNG() = cv::RNG(PROTOTYPE_SEED);
+
+    for (int labelId = 0; labelId < static_cast<int>(labelRows.size()); labelId++) {
+        const std::vector<int> &rows = labelRows[labelId];
+        if (rows.empty()) {
+            continue;
+        }
+
+        // kmeans wants the label's histograms as the continuous rows of one matrix
+        cv::Mat samples(static_cast<int>(rows.size()), dims(), CV_32F);
+        for (size_t i = 0; i < rows.size(); i++) {
+            std::copy(getRow(rows[i]), getRow(rows[i]) + dims(), samples.ptr<float>(static_cast<int>(i)));
+        }
+
+        int numPrototypes = std::min(prototypesPerLabel, samples.rows);
+        cv::Mat centers;
+        if (numPrototypes == samples.rows) {
+            centers = samples;
+        }
+        else {
+            cv::Mat assignments;
+            cv::kmeans(samples, numPrototypes, assignments,
+                       cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 20, 1e-4), 3, cv::KMEANS_PP_CENTERS, centers);
+        }
+
+        prototypes.push_back(centers);
+        prototypeLabelIds.insert(prototypeLabelIds.end(), centers.rows, labelId);
+    }
+
+    cv::theRNG() = savedRng;
+    logPrintf(LOG_DEBUG, "Built %d prototypes for the %d histograms of %zu labels\n", prototypes.rows, size(), labelRows.size());
+
+    return 0;
+}
+
+/**
+ * @returns the number of prototypes, 0 if they haven't been built
+*/
+int FeatureIndex::getNumPrototypes() const {
+    return prototypes.rows;
+}
+
+/**
+ * Classifies the query like classifyKNN, but only searches the histograms of the searchedLabels labels whose
+ *   prototypes are closest to it. Without prototypes it searches every histogram.
+ * @param query             pointer to the dims() floats of the query histogram
+ * @param k                 int for the number of neighbours that vote
+ * @param numComparisons    int for the resulting number of histograms and prototypes the query was scored against
+ *
+ * @returns the winning Piece, or PIECE_UNKNOWN if the index is empty
+*/
+Piece FeatureIndex::classify(const float *query, int k, int &numComparisons) const {
+    if (prototypes.empty()) {
+        numComparisons = size();
+        return classifyKNN(query, k);
+    }
+
+    // each label is as close as its closest prototype
+    std::vector<float> prototypeDistances(prototypes.rows);
+    computeIntersectionDistances(query, prototypes.rows, dims(), [this](int i) { return prototypes.ptr<float>(i); },
+                                 prototypeDistances.data());
+    std::vector<float> labelDistances(labelPieces.size(), FLT_MAX);
+    for (int i = 0; i < prototypes.rows; i++) {
+        labelDistances[prototypeLabelIds[i]] = std::min(labelDistances[prototypeLabelIds[i]], prototypeDistances[i]);
+    }
+
+    std::vector<int> labelOrder(labelPieces.size());
+    std::iota(labelOrder.begin(), labelOrder.end(), 0);
+    int numSearched = std::min(searchedLabels, static_cast<int>(labelOrder.size()));
+    std::partial_sort(labelOrder.begin(), labelOrder.begin() + numSearched, labelOrder.end(),
+                      [&](int a, int b) { return labelDistances[a] < labelDistances[b]; });
+
+    // the rows are searched in order, so ties keep the earlier row like the exhaustive search
+    std::vector<int> candidates;
+    for (int i = 0; i < numSearched; i++) {
+        candidates.insert(candidates.end(), labelRows[labelOrder[i]].begin(), labelRows[labelOrder[i]].end());
+    }
+    std::sort(candidates.begin(), candidates.end());
+    numComparisons = prototypes.rows + static_cast<int>(candidates.size());
+
+    // the same kernel as the exhaustive search, over only the candidate rows
+    std::vector<float> distances(candidates.size());
+    computeIntersectionDistances(query, static_cast<int>(candidates.size()), dims(),
+                                 [&](int i) { return getRow(candidates[i]); }, distances.data());
+    std::vector<FeatureMatch> matches;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        matches.push_back(FeatureMatch{candidates[i], distances[i]});
+    }
+    keepClosestMatches(matches, k);
+
+    return voteMatches(matches);
+}
+
+/**
+ * Gets the process-wide feature index for light or dark squares, loading it on first use.
+ * @param isDarkSquare  bool for if the index for dark squares (true) or light squares (false) is wanted
+ *
+ * @returns a reference to the shared FeatureIndex
+*/
+const FeatureIndex &getFeatureIndex(bool isDarkSquare) {
+    // function statics are only initialized once, even with several threads asking at the same time
+    static FeatureIndex lightIndex = []() {
+        FeatureIndex index;
+        index.load(isFeatureFile(FEATURE_LIGHT_FILE_PATH) ? FEATURE_LIGHT_FILE_PATH : CSV_LIGHT_FILE_PATH);
+        index.buildPrototypes(featureIndexOptions.prototypesPerLabel, featureIndexOptions.searchedLabels);
+        return index;
+    }();
+    static FeatureIndex darkIndex = []() {
+        FeatureIndex index;
+        index.load(isFeatureFile(FEATURE_DARK_FILE_PATH) ? FEATURE_DARK_FILE_PATH : CSV_DARK_FILE_PATH);
+        index.buildPrototypes(featureIndexOptions.prototypesPerLabel, featureIndexOptions.searchedLabels);
+        return index;
+    }();
+
+    return isDarkSquare ? darkIndex : lightIndex;
+}
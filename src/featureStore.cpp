@@ -0,0 +1,543 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the binary feature file, a compact and memory-mappable replacement for the feature csv files.
+*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "featureStore.hpp"
+#include "csv_util.h"
+
+
+/**
+ * Fills in a new header with no rows or labels.
+ * @param header    the FeatureFileHeader to fill in
+ * @param numBins   int for the number of bins for each side of the histograms
+ * @param dataType  FeatureDataType the values are stored as
+*/
+void initFeatureFileHeader(FeatureFileHeader &header, int numBins, FeatureDataType dataType) {
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, FEATURE_FILE_MAGIC, sizeof(header.magic));
+    header.version = FEATURE_FILE_VERSION;
+    header.dataType = dataType;
+    header.numBins = numBins;
+    header.dims = numBins * numBins;
+    header.dataOffset = FEATURE_FILE_DATA_OFFSET;
+
+    // label id, reserved bytes and values, rounded up to keep every row 16 byte aligned
+    size_t valueSize = dataType == FEATURE_FLOAT16 ? 2 : 4;
+    header.recordSize = static_cast<uint32_t>((16 + header.dims * valueSize + 15) / 16 * 16);
+}
+
+/**
+ * Checks that a header read from a file is one we can use.
+ * @param header    the FeatureFileHeader to check
+ *
+ * @returns true if the header is valid
+*/
+bool isValidFeatureFileHeader(const FeatureFileHeader &header) {
+    size_t valueSize = header.dataType == FEATURE_FLOAT16 ? 2 : 4;
+
+    return std::memcmp(header.magic, FEATURE_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+           header.version == FEATURE_FILE_VERSION &&
+           (header.dataType == FEATURE_FLOAT32 || header.dataType == FEATURE_FLOAT16) &&
+           header.dims == header.numBins * header.numBins &&
+           header.recordSize >= 16 + header.dims * valueSize &&
+           header.dataOffset >= sizeof(FeatureFileHeader) &&
+           header.numLabels <= FEATURE_FILE_MAX_LABELS;
+}
+
+/**
+ * Finds the id of the label in the header's label table, adding it if it isn't there yet.
+ * @param header    the FeatureFileHeader with the label table
+ * @param label     string for the label
+ *
+ * @returns the label id, or -1 if the label is too long or the table is full
+*/
+int findOrAddFeatureLabel(FeatureFileHeader &header, const std::string &label) {
+    for (uint32_t i = 0; i < header.numLabels; i++) {
+        if (label == header.labelNames[i]) {
+            return static_cast<int>(i);
+        }
+    }
+
+    if (label.size() >= sizeof(header.labelNames[0]) || header.numLabels >= FEATURE_FILE_MAX_LABELS) {
+        printf("Unable to add label %s to the feature file's label table\n", label.c_str());
+        return -1;
+    }
+
+    std::strcpy(header.labelNames[header.numLabels], label.c_str());
+    return static_cast<int>(header.numLabels++);
+}
+
+/**
+ * Packs one labeled row into the on-disk record layout.
+ * @param header    the FeatureFileHeader of the file the record is for
+ * @param labelId   int for the label id of the row
+ * @param features  vector of floats for the features of the row (header.dims of them)
+ * @param record    the resulting bytes of the record
+*/
+void packFeatureRecord(const FeatureFileHeader &header, int labelId, const std::vector<float> &features, std::vector<uchar> &record) {
+    record.assign(header.recordSize, 0);
+    uint32_t id = static_cast<uint32_t>(labelId);
+    std::memcpy(record.data(), &id, sizeof(id));
+
+    cv::Mat values(1, static_cast<int>(header.dims), CV_32FC1, const_cast<float *>(features.data()));
+    if (header.dataType == FEATURE_FLOAT16) {
+        cv::Mat halfValues(1, static_cast<int>(header.dims), CV_16F, record.data() + 16);
+        values.convertTo(halfValues, CV_16F);
+    }
+    else {
+        std::memcpy(record.data() + 16, features.data(), header.dims * sizeof(float));
+    }
+}
+
+
+MappedFeatureFile::MappedFeatureFile() : mapping(nullptr), mappingSize(0) {
+    std::memset(&header, 0, sizeof(header));
+}
+
+MappedFeatureFile::~MappedFeatureFile() {
+    close();
+}
+
+/**
+ * Maps the given binary feature file, closing anything already mapped.
+ * @param filename  the name of the binary feature file
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int MappedFeatureFile::open(const std::string &filename) {
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("Unable to open feature file %s\n", filename.c_str());
+        return 1;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) < sizeof(FeatureFileHeader)) {
+        printf("Feature file %s is too small\n", filename.c_str());
+        ::close(fd);
+        return 1;
+    }
+
+    mappingSize = static_cast<size_t>(fileStat.st_size);
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive on its own
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("Unable to map feature file %s\n", filename.c_str());
+        mapping = nullptr;
+        mappingSize = 0;
+        return 1;
+    }
+
+    std::memcpy(&header, mapping, sizeof(header));
+    if (!isValidFeatureFileHeader(header) || header.dataOffset + header.numRows * header.recordSize > mappingSize) {
+        printf("Feature file %s has an invalid header\n", filename.c_str());
+        close();
+        return 1;
+    }
+
+    // the rows are scanned front to back, so let the kernel read ahead
+    madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+
+    return 0;
+}
+
+/**
+ * Unmaps the file. Any cv::Mat returned by getValues or getLabelIds is invalid afterwards.
+*/
+void MappedFeatureFile::close() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+    mapping = nullptr;
+    mappingSize = 0;
+    std::memset(&header, 0, sizeof(header));
+}
+
+/**
+ * @returns true if a file is currently mapped
+*/
+bool MappedFeatureFile::isOpen() const {
+    return mapping != nullptr;
+}
+
+/**
+ * @returns the header of the mapped file
+*/
+const FeatureFileHeader &MappedFeatureFile::getHeader() const {
+    return header;
+}
+
+/**
+ * @returns the labels in the file's label table, indexed by label id
+*/
+std::vector<std::string> MappedFeatureFile::getLabelNames() const {
+    std::vector<std::string> labelNames;
+    for (uint32_t i = 0; i < header.numLabels; i++) {
+        labelNames.push_back(std::string(header.labelNames[i], strnlen(header.labelNames[i], sizeof(header.labelNames[i]))));
+    }
+
+    return labelNames;
+}
+
+/**
+ * @returns a cv::Mat of the feature values (CV_32F or CV_16F) that points into the mapping, one row per record
+*/
+cv::Mat MappedFeatureFile::getValues() const {
+    if (!mapping || header.numRows == 0) {
+        return cv::Mat();
+    }
+
+    uchar *rows = static_cast<uchar *>(mapping) + header.dataOffset;
+    int type = header.dataType == FEATURE_FLOAT16 ? CV_16F : CV_32FC1;
+
+    return cv::Mat(static_cast<int>(header.numRows), static_cast<int>(header.dims), type, rows + 16, header.recordSize);
+}
+
+/**
+ * @returns a CV_32S column cv::Mat of the label ids that points into the mapping, one row per record
+*/
+cv::Mat MappedFeatureFile::getLabelIds() const {
+    if (!mapping || header.numRows == 0) {
+        return cv::Mat();
+    }
+
+    uchar *rows = static_cast<uchar *>(mapping) + header.dataOffset;
+
+    return cv::Mat(static_cast<int>(header.numRows), 1, CV_32SC1, rows, header.recordSize);
+}
+
+
+/**
+ * Checks if the file at the given path starts with the binary feature file magic.
+ * @param filename  the name of the file
+ *
+ * @returns true if the file is a binary feature file
+*/
+bool isFeatureFile(const std::string &filename) {
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+
+    char magic[sizeof(FEATURE_FILE_MAGIC)];
+    bool matches = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && std::memcmp(magic, FEATURE_FILE_MAGIC, sizeof(magic)) == 0;
+    fclose(fp);
+
+    return matches;
+}
+
+/**
+ * Writes a whole binary feature file, replacing the file if it already exists.
+ * @param filename  the name of the binary feature file
+ * @param labels    vector of the piece of each row, stored in the label table by its label such as "wp"
+ * @param data      2D vector of floats for the features of each row
+ * @param numBins   int for the number of bins for each side of the histograms
+ * @param dataType  FeatureDataType the values are stored as
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int writeFeatureFile(const std::string &filename, const std::vector<Piece> &labels,
+                     const std::vector<std::vector<float>> &data, int numBins, FeatureDataType dataType) {
+    if (labels.size() != data.size()) {
+        printf("Got %zu labels for %zu rows of features\n", labels.size(), data.size());
+        return 1;
+    }
+
+    FeatureFileHeader header;
+    initFeatureFileHeader(header, numBins, dataType);
+
+    // fill in the label table first, so the header only has to be written once
+    std::vector<int> labelIds;
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i].size() != header.dims) {
+            printf("Row %zu has %zu features instead of %u\n", i, data[i].size(), header.dims);
+            return 1;
+        }
+
+        int labelId = findOrAddFeatureLabel(header, PIECE_LABELS[labels[i]]);
+        if (labelId < 0) {
+            return 1;
+        }
+        labelIds.push_back(labelId);
+    }
+    header.numRows = data.size();
+
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        printf("Unable to open output file %s\n", filename.c_str());
+        return 1;
+    }
+
+    std::vector<uchar> padding(header.dataOffset - sizeof(header), 0);
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(padding.data(), 1, padding.size(), fp) == padding.size();
+
+    std::vector<uchar> record;
+    for (size_t i = 0; ok && i < data.size(); i++) {
+        packFeatureRecord(header, labelIds[i], data[i], record);
+        ok = fwrite(record.data(), 1, record.size(), fp) == record.size();
+    }
+
+    if (fclose(fp) != 0 || !ok) {
+        printf("Unable to write feature file %s\n", filename.c_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Appends one labeled row to a binary feature file, creating a float32 file if it doesn't exist yet.
+ * @param filename  the name of the binary feature file
+ * @param label     Piece of the row
+ * @param features  vector of floats for the features of the row
+ * @param numBins   int for the number of bins for each side of the histogram
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int appendFeatureRecord(const std::string &filename, Piece label, const std::vector<float> &features, int numBins) {
+    return appendFeatureRecords(filename, {label}, {features}, numBins);
+}
+
+/**
+ * Appends labeled rows to a binary feature file in one pass, creating a float32 file if it doesn't exist yet.
+ *   The header is only rewritten once, after every row has been written.
+ * @param filename  the name of the binary feature file
+ * @param labels    vector of the piece of each row
+ * @param data      2D vector of floats for the features of each row
+ * @param numBins   int for the number of bins for each side of the histograms
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int appendFeatureRecords(const std::string &filename, const std::vector<Piece> &labels,
+                         const std::vector<std::vector<float>> &data, int numBins) {
+    if (labels.size() != data.size()) {
+        printf("Got %zu labels for %zu rows of features\n", labels.size(), data.size());
+        return 1;
+    }
+    if (data.empty()) {
+        return 0;
+    }
+
+    FILE *fp = fopen(filename.c_str(), "r+b");
+    if (!fp) {
+        return writeFeatureFile(filename, labels, data, numBins);
+    }
+
+    FeatureFileHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || !isValidFeatureFileHeader(header) ||
+        header.numBins != static_cast<uint32_t>(numBins)) {
+        printf("Feature file %s doesn't match the features being appended\n", filename.c_str());
+        fclose(fp);
+        return 1;
+    }
+
+    // the records go after the last row first, then the header is updated to count them
+    long recordOffset = static_cast<long>(header.dataOffset + header.numRows * header.recordSize);
+    bool ok = fseek(fp, recordOffset, SEEK_SET) == 0;
+
+    std::vector<uchar> record;
+    size_t numWritten = 0;
+    for (size_t i = 0; ok && i < data.size(); i++) {
+        int labelId = data[i].size() == header.dims ? findOrAddFeatureLabel(header, PIECE_LABELS[labels[i]]) : -1;
+        if (labelId < 0) {
+            printf("Row %zu doesn't match the features of %s\n", i, filename.c_str());
+            ok = false;
+            break;
+        }
+        packFeatureRecord(header, labelId, data[i], record);
+        ok = fwrite(record.data(), 1, record.size(), fp) == record.size();
+        numWritten += ok ? 1 : 0;
+    }
+
+    // the rows written before a failure are still counted, so the file stays consistent
+    header.numRows += numWritten;
+    bool headerOk = fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    if (fclose(fp) != 0 || !ok || !headerOk) {
+        printf("Unable to append to feature file %s\n", filename.c_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Appends a labeled row to a buffer in the format of the feature csv files, such as "p,w,0.0123,...". The values are
+ *   written with 4 decimals like append_image_data_csv, without going through printf for each one.
+ * @param buffer    string the row is appended to, with its newline
+ * @param label     Piece of the row
+ * @param features  vector of floats for the features of the row
+*/
+void appendFeatureCsvRow(std::string &buffer, Piece label, const std::vector<float> &features) {
+    // the csv files have the type of the piece first, then its colour
+    buffer += getPieceType(label);
+    buffer += ',';
+    buffer += PIECE_LABELS[label][0];
+
+    char digits[24];
+    for (float value : features) {
+        long long scaled = std::llround(static_cast<double>(value) * 10000.0);
+        buffer += ',';
+        if (scaled < 0) {
+            buffer += '-';
+            scaled = -scaled;
+        }
+
+        // whole part, then exactly 4 decimals
+        long long whole = scaled / 10000;
+        int length = 0;
+        do {
+            digits[length++] = static_cast<char>('0' + whole % 10);
+            whole /= 10;
+        } while (whole > 0);
+        while (length > 0) {
+            buffer += digits[--length];
+        }
+
+        int fraction = static_cast<int>(scaled % 10000);
+        buffer += '.';
+        buffer += static_cast<char>('0' + fraction / 1000);
+        buffer += static_cast<char>('0' + fraction / 100 % 10);
+        buffer += static_cast<char>('0' + fraction / 10 % 10);
+        buffer += static_cast<char>('0' + fraction % 10);
+    }
+    buffer += '\n';
+}
+
+/**
+ * Creates the writer. The binary feature file is only kept in step if it already exists, like addLabelFeatures.
+ * @param csvFilename   the name of the feature csv file, appended to
+ * @param binFilename   the name of the binary feature file, appended to if it exists
+ * @param numBins       int for the number of bins for each side of the histograms
+ * @param bufferRows    size_t for the number of rows held before they are written
+*/
+FeatureWriter::FeatureWriter(const std::string &csvFilename, const std::string &binFilename, int numBins, size_t bufferRows)
+    : csvFilename(csvFilename), binFilename(binFilename), numBins(numBins), bufferRows(bufferRows > 0 ? bufferRows : 1),
+      writeBinary(!binFilename.empty() && isFeatureFile(binFilename)), numRows(0) {}
+
+/**
+ * Writes the rows that are still buffered.
+*/
+FeatureWriter::~FeatureWriter() {
+    flush();
+}
+
+/**
+ * Adds a labeled row, writing the buffer out if it is full.
+ * @param label     Piece of the row
+ * @param features  vector of floats for the features of the row
+ *
+ * @returns 0 if the function returns successfully, non-zero if the buffer couldn't be written
+*/
+int FeatureWriter::add(Piece label, const std::vector<float> &features) {
+    // formatted before taking the lock, so the threads only wait on each other for the copy
+    std::string row;
+    appendFeatureCsvRow(row, label, features);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    csvBuffer += row;
+    if (writeBinary) {
+        bufferedLabels.push_back(label);
+        bufferedData.push_back(features);
+    }
+    numRows++;
+
+    return numRows % bufferRows == 0 ? flushBuffered() : 0;
+}
+
+/**
+ * Writes out every buffered row.
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int FeatureWriter::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return flushBuffered();
+}
+
+/**
+ * @returns the number of rows added so far
+*/
+size_t FeatureWriter::getNumRows() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return numRows;
+}
+
+/**
+ * Writes the buffered rows to the csv file, and the binary feature file if it is kept. Must be called with the mutex held.
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int FeatureWriter::flushBuffered() {
+    int ret = 0;
+    if (!csvBuffer.empty()) {
+        FILE *fp = fopen(csvFilename.c_str(), "a");
+        if (!fp) {
+            printf("Unable to open output file %s\n", csvFilename.c_str());
+            return 1;
+        }
+        bool ok = fwrite(csvBuffer.data(), 1, csvBuffer.size(), fp) == csvBuffer.size();
+        if (fclose(fp) != 0 || !ok) {
+            printf("Unable to write feature file %s\n", csvFilename.c_str());
+            ret = 1;
+        }
+        csvBuffer.clear();
+    }
+
+    if (!bufferedData.empty()) {
+        ret |= appendFeatureRecords(binFilename, bufferedLabels, bufferedData, numBins);
+        bufferedLabels.clear();
+        bufferedData.clear();
+    }
+
+    return ret;
+}
+
+/**
+ * Converts a feature csv file to a binary feature file.
+ * @param csvFilename   the name of the feature csv file
+ * @param binFilename   the name of the binary feature file to write
+ * @param dataType      FeatureDataType the values are stored as
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int convertFeatureFile(const std::string &csvFilename, const std::string &binFilename, FeatureDataType dataType) {
+    std::vector<Piece> labels;
+    std::vector<std::vector<float>> data;
+    if (read_image_data_csv(csvFilename.c_str(), labels, data, 0) != 0) {
+        return 1;
+    }
+    if (data.empty()) {
+        printf("No features in %s\n", csvFilename.c_str());
+        return 1;
+    }
+
+    // the csv doesn't store the bin count, but the histograms are always square
+    int numBins = static_cast<int>(std::lround(std::sqrt(static_cast<double>(data[0].size()))));
+    if (numBins * numBins != static_cast<int>(data[0].size())) {
+        printf("%s has %zu features per row, which isn't a square histogram\n", csvFilename.c_str(), data[0].size());
+        return 1;
+    }
+
+    if (writeFeatureFile(binFilename, labels, data, numBins, dataType) != 0) {
+        return 1;
+    }
+    printf("Converted %zu rows from %s to %s\n", data.size(), csvFilename.c_str(), binFilename.c_str());
+
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of labeling the board incrementally, only re-classifying the squares that changed between frames.
+*/
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "incrementalLabeler.hpp"
+#include "pieceDetectionOps.hpp"
+#include "featureIndex.hpp"
+
+
+/**
+ * Creates a labeler with no board yet, so the first update classifies every square.
+ * @param changeThreshold   float for the mean absolute difference (0-255) above which a square has changed
+ * @param useNN             bool for if the neural network should be used instead of the histograms
+ * @param tileSize          cv::Size of the grayscale tiles kept for each square
+*/
+IncrementalLabeler::IncrementalLabeler(float changeThreshold, bool useNN, cv::Size tileSize)
+    : changeThreshold(changeThreshold), useNN(useNN), tileSize(tileSize), initialized(false) {}
+
+/**
+ * Forgets the previous board, so the next update classifies every square again.
+*/
+void IncrementalLabeler::reset() {
+    initialized = false;
+}
+
+/**
+ * @returns the change score of each square from the last update
+*/
+const std::vector<float> &IncrementalLabeler::getChangeScores() const {
+    return changeScores;
+}
+
+/**
+ * @returns the indices of the squares that were classified in the last update
+*/
+const std::vector<int> &IncrementalLabeler::getChangedSquares() const {
+    return changedSquares;
+}
+
+/**
+ * Makes the small grayscale tile used to check if a square changed.
+ * @param frame     cv::Mat of the frame
+ * @param rect      cv::Rect of the square in the frame
+ * @param tileSize  cv::Size of the tile
+ *
+ * @returns the grayscale tile
+*/
+cv::Mat getChangeTile(const cv::Mat &frame, const cv::Rect &rect, cv::Size tileSize) {
+    cv::Mat small, gray;
+    cv::resize(frame(rect), small, tileSize, 0, 0, cv::INTER_AREA);
+    cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+    return gray;
+}
+
+/**
+ * Computes the mean absolute difference between two tiles.
+ * @param t1    cv::Mat for the first tile
+ * @param t2    cv::Mat for the second tile
+ *
+ * @returns the mean absolute difference, from 0 to 255
+*/
+float getTileDifference(const cv::Mat &t1, const cv::Mat &t2) {
+    cv::Mat diff;
+    cv::absdiff(t1, t2, diff);
+    return static_cast<float>(cv::mean(diff)[0]);
+}
+
+/**
+ * Updates the labels for the new frame, re-classifying only the squares that changed.
+ * @param frame         cv::Mat of the current frame
+ * @param rectangles    vector of the 64 cv::Rect's for the squares of the board in the frame
+ * @param squareLabels  the resulting Board of labels for each square
+ * @param move          the resulting move, if the changed squares amount to a move
+ *
+ * @returns the number of squares that were classified, or -1 if the rectangles aren't a full board
+*/
+int IncrementalLabeler::update(const cv::Mat &frame, const std::vector<cv::Rect> &rectangles, Board &squareLabels,
+                               BoardMove &move) {
+    move = BoardMove();
+    changedSquares.clear();
+    if (rectangles.size() != 64) {
+        return -1;
+    }
+
+    // a camera frame isn't a scaled down photo, so the scale of the empty square threshold comes from its squares
+    float imageScale = getSquareImageScale(rectangles);
+    std::vector<cv::Mat> tiles;
+    for (const cv::Rect &rect : rectangles) {
+        tiles.push_back(getChangeTile(frame, rect, tileSize));
+    }
+
+    // the first frame has nothing to compare against, so every square is classified
+    if (!initialized) {
+        labels = Board();
+        changeScores.assign(64, 0.0f);
+        for (int i = 0; i < 64; i++) {
+            changedSquares.push_back(i);
+        }
+        classifySquares(frame, rectangles, changedSquares, imageScale);
+
+        referenceTiles = tiles;
+        previousTiles = tiles;
+        labelsBeforeMove = labels;
+        initialized = true;
+        squareLabels = labels;
+        return 64;
+    }
+
+    for (int i = 0; i < 64; i++) {
+        changeScores[i] = getTileDifference(tiles[i], referenceTiles[i]);
+        // only classify a changed square once it has settled, so hands and half-moved pieces are ignored
+        bool settled = getTileDifference(tiles[i], previousTiles[i]) < 0.5 * changeThreshold;
+        if (changeScores[i] > changeThreshold && settled) {
+            changedSquares.push_back(i);
+        }
+    }
+    previousTiles = tiles;
+
+    if (!changedSquares.empty()) {
+        classifySquares(frame, rectangles, changedSquares, imageScale);
+        for (int index : changedSquares) {
+            referenceTiles[index] = tiles[index];
+        }
+        // compare against the board from the last move, since the squares of a move can settle on different frames
+        move = inferMove(labelsBeforeMove, labels);
+        if (move.isValid()) {
+            labelsBeforeMove = labels;
+        }
+    }
+
+    squareLabels = labels;
+    return static_cast<int>(changedSquares.size());
+}
+
+/**
+ * Classifies the given squares of the frame, storing the results in the labels.
+ * @param frame         cv::Mat of the current frame
+ * @param rectangles    vector of the 64 cv::Rect's for the squares of the board in the frame
+ * @param indices       vector of the indices of the squares to classify
+ * @param imageScale    float for the size of the squares relative to the full resolution photos, passed to isEmptySpace
+ *
+ * @returns 0 if the function returns successfully
+*/
+int IncrementalLabeler::classifySquares(const cv::Mat &frame, const std::vector<cv::Rect> &rectangles, const std::vector<int> &indices,
+                                        float imageScale) {
+    cv::Mat image = frame;
+    std::vector<cv::Mat> occupiedSquares;
+    std::vector<int> occupiedIndices;
+
+    for (int index : indices) {
+        cv::Rect currentRect = rectangles[index];
+        bool isDarkSquare = isDarkSquareIndex(index);
+
+        if (isEmptySpace(image, currentRect, isDarkSquare, imageScale)) {
+            labels[index] = PIECE_EMPTY;
+        }
+        else if (useNN) {
+            occupiedSquares.push_back(image(currentRect));
+            occupiedIndices.push_back(index);
+        }
+        else {
+            labels[index] = computeHistogramDiffs(image, currentRect, getFeatureIndex(isDarkSquare));
+        }
+    }
+
+    // the changed squares for the neural network are classified together in one batch
+    if (!occupiedSquares.empty()) {
+        std::vector<Piece> nnLabels;
+        std::vector<float> nnConfidences;
+        if (getPieceClassifier().classify(occupiedSquares, nnLabels, nnConfidences) != 0) {
+            return 1;
+        }
+        for (size_t i = 0; i < occupiedIndices.size(); i++) {
+            labels[occupiedIndices[i]] = nnLabels[i];
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Infers the move that was played from the labels of the board before and after it.
+ *   Handles normal moves, captures, promotions, castling (the king's move is returned) and en passant.
+ * @param before    Board of the labels before the move
+ * @param after     Board of the labels after the move
+ *
+ * @returns the inferred BoardMove, which is not valid if the changes don't make up a single move
+*/
+BoardMove inferMove(const Board &before, const Board &after) {
+    BoardMove move;
+
+    // squares a piece left, and squares a piece (possibly capturing) arrived on. No move changes more than two of
+    // either, so anything past that is only counted
+    int vacated[2], arrived[2];
+    int numVacated = 0, numArrived = 0;
+    for (int i = 0; i < 64; i++) {
+        if (before[i] != PIECE_EMPTY && after[i] == PIECE_EMPTY) {
+            if (numVacated < 2) {
+                vacated[numVacated] = i;
+            }
+            numVacated++;
+        }
+        else if (after[i] != PIECE_EMPTY && after[i] != before[i]) {
+            if (numArrived < 2) {
+                arrived[numArrived] = i;
+            }
+            numArrived++;
+        }
+    }
+
+    // a normal move, capture or promotion
+    if (numVacated == 1 && numArrived == 1) {
+        move.from = vacated[0];
+        move.to = arrived[0];
+    }
+    // en passant, where the captured pawn also leaves its square
+    else if (numVacated == 2 && numArrived == 1) {
+        for (int index : vacated) {
+            if (before[index] == after[arrived[0]]) {
+                move.from = index;
+                move.to = arrived[0];
+            }
+        }
+    }
+    // castling, which is written as the king's move
+    else if (numVacated == 2 && numArrived == 2) {
+        for (int from : vacated) {
+            for (int to : arrived) {
+                if (getPieceType(before[from]) == 'k' && after[to] == before[from]) {
+                    move.from = from;
+                    move.to = to;
+                }
+            }
+        }
+    }
+
+    return move;
+}
@@ -0,0 +1,256 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the instrumentation: a log level for the debug prints, and scoped timers and counters for each
+  stage that are collected into a per-run report.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+
+#include "instrumentation.hpp"
+
+
+// the debug prints are off unless asked for
+std::atomic<int> logLevel(LOG_INFO);
+
+/**
+ * Sets how much is printed.
+ * @param level     LogLevel for the most detailed messages that are printed
+*/
+void setLogLevel(LogLevel level) {
+    logLevel = level;
+}
+
+/**
+ * Parses a log level from its name.
+ * @param name      string for the level, "error", "warning", "info" or "debug"
+ * @param level     the resulting LogLevel
+ *
+ * @returns 0 if the name was valid, non-zero otherwise
+*/
+int parseLogLevel(const std::string &name, LogLevel &level) {
+    const std::map<std::string, LogLevel> levels = {
+        {"error", LOG_ERROR}, {"warning", LOG_WARNING}, {"info", LOG_INFO}, {"debug", LOG_DEBUG}};
+
+    auto found = levels.find(name);
+    if (found == levels.end()) {
+        return 1;
+    }
+    level = found->second;
+    return 0;
+}
+
+/**
+ * @returns true if messages at the level are printed, to skip building them otherwise
+*/
+bool isLogEnabled(LogLevel level) {
+    return level <= logLevel.load(std::memory_order_relaxed);
+}
+
+/**
+ * Prints a message the same way as printf, if the log level allows it.
+ * @param level     LogLevel of the message
+ * @param format    printf format string
+*/
+void logPrintf(LogLevel level, const char *format, ...) {
+    if (!isLogEnabled(level)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+}
+
+
+/**
+ * Everything recorded in the run, shared by every thread.
+*/
+struct RunMetricsStore {
+    std::mutex mutex;
+    RunMetrics metrics;
+};
+
+/**
+ * @returns the process-wide store of the run's metrics
+*/
+RunMetricsStore &getRunMetricsStore() {
+    static RunMetricsStore store;
+    return store;
+}
+
+// innermost capture on each thread, with the rest linked through previous
+thread_local MetricsCapture *currentCapture = nullptr;
+
+/**
+ * Adds one run of a stage to its stats.
+ * @param stats     TimerStats to update
+ * @param ms        double for the milliseconds it took
+*/
+void addTimerRun(TimerStats &stats, double ms) {
+    stats.calls++;
+    stats.totalMs += ms;
+    stats.maxMs = std::max(stats.maxMs, ms);
+}
+
+/**
+ * Records one run of a stage.
+ * @param name      string for the stage
+ * @param ms        double for the milliseconds it took
+*/
+void recordTimer(const std::string &name, double ms) {
+    for (MetricsCapture *capture = currentCapture; capture; capture = capture->previous) {
+        addTimerRun(capture->metrics.timers[name], ms);
+    }
+
+    RunMetricsStore &store = getRunMetricsStore();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    addTimerRun(store.metrics.timers[name], ms);
+}
+
+/**
+ * Adds to a counter, such as the number of hough segments found.
+ * @param name      string for the counter
+ * @param amount    uint64_t to add to it
+*/
+void addCounter(const std::string &name, uint64_t amount) {
+    for (MetricsCapture *capture = currentCapture; capture; capture = capture->previous) {
+        capture->metrics.counters[name] += amount;
+    }
+
+    RunMetricsStore &store = getRunMetricsStore();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    store.metrics.counters[name] += amount;
+}
+
+/**
+ * @returns a copy of everything recorded so far in the run
+*/
+RunMetrics getRunMetrics() {
+    RunMetricsStore &store = getRunMetricsStore();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    return store.metrics;
+}
+
+/**
+ * Converts the metrics to JSON, with "timers" holding calls, total_ms, mean_ms and max_ms for each stage and
+ *   "counters" holding each count.
+ * @param metrics   RunMetrics to convert
+ *
+ * @returns the JSON object
+*/
+nlohmann::json getMetricsJson(const RunMetrics &metrics) {
+    nlohmann::json json;
+    json["timers"] = nlohmann::json::object();
+    json["counters"] = metrics.counters;
+
+    for (const auto &timer : metrics.timers) {
+        const TimerStats &stats = timer.second;
+        json["timers"][timer.first] = {
+            {"calls", stats.calls},
+            {"total_ms", stats.totalMs},
+            {"mean_ms", stats.calls > 0 ? stats.totalMs / stats.calls : 0.0},
+            {"max_ms", stats.maxMs}};
+    }
+
+    return json;
+}
+
+/**
+ * Writes the run's metrics to a report, as CSV if the path ends in ".csv" and as JSON otherwise.
+ * @param reportPath    string for the path of the report
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int writeRunReport(const std::string &reportPath) {
+    std::ofstream report(reportPath);
+    if (!report) {
+        printf("Unable to open report file %s\n", reportPath.c_str());
+        return 1;
+    }
+
+    RunMetrics metrics = getRunMetrics();
+    bool isCsv = reportPath.size() >= 4 && reportPath.compare(reportPath.size() - 4, 4, ".csv") == 0;
+
+    if (!isCsv) {
+        report << getMetricsJson(metrics).dump(2) << "\n";
+    }
+    else {
+        // one row per timer and counter, with the timer columns left empty for counters
+        report << "type,name,calls,total_ms,mean_ms,max_ms,value\n";
+        for (const auto &timer : metrics.timers) {
+            const TimerStats &stats = timer.second;
+            report << "timer," << timer.first << "," << stats.calls << "," << stats.totalMs << ","
+                   << (stats.calls > 0 ? stats.totalMs / stats.calls : 0.0) << "," << stats.maxMs << ",\n";
+        }
+        for (const auto &counter : metrics.counters) {
+            report << "counter," << counter.first << ",,,,," << counter.second << "\n";
+        }
+    }
+
+    return report ? 0 : 1;
+}
+
+// report written when the program exits, if one was asked for
+std::string runReportPath;
+
+/**
+ * Writes the run report, registered with atexit.
+*/
+void writeRunReportAtExit() {
+    if (!runReportPath.empty() && writeRunReport(runReportPath) == 0) {
+        printf("Wrote the run report to %s\n", runReportPath.c_str());
+    }
+}
+
+/**
+ * Sets the report to write with writeRunReport when the program exits.
+ * @param reportPath    string for the path of the report
+*/
+void setRunReportPath(const std::string &reportPath) {
+    // the store has to exist before the handler is registered, so it is only destroyed after the report is written
+    getRunMetricsStore();
+    if (runReportPath.empty()) {
+        std::atexit(writeRunReportAtExit);
+    }
+    runReportPath = reportPath;
+}
+
+
+/**
+ * Starts the timer.
+ * @param name      string for the stage being timed, which should outlive the timer (such as a literal)
+*/
+ScopedTimer::ScopedTimer(const char *name) : name(name), start(std::chrono::steady_clock::now()) {}
+
+/**
+ * Records the time since the timer started.
+*/
+ScopedTimer::~ScopedTimer() {
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    recordTimer(name, elapsed.count());
+}
+
+
+MetricsCapture::MetricsCapture() : previous(currentCapture) {
+    currentCapture = this;
+}
+
+MetricsCapture::~MetricsCapture() {
+    currentCapture = previous;
+}
+
+/**
+ * @returns what has been recorded on this thread since the capture started
+*/
+const RunMetrics &MetricsCapture::getMetrics() const {
+    return metrics;
+}
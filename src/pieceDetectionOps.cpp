@@ -4,6 +4,8 @@
    Implementation of the code for detecting pieces on the chess board squares.
 */
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <numeric>
 #include <unordered_set>
@@ -16,39 +18,186 @@
 
 #include "pieceDetectionOps.hpp"
 #include "csv_util.h"
+#include "instrumentation.hpp"
 
 
 /**
- * Check to see if the chessboard square specified is empty or not.
- * @param image         cv::Mat representing the image of the chessboard
- * @param currentRect   cv::Rect representing the area of the square in the image
- * @param isDarkSquare  bool representing if the square is a dark square (true) or a light square (false)
+ * Checks if the square at the given index is a dark square, with index 0 being the top left (light) square.
+ * @param squareIndex   int for the index of the square, in the same order as the rectangles
  * 
- * @returns true if the space is identified to be empty, false otherwise
+ * @returns true if the square is a dark square, false if it is a light square
 */
-bool isEmptySpace(cv::Mat &image, cv::Rect &currentRect, bool isDarkSquare) {
-    float startX = currentRect.width * 0.2;
-    float endX = currentRect.width * 0.8;
-    float startY = currentRect.height * 0.2;
-    float endY = currentRect.height * 0.8;
+bool isDarkSquareIndex(int squareIndex) {
+    return ((squareIndex / 8) + (squareIndex % 8)) % 2 == 1;
+}
 
-    cv::Mat square = image(currentRect);
-    cv::Mat temp;
+// thresholds for the empty squares, set from the command line
+OccupancyThresholds occupancyThresholds;
 
-    cv::cvtColor(square, temp, cv::COLOR_BGR2GRAY);
-    //cv::GaussianBlur(temp, temp, cv::Size(5, 5), 0);
+/**
+ * Sets the thresholds the empty squares are found with.
+ * @param thresholds    OccupancyThresholds for the light and dark squares
+*/
+void setOccupancyThresholds(const OccupancyThresholds &thresholds) {
+    occupancyThresholds = thresholds;
+}
 
-    // Applies Canny
-    cv::Canny(temp, temp, 10, 250);
-    cv::Mat regionToCheck = temp(cv::Rect(cv::Point2f(startX, startY), cv::Point2f(endX, endY)));
+/**
+ * @returns the thresholds the empty squares are found with
+*/
+const OccupancyThresholds &getOccupancyThresholds() {
+    return occupancyThresholds;
+}
 
-    double cannySum = cv::sum(regionToCheck)[0];
-    // printf("Canny sum: %f    isDark: %d\n", cannySum, isDarkSquare);
-    // printf("Result: %d\n", (isDarkSquare ? (cannySum < 7000) : (cannySum < 60000)));
+/**
+ * Computes the occupancy score of each square, the sum of the Canny edges in the inner 60% of the square.
+ *   The grayscale conversion and Canny are done once over the part of the image the squares cover, and every
+ *   square's sum is then read from a single integral image. With the transparent API on, the cv::UMat version runs instead.
+ * @param image         cv::Mat representing the image of the chessboard
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ * @param scores        the resulting score of each square, in the same order as the rectangles
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int computeOccupancyScores(const cv::Mat &image, const std::vector<cv::Rect> &rectangles, std::vector<double> &scores) {
+    if (getUseTransparentApi()) {
+        return computeOccupancyScores(image.getUMat(cv::ACCESS_READ), rectangles, scores);
+    }
+
+    ScopedTimer timer("computeOccupancyScores");
+    addCounter("occupancySquares", rectangles.size());
+    scores.assign(rectangles.size(), 0.0);
+    if (rectangles.empty()) {
+        return 0;
+    }
+
+    cv::Rect bounds = rectangles[0];
+    for (const cv::Rect &rect : rectangles) {
+        bounds |= rect;
+    }
+    bounds &= cv::Rect(0, 0, image.cols, image.rows);
+    if (bounds.empty()) {
+        return 1;
+    }
+
+    cv::Mat gray, edges, edgeCounts;
+    cv::cvtColor(image(bounds), gray, cv::COLOR_BGR2GRAY);
+    cv::Canny(gray, edges, 10, 250);
+    // the edges are 0 or 255, so they are counted as 0 or 1 to keep the integral in 32 bits for any image size
+    edges /= 255;
+    cv::integral(edges, edgeCounts, CV_32S);
+
+    for (size_t i = 0; i < rectangles.size(); i++) {
+        cv::Rect rect = rectangles[i] - bounds.tl();
+        cv::Rect inner(cv::Point(rect.x + cvRound(rect.width * 0.2), rect.y + cvRound(rect.height * 0.2)),
+                       cv::Point(rect.x + cvRound(rect.width * 0.8), rect.y + cvRound(rect.height * 0.8)));
+        inner &= cv::Rect(0, 0, edges.cols, edges.rows);
+        if (inner.empty()) {
+            continue;
+        }
 
+        int count = edgeCounts.at<int>(inner.br().y, inner.br().x) - edgeCounts.at<int>(inner.y, inner.br().x)
+                  - edgeCounts.at<int>(inner.br().y, inner.x) + edgeCounts.at<int>(inner.y, inner.x);
+        // kept in the same units as summing the Canny image, which the thresholds were tuned with
+        scores[i] = count * 255.0;
+    }
+
+    return 0;
+}
 
-    return cannySum < 7000;
+/**
+ * Computes the occupancy score of each square on a cv::UMat, so the grayscale conversion and Canny can run on an OpenCL
+ *   device. Each square's edges are counted on the device too, so only the 64 sums are downloaded.
+ * @param image         cv::UMat representing the image of the chessboard
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ * @param scores        the resulting score of each square, in the same order as the rectangles
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int computeOccupancyScores(const cv::UMat &image, const std::vector<cv::Rect> &rectangles, std::vector<double> &scores) {
+    ScopedTimer timer("computeOccupancyScores");
+    addCounter("occupancySquares", rectangles.size());
+    scores.assign(rectangles.size(), 0.0);
+    if (rectangles.empty()) {
+        return 0;
+    }
+
+    cv::Rect bounds = rectangles[0];
+    for (const cv::Rect &rect : rectangles) {
+        bounds |= rect;
+    }
+    bounds &= cv::Rect(0, 0, image.cols, image.rows);
+    if (bounds.empty()) {
+        return 1;
+    }
+
+    cv::UMat gray, edges;
+    cv::cvtColor(image(bounds), gray, cv::COLOR_BGR2GRAY);
+    cv::Canny(gray, edges, 10, 250);
+
+    for (size_t i = 0; i < rectangles.size(); i++) {
+        cv::Rect rect = rectangles[i] - bounds.tl();
+        cv::Rect inner(cv::Point(rect.x + cvRound(rect.width * 0.2), rect.y + cvRound(rect.height * 0.2)),
+                       cv::Point(rect.x + cvRound(rect.width * 0.8), rect.y + cvRound(rect.height * 0.8)));
+        inner &= cv::Rect(0, 0, edges.cols, edges.rows);
+        if (inner.empty()) {
+            continue;
+        }
+
+        // the edges are 0 or 255, so counting them gives the same score as the integral image
+        scores[i] = cv::countNonZero(edges(inner)) * 255.0;
+    }
+
+    return 0;
+}
+
+/**
+ * Checks if a square's occupancy score is low enough for it to be empty.
+ * @param score         double for the score of the square from computeOccupancyScores
+ * @param isDarkSquare  bool representing if the square is a dark square (true) or a light square (false)
+ * @param imageScale    float for the size of the image relative to the full resolution photos the thresholds were tuned on
+ *
+ * @returns true if the space is identified to be empty, false otherwise
+*/
+bool isEmptyOccupancyScore(double score, bool isDarkSquare, float imageScale) {
+    const OccupancyThresholds &thresholds = getOccupancyThresholds();
+    // the edges are thin curves, so their sum grows with the side of the square rather than its area
+    return score < (isDarkSquare ? thresholds.dark : thresholds.light) * imageScale;
+}
+
+/**
+ * Gets the scale of the squares relative to the full resolution photos the thresholds were tuned on, from their mean
+ *   width. For images that aren't a scaled down full resolution photo, such as the frames of a camera.
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ *
+ * @returns the scale to pass to isEmptyOccupancyScore, or 1 if there are no rectangles
+*/
+float getSquareImageScale(const std::vector<cv::Rect> &rectangles) {
+    if (rectangles.empty()) {
+        return 1.0f;
+    }
+    int widthSum = 0;
+    for (const cv::Rect &rect : rectangles) {
+        widthSum += rect.width;
+    }
+    return static_cast<float>(widthSum) / rectangles.size() / FULL_RESOLUTION_SQUARE_SIZE;
+}
+
+/**
+ * Check to see if the chessboard square specified is empty or not.
+ *   To check every square of a board, computeOccupancyScores does the filtering once instead of once per square.
+ * @param image         cv::Mat representing the image of the chessboard
+ * @param currentRect   cv::Rect representing the area of the square in the image
+ * @param isDarkSquare  bool representing if the square is a dark square (true) or a light square (false)
+ * @param imageScale    float for the size of the image relative to the full resolution photos the threshold was tuned on
+ * 
+ * @returns true if the space is identified to be empty, false otherwise
+*/
+bool isEmptySpace(cv::Mat &image, cv::Rect &currentRect, bool isDarkSquare, float imageScale) {
+    std::vector<double> scores;
+    computeOccupancyScores(image, {currentRect}, scores);
 
+    return isEmptyOccupancyScore(scores[0], isDarkSquare, imageScale);
 }
 
 /**
@@ -80,14 +229,14 @@ bool isEmptySpace2(cv::Mat &image, cv::Rect &currentRect, bool isDarkSquare) {
     float emptyDifference;
     if (isDarkSquare) {
         emptyDifference = SSD(squareMean, emptyDarkSpacesMean);
-        printf("Dark\n");
-        printf("Empty, black, white: %f   %f   %f\n", emptyDifference, SSD(squareMean, blackPiecesDarkMean), SSD(squareMean, whitePiecesDarkMean));
+        logPrintf(LOG_DEBUG, "Dark\n");
+        logPrintf(LOG_DEBUG, "Empty, black, white: %f   %f   %f\n", emptyDifference, SSD(squareMean, blackPiecesDarkMean), SSD(squareMean, whitePiecesDarkMean));
         isCloserToEmpty = emptyDifference < SSD(squareMean, blackPiecesDarkMean) && emptyDifference < SSD(squareMean, whitePiecesDarkMean);
     }
     else {
         emptyDifference = SSD(squareMean, emptyLightSpacesMean);
-        printf("Light\n");
-        printf("Empty, black, white: %f   %f   %f\n", emptyDifference, SSD(squareMean, blackPiecesLightMean), SSD(squareMean, whitePiecesLightMean));
+        logPrintf(LOG_DEBUG, "Light\n");
+        logPrintf(LOG_DEBUG, "Empty, black, white: %f   %f   %f\n", emptyDifference, SSD(squareMean, blackPiecesLightMean), SSD(squareMean, whitePiecesLightMean));
         isCloserToEmpty = emptyDifference < SSD(squareMean, blackPiecesLightMean) && emptyDifference < SSD(squareMean, whitePiecesLightMean);
     }
 
@@ -98,155 +247,453 @@ bool isEmptySpace2(cv::Mat &image, cv::Rect &currentRect, bool isDarkSquare) {
 
 
 
+// names of the classifier backends, and the cv::dnn backend and target each one runs on
+const struct {
+    ClassifierBackend backend;
+    const char *name;
+    int dnnBackend;
+    int dnnTarget;
+} CLASSIFIER_BACKENDS[] = {
+    {CLASSIFIER_BACKEND_CPU, "cpu", cv::dnn::DNN_BACKEND_OPENCV, cv::dnn::DNN_TARGET_CPU},
+    {CLASSIFIER_BACKEND_OPENCL, "opencl", cv::dnn::DNN_BACKEND_OPENCV, cv::dnn::DNN_TARGET_OPENCL},
+    {CLASSIFIER_BACKEND_OPENCL_FP16, "opencl-fp16", cv::dnn::DNN_BACKEND_OPENCV, cv::dnn::DNN_TARGET_OPENCL_FP16},
+    {CLASSIFIER_BACKEND_CUDA, "cuda", cv::dnn::DNN_BACKEND_CUDA, cv::dnn::DNN_TARGET_CUDA},
+    {CLASSIFIER_BACKEND_CUDA_FP16, "cuda-fp16", cv::dnn::DNN_BACKEND_CUDA, cv::dnn::DNN_TARGET_CUDA_FP16},
+    {CLASSIFIER_BACKEND_OPENVINO, "openvino", cv::dnn::DNN_BACKEND_INFERENCE_ENGINE, cv::dnn::DNN_TARGET_CPU}};
+
+// ImageNet mean and std of each RGB channel, which train_chess_nn.py normalizes the squares with
+const float CLASSIFIER_MEAN[3] = {0.485f, 0.456f, 0.406f};
+const float CLASSIFIER_STD[3] = {0.229f, 0.224f, 0.225f};
+
 /**
- * Uses the neural network to get the predicted piece label for the location.
- * @param image         cv::Mat representing the image of the chessboard
- * @param currentRect   cv::Rect representing the square of interest
+ * Parses a classifier backend name: cpu, opencl, opencl-fp16, cuda, cuda-fp16 or openvino.
+ * @param name      string for the name of the backend
+ * @param backend   the resulting ClassifierBackend
+ *
+ * @returns 0 if the name is a backend, non-zero otherwise
+*/
+int parseClassifierBackend(const std::string &name, ClassifierBackend &backend) {
+    for (const auto &entry : CLASSIFIER_BACKENDS) {
+        if (name == entry.name) {
+            backend = entry.backend;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @returns the name of the backend, as parseClassifierBackend takes it
+*/
+const char *getClassifierBackendName(ClassifierBackend backend) {
+    return CLASSIFIER_BACKENDS[backend].name;
+}
+
+/**
+ * Parses the input size of a classifier, either one number for a square input such as "128" or "WIDTHxHEIGHT".
+ * @param text      string for the size
+ * @param size      the resulting cv::Size
+ *
+ * @returns 0 if the text is a positive size, non-zero otherwise
+*/
+int parseClassifierInputSize(const std::string &text, cv::Size &size) {
+    int width = 0, height = 0;
+    char extra = 0;
+    int numRead = std::sscanf(text.c_str(), "%dx%d%c", &width, &height, &extra);
+    if (numRead == 1 && text.find('x') == std::string::npos) {
+        height = width;
+    }
+    else if (numRead != 2) {
+        return 1;
+    }
+    if (width <= 0 || height <= 0) {
+        return 1;
+    }
+    size = cv::Size(width, height);
+    return 0;
+}
+
+// options of the process-wide classifier, set from the command line
+ClassifierOptions classifierOptions;
+
+/**
+ * Sets the model and backend of the process-wide piece classifier. Must be called before its first use.
+ * @param options   ClassifierOptions for the classifier
+*/
+void setClassifierOptions(const ClassifierOptions &options) {
+    classifierOptions = options;
+}
+
+/**
+ * @returns the options of the process-wide piece classifier
+*/
+const ClassifierOptions &getClassifierOptions() {
+    return classifierOptions;
+}
+
+/**
+ * Loads the network from the model file of the options and moves it to their backend, falling back to the CPU
+ *   if the backend isn't available in this build of OpenCV.
+ * @param options   ClassifierOptions for the model, its input and backend
+*/
+PieceClassifier::PieceClassifier(const ClassifierOptions &options)
+    : inputSize(options.inputSize), backend(CLASSIFIER_BACKEND_CPU), normalize(options.normalize), loaded(false) {
+    try {
+        net = cv::dnn::readNetFromONNX(options.modelPath);
+        loaded = !net.empty();
+    }
+    catch (const cv::Exception &e) {
+        logPrintf(LOG_ERROR, "Unable to load piece classifier %s: %s\n", options.modelPath.c_str(), e.what());
+    }
+    if (!loaded) {
+        return;
+    }
+
+    // only backends this build of OpenCV was compiled with can be used
+    const auto &requested = CLASSIFIER_BACKENDS[options.backend];
+    bool available = false;
+    for (const auto &pair : cv::dnn::getAvailableBackends()) {
+        available = available || (pair.first == requested.dnnBackend && pair.second == requested.dnnTarget);
+    }
+    if (!available) {
+        logPrintf(LOG_WARNING, "The %s backend isn't available, classifying pieces on the CPU\n", requested.name);
+        return;
+    }
+    net.setPreferableBackend(requested.dnnBackend);
+    net.setPreferableTarget(requested.dnnTarget);
+    backend = options.backend;
+
+    // the backend compiles the network on the first forward pass, so that is done now, and any failure falls back to the CPU
+    try {
+        net.setInput(getInputBlob({cv::Mat(inputSize, CV_8UC3, cv::Scalar(0, 0, 0))}));
+        net.forward();
+    }
+    catch (const cv::Exception &e) {
+        logPrintf(LOG_WARNING, "The %s backend failed (%s), classifying pieces on the CPU\n", requested.name, e.what());
+        net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+        net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+        backend = CLASSIFIER_BACKEND_CPU;
+    }
+    logPrintf(LOG_DEBUG, "Piece classifier %s on %s at %dx%d\n", options.modelPath.c_str(), getClassifierBackendName(backend),
+              inputSize.width, inputSize.height);
+}
+
+/**
+ * @returns true if the network was loaded successfully
+*/
+bool PieceClassifier::isLoaded() const {
+    return loaded;
+}
+
+/**
+ * @returns the backend the network runs on, which is the CPU if the requested one wasn't available
+*/
+ClassifierBackend PieceClassifier::getBackend() const {
+    return backend;
+}
+
+/**
+ * Makes one NCHW blob of the squares, already resized to the input size, normalized if the options asked for it.
+ * @param squares   vector of cv::Mat's of the BGR squares at the input size
+ *
+ * @returns the blob of RGB float values
+*/
+cv::Mat PieceClassifier::getInputBlob(const std::vector<cv::Mat> &squares) const {
+    cv::Mat blob = cv::dnn::blobFromImages(squares, 1.0, inputSize, cv::Scalar(0, 0, 0), true, false);
+    if (!normalize) {
+        return blob;
+    }
+
+    // (value / 255 - mean) / std of each channel's plane, in place
+    size_t planeSize = static_cast<size_t>(inputSize.width) * inputSize.height;
+    float *data = blob.ptr<float>();
+    for (size_t i = 0; i < squares.size(); i++) {
+        for (int c = 0; c < 3; c++) {
+            float *plane = data + (i * 3 + c) * planeSize;
+            float scale = 1.0f / (255.0f * CLASSIFIER_STD[c]);
+            float offset = -CLASSIFIER_MEAN[c] / CLASSIFIER_STD[c];
+            for (size_t j = 0; j < planeSize; j++) {
+                plane[j] = plane[j] * scale + offset;
+            }
+        }
+    }
+    return blob;
+}
+
+/**
+ * Classifies each of the given square images with one forward pass of the network.
+ * @param squares       vector of cv::Mat's of the square images to classify
+ * @param labels        the resulting vector of pieces, one for each square
+ * @param confidences   the resulting vector of softmax confidences for each label
  * 
- * @returns a std::string containing the piece prediction
+ * @returns 0 if the function returns successfully, non-zero otherwise
 */
-std::string getNNPieceLabel(cv::Mat &image, cv::Rect &currentRect) {
-    cv::Size dnnImageSize(224, 224);
-    cv::Mat square = image(currentRect);
-    cv::Mat input = cv::dnn::blobFromImage(square, 1.0, cv::Size(224, 224), cv::Scalar(0, 0, 0), true, false);
+int PieceClassifier::classify(const std::vector<cv::Mat> &squares, std::vector<Piece> &labels, std::vector<float> &confidences) {
+    labels.clear();
+    confidences.clear();
+    if (!loaded) {
+        return 1;
+    }
+    if (squares.empty()) {
+        return 0;
+    }
+    ScopedTimer timer("PieceClassifier::classify");
+    addCounter("nnClassifiedSquares", squares.size());
+
+    // the squares are resized to the network's input in parallel (the same linear resize blobFromImages would do),
+    //   since the forward pass itself can only run one at a time on the shared net
+    std::vector<cv::Mat> resizedSquares(squares.size());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(squares.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            cv::resize(squares[i], resizedSquares[i], inputSize, 0, 0, cv::INTER_LINEAR);
+        }
+    });
+
+    // one NCHW blob holding every square
+    cv::Mat input = getInputBlob(resizedSquares);
+
+    cv::Mat output;
+    {
+        std::lock_guard<std::mutex> lock(netMutex);
+        try {
+            net.setInput(input);
+            // Forward pass to get output, one row of class scores per square
+            output = net.forward().clone();
+        }
+        catch (const cv::Exception &e) {
+            // models exported with a fixed batch size of 1 can't take the whole batch, so run them one at a time
+            logPrintf(LOG_WARNING, "Batched forward pass failed, classifying squares individually\n");
+            output.release();
+            for (const cv::Mat &square : resizedSquares) {
+                net.setInput(getInputBlob({square}));
+                output.push_back(net.forward().reshape(1, 1));
+            }
+        }
+    }
+    output = output.reshape(1, static_cast<int>(squares.size()));
 
-    cv::dnn::Net net = cv::dnn::readNetFromONNX(PIECE_CLASSIFIER_FILE_PATH);
-    net.setInput(input);
+    for (int i = 0; i < output.rows; i++) {
+        const float *scores = output.ptr<float>(i);
 
-    // Forward pass to get output
-    cv::Mat output = net.forward();
+        // Find the index of the top prediction
+        int classId = 0;
+        for (int j = 1; j < output.cols; j++) {
+            if (scores[j] > scores[classId]) {
+                classId = j;
+            }
+        }
 
-    // Find the index of the top prediction
-    cv::Point classIdPoint;
-    double confidence;
-    cv::minMaxLoc(output.reshape(1, 1), nullptr, &confidence, nullptr, &classIdPoint);
-    int classId = classIdPoint.x;
+        // softmax of the top class so the confidence is comparable between squares
+        double expSum = 0.0;
+        for (int j = 0; j < output.cols; j++) {
+            expSum += std::exp(scores[j] - scores[classId]);
+        }
 
-    printf("class ID: %d\n", classId);
-    // Get the label corresponding to the predicted class
-    std::string label = PIECE_VALUES[classId];
-    printf("label name: %s\n", label.c_str());
-    // cv::imshow("square", square);
-    // cv::waitKey(0);
-    // cv::destroyWindow("square");
+        labels.push_back(CLASSIFIER_PIECES[classId]);
+        confidences.push_back(static_cast<float>(1.0 / expSum));
+    }
 
-    return label;
+    return 0;
+}
+
+/**
+ * Gets the process-wide piece classifier, loading it with the options from setClassifierOptions on first use.
+ * 
+ * @returns a reference to the shared PieceClassifier
+*/
+PieceClassifier &getPieceClassifier() {
+    static PieceClassifier classifier(classifierOptions);
+    return classifier;
+}
+
+
+/**
+ * Uses the neural network to get the predicted piece label for the location.
+ * @param image         cv::Mat representing the image of the chessboard
+ * @param currentRect   cv::Rect representing the square of interest
+ * 
+ * @returns the predicted Piece, or PIECE_UNKNOWN if the network couldn't classify it
+*/
+Piece getNNPieceLabel(const cv::Mat &image, const cv::Rect &currentRect) {
+    std::vector<cv::Mat> squares = { image(currentRect) };
+    std::vector<Piece> labels;
+    std::vector<float> confidences;
+
+    if (getPieceClassifier().classify(squares, labels, confidences) != 0 || labels.empty()) {
+        return PIECE_UNKNOWN;
+    }
+
+    return labels[0];
 }
 
 
 /**
  * Find the predicted piece labels for each square on the board.
- *   "ee" for empty, and "b" or "w" for black and white followed by the letter for the piece.
- * @param dst           cv::Mat represeting the image
+ *   Squares past the rectangles (or that couldn't be classified) are left as PIECE_UNKNOWN.
+ * @param src           cv::Mat represeting the image, which is only read
  * @param rectangles    vector of cv::Rect's representing each square on the chess board
- * @param squareLabels  the resulting vector of strings containing the labels for each square
- * @param showLabels    boolean representing if we want to show the labels on dst
+ * @param board         the resulting Board holding the piece on each square
+ * @param imageScale    float for the size of src relative to the full resolution photos, passed to isEmptyOccupancyScore
  * 
  * @returns 0 if the function returns successfully
 */
-int getPieceLabels(cv::Mat &dst, std::vector<cv::Rect> rectangles, std::vector<std::string> &squareLabels, bool showLabels) {
-    std::vector<std::string> lightLabels, darkLabels;
-    std::vector<std::vector<float>> lightData, darkData;
-    // read the relevant data
-    read_image_data_csv(CSV_LIGHT_FILE_PATH, lightLabels, lightData, 0);
-    read_image_data_csv(CSV_DARK_FILE_PATH, darkLabels, darkData, 0);
-    std::string currentLabel;
-    cv::Mat temp;
-
-    dst.copyTo(temp);
+int getPieceLabels(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board, float imageScale) {
+    std::vector<double> occupancyScores;
+    return getPieceLabels(src, rectangles, board, occupancyScores, imageScale);
+}
 
-    int current = 0;
-    bool isDarkSquare = false;
-    for (cv::Rect currentRect : rectangles) {
-        // see if we can easily determine if space is empty  
-        // printf("current: %d\n", current);
-        if (isEmptySpace(temp, currentRect, isDarkSquare)) {
-            // printf("Empty\n");
-            if (showLabels) {
-                cv::putText(dst, //target image
-                    "ee",
-                    cv::Point(currentRect.x + (0.25 * currentRect.width), currentRect.y + (0.6 * currentRect.height)),
-                    cv::FONT_HERSHEY_DUPLEX,
-                    3.0,
-                    CV_RGB(0, 255, 0), //font color
-                    4);
+/**
+ * Find the predicted piece labels for each square on the board.
+ *   Squares past the rectangles (or that couldn't be classified) are left as PIECE_UNKNOWN.
+ *   The occupancy scores the empty squares were found with are kept, so the thresholds can be calibrated from them.
+ *   The occupied squares are classified in parallel with cv::parallel_for_, so it follows cv::setNumThreads.
+ * @param src           cv::Mat represeting the image, which is only read
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ * @param board         the resulting Board holding the piece on each square
+ * @param occupancyScores   the resulting occupancy score of each square from computeOccupancyScores
+ * @param imageScale    float for the size of src relative to the full resolution photos, passed to isEmptyOccupancyScore
+ * 
+ * @returns 0 if the function returns successfully
+*/
+int getPieceLabels(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board,
+                   std::vector<double> &occupancyScores, float imageScale) {
+    ScopedTimer timer("getPieceLabels");
+    // the feature data is loaded once per process and shared
+    const FeatureIndex &lightIndex = getFeatureIndex(false);
+    const FeatureIndex &darkIndex = getFeatureIndex(true);
+
+    // the occupancy of every square comes from one pass over the board
+    computeOccupancyScores(src, rectangles, occupancyScores);
+
+    // the squares are classified in parallel, each writing only its own byte so the order never depends on the threads
+    int numSquares = std::min(static_cast<int>(rectangles.size()), 64);
+    board = Board(PIECE_UNKNOWN);
+    std::vector<int> comparisons(numSquares, 0);
+    cv::parallel_for_(cv::Range(0, numSquares), [&](const cv::Range &range) {
+        for (int current = range.start; current < range.end; current++) {
+            bool isDarkSquare = isDarkSquareIndex(current);
+            // see if we can easily determine if space is empty
+            if (isEmptyOccupancyScore(occupancyScores[current], isDarkSquare, imageScale)) {
+                board[current] = PIECE_EMPTY;
+            }
+            // otherwise, use histogram intersection to compare
+            else {
+                board[current] = computeHistogramDiffs(src, rectangles[current], isDarkSquare ? darkIndex : lightIndex, 16,
+                                                       HISTOGRAM_NEIGHBOURS, &comparisons[current]);
             }
-            squareLabels.push_back("ee");
-        }
-        // otherwise, use histogram intersection to compare
-        else {// if (false) {
-            currentLabel = isDarkSquare ? computeHistogramDiffs(dst, currentRect, darkLabels, darkData) : computeHistogramDiffs(dst, currentRect, lightLabels, lightData);
-            squareLabels.push_back(currentLabel);
-                if (showLabels) {
-                    cv::putText(dst, //target image
-                                currentLabel,
-                                cv::Point(currentRect.x + (0.25 * currentRect.width), currentRect.y + (0.6 * currentRect.height)),
-                                cv::FONT_HERSHEY_DUPLEX,
-                                3.0,
-                                CV_RGB(0, 255, 0), //font color
-                                4);
-                }
         }
-        // switch from dark to light unless starting at new row
-        if (current % 8 != 7) {
-            isDarkSquare = !isDarkSquare;
+    });
+
+    // counted here rather than in the parallel loop, so they are recorded on the calling thread
+    uint64_t numClassified = 0, numComparisons = 0;
+    for (int current = 0; current < numSquares; current++) {
+        bool isDarkSquare = isDarkSquareIndex(current);
+        if (!isEmptyOccupancyScore(occupancyScores[current], isDarkSquare, imageScale)) {
+            numClassified++;
+            numComparisons += comparisons[current];
         }
-        current++;
     }
+    addCounter("histogramClassifiedSquares", numClassified);
+    addCounter("nearestNeighbourComparisons", numComparisons);
 
     return 0;
 }
 
 /**
- * Find the predicted piece labels for each square on the board.
- *   "ee" for empty, and "b" or "w" for black and white followed by the letter for the piece.
- * @param dst           cv::Mat represeting the image
+ * Find the predicted piece labels for each square on the board using the neural network.
+ *   Squares past the rectangles are left as PIECE_UNKNOWN.
+ * @param src           cv::Mat represeting the image, which is only read
  * @param rectangles    vector of cv::Rect's representing each square on the chess board
- * @param squareLabels  the resulting vector of strings containing the labels for each square
- * @param showLabels    boolean representing if we want to show the labels on dst
+ * @param board         the resulting Board holding the piece on each square
  * 
  * @returns 0 if the function returns successfully
 */
-int getPieceLabelsNN(cv::Mat &dst, std::vector<cv::Rect> rectangles, std::vector<std::string> &squareLabels, bool showLabels) {
-    std::string currentLabel;
-    cv::Mat temp;
+int getPieceLabelsNN(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board) {
+    std::vector<float> squareConfidences;
+    return getPieceLabelsNN(src, rectangles, board, squareConfidences);
+}
 
-    dst.copyTo(temp);
+/**
+ * Find the predicted piece labels and their confidences for each square on the board using the neural network.
+ *   Every occupied square is classified together in one batched forward pass. Empty squares have a confidence of 1.
+ * @param src                   cv::Mat represeting the image, which is only read
+ * @param rectangles            vector of cv::Rect's representing each square on the chess board
+ * @param board                 the resulting Board holding the piece on each square
+ * @param squareConfidences     the resulting vector of floats containing the confidence of each label
+ * 
+ * @returns 0 if the function returns successfully
+*/
+int getPieceLabelsNN(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board,
+                     std::vector<float> &squareConfidences) {
+    std::vector<double> occupancyScores;
+    return getPieceLabelsNN(src, rectangles, board, squareConfidences, occupancyScores);
+}
 
-    bool isDarkSquare = false;
-    for (cv::Rect currentRect : rectangles) {
-        // see if we can easily determine if space is empty  
-        if (isEmptySpace(temp, currentRect, isDarkSquare)) {
-            if (showLabels) {
-                cv::putText(dst, //target image
-                    "ee",
+/**
+ * Find the predicted piece labels and their confidences for each square on the board using the neural network,
+ *   keeping the occupancy scores the empty squares were found with.
+ * @param src                   cv::Mat represeting the image, which is only read
+ * @param rectangles            vector of cv::Rect's representing each square on the chess board
+ * @param board                 the resulting Board holding the piece on each square
+ * @param squareConfidences     the resulting vector of floats containing the confidence of each label
+ * @param occupancyScores       the resulting occupancy score of each square from computeOccupancyScores
+ * @param imageScale            float for the size of src relative to the full resolution photos, passed to isEmptyOccupancyScore
+ * 
+ * @returns 0 if the function returns successfully
+*/
+int getPieceLabelsNN(const cv::Mat &src, const std::vector<cv::Rect> &rectangles, Board &board, std::vector<float> &squareConfidences,
+                     std::vector<double> &occupancyScores, float imageScale) {
+    ScopedTimer timer("getPieceLabelsNN");
+    size_t numSquares = std::min(rectangles.size(), static_cast<size_t>(64));
+    board = Board(PIECE_UNKNOWN);
+    std::fill(board.squares.begin(), board.squares.begin() + numSquares, PIECE_EMPTY);
+    squareConfidences.assign(numSquares, 1.0f);
+
+    // nothing is drawn on src, so the squares can be views of it rather than a copy
+    computeOccupancyScores(src, rectangles, occupancyScores);
+
+    // gather the occupied squares so they can all be classified together
+    std::vector<cv::Mat> occupiedSquares;
+    std::vector<int> occupiedIndices;
+    for (size_t current = 0; current < numSquares; current++) {
+        // see if we can easily determine if space is empty
+        if (!isEmptyOccupancyScore(occupancyScores[current], isDarkSquareIndex(static_cast<int>(current)), imageScale)) {
+            occupiedSquares.push_back(src(rectangles[current]));
+            occupiedIndices.push_back(static_cast<int>(current));
+        }
+    }
+
+    std::vector<Piece> occupiedLabels;
+    std::vector<float> occupiedConfidences;
+    if (getPieceClassifier().classify(occupiedSquares, occupiedLabels, occupiedConfidences) != 0) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < occupiedIndices.size(); i++) {
+        board[occupiedIndices[i]] = occupiedLabels[i];
+        squareConfidences[occupiedIndices[i]] = occupiedConfidences[i];
+    }
+
+    return 0;
+}
+
+/**
+ * Display the piece labels in each of the squares on the given destination image.
+ * @param dst           cv::Mat representing the destination image
+ * @param rectangles    vector of cv::Rect's representing each square on the chess board
+ * @param board         Board holding the piece on each square, drawn as labels such as "wp"
+*/
+void displayLabels(cv::Mat &dst, const std::vector<cv::Rect> &rectangles, const Board &board) {
+    for (size_t i = 0; i < rectangles.size() && i < 64; i++) {
+        const cv::Rect &currentRect = rectangles[i];
+        cv::putText(dst, //target image
+                    PIECE_LABELS[board[static_cast<int>(i)]],
                     cv::Point(currentRect.x + (0.25 * currentRect.width), currentRect.y + (0.6 * currentRect.height)),
                     cv::FONT_HERSHEY_DUPLEX,
                     3.0,
                     CV_RGB(0, 255, 0), //font color
                     4);
-            }
-            squareLabels.push_back("ee");
-        }
-        // otherwise, use histogram intersection to compare
-        else { //if (false) {
-            currentLabel = getNNPieceLabel(dst, currentRect);
-            squareLabels.push_back(currentLabel);
-                if (showLabels) {
-                    cv::putText(dst, //target image
-                                currentLabel,
-                                cv::Point(currentRect.x + (0.25 * currentRect.width), currentRect.y + (0.6 * currentRect.height)),
-                                cv::FONT_HERSHEY_DUPLEX,
-                                3.0,
-                                CV_RGB(0, 255, 0), //font color
-                                4);
-                }
-            }
-
-            isDarkSquare = !isDarkSquare;
     }
-
-    return 0;
 }
 
 
@@ -286,13 +733,13 @@ void convertMatToVec(cv::Mat &histogram, std::vector<float> &result) {
  * Computes the histogram differences between the image of the square and other square images and returns the best label
  * @param image         a cv::Mat storing the relevant image
  * @param currentRect   a cv::Rect for the rectangle of the square of interest on the board
- * @param labels        a vector of strings representing the labels of the existing data
+ * @param labels        a vector of the pieces of the existing data
  * @param featureData   a vector of vectors of histogram features from the existing data
  * @param nBins         an int that states how many bins the histograms will be split into
  * 
- * @returns a string representing the best label
+ * @returns the Piece of the best match, or PIECE_UNKNOWN if there is no data
 */
-std::string computeHistogramDiffs(cv::Mat &image, cv::Rect currentRect, std::vector<std::string> &labels, std::vector<std::vector<float>> featureData, int nBins) {
+Piece computeHistogramDiffs(const cv::Mat &image, cv::Rect currentRect, const std::vector<Piece> &labels, const std::vector<std::vector<float>> &featureData, int nBins) {
     cv::Mat square = image(currentRect);
 
     cv::Mat featuresMat = getHistogramFeature(square, nBins);
@@ -300,7 +747,7 @@ std::string computeHistogramDiffs(cv::Mat &image, cv::Rect currentRect, std::vec
     convertMatToVec(featuresMat, features);
     float bestDiff = FLT_MAX;
     float currentDiff;
-    std::string bestLabel = "";
+    Piece bestLabel = PIECE_UNKNOWN;
 
     //std::cout << "Calculating scores for histogram... " << std::endl;
     for (int i = 0; i < labels.size(); i++) {
@@ -309,7 +756,7 @@ std::string computeHistogramDiffs(cv::Mat &image, cv::Rect currentRect, std::vec
         if (currentDiff < bestDiff) {
             bestDiff = currentDiff;
             bestLabel = labels[i];
-            //printf("Current Diff and label: %s  %f    %d\n", bestLabel.c_str(), bestDiff, i);
+            //printf("Current Diff and label: %s  %f    %d\n", PIECE_LABELS[bestLabel], bestDiff, i);
 
         }
     }
@@ -322,6 +769,36 @@ std::string computeHistogramDiffs(cv::Mat &image, cv::Rect currentRect, std::vec
 }
 
 
+/**
+ * Computes the histogram differences between the image of the square and the histograms in the feature index and returns the best label
+ * @param image         a cv::Mat storing the relevant image
+ * @param currentRect   a cv::Rect for the rectangle of the square of interest on the board
+ * @param index         a FeatureIndex holding the labeled histograms to compare against
+ * @param nBins         an int that states how many bins the histograms will be split into
+ * @param k             an int for how many nearest neighbours vote on the label
+ * @param numComparisons    the resulting number of histograms the square was scored against, if not null
+ * 
+ * @returns the Piece of the best label, or PIECE_UNKNOWN if the index has no matching features
+*/
+Piece computeHistogramDiffs(const cv::Mat &image, cv::Rect currentRect, const FeatureIndex &index, int nBins, int k,
+                            int *numComparisons) {
+    cv::Mat square = image(currentRect);
+
+    cv::Mat featuresMat = getHistogramFeature(square, nBins);
+    if (index.size() == 0 || index.dims() != static_cast<int>(featuresMat.total())) {
+        return PIECE_UNKNOWN;
+    }
+
+    // one call scores the square against the index, or only the closest labels if it has prototypes
+    int comparisons = 0;
+    Piece piece = index.classify(featuresMat.ptr<float>(0), k, comparisons);
+    if (numComparisons != nullptr) {
+        *numComparisons = comparisons;
+    }
+    return piece;
+}
+
+
 /**
  * Computes the histogram intersection difference between the given histograms
  * @param h1    vector of floats for the first histogram
@@ -329,21 +806,24 @@ std::string computeHistogramDiffs(cv::Mat &image, cv::Rect currentRect, std::vec
  * 
  * @returns a float representing the difference
 */
-float computeHistogramIntersectionDifference(std::vector<float> h1, std::vector<float> h2) {
-    float intersection = 0.0;
-
+float computeHistogramIntersectionDifference(const std::vector<float> &h1, const std::vector<float> &h2) {
     if (h1.size() != h2.size()) {
         printf("Size issues...\n");
     }
 
-    for (int i = 0; i < h1.size(); i++) {
-        if (std::min(h1[i], h2[i]) != 0.0) {
-        }
-        intersection += std::min(h1[i], h2[i]);
-    }
+    return computeHistogramIntersectionDifference(h1.data(), h2.data(), static_cast<int>(std::min(h1.size(), h2.size())));
+}
 
-    // printf("intersection is: %f\n", intersection);
-    return 1.0 - intersection;
+/**
+ * Computes the histogram intersection difference between the given histograms
+ * @param h1        pointer to the floats of the first histogram
+ * @param h2        pointer to the floats of the second histogram
+ * @param length    int for the number of values in each histogram
+ * 
+ * @returns a float representing the difference
+*/
+float computeHistogramIntersectionDifference(const float *h1, const float *h2, int length) {
+    return histogramIntersectionDifference(h1, h2, length);
 }
 
 
@@ -356,48 +836,73 @@ void convertVecToMat(std::vector<float> &result, cv::Mat &histogram, int numBins
     histogram = cv::Mat(numBins, numBins, CV_32FC1, result.data());
 }
 
+/**
+ * Gets the lookup table of histogram bins for getHistogramFeature, built once for each number of bins.
+ *   The bin of a channel only depends on the channel's value and the sum of b, g and r, so the entry at
+ *   [total * 256 + value] holds static_cast<int>(value / total * (numBins-1) + .5), computed exactly as before.
+ * @param numBins    the number of bins for each side of the histogram, from 1 to 256
+ * 
+ * @returns a reference to the table of 766 * 256 bin indices
+*/
+const std::vector<uchar> &getChromaticityBinTable(int numBins) {
+    // one table per supported number of bins, each built by the first call that needs it and read without a lock after
+    static std::once_flag builtTables[256];
+    static std::vector<uchar> tables[256];
+
+    std::vector<uchar> &table = tables[numBins - 1];
+    std::call_once(builtTables[numBins - 1], [&]() {
+        table.assign((3 * 255 + 1) * 256, 0);
+        for (int total = 1; total <= 3 * 255; total++) {
+            for (int value = 0; value <= std::min(total, 255); value++) {
+                float ratio = static_cast<uchar>(value) / static_cast<float>(total);
+                table[total * 256 + value] = static_cast<uchar>(static_cast<int>(ratio * (numBins-1) + .5));
+            }
+        }
+    });
+
+    return table;
+}
+
 /**
  * Computes the 2D histogram for an image based on the image's r and g values
  * @param image      the cv::Mat image to find the histogram for
  * @param numBins    the number of bins for each side of the histogram
+ * @param stride     the step between the sampled rows and columns, 1 to use every pixel
  * 
  * @returns a cv::Mat for the 2D histogram, where the rows are normalized r values and the columns are normalized g values
 */
-cv::Mat getHistogramFeature(cv::Mat &image, int numBins=16) {
+cv::Mat getHistogramFeature(const cv::Mat &image, int numBins=16, int stride) {
     cv::Mat histogram = cv::Mat::zeros(numBins, numBins, CV_32FC1);
-    cv::Vec3b *row;
-    uchar blue, red, green;
-    float r, g;
-    int rIndex, gIndex;
-    float total;
-    
-    for (int i = 0; i < image.rows; i++) {
-        row = image.ptr<cv::Vec3b>(i);
- 
-        for (int j = 0; j < image.cols; j++) {
-            blue = row[j][0];
-            green = row[j][1];
-            red = row[j][2];
-
-            total = static_cast<float>(blue + green + red);
-            if (total == 0) {
-                r = 0;
-                g = 0;
-            }
-            else {
-                r = red / total;
-                g = green / total;
-            }
+    if (numBins < 1 || numBins > 256) {
+        printf("Unsupported number of histogram bins: %d\n", numBins);
+        return histogram;
+    }
+    stride = std::max(stride, 1);
+
+    // the divisions are all in the table, so each pixel is two lookups and an integer increment
+    const uchar *binTable = getChromaticityBinTable(numBins).data();
+    std::vector<int> counts(numBins * numBins, 0);
+    const cv::Vec3b *row;
+    const uchar *binRow;
+    int numSampled = 0;
 
-            rIndex = static_cast<int>(r * (numBins-1) + .5);
-            gIndex = static_cast<int>(g * (numBins-1) + .5);
-            histogram.at<float>(rIndex, gIndex) = histogram.at<float>(rIndex, gIndex) + 1;
+    for (int i = 0; i < image.rows; i += stride) {
+        row = image.ptr<cv::Vec3b>(i);
 
+        for (int j = 0; j < image.cols; j += stride) {
+            binRow = binTable + (row[j][0] + row[j][1] + row[j][2]) * 256;
+            counts[binRow[row[j][2]] * numBins + binRow[row[j][1]]]++;
         }
+        numSampled += (image.cols + stride - 1) / stride;
     }
 
-    float hTotal = image.rows * image.cols;
-    normalizeHistogram(histogram, hTotal);
+    float hTotal = static_cast<float>(numSampled);
+    for (int i = 0; i < numBins; i++) {
+        float *hRow = histogram.ptr<float>(i);
+        for (int j = 0; j < numBins; j++) {
+            hRow[j] = static_cast<float>(counts[i * numBins + j]) / hTotal;
+        }
+    }
     // printf("Sum of histogram feature: %f\n", cv::sum(histogram)[0]);
 
     return histogram;
@@ -430,14 +935,14 @@ float computeHistogramIntersectionDifference(cv::Mat h1, cv::Mat h2, int numBins
 
 
 /**
- * Adds a label and the relevant features to the relevant features.csv file.
+ * Adds a label and the relevant features to the relevant features.csv file (and binary feature file, if there is one).
  * @param src           cv::Mat representing the source image
  * @param rectangle     cv::Rect representing the box for the square of interest
  * @param label         char representing the label of the square ('e', 'p', 'n', 'b', 'r', 'q', 'k')
  * @param pieceColor    char representing the piece color ('b', 'w', 'e')
  * @param isDarkSquare  bool for if the square is dark (true) or light (false)
 */
-void addLabelFeatures(cv::Mat src, cv::Rect rectangle, char label, char pieceColor, bool isDarkSquare) {
+void addLabelFeatures(const cv::Mat &src, cv::Rect rectangle, char label, char pieceColor, bool isDarkSquare) {
     cv::Scalar boardColors[] = { cv::Scalar(125, 150, 160), cv::Scalar(30, 35, 15) };
     cv::Scalar pieceColors[] = { cv::Scalar(20, 25, 25), cv::Scalar(110, 175, 215) };
     // cv::Scalar boardShadowColors[] = { cv::Scalar(95, 120, 130), cv::Scalar(18, 25, 10) };
@@ -450,6 +955,12 @@ void addLabelFeatures(cv::Mat src, cv::Rect rectangle, char label, char pieceCol
 
     append_image_data_csv((isDarkSquare ? CSV_DARK_FILE_PATH : CSV_LIGHT_FILE_PATH), label, pieceColor, histVec, 0);
 
+    // keep the binary feature file in step with the csv, if one has been made
+    const char *featurePath = isDarkSquare ? FEATURE_DARK_FILE_PATH : FEATURE_LIGHT_FILE_PATH;
+    if (isFeatureFile(featurePath)) {
+        appendFeatureRecord(featurePath, getPieceFromLabel(pieceColor, label), histVec, nBins);
+    }
+
 
     return;
 }
@@ -461,7 +972,7 @@ void addLabelFeatures(cv::Mat src, cv::Rect rectangle, char label, char pieceCol
  * @returns 0 if the function returns successfully
 */
 int labelImages(cv::Mat &src) {
-    cv::Mat resized, temp, temp2;
+    cv::Mat resized, shown;
     cv::Size newSize(428, 524);
     std::vector<cv::Vec4i> lines;
     // possible labels are empty, pawn, bishop, knight (n), rook, queen, king  
@@ -469,35 +980,32 @@ int labelImages(cv::Mat &src) {
 
     // calculates lines from hough transform
     calcHoughLines(src, resized, newSize, lines);
-    resized.copyTo(temp);
 
-    // Find intersections between lines
+    // Find intersections between lines, nothing is drawn so none of the images need copying
     std::vector<cv::Point2f> intersections;
-    getIntersections(temp, lines, newSize, intersections);
+    getIntersections(resized, lines, newSize, intersections);
 
-    src.copyTo(temp);
-    std::vector<cv::Point2f> originalPoints = scalePointsToOriginal(temp, intersections, src.size(), newSize);
+    std::vector<cv::Point2f> originalPoints = scalePointsToOriginal(src, intersections, src.size(), newSize);
 
     // find rectangles based on the intersections
     std::vector<cv::Rect> rectangles;
-    setRectangles(temp, originalPoints, rectangles);
-
-    src.copyTo(temp2);
+    setRectangles(src, originalPoints, rectangles);
 
     int current = 0;
     bool isDarkSquare = false;
     for (cv::Rect currentRect : rectangles) {
-        cv::rectangle(temp2, currentRect, cv::Scalar(0, 255, 0), 5);
+        // the outline is drawn on a copy, so the features are still taken from the untouched source
+        src.copyTo(shown);
+        cv::rectangle(shown, currentRect, cv::Scalar(0, 255, 0), 5);
         
-        cv::imshow("Rectangle " + std::to_string(current), temp2);
+        cv::imshow("Rectangle " + std::to_string(current), shown);
         int key = cv::waitKey(0);
-        src.copyTo(temp2);
         if (possibleLabels.find(key) != possibleLabels.end()) {
             printf("Identified as: %c\n", static_cast<char>(key));
             int color = cv::waitKey(0);
 
             // add the label and its features to the relevant features.csv file
-            addLabelFeatures(temp2, currentRect, static_cast<char>(key), static_cast<char>(color), isDarkSquare);
+            addLabelFeatures(src, currentRect, static_cast<char>(key), static_cast<char>(color), isDarkSquare);
         }
 
         cv::destroyWindow("Rectangle " + std::to_string(current));
@@ -6,13 +6,17 @@
 */
 
 #include <opencv2/core.hpp>
+#include <opencv2/core/ocl.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
 #include "processingOps.hpp"
+#include "instrumentation.hpp"
 
 
 /**
@@ -54,7 +58,7 @@ bool checkIntersection(cv::Vec4i &line1, cv::Vec4i &line2, cv::Size imageSize,
 
     if (o1.x < 0 || o1.y < 0  || p1.x < 0 || p1.y < 0 || o2.x < 0 || o2.y < 0
      || p2.x < 0  || p2.y < 0) {
-        printf("We got negatives\n");
+        logPrintf(LOG_DEBUG, "We got negatives\n");
      }
     cv::Point2f x = o2 - o1;
     cv::Point2f d1 = p1 - o1;
@@ -91,6 +95,92 @@ bool arePointsNearby(const cv::Point2f& point, const std::vector<cv::Point2f>& p
 }
 
 
+/**
+ * Uniform grid of the points accepted so far, with cells as big as the merge distance, so any point within that
+ *      distance of a new point is in the same cell or one of the 8 around it.
+*/
+struct PointGrid {
+    float cellSize;
+    int cols;
+    int rows;
+    std::vector<std::vector<cv::Point2f>> cells;
+};
+
+/**
+ * Creates an empty grid covering the image.
+ * @param imageSize     cv::Size of the image the points are in
+ * @param cellSize      float for the size of each cell, which should be the merge distance
+ * 
+ * @returns the empty PointGrid
+*/
+PointGrid createPointGrid(cv::Size imageSize, float cellSize) {
+    PointGrid grid;
+    grid.cellSize = std::max(cellSize, 1.0f);
+    grid.cols = std::max(1, static_cast<int>(std::ceil(imageSize.width / grid.cellSize)));
+    grid.rows = std::max(1, static_cast<int>(std::ceil(imageSize.height / grid.cellSize)));
+    grid.cells.resize(grid.cols * grid.rows);
+    return grid;
+}
+
+/**
+ * Checks if any point in the grid is within the distance of the point, only looking at the neighbouring cells.
+ * @param grid      PointGrid of the points to check
+ * @param point     a cv::Point2f representing the point of interest
+ * @param distance  a float for the threshold to determine if the points are close enough to be considered "duplicates"
+ * 
+ * @returns true if any point is within the specified distance from the point, false otherwise
+*/
+bool isPointNearbyInGrid(const PointGrid &grid, const cv::Point2f &point, float distance) {
+    int col = std::min(std::max(static_cast<int>(point.x / grid.cellSize), 0), grid.cols - 1);
+    int row = std::min(std::max(static_cast<int>(point.y / grid.cellSize), 0), grid.rows - 1);
+
+    for (int r = std::max(row - 1, 0); r <= std::min(row + 1, grid.rows - 1); r++) {
+        for (int c = std::max(col - 1, 0); c <= std::min(col + 1, grid.cols - 1); c++) {
+            if (arePointsNearby(point, grid.cells[r * grid.cols + c], distance)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Adds the point to its cell of the grid.
+ * @param grid      PointGrid to add the point to
+ * @param point     a cv::Point2f representing the point to add
+*/
+void addPointToGrid(PointGrid &grid, const cv::Point2f &point) {
+    int col = std::min(std::max(static_cast<int>(point.x / grid.cellSize), 0), grid.cols - 1);
+    int row = std::min(std::max(static_cast<int>(point.y / grid.cellSize), 0), grid.rows - 1);
+    grid.cells[row * grid.cols + col].push_back(point);
+}
+
+
+/**
+ * Splits the lines into the near-horizontal and near-vertical families by their angle, so only lines from different
+ *      families have to be intersected.
+ * @param lines         vector of cv::Vec4i's representing the hough lines
+ * @param horizontal    the resulting indices of the lines within 45 degrees of horizontal, in increasing order
+ * @param vertical      the resulting indices of the other lines, in increasing order
+*/
+void splitLineFamilies(const std::vector<cv::Vec4i> &lines, std::vector<int> &horizontal, std::vector<int> &vertical) {
+    horizontal.clear();
+    vertical.clear();
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        int dx = std::abs(lines[i][2] - lines[i][0]);
+        int dy = std::abs(lines[i][3] - lines[i][1]);
+
+        if (dx >= dy) {
+            horizontal.push_back(static_cast<int>(i));
+        }
+        else {
+            vertical.push_back(static_cast<int>(i));
+        }
+    }
+}
+
+
 /**
  * Calculates the Hough lines for the source image
  *      First resizes and converts to grayscale, applies gaussian blur, and applies Canny.
@@ -103,6 +193,29 @@ bool arePointsNearby(const cv::Point2f& point, const std::vector<cv::Point2f>& p
  * @returns 0 if the function returns successfully.
 */
 int calcHoughLines(cv::Mat &src, cv::Mat &resized, cv::Size newSize, std::vector<cv::Vec4i> &lines, bool showCanny) {
+        cv::Mat edges;
+        calcHoughLines(src, resized, newSize, lines, edges);
+
+        if (showCanny) {
+            cv::imshow("Canny", edges);
+            cv::waitKey(0);
+        }
+
+        return 0;
+}
+
+/**
+ * Calculates the Hough lines for the source image, also returning the Canny edges the lines were found from.
+ * @param src       cv::Mat representing the source image
+ * @param resized   cv::Mat representing the the resized image, to be used for its size
+ * @param newSize   cv::Size representing the size of the resized image
+ * @param lines     vector of cv::Vec4i's representing the resulting hough lines calculated
+ * @param edges     cv::Mat for the resulting Canny edges of the resized image
+ * 
+ * @returns 0 if the function returns successfully.
+*/
+int calcHoughLines(cv::Mat &src, cv::Mat &resized, cv::Size newSize, std::vector<cv::Vec4i> &lines, cv::Mat &edges) {
+        ScopedTimer timer("calcHoughLines");
         cv::Mat temp;
         // Resize image
         
@@ -119,19 +232,80 @@ int calcHoughLines(cv::Mat &src, cv::Mat &resized, cv::Size newSize, std::vector
         // cv::waitKey(0);
 
         // Applies Canny
-        cv::Canny(temp, temp, 10, 250, 3);
-        if (showCanny) {
-            cv::imshow("Canny", temp);
-            cv::waitKey(0);
-        }
+        cv::Canny(temp, edges, 10, 250, 3);
 
         // Gets Hough Lines
-        cv::HoughLinesP(temp, lines, 0.5, CV_PI/180, 50, 30, 100);
+        cv::HoughLinesP(edges, lines, 0.5, CV_PI/180, 50, 30, 100);
+        addCounter("houghSegments", lines.size());
 
         return 0;
 }
 
 
+/**
+ * Calculates the Hough lines for the source image on cv::UMat's, so OpenCV's transparent API can run every step on an
+ *   OpenCL device. The images stay on the device between the steps, and only the line segments are downloaded.
+ * @param src       cv::UMat representing the source image
+ * @param resized   cv::UMat for the resulting resized image, left on the device
+ * @param newSize   cv::Size representing the size of the resized image
+ * @param lines     vector of cv::Vec4i's representing the resulting hough lines calculated
+ * @param edges     cv::UMat for the resulting Canny edges of the resized image, left on the device
+ * 
+ * @returns 0 if the function returns successfully.
+*/
+int calcHoughLines(const cv::UMat &src, cv::UMat &resized, cv::Size newSize, std::vector<cv::Vec4i> &lines, cv::UMat &edges) {
+        ScopedTimer timer("calcHoughLines");
+        cv::UMat gray, blurred;
+
+        cv::resize(src, resized, newSize, 0, 0, cv::INTER_AREA);
+        cv::cvtColor(resized, gray, cv::COLOR_BGR2GRAY);
+        cv::GaussianBlur(gray, blurred, cv::Size(5, 5), 0);
+        cv::Canny(blurred, edges, 10, 250, 3);
+
+        // the OpenCL version of HoughLinesP only runs when its output is a UMat too
+        cv::UMat segments;
+        cv::HoughLinesP(edges, segments, 0.5, CV_PI/180, 50, 30, 100);
+        lines.clear();
+        if (!segments.empty()) {
+            segments.copyTo(lines);
+        }
+        addCounter("houghSegments", lines.size());
+
+        return 0;
+}
+
+// if the geometry front end and the occupancy scores run on cv::UMat, set from the command line
+bool useTransparentApi = false;
+
+/**
+ * Sets if the geometry front end and the occupancy scores run on cv::UMat through OpenCV's transparent API, so they are
+ *   offloaded to an OpenCL device. Stays on the CPU if this build of OpenCV or the machine has no OpenCL.
+ * @param use   bool for if the transparent API should be used
+ *
+ * @returns 0 if the setting was applied, non-zero if OpenCL was asked for but isn't available
+*/
+int setUseTransparentApi(bool use) {
+    if (use && !cv::ocl::haveOpenCL()) {
+        logPrintf(LOG_WARNING, "OpenCL isn't available, so the geometry stays on the CPU\n");
+        useTransparentApi = false;
+        return 1;
+    }
+
+    if (use) {
+        cv::ocl::setUseOpenCL(true);
+        logPrintf(LOG_INFO, "Running the geometry on OpenCL device: %s\n", cv::ocl::Device::getDefault().name().c_str());
+    }
+    useTransparentApi = use;
+    return 0;
+}
+
+/**
+ * @returns true if the geometry front end and the occupancy scores run on cv::UMat
+*/
+bool getUseTransparentApi() {
+    return useTransparentApi;
+}
+
 /**
  * Scale the points back to the original size so we can work with bigger images.
  * @param image         cv::Mat for the original size image
@@ -148,22 +322,13 @@ std::vector<cv::Point2f> scalePointsToOriginal(cv::Mat &image, std::vector<cv::P
     float scaleX = static_cast<float>(originalSize.width) / smallerSize.width;
     float scaleY = static_cast<float>(originalSize.height) / smallerSize.height;
 
-    int current = 0;
     for (const cv::Point2f& point : points) {
         cv::Point2f scaledPoint(point.x * scaleX, point.y * scaleY);
         scaledPoints.push_back(scaledPoint);
-        if (showPoints) {
-            cv::circle(image, scaledPoint, 15, cv::Scalar(0, 0, 255), -1);
-            cv::putText(image, //target image
-                        std::to_string(current),
-                        cv::Point(scaledPoint.x, scaledPoint.y - 20),
-                        cv::FONT_HERSHEY_DUPLEX,
-                        3.0,
-                        CV_RGB(65, 105, 225), //font color
-                        5);
-            current++;
-        }
-        
+    }
+
+    if (showPoints) {
+        displayPoints(image, scaledPoints);
     }
 
     return scaledPoints;
@@ -181,11 +346,30 @@ std::vector<cv::Point2f> scalePointsToOriginal(cv::Mat &image, std::vector<cv::P
 */
 int getIntersections(cv::Mat &dst, std::vector<cv::Vec4i> &lines, cv::Size imageSize, std::vector<cv::Point2f> &intersections,
                      bool showIntersections) {
-    // compute intersections based on combinations of lines
+    ScopedTimer timer("getIntersections");
+    float mergeDistance = 30;
+    PointGrid grid = createPointGrid(imageSize, mergeDistance);
+    for (const cv::Point2f &point : intersections) {
+        addPointToGrid(grid, point);
+    }
+
+    // board lines only cross lines of the other family, so lines of the same family are never intersected
+    std::vector<int> horizontal, vertical;
+    splitLineFamilies(lines, horizontal, vertical);
+    std::vector<char> isHorizontal(lines.size(), 0);
+    for (int index : horizontal) {
+        isHorizontal[index] = 1;
+    }
+
+    // compute intersections based on combinations of lines, in the same (i, j > i) order as every pair would be
+    uint64_t numPairs = 0;
     for (size_t i = 0; i < lines.size(); i++) {
-        for (size_t j = i + 1; j < lines.size(); j++) {
+        const std::vector<int> &others = isHorizontal[i] ? vertical : horizontal;
+
+        for (auto j = std::upper_bound(others.begin(), others.end(), static_cast<int>(i)); j != others.end(); j++) {
             cv::Vec4i line1 = lines[i];
-            cv::Vec4i line2 = lines[j];
+            cv::Vec4i line2 = lines[*j];
+            numPairs++;
             
             // Compute intersection point
             cv::Point2f intersection;
@@ -194,11 +378,12 @@ int getIntersections(cv::Mat &dst, std::vector<cv::Vec4i> &lines, cv::Size image
                 intersection);
             
             // If there is an intersection, draw it on the image
-            if (hasIntersection && (intersection.x > 25 && intersection.x < dst.cols - 25 && intersection.y > 25 && intersection.y < dst.rows - 25)) {
-                bool nearby = arePointsNearby(intersection, intersections, 30);
+            if (hasIntersection && (intersection.x > 25 && intersection.x < imageSize.width - 25 && intersection.y > 25 && intersection.y < imageSize.height - 25)) {
+                // only the neighbouring cells of the grid can hold a duplicate
+                bool nearby = isPointNearbyInGrid(grid, intersection, mergeDistance);
                 if (!nearby) {
                     intersections.push_back(intersection);
-                    
+                    addPointToGrid(grid, intersection);
                 }
             }
         }
@@ -222,7 +407,9 @@ int getIntersections(cv::Mat &dst, std::vector<cv::Vec4i> &lines, cv::Size image
             current++;
         }
     }
-    printf("Number of found intersections: %zu\n", intersections.size());
+    addCounter("intersectionPairs", numPairs);
+    addCounter("intersections", intersections.size());
+    logPrintf(LOG_DEBUG, "Number of found intersections: %zu\n", intersections.size());
 
     return 0;
 }
@@ -235,9 +422,16 @@ int getIntersections(cv::Mat &dst, std::vector<cv::Vec4i> &lines, cv::Size image
  * @param rectangles        vector of cv::Rect's representing the rectangles for each space on the board
  * @param showRectangles    bool flag to represent if the output image should include rectangles numbered and highlighted
  * 
- * @returns 0 if the function returns successfully.
+ * @returns 0 if the function returns successfully, 1 if there aren't exactly 81 intersections.
 */
 int setRectangles(cv::Mat &dst, std::vector<cv::Point2f> &intersections, std::vector<cv::Rect> &rectangles, bool showRectangles) {
+    ScopedTimer timer("setRectangles");
+    // a full board needs exactly the 9x9 grid of intersections, anything else would put the squares in the wrong places
+    if (intersections.size() != 81) {
+        logPrintf(LOG_WARNING, "Need the 81 intersections of a full board, found: %zu\n", intersections.size());
+        return 1;
+    }
+
     // creates rectangles based on the top left corner and bottom right corner. With 9 corners in each row, this would be the i + 10 corner for the bottom right
     for (int row = 0; row < 8; row++) {
         for (int col = 0; col < 8; col++) {
@@ -250,21 +444,10 @@ int setRectangles(cv::Mat &dst, std::vector<cv::Point2f> &intersections, std::ve
 
     // display rectangles on image if desired
     if (showRectangles) {
-        int current = 0;
-        for (cv::Rect currentRect : rectangles) {
-            cv::rectangle(dst, currentRect, cv::Scalar(0, 255, 0), 5);
-            cv::putText(dst, //target image
-                    std::to_string(current),
-                    cv::Point(currentRect.x + (0.5 * currentRect.width), currentRect.y + (0.5 * currentRect.height)),
-                    cv::FONT_HERSHEY_DUPLEX,
-                    3.0,
-                    CV_RGB(0, 255, 0), //font color
-                    5);
-            current++;
-        }
+        displayRectangles(dst, rectangles);
     }
 
-    printf("Number of squares found: %zu\n", rectangles.size());
+    logPrintf(LOG_DEBUG, "Number of squares found: %zu\n", rectangles.size());
 
     return 0;
 }
@@ -274,10 +457,49 @@ int setRectangles(cv::Mat &dst, std::vector<cv::Point2f> &intersections, std::ve
  * @param dst   a cv::Mat of the destination to display the lines
  * @param lines a vector of cv::Vec4i's representing the existing lines from Hough.
 */
-void displayLines(cv::Mat &dst, std::vector<cv::Vec4i> &lines) {
+void displayLines(cv::Mat &dst, const std::vector<cv::Vec4i> &lines) {
     for (size_t i = 0; i < lines.size(); i++ ){
             cv::Vec4i l = lines[i];
             cv::line(dst, cv::Point(l[0], l[1]), cv::Point(l[2], l[3]), cv::Scalar(0,0,255), 3, cv::LINE_AA);
         }
 }
 
+/**
+ * Display the points, numbered in order, on the given (full size) destination image.
+ * @param dst       a cv::Mat of the destination to display the points
+ * @param points    a vector of cv::Point2f's representing the points to display
+*/
+void displayPoints(cv::Mat &dst, const std::vector<cv::Point2f> &points) {
+    int current = 0;
+    for (const cv::Point2f &point : points) {
+        cv::circle(dst, point, 15, cv::Scalar(0, 0, 255), -1);
+        cv::putText(dst, //target image
+                    std::to_string(current),
+                    cv::Point(point.x, point.y - 20),
+                    cv::FONT_HERSHEY_DUPLEX,
+                    3.0,
+                    CV_RGB(65, 105, 225), //font color
+                    5);
+        current++;
+    }
+}
+
+/**
+ * Display the rectangles, numbered in order, on the given destination image.
+ * @param dst           a cv::Mat of the destination to display the rectangles
+ * @param rectangles    a vector of cv::Rect's representing the squares of the board
+*/
+void displayRectangles(cv::Mat &dst, const std::vector<cv::Rect> &rectangles) {
+    int current = 0;
+    for (const cv::Rect &currentRect : rectangles) {
+        cv::rectangle(dst, currentRect, cv::Scalar(0, 255, 0), 5);
+        cv::putText(dst, //target image
+                std::to_string(current),
+                cv::Point(currentRect.x + (0.5 * currentRect.width), currentRect.y + (0.5 * currentRect.height)),
+                cv::FONT_HERSHEY_DUPLEX,
+                3.0,
+                CV_RGB(0, 255, 0), //font color
+                5);
+        current++;
+    }
+}
@@ -0,0 +1,720 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the serve mode, a long-running HTTP server that keeps the feature data, classifier and engine warm
+  and turns uploaded photos into fens.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <opencv2/core.hpp>
+#include <nlohmann/json.hpp>
+
+#include "serveOps.hpp"
+#include "boundedQueue.hpp"
+#include "boardImage.hpp"
+#include "chessAnalysis.hpp"
+#include "analysisService.hpp"
+#include "featureIndex.hpp"
+#include "pieceDetectionOps.hpp"
+#include "instrumentation.hpp"
+
+// largest the request line and headers can be, to stop a client from sending headers forever
+const size_t MAX_HEADER_BYTES = 16 * 1024;
+
+// number of threads waiting for analyses and answering the evaluated uploads, which only wait and never compute
+const int SERVE_RESPONDERS = 4;
+
+// set by SIGINT and SIGTERM, so the server stops accepting and lets the workers finish
+volatile std::sig_atomic_t serverStopping = 0;
+
+/**
+ * Asks the server to stop, from SIGINT or SIGTERM.
+*/
+void handleServerSignal(int) {
+    serverStopping = 1;
+}
+
+/**
+ * Parses the server options from the command line arguments after "serve".
+ *   Usage: serve [--host ADDRESS] [--port N] [--threads N] [--queue N] [--max-upload-mb N] [--turn w|b] [--eval]
+ *                [--rectified] [--nn]
+ * @param argc      int for the number of arguments
+ * @param argv      array of the argument strings
+ * @param first     int for the index of the first argument after "serve"
+ * @param options   the resulting ServeOptions
+ *
+ * @returns 0 if the arguments were valid, non-zero otherwise
+*/
+int parseServeOptions(int argc, char *argv[], int first, ServeOptions &options) {
+    for (int i = first; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--host" && hasValue) {
+            options.host = argv[++i];
+        }
+        else if (arg == "--port" && hasValue) {
+            options.port = std::atoi(argv[++i]);
+        }
+        else if (arg == "--threads" && hasValue) {
+            options.numThreads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--queue" && hasValue) {
+            options.queueSize = std::atoi(argv[++i]);
+        }
+        else if (arg == "--max-upload-mb" && hasValue) {
+            options.maxUploadBytes = static_cast<size_t>(std::max(1, std::atoi(argv[++i]))) * 1024 * 1024;
+        }
+        else if (arg == "--turn" && hasValue) {
+            options.defaults.turn = argv[++i];
+        }
+        else if (arg == "--eval") {
+            options.defaults.eval = true;
+        }
+        else if (arg == "--rectified") {
+            options.defaults.rectified = true;
+        }
+        else if (arg == "--nn") {
+            options.defaults.useClassifier = true;
+        }
+        else {
+            printf("Unknown serve option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if (options.port <= 0 || options.port > 65535) {
+        printf("Port must be between 1 and 65535, not: %d\n", options.port);
+        return 1;
+    }
+    if (options.queueSize < 0) {
+        printf("Queue size can't be negative\n");
+        return 1;
+    }
+    if (options.defaults.turn != "w" && options.defaults.turn != "b") {
+        printf("Turn must be 'w' or 'b', not: %s\n", options.defaults.turn.c_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @returns the reason phrase of the HTTP status
+*/
+const char *getHttpStatusText(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 422: return "Unprocessable Entity";
+        case 503: return "Service Unavailable";
+        default: return "Internal Server Error";
+    }
+}
+
+/**
+ * Writes all of the data to the socket.
+ * @param fd        int for the connected socket
+ * @param data      string of the bytes to write
+ *
+ * @returns 0 if everything was written, non-zero otherwise
+*/
+int sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t numSent = send(fd, data.data() + sent, data.size() - sent, 0);
+        if (numSent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (numSent <= 0) {
+            return 1;
+        }
+        sent += static_cast<size_t>(numSent);
+    }
+    return 0;
+}
+
+/**
+ * Writes a JSON response and asks the client to close the connection.
+ * @param fd        int for the connected socket
+ * @param status    int for the HTTP status
+ * @param body      nlohmann::json for the body
+ *
+ * @returns 0 if the response was written, non-zero otherwise
+*/
+int sendJsonResponse(int fd, int status, const nlohmann::json &body) {
+    std::string content = body.dump() + "\n";
+    std::string response = "HTTP/1.1 " + std::to_string(status) + " " + getHttpStatusText(status) + "\r\n" +
+                           "Content-Type: application/json\r\n" +
+                           "Content-Length: " + std::to_string(content.size()) + "\r\n" +
+                           (status == 503 ? "Retry-After: 1\r\n" : "") +
+                           "Connection: close\r\n\r\n" + content;
+    return sendAll(fd, response);
+}
+
+/**
+ * Writes an error response with a JSON body of {"error": message}.
+ * @param fd        int for the connected socket
+ * @param status    int for the HTTP status
+ * @param message   string for the error
+ *
+ * @returns 0 if the response was written, non-zero otherwise
+*/
+int sendErrorResponse(int fd, int status, const std::string &message) {
+    return sendJsonResponse(fd, status, {{"error", message}});
+}
+
+/**
+ * Reads more of the request from the socket.
+ * @param fd        int for the connected socket
+ * @param data      string the bytes are appended to
+ *
+ * @returns 0 if bytes were read, otherwise the HTTP status to answer with (400 if the client closed, 408 on a timeout)
+*/
+int receiveMore(int fd, std::string &data) {
+    char buffer[64 * 1024];
+    while (true) {
+        ssize_t numRead = recv(fd, buffer, sizeof(buffer), 0);
+        if (numRead > 0) {
+            data.append(buffer, static_cast<size_t>(numRead));
+            return 0;
+        }
+        if (numRead < 0 && errno == EINTR) {
+            continue;
+        }
+        return numRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? 408 : 400;
+    }
+}
+
+/**
+ * @returns the string without spaces or tabs at either end
+*/
+std::string trimSpaces(const std::string &text) {
+    size_t start = text.find_first_not_of(" \t");
+    size_t end = text.find_last_not_of(" \t");
+    return start == std::string::npos ? "" : text.substr(start, end - start + 1);
+}
+
+/**
+ * Reads one HTTP request from the socket, up to the end of its body.
+ * @param fd                int for the connected socket
+ * @param maxBodyBytes      size_t for the largest body that is read
+ * @param request           the resulting HttpRequest
+ *
+ * @returns 0 if the request was read, otherwise the HTTP status to answer with (400, 408, 411 or 413)
+*/
+int readHttpRequest(int fd, size_t maxBodyBytes, HttpRequest &request) {
+    request = HttpRequest();
+    std::string data;
+    size_t headerEnd;
+    while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos) {
+        if (data.size() > MAX_HEADER_BYTES) {
+            return 400;
+        }
+        int status = receiveMore(fd, data);
+        if (status != 0) {
+            return status;
+        }
+    }
+
+    // the request line, such as "POST /analyze?turn=b HTTP/1.1"
+    std::istringstream headerStream(data.substr(0, headerEnd));
+    std::string line, target, version;
+    std::getline(headerStream, line);
+    std::istringstream requestLine(line);
+    if (!(requestLine >> request.method >> target >> version) || version.rfind("HTTP/1.", 0) != 0) {
+        return 400;
+    }
+
+    size_t queryStart = target.find('?');
+    request.path = target.substr(0, queryStart);
+    if (queryStart != std::string::npos) {
+        std::stringstream queryStream(target.substr(queryStart + 1));
+        std::string pair;
+        while (std::getline(queryStream, pair, '&')) {
+            size_t equals = pair.find('=');
+            if (!pair.empty()) {
+                request.query[pair.substr(0, equals)] = equals == std::string::npos ? "" : pair.substr(equals + 1);
+            }
+        }
+    }
+
+    while (std::getline(headerStream, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        request.headers[name] = trimSpaces(line.substr(colon + 1));
+    }
+
+    // only bodies with a length are read, which is what every client sends for a file upload
+    auto transferEncoding = request.headers.find("transfer-encoding");
+    if (transferEncoding != request.headers.end() && transferEncoding->second != "identity") {
+        return 411;
+    }
+    auto contentLength = request.headers.find("content-length");
+    if (contentLength == request.headers.end()) {
+        return request.method == "POST" ? 411 : 0;
+    }
+    char *end = nullptr;
+    unsigned long long bodyBytes = std::strtoull(contentLength->second.c_str(), &end, 10);
+    if (contentLength->second.empty() || *end != '\0') {
+        return 400;
+    }
+    if (bodyBytes > maxBodyBytes) {
+        return 413;
+    }
+
+    // clients like curl wait for this before sending a large body
+    auto expect = request.headers.find("expect");
+    if (expect != request.headers.end() && expect->second == "100-continue") {
+        sendAll(fd, "HTTP/1.1 100 Continue\r\n\r\n");
+    }
+
+    request.body = data.substr(headerEnd + 4);
+    request.body.reserve(bodyBytes);
+    while (request.body.size() < bodyBytes) {
+        int status = receiveMore(fd, request.body);
+        if (status != 0) {
+            return status;
+        }
+    }
+    request.body.resize(bodyBytes);
+
+    return 0;
+}
+
+/**
+ * Gets the uploaded image from a request, either the whole body or the first file of a multipart/form-data body.
+ * @param request   HttpRequest holding the upload
+ * @param image     the resulting bytes of the encoded image
+ *
+ * @returns 0 if an image was found, non-zero otherwise
+*/
+int getUploadedImage(const HttpRequest &request, std::vector<uchar> &image) {
+    image.clear();
+    auto contentType = request.headers.find("content-type");
+    bool isMultipart = contentType != request.headers.end() && contentType->second.rfind("multipart/form-data", 0) == 0;
+
+    if (!isMultipart) {
+        image.assign(request.body.begin(), request.body.end());
+        return image.empty() ? 1 : 0;
+    }
+
+    size_t boundaryStart = contentType->second.find("boundary=");
+    if (boundaryStart == std::string::npos) {
+        return 1;
+    }
+    std::string boundary = contentType->second.substr(boundaryStart + 9);
+    boundary = boundary.substr(0, boundary.find(';'));
+    if (boundary.size() >= 2 && boundary.front() == '"' && boundary.back() == '"') {
+        boundary = boundary.substr(1, boundary.size() - 2);
+    }
+    std::string delimiter = "--" + boundary;
+
+    // each part is the delimiter, its headers, a blank line and its data up to the next delimiter
+    size_t partStart = request.body.find(delimiter);
+    while (partStart != std::string::npos) {
+        partStart += delimiter.size();
+        if (request.body.compare(partStart, 2, "--") == 0) {
+            break;
+        }
+        size_t headersEnd = request.body.find("\r\n\r\n", partStart);
+        if (headersEnd == std::string::npos) {
+            break;
+        }
+        size_t dataStart = headersEnd + 4;
+        size_t dataEnd = request.body.find("\r\n" + delimiter, dataStart);
+        if (dataEnd == std::string::npos) {
+            break;
+        }
+
+        std::string partHeaders = request.body.substr(partStart, headersEnd - partStart);
+        if (partHeaders.find("filename=") != std::string::npos || partHeaders.find("name=\"image\"") != std::string::npos) {
+            image.assign(request.body.begin() + dataStart, request.body.begin() + dataEnd);
+            return image.empty() ? 1 : 0;
+        }
+        partStart = dataEnd + 2;
+    }
+
+    return 1;
+}
+
+/**
+ * Reads a flag from the query of the request, such as eval=1.
+ * @param request   HttpRequest with the query
+ * @param name      string for the name of the flag
+ * @param value     bool set to the flag's value if it is in the query
+ *
+ * @returns 0 if the flag is missing or valid, non-zero otherwise
+*/
+int getQueryFlag(const HttpRequest &request, const std::string &name, bool &value) {
+    auto found = request.query.find(name);
+    if (found == request.query.end()) {
+        return 0;
+    }
+    if (found->second == "1" || found->second == "true" || found->second.empty()) {
+        value = true;
+    }
+    else if (found->second == "0" || found->second == "false") {
+        value = false;
+    }
+    else {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * A connection accepted by the server, waiting in the queue for a worker.
+*/
+struct QueuedConnection {
+    int fd;
+    int64 acceptedTicks;
+};
+
+/**
+ * Connections waiting for a worker, shared by the accepting thread and the workers.
+*/
+struct ConnectionQueue {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<QueuedConnection> connections;
+    bool stopping = false;
+    int numBusy = 0;
+};
+
+/**
+ * A labeled upload waiting for its analysis, which is answered by a responder rather than the worker that labeled it.
+*/
+struct PendingResponse {
+    int fd = -1;
+    nlohmann::json result;
+    std::shared_future<ChessAnalysisResult> analysis;
+    int64 analysisStart = 0;
+};
+
+/**
+ * Answers one request of a connection. Uploads that are evaluated are handed to the responders once their analysis
+ *   has been requested, so the worker can label the next upload while the engine works.
+ * @param fd            int for the connected socket
+ * @param queueMs       double for the milliseconds the connection waited for a worker
+ * @param options       ServeOptions for the server
+ * @param queue         ConnectionQueue the health check reports on
+ * @param responses     BoundedQueue the uploads waiting for their analysis are handed to
+ *
+ * @returns true if the connection was handed to the responders, which close it, false if it was answered here
+*/
+bool handleConnection(int fd, double queueMs, const ServeOptions &options, ConnectionQueue &queue,
+                      BoundedQueue<PendingResponse> &responses) {
+    ScopedTimer timer("handleServeRequest");
+    addCounter("serveRequests");
+
+    HttpRequest request;
+    int status = readHttpRequest(fd, options.maxUploadBytes, request);
+    if (status != 0) {
+        sendErrorResponse(fd, status, status == 413 ? "upload too large" : "could not read request");
+        return false;
+    }
+
+    if (request.path == "/health") {
+        // the counts are copied so the response is sent without the lock, which a slow client would hold up;
+        //   the health check's own worker isn't counted as busy
+        size_t numQueued;
+        int numBusy;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            numQueued = queue.connections.size();
+            numBusy = queue.numBusy - 1;
+        }
+        sendJsonResponse(fd, 200, {{"status", "ok"}, {"queued", numQueued}, {"busy", numBusy}, {"queue_size", options.queueSize}});
+        return false;
+    }
+    if (request.path != "/analyze" && request.path != "/analyse") {
+        sendErrorResponse(fd, 404, "unknown path, use POST /analyze or GET /health");
+        return false;
+    }
+    if (request.method != "POST") {
+        sendErrorResponse(fd, 405, "upload the image with POST");
+        return false;
+    }
+
+    // each request can change the defaults the server was started with
+    BatchOptions requestOptions = options.defaults;
+    auto turn = request.query.find("turn");
+    if (turn != request.query.end()) {
+        requestOptions.turn = turn->second;
+    }
+    if ((requestOptions.turn != "w" && requestOptions.turn != "b") || getQueryFlag(request, "eval", requestOptions.eval) != 0 ||
+        getQueryFlag(request, "nn", requestOptions.useClassifier) != 0 || getQueryFlag(request, "rectified", requestOptions.rectified) != 0) {
+        sendErrorResponse(fd, 400, "turn must be w or b, and eval, nn and rectified 0 or 1");
+        return false;
+    }
+
+    std::vector<uchar> encoded;
+    if (getUploadedImage(request, encoded) != 0) {
+        sendErrorResponse(fd, 400, "no image in the request");
+        return false;
+    }
+    // the request's copy of the upload is no longer needed once the image has its own
+    request.body.clear();
+    request.body.shrink_to_fit();
+
+    std::shared_ptr<BoardImage> image = std::make_shared<BoardImage>();
+    if (image->loadEncoded(std::move(encoded), "upload") != 0) {
+        sendErrorResponse(fd, 400, "could not read image");
+        return false;
+    }
+
+    // the analysis is only requested here, and waited for by a responder
+    bool eval = requestOptions.eval;
+    requestOptions.eval = false;
+    nlohmann::json result = processBatchImage(image, requestOptions);
+    result["queue_ms"] = queueMs;
+
+    if (result.contains("error")) {
+        addCounter("serveFailedImages");
+        sendJsonResponse(fd, result["error"] == "could not decode image" ? 400 : 422, result);
+        return false;
+    }
+    if (!eval) {
+        sendJsonResponse(fd, 200, result);
+        return false;
+    }
+
+    PendingResponse response;
+    response.fd = fd;
+    response.analysisStart = cv::getTickCount();
+    response.analysis = getAnalysisService().requestAnalysis(result["fen"].get<std::string>());
+    response.result = std::move(result);
+    return responses.push(std::move(response));
+}
+
+/**
+ * Loads everything the requests share before the first one arrives: the feature data, the piece classifier if it is
+ *   used by default, and the analysis service and local engine if positions are evaluated.
+ * @param options   ServeOptions for the server
+*/
+void warmServer(const ServeOptions &options) {
+    ScopedTimer timer("warmServer");
+    logPrintf(LOG_INFO, "Loading the feature data\n");
+    getFeatureIndex(false);
+    getFeatureIndex(true);
+
+    if (options.defaults.useClassifier && !getPieceClassifier().isLoaded()) {
+        logPrintf(LOG_WARNING, "The piece classifier could not be loaded, requests with nn will fail\n");
+    }
+
+    getAnalysisService();
+    if (getAnalysisBackend().backend == ANALYSIS_BACKEND_UCI) {
+        // launches the engines through the service, so the first evaluated request doesn't pay for it
+        getAnalysisService().requestAnalysis("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w - - 0 0", 1).wait();
+    }
+}
+
+/**
+ * Opens the socket the server listens on.
+ * @param options   ServeOptions with the host and port
+ *
+ * @returns the listening socket, or -1 if it couldn't be opened
+*/
+int openListeningSocket(const ServeOptions &options) {
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(options.port));
+    if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+        printf("The host must be an IPv4 address, not: %s\n", options.host.c_str());
+        return -1;
+    }
+
+    // close-on-exec, so the engines started by the analysis backend don't hold the port open
+    int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        printf("Unable to open a socket: %s\n", std::strerror(errno));
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listenFd, std::max(options.queueSize, 16)) != 0) {
+        printf("Unable to listen on %s:%d: %s\n", options.host.c_str(), options.port, std::strerror(errno));
+        close(listenFd);
+        return -1;
+    }
+    return listenFd;
+}
+
+/**
+ * Runs the server until it is interrupted. The feature data, classifier and analysis backend are loaded before the
+ *   first connection is accepted. Accepted connections wait in a bounded queue for a worker, and once it is full new
+ *   ones are answered with 503 straight away, so a burst of uploads can't build an unbounded backlog.
+ *   POST /analyze takes a photo (raw or multipart) with optional ?turn=w|b&eval=0|1&nn=0|1&rectified=0|1 and answers
+ *   with the JSON of the batch mode, and GET /health reports the queue.
+ * @param options   ServeOptions for the server
+ *
+ * @returns 0 if the server stopped cleanly, non-zero if it couldn't start
+*/
+int runServer(const ServeOptions &options) {
+    int numThreads = options.numThreads > 0 ? options.numThreads : static_cast<int>(std::thread::hardware_concurrency());
+    numThreads = std::max(1, numThreads);
+    // the requests are what run in parallel, so OpenCV's own threads would only oversubscribe the cores
+    if (numThreads > 1) {
+        cv::setNumThreads(1);
+    }
+
+    int listenFd = openListeningSocket(options);
+    if (listenFd < 0) {
+        return 1;
+    }
+    // a client hanging up mid-response (or an engine dying) shouldn't end the server, which warming can already hit
+    std::signal(SIGPIPE, SIG_IGN);
+    warmServer(options);
+
+    std::signal(SIGINT, handleServerSignal);
+    std::signal(SIGTERM, handleServerSignal);
+
+    ConnectionQueue queue;
+    BoundedQueue<PendingResponse> responses(static_cast<size_t>(options.queueSize + numThreads));
+
+    // responders wait for the analysis of the evaluated uploads, which keeps the workers free for labeling
+    auto responder = [&]() {
+        PendingResponse response;
+        while (responses.pop(response)) {
+            addAnalysisToResult(response.analysis.get(), response.result);
+            double analysisMs = (cv::getTickCount() - response.analysisStart) * 1000.0 / cv::getTickFrequency();
+            response.result["timings_ms"]["getChessAnalysis"] = analysisMs;
+            response.result["timings_ms"]["total"] = response.result["timings_ms"]["total"].get<double>() + analysisMs;
+            sendJsonResponse(response.fd, 200, response.result);
+            close(response.fd);
+        }
+    };
+
+    auto worker = [&]() {
+        while (true) {
+            QueuedConnection connection;
+            {
+                std::unique_lock<std::mutex> lock(queue.mutex);
+                queue.condition.wait(lock, [&]() { return queue.stopping || !queue.connections.empty(); });
+                if (queue.connections.empty()) {
+                    return;
+                }
+                connection = queue.connections.front();
+                queue.connections.pop_front();
+                queue.numBusy++;
+            }
+
+            double queueMs = (cv::getTickCount() - connection.acceptedTicks) * 1000.0 / cv::getTickFrequency();
+            if (!handleConnection(connection.fd, queueMs, options, queue, responses)) {
+                close(connection.fd);
+            }
+
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.numBusy--;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; i++) {
+        workers.emplace_back(worker);
+    }
+    std::vector<std::thread> responders;
+    for (int i = 0; i < SERVE_RESPONDERS; i++) {
+        responders.emplace_back(responder);
+    }
+    printf("Serving on http://%s:%d with %d workers and a queue of %d. POST an image to /analyze\n",
+           options.host.c_str(), options.port, numThreads, options.queueSize);
+
+    // the accept loop wakes up regularly to see if it has been asked to stop
+    pollfd listenPoll = {listenFd, POLLIN, 0};
+    while (!serverStopping) {
+        if (poll(&listenPoll, 1, 250) <= 0 || !(listenPoll.revents & POLLIN)) {
+            continue;
+        }
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+
+        // a slow client can only hold its worker for the timeout
+        timeval timeout;
+        timeout.tv_sec = options.timeoutMs / 1000;
+        timeout.tv_usec = (options.timeoutMs % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        // idle workers take connections straight away, so only the ones past them count against the queue
+        bool accepted = false;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            int numIdle = numThreads - queue.numBusy;
+            if (static_cast<int>(queue.connections.size()) < options.queueSize + numIdle) {
+                queue.connections.push_back({fd, cv::getTickCount()});
+                accepted = true;
+            }
+        }
+
+        if (accepted) {
+            queue.condition.notify_one();
+        }
+        else {
+            // turned away now rather than waiting behind a queue that is already full
+            addCounter("serveRejected");
+            sendErrorResponse(fd, 503, "server busy, try again");
+            close(fd);
+        }
+    }
+
+    printf("Stopping the server\n");
+    close(listenFd);
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.stopping = true;
+    }
+    queue.condition.notify_all();
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+    // the responders finish the uploads already handed to them
+    responses.close();
+    for (std::thread &thread : responders) {
+        thread.join();
+    }
+
+    return 0;
+}
@@ -0,0 +1,409 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of the tile export mode, which cuts the labeled squares of many photos into training tiles for
+  train_chess_nn.py, as ImageFolder class directories and optionally as one packed tensor file.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "tileExportOps.hpp"
+#include "autoLabelOps.hpp"
+#include "boardImage.hpp"
+#include "boardLattice.hpp"
+#include "boardPipeline.hpp"
+#include "boundedQueue.hpp"
+#include "instrumentation.hpp"
+
+/**
+ * A tile on its way to the writer threads, either encoded for its image file or as the raw pixels for the packed file.
+*/
+struct ExportedTile {
+    std::string path;           // image file to write, empty for a tile of the packed file
+    Piece label = PIECE_EMPTY;
+    std::vector<uchar> bytes;
+};
+
+PackedTileWriter::PackedTileWriter() : fp(nullptr), ok(false) {
+    std::memset(&header, 0, sizeof(header));
+}
+
+/**
+ * Finishes the file if it is still open.
+*/
+PackedTileWriter::~PackedTileWriter() {
+    close();
+}
+
+/**
+ * Creates the file, replacing it if it exists.
+ * @param filename  the name of the packed tile file
+ * @param tileSize  int for the side of each tile
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int PackedTileWriter::open(const std::string &filename, int tileSize) {
+    std::lock_guard<std::mutex> lock(mutex);
+    fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        printf("Unable to open output file %s\n", filename.c_str());
+        return 1;
+    }
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TILE_FILE_MAGIC, sizeof(header.magic));
+    header.version = TILE_FILE_VERSION;
+    header.tileWidth = static_cast<uint32_t>(tileSize);
+    header.tileHeight = static_cast<uint32_t>(tileSize);
+    header.channels = 3;
+    header.recordSize = TILE_RECORD_LABEL_BYTES + header.tileWidth * header.tileHeight * header.channels;
+    header.dataOffset = TILE_FILE_DATA_OFFSET;
+    for (int piece = 0; piece < NUM_PIECES; piece++) {
+        std::strncpy(header.labelNames[piece], PIECE_LABELS[piece], sizeof(header.labelNames[piece]) - 1);
+    }
+
+    // the header is written again with the count once every tile is in
+    std::vector<uchar> padding(header.dataOffset - sizeof(header), 0);
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(padding.data(), 1, padding.size(), fp) == padding.size();
+    return ok ? 0 : 1;
+}
+
+/**
+ * Appends a tile.
+ * @param label     Piece of the tile
+ * @param rgb       bytes of the tile's pixels, tileSize x tileSize x 3 in RGB order
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int PackedTileWriter::add(Piece label, const std::vector<uchar> &rgb) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!fp || rgb.size() != header.recordSize - TILE_RECORD_LABEL_BYTES) {
+        return 1;
+    }
+
+    uchar labelBytes[TILE_RECORD_LABEL_BYTES] = {static_cast<uchar>(label)};
+    ok = ok && fwrite(labelBytes, 1, sizeof(labelBytes), fp) == sizeof(labelBytes)
+            && fwrite(rgb.data(), 1, rgb.size(), fp) == rgb.size();
+    header.numTiles += ok ? 1 : 0;
+    return ok ? 0 : 1;
+}
+
+/**
+ * Writes the number of tiles into the header and closes the file.
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int PackedTileWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!fp) {
+        return 0;
+    }
+
+    ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+    fp = nullptr;
+    if (!ok) {
+        printf("Unable to write the packed tile file\n");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @returns the number of tiles added so far
+*/
+uint64_t PackedTileWriter::getNumTiles() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return header.numTiles;
+}
+
+/**
+ * Parses the tile export options from the command line arguments after "export".
+ *   Usage: export <ground_truth.csv> [--images DIR] [--out DIR] [--packed tiles.bin] [--size N] [--jpg] [--raw]
+ *                 [--empty] [--no-images] [--threads N] [--writers N] [--queue N]
+ * @param argc      int for the number of arguments
+ * @param argv      array of the argument strings
+ * @param first     int for the index of the first argument after "export"
+ * @param options   the resulting TileExportOptions
+ *
+ * @returns 0 if the arguments were valid, non-zero otherwise
+*/
+int parseTileExportOptions(int argc, char *argv[], int first, TileExportOptions &options) {
+    if (first >= argc) {
+        return 1;
+    }
+    options.truthPath = argv[first];
+    options.imageDir = std::filesystem::path(options.truthPath).parent_path().string();
+
+    for (int i = first + 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--images" && hasValue) {
+            options.imageDir = argv[++i];
+        }
+        else if (arg == "--out" && hasValue) {
+            options.outputDir = argv[++i];
+        }
+        else if (arg == "--packed" && hasValue) {
+            options.packedPath = argv[++i];
+        }
+        else if (arg == "--size" && hasValue) {
+            options.tileSize = std::atoi(argv[++i]);
+        }
+        else if (arg == "--jpg") {
+            options.extension = ".jpg";
+        }
+        else if (arg == "--raw") {
+            options.rectified = false;
+        }
+        else if (arg == "--empty") {
+            options.includeEmpty = true;
+        }
+        else if (arg == "--no-images") {
+            options.writeImages = false;
+        }
+        else if (arg == "--threads" && hasValue) {
+            options.numThreads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--writers" && hasValue) {
+            options.numWriters = std::atoi(argv[++i]);
+        }
+        else if (arg == "--queue" && hasValue) {
+            options.queueSize = std::atoi(argv[++i]);
+        }
+        else {
+            printf("Unknown export option: %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if (options.tileSize < 8) {
+        printf("Tiles must be at least 8 pixels, not: %d\n", options.tileSize);
+        return 1;
+    }
+    if (!options.writeImages && options.packedPath.empty()) {
+        printf("With --no-images there has to be a --packed file to write\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Cuts the 64 tiles of a board out of a photo, each tileSize x tileSize. With rectified the board is warped straight to
+ *   the tile size, so no tile is resized twice; otherwise (or if the lattice couldn't be fit) each square's rectangle is
+ *   cropped and resized.
+ * @param imgPath   string for the path of the image
+ * @param options   TileExportOptions for the export
+ * @param tiles     the resulting 64 BGR tiles, row by row from a8
+ *
+ * @returns 0 if the function returns successfully, 1 if the image couldn't be read and 2 if the board wasn't found
+*/
+int cutBoardTiles(const std::string &imgPath, const TileExportOptions &options, std::vector<cv::Mat> &tiles) {
+    ScopedTimer timer("cutBoardTiles");
+    tiles.clear();
+
+    std::shared_ptr<BoardImage> image = std::make_shared<BoardImage>();
+    if (image->load(imgPath) != 0 || image->getClassificationImage().empty()) {
+        return 1;
+    }
+
+    BoardPipeline pipeline(image);
+    cv::Size tileSize(options.tileSize, options.tileSize);
+
+    // warped at the tile size rather than taking the pipeline's rectified board, which has smaller squares
+    cv::Mat board;
+    if (options.rectified && !pipeline.getHomography().empty() &&
+        rectifyBoard(pipeline.getSource(), pipeline.getHomography(), board, options.tileSize) == 0) {
+        for (const cv::Rect &square : getRectifiedSquares(options.tileSize)) {
+            tiles.push_back(board(square));
+        }
+        return 0;
+    }
+
+    const std::vector<cv::Rect> &rectangles = pipeline.getRectangles();
+    if (rectangles.size() != 64) {
+        return 2;
+    }
+    for (const cv::Rect &rect : rectangles) {
+        cv::Mat tile;
+        cv::resize(pipeline.getSource()(rect), tile, tileSize, 0, 0, cv::INTER_AREA);
+        tiles.push_back(tile);
+    }
+    return 0;
+}
+
+/**
+ * Exports the tiles of every photo in the ground truth file, labeled from its fen. The cutting, resizing and encoding
+ *   is spread over numThreads workers, which hand the encoded tiles to numWriters writer threads through a bounded
+ *   queue, so the disk is written while the next boards are cut. Never uses HighGUI or stdin.
+ * @param options   TileExportOptions for the export
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int runTileExport(const TileExportOptions &options) {
+    std::map<std::string, std::string> truth;
+    if (readGroundTruth(options.truthPath, truth) != 0) {
+        return 1;
+    }
+
+    std::vector<std::string> names;
+    std::vector<Board> boards;
+    for (const auto &entry : truth) {
+        Board board;
+        if (getBoardFromFen(entry.second, board) != 0) {
+            printf("Skipping %s, its fen isn't a valid placement: %s\n", entry.first.c_str(), entry.second.c_str());
+            continue;
+        }
+        names.push_back(entry.first);
+        boards.push_back(board);
+    }
+    if (names.empty()) {
+        printf("No images to export in %s\n", options.truthPath.c_str());
+        return 1;
+    }
+
+    PackedTileWriter packedWriter;
+    if (!options.packedPath.empty() && packedWriter.open(options.packedPath, options.tileSize) != 0) {
+        return 1;
+    }
+
+    int numThreads = options.numThreads > 0 ? options.numThreads : static_cast<int>(std::thread::hardware_concurrency());
+    numThreads = std::max(1, std::min(numThreads, static_cast<int>(names.size())));
+    int numWriters = std::max(1, options.numWriters);
+    // the boards are already spread over the threads, so OpenCV's own threads would only compete with them
+    if (numThreads > 1) {
+        cv::setNumThreads(1);
+    }
+
+    std::vector<int> encodeParams;
+    if (options.extension == ".png") {
+        // the tiles are small and written once, so fast compression beats small files
+        encodeParams = {cv::IMWRITE_PNG_COMPRESSION, 1};
+    }
+    else {
+        encodeParams = {cv::IMWRITE_JPEG_QUALITY, 95};
+    }
+
+    BoundedQueue<ExportedTile> tileQueue(std::max(1, options.queueSize));
+    std::atomic<size_t> nextImage(0);
+    std::atomic<int> cuttersLeft(numThreads);
+    std::atomic<int> numExported(0), numUnreadable(0), numNotFound(0), numWriteErrors(0);
+    std::atomic<size_t> numTiles(0);
+    int64 start = cv::getTickCount();
+
+    // each cutter takes the next board, cuts its tiles and encodes them, then hands them to the writers
+    auto cutter = [&]() {
+        std::vector<cv::Mat> tiles;
+        for (size_t i = nextImage++; i < names.size(); i = nextImage++) {
+            std::string imgPath = (std::filesystem::path(options.imageDir) / names[i]).string();
+            int ret = cutBoardTiles(imgPath, options, tiles);
+            if (ret != 0) {
+                (ret == 1 ? numUnreadable : numNotFound)++;
+                logPrintf(LOG_WARNING, ret == 1 ? "Could not read %s\n" : "Could not find the board in %s\n", imgPath.c_str());
+                continue;
+            }
+
+            std::string stem = std::filesystem::path(names[i]).stem().string();
+            for (int square = 0; square < 64; square++) {
+                Piece label = boards[i][square];
+                if (label == PIECE_EMPTY && !options.includeEmpty) {
+                    continue;
+                }
+
+                if (options.writeImages) {
+                    ExportedTile tile;
+                    tile.path = (std::filesystem::path(options.outputDir) / PIECE_LABELS[label] /
+                                 (stem + "_" + SQUARE_NAMES[square] + options.extension)).string();
+                    tile.label = label;
+                    cv::imencode(options.extension, tiles[square], tile.bytes, encodeParams);
+                    tileQueue.push(std::move(tile));
+                }
+                if (!options.packedPath.empty()) {
+                    // RGB like the images torchvision loads, and continuous so it is one copy
+                    cv::Mat rgb;
+                    cv::cvtColor(tiles[square], rgb, cv::COLOR_BGR2RGB);
+                    ExportedTile tile;
+                    tile.label = label;
+                    tile.bytes.assign(rgb.data, rgb.data + rgb.total() * rgb.elemSize());
+                    tileQueue.push(std::move(tile));
+                }
+                numTiles++;
+            }
+            numExported++;
+        }
+
+        // the last cutter to finish lets the writers drain the queue and stop
+        if (--cuttersLeft == 0) {
+            tileQueue.close();
+        }
+    };
+
+    // the class directories are named by label, which ImageFolder sorts into the order of CLASSIFIER_PIECES. Each is
+    //   made with its first tile, since ImageFolder fails on an empty one (such as a corpus without a white queen)
+    std::once_flag createdDirectories[NUM_PIECES];
+    auto writer = [&]() {
+        ExportedTile tile;
+        while (tileQueue.pop(tile)) {
+            if (tile.path.empty()) {
+                numWriteErrors += packedWriter.add(tile.label, tile.bytes) != 0 ? 1 : 0;
+                continue;
+            }
+
+            std::call_once(createdDirectories[tile.label], [&]() {
+                std::error_code error;
+                std::filesystem::create_directories(std::filesystem::path(tile.path).parent_path(), error);
+                if (error) {
+                    logPrintf(LOG_WARNING, "Unable to create the directory for %s in %s\n", PIECE_LABELS[tile.label],
+                              options.outputDir.c_str());
+                }
+            });
+
+            FILE *fp = fopen(tile.path.c_str(), "wb");
+            bool ok = fp && fwrite(tile.bytes.data(), 1, tile.bytes.size(), fp) == tile.bytes.size();
+            ok = fp && fclose(fp) == 0 && ok;
+            if (!ok) {
+                numWriteErrors++;
+                logPrintf(LOG_WARNING, "Unable to write tile %s\n", tile.path.c_str());
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < numThreads; i++) {
+        threads.emplace_back(cutter);
+    }
+    for (int i = 0; i < numWriters; i++) {
+        threads.emplace_back(writer);
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    int ret = packedWriter.close();
+    double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    printf("Exported %zu tiles from %d of %zu images with %d threads in %.2f s (%d unreadable, %d without a board)\n",
+           numTiles.load(), numExported.load(), names.size(), numThreads, seconds, numUnreadable.load(), numNotFound.load());
+    if (!options.packedPath.empty()) {
+        printf("Packed %llu tiles into %s\n", static_cast<unsigned long long>(packedWriter.getNumTiles()), options.packedPath.c_str());
+    }
+    if (numWriteErrors > 0) {
+        printf("%d tiles could not be written\n", numWriteErrors.load());
+        ret = 1;
+    }
+
+    return ret;
+}
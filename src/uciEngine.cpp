@@ -0,0 +1,522 @@
+/*
+  Author: Benjamin Wolff
+  Date: October 14, 2026
+
+  Implementation of running a local UCI chess engine (such as Stockfish) as a persistent subprocess.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "uciEngine.hpp"
+#include "instrumentation.hpp"
+
+
+UciEngine::UciEngine() : pid(-1), toEngine(-1), fromEngine(-1) {}
+
+UciEngine::~UciEngine() {
+    stop();
+}
+
+/**
+ * Launches the engine and waits for it to be ready, stopping any engine already running.
+ * @param enginePath    string for the engine binary, looked up on the PATH if it has no '/'
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int UciEngine::start(const std::string &enginePath) {
+    stop();
+
+    // close-on-exec, so no engine inherits the pipes of the others (or whatever else the process has open)
+    int inputPipe[2], outputPipe[2];
+    if (pipe2(inputPipe, O_CLOEXEC) != 0) {
+        printf("Unable to create pipes for %s\n", enginePath.c_str());
+        return 1;
+    }
+    if (pipe2(outputPipe, O_CLOEXEC) != 0) {
+        printf("Unable to create pipes for %s\n", enginePath.c_str());
+        close(inputPipe[0]);
+        close(inputPipe[1]);
+        return 1;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        printf("Unable to start %s\n", enginePath.c_str());
+        close(inputPipe[0]);
+        close(inputPipe[1]);
+        close(outputPipe[0]);
+        close(outputPipe[1]);
+        pid = -1;
+        return 1;
+    }
+
+    if (pid == 0) {
+        // the child's stdin and stdout become the pipes (dup2 clears close-on-exec on them), then it turns into the engine
+        dup2(inputPipe[0], STDIN_FILENO);
+        dup2(outputPipe[1], STDOUT_FILENO);
+        close(inputPipe[0]);
+        close(inputPipe[1]);
+        close(outputPipe[0]);
+        close(outputPipe[1]);
+        execlp(enginePath.c_str(), enginePath.c_str(), static_cast<char *>(nullptr));
+        _exit(127);
+    }
+
+    close(inputPipe[0]);
+    close(outputPipe[1]);
+    toEngine = inputPipe[1];
+    fromEngine = outputPipe[0];
+    readBuffer.clear();
+
+    if (sendCommand("uci") != 0 || waitFor("uciok", UCI_ENGINE_TIMEOUT_MS) != 0 ||
+        sendCommand("isready") != 0 || waitFor("readyok", UCI_ENGINE_TIMEOUT_MS) != 0) {
+        printf("Engine %s did not start up as a UCI engine\n", enginePath.c_str());
+        stop();
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Asks the engine to quit and waits for the process to exit.
+*/
+void UciEngine::stop() {
+    if (toEngine >= 0) {
+        sendCommand("quit");
+        close(toEngine);
+    }
+    if (fromEngine >= 0) {
+        close(fromEngine);
+    }
+
+    if (pid > 0) {
+        // give it a moment to quit on its own before making it
+        int status;
+        for (int i = 0; i < 50 && waitpid(pid, &status, WNOHANG) == 0; i++) {
+            usleep(10000);
+        }
+        if (waitpid(pid, &status, WNOHANG) == 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+        }
+    }
+
+    pid = -1;
+    toEngine = -1;
+    fromEngine = -1;
+    readBuffer.clear();
+}
+
+/**
+ * @returns true if the engine process is running
+*/
+bool UciEngine::isRunning() const {
+    return pid > 0 && toEngine >= 0 && fromEngine >= 0;
+}
+
+/**
+ * Writes one command to the engine's stdin.
+ * @param command   string for the command, without the newline
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int UciEngine::sendCommand(const std::string &command) {
+    std::string line = command + "\n";
+    size_t written = 0;
+
+    while (written < line.size()) {
+        ssize_t ret = write(toEngine, line.c_str() + written, line.size() - written);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return 1;
+        }
+        written += static_cast<size_t>(ret);
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the next line the engine printed, waiting at most the given time for it.
+ * @param line      the resulting line, without the newline
+ * @param timeoutMs int for the milliseconds to wait
+ *
+ * @returns 0 if the function returns successfully, 1 on a timeout and 2 if the engine exited
+*/
+int UciEngine::readLine(std::string &line, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    for (;;) {
+        size_t end = readBuffer.find('\n');
+        if (end != std::string::npos) {
+            line = readBuffer.substr(0, end);
+            readBuffer.erase(0, end + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            return 0;
+        }
+
+        int remainingMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count());
+        if (remainingMs <= 0) {
+            return 1;
+        }
+
+        pollfd request = {fromEngine, POLLIN, 0};
+        int ready = poll(&request, 1, remainingMs);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready == 0) {
+            return 1;
+        }
+        if (ready < 0) {
+            return 2;
+        }
+
+        char chunk[4096];
+        ssize_t numRead = read(fromEngine, chunk, sizeof(chunk));
+        if (numRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (numRead <= 0) {
+            return 2;
+        }
+        readBuffer.append(chunk, static_cast<size_t>(numRead));
+    }
+}
+
+/**
+ * Reads lines from the engine until one starts with the expected token.
+ * @param expected  string the line should start with
+ * @param timeoutMs int for the milliseconds to wait in total
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int UciEngine::waitFor(const std::string &expected, int timeoutMs) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::string line;
+
+    for (;;) {
+        int remainingMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count());
+        if (remainingMs <= 0 || readLine(line, remainingMs) != 0) {
+            return 1;
+        }
+        if (line.rfind(expected, 0) == 0) {
+            return 0;
+        }
+    }
+}
+
+/**
+ * Analyses the position, filling in the evaluation and best move the same way as the Stockfish API.
+ * @param fen       string of the 'fen' representation of the board's pieces
+ * @param limits    UciSearchLimits for how long to search
+ * @param result    the resulting ChessAnalysisResult
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int UciEngine::analyse(const std::string &fen, const UciSearchLimits &limits, ChessAnalysisResult &result) {
+    result = ChessAnalysisResult();
+    if (!isRunning()) {
+        return 1;
+    }
+
+    std::string go = limits.movetimeMs > 0 ? "go movetime " + std::to_string(limits.movetimeMs)
+                                           : "go depth " + std::to_string(limits.depth);
+    if (sendCommand("position fen " + fen) != 0 || sendCommand(go) != 0) {
+        printf("Lost the connection to the engine\n");
+        stop();
+        return 1;
+    }
+
+    // the scores are from the side to move's point of view, the API's are from white's
+    std::istringstream fields(fen);
+    std::string placement, turn;
+    fields >> placement >> turn;
+    bool whiteToMove = turn != "b";
+
+    std::string line;
+    for (;;) {
+        if (readLine(line, UCI_ENGINE_TIMEOUT_MS) != 0) {
+            printf("Engine did not finish its search\n");
+            stop();
+            return 1;
+        }
+
+        // with several principal variations only the best one's score is kept
+        int depth, pv;
+        std::string move;
+        if (line.rfind("info", 0) == 0 && !(parseUciPvLine(line, depth, pv, move) && pv != 1)) {
+            parseUciInfoLine(line, whiteToMove, result);
+        }
+        else if (line.rfind("bestmove", 0) == 0) {
+            // the same "bestmove e2e4 ponder e7e5" string the API returns
+            result.bestMoveString = line;
+            result.bestMove = getBestMove(result.bestMoveString);
+            break;
+        }
+    }
+
+    if (result.hasEval) {
+        logPrintf(LOG_INFO, "Eval: %f\n", result.eval);
+    }
+    result.success = true;
+    return 0;
+}
+
+/**
+ * Analyses the position with iterative deepening, handing over the result of every depth as soon as the engine has
+ *   finished it instead of only the last one. With limits.multiPv above 1 each result also has the first moves of
+ *   the other principal variations. The search is stopped as soon as shouldStop returns true.
+ * @param fen           string of the 'fen' representation of the board's pieces
+ * @param limits        UciSearchLimits for the deepest search and the number of principal variations
+ * @param minDepth      int for the shallowest depth that is handed over
+ * @param onDepth       function called with the result of each finished depth, on the calling thread
+ * @param shouldStop    function checked every UCI_STOP_POLL_MS while the engine searches
+ *
+ * @returns 0 if the search finished or was stopped, non-zero if the engine failed
+*/
+int UciEngine::analyseProgressive(const std::string &fen, const UciSearchLimits &limits, int minDepth,
+                                  const std::function<void(const ChessAnalysisResult &)> &onDepth,
+                                  const std::function<bool()> &shouldStop) {
+    if (!isRunning()) {
+        return 1;
+    }
+
+    int multiPv = std::max(1, limits.multiPv);
+    std::string go = limits.movetimeMs > 0 ? "go movetime " + std::to_string(limits.movetimeMs)
+                                           : "go depth " + std::to_string(limits.depth);
+    if (sendCommand("setoption name MultiPV value " + std::to_string(multiPv)) != 0 ||
+        sendCommand("position fen " + fen) != 0 || sendCommand(go) != 0) {
+        printf("Lost the connection to the engine\n");
+        stop();
+        return 1;
+    }
+
+    std::istringstream fields(fen);
+    std::string placement, turn;
+    fields >> placement >> turn;
+    bool whiteToMove = turn != "b";
+
+    // the engine prints every principal variation of a depth before starting the next depth
+    ChessAnalysisResult current;
+    bool handedOver = true;
+    bool stopped = false;
+    // once stopped the depth being searched isn't finished, so nothing more is handed over
+    auto handOver = [&]() {
+        if (!handedOver && !stopped && current.depth >= minDepth) {
+            current.success = true;
+            onDepth(current);
+            addCounter("progressiveDepths");
+        }
+        handedOver = true;
+    };
+
+    auto lastOutput = std::chrono::steady_clock::now();
+    std::string line;
+    for (;;) {
+        if (!stopped && shouldStop()) {
+            // the engine still answers with a bestmove, which is read so the next search starts clean
+            stopped = true;
+            addCounter("progressiveSearchesStopped");
+            if (sendCommand("stop") != 0) {
+                printf("Lost the connection to the engine\n");
+                stop();
+                return 1;
+            }
+        }
+
+        int ret = readLine(line, UCI_STOP_POLL_MS);
+        if (ret == 1 && std::chrono::steady_clock::now() - lastOutput < std::chrono::milliseconds(UCI_ENGINE_TIMEOUT_MS)) {
+            continue;
+        }
+        if (ret != 0) {
+            printf("Engine did not finish its search\n");
+            stop();
+            return 1;
+        }
+        lastOutput = std::chrono::steady_clock::now();
+
+        int depth, pv;
+        std::string move;
+        if (line.rfind("info", 0) == 0 && parseUciPvLine(line, depth, pv, move)) {
+            if (pv == 1) {
+                handOver();
+                current = ChessAnalysisResult();
+                parseUciInfoLine(line, whiteToMove, current);
+                current.depth = depth;
+                current.bestMoveString = "bestmove " + move;
+                current.bestMove = getBestMove(current.bestMoveString);
+                handedOver = false;
+            }
+            else if (depth == current.depth && pv <= multiPv) {
+                current.otherMoves.push_back(getBestMove("bestmove " + move));
+            }
+
+            // a position with fewer legal moves than principal variations is handed over with the next depth instead
+            if (pv == multiPv) {
+                handOver();
+            }
+        }
+        else if (line.rfind("bestmove", 0) == 0) {
+            handOver();
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Launches the engines of the pool.
+ * @param enginePath    string for the engine binary
+ * @param numEngines    int for the number of engine processes
+*/
+UciEnginePool::UciEnginePool(const std::string &enginePath, int numEngines) : enginePath(enginePath) {
+    for (int i = 0; i < numEngines; i++) {
+        std::unique_ptr<UciEngine> engine(new UciEngine());
+        if (engine->start(enginePath) == 0) {
+            freeEngines.push_back(engine.get());
+            engines.push_back(std::move(engine));
+        }
+    }
+    printf("Started %zu of %d %s engines\n", engines.size(), numEngines, enginePath.c_str());
+}
+
+/**
+ * @returns the number of engines that started successfully
+*/
+int UciEnginePool::size() const {
+    return static_cast<int>(engines.size());
+}
+
+/**
+ * Analyses the position with the next free engine, waiting for one if they are all busy.
+ * @param fen       string of the 'fen' representation of the board's pieces
+ * @param limits    UciSearchLimits for how long to search
+ * @param result    the resulting ChessAnalysisResult
+ *
+ * @returns 0 if the function returns successfully, non-zero otherwise
+*/
+int UciEnginePool::analyse(const std::string &fen, const UciSearchLimits &limits, ChessAnalysisResult &result) {
+    if (engines.empty()) {
+        printf("No %s engines are running\n", enginePath.c_str());
+        result = ChessAnalysisResult();
+        return 1;
+    }
+
+    UciEngine *engine;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        engineFreed.wait(lock, [this]() { return !freeEngines.empty(); });
+        engine = freeEngines.back();
+        freeEngines.pop_back();
+    }
+
+    // an engine that crashed or hung is started again for the next position
+    if (!engine->isRunning()) {
+        engine->start(enginePath);
+    }
+    int ret = engine->analyse(fen, limits, result);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeEngines.push_back(engine);
+    }
+    engineFreed.notify_one();
+
+    return ret;
+}
+
+
+/**
+ * Parses one 'info' line from a UCI engine into the evaluation of the result, from white's point of view.
+ * @param line          string for the line the engine printed
+ * @param whiteToMove   bool for if it is white's turn in the position being analysed
+ * @param result        the ChessAnalysisResult to update, left alone if the line has no score
+*/
+void parseUciInfoLine(const std::string &line, bool whiteToMove, ChessAnalysisResult &result) {
+    std::istringstream tokens(line);
+    std::string token;
+
+    while (tokens >> token) {
+        if (token == "depth") {
+            tokens >> result.depth;
+            continue;
+        }
+        if (token != "score") {
+            continue;
+        }
+
+        std::string type;
+        int value;
+        if (!(tokens >> type >> value)) {
+            return;
+        }
+
+        int sign = whiteToMove ? 1 : -1;
+        if (type == "cp") {
+            result.eval = sign * value / 100.0f;
+            result.hasEval = true;
+            result.hasMate = false;
+        }
+        else if (type == "mate") {
+            result.mate = sign * value;
+            result.hasMate = true;
+            result.hasEval = false;
+        }
+        return;
+    }
+}
+
+/**
+ * Parses the depth, principal variation number and first move of one 'info' line from a UCI engine.
+ * @param line      string for the line the engine printed
+ * @param depth     the resulting depth of the line
+ * @param multiPv   the resulting number of its principal variation, 1 for the best
+ * @param move      the resulting first move of the principal variation, such as "e2e4"
+ *
+ * @returns true if the line finishes a principal variation with an exact score, false for every other line
+*/
+bool parseUciPvLine(const std::string &line, int &depth, int &multiPv, std::string &move) {
+    std::istringstream tokens(line);
+    std::string token;
+    depth = 0;
+    multiPv = 1;
+    move.clear();
+
+    while (tokens >> token) {
+        if (token == "depth") {
+            tokens >> depth;
+        }
+        else if (token == "multipv") {
+            tokens >> multiPv;
+        }
+        // a bound only says the score is above or below the value, the line after it has the real one
+        else if (token == "lowerbound" || token == "upperbound") {
+            return false;
+        }
+        else if (token == "pv") {
+            tokens >> move;
+            break;
+        }
+    }
+
+    return depth > 0 && !move.empty();
+}
@@ -7,30 +7,78 @@ import torchvision
 from torchvision import datasets, transforms, models
 
 
-def train_vgg16(train_dir, test_dir):
+def load_packed_tiles(packed_path, transform=None, include_empty=False):
+    # reads the packed tile file from ./chessCV export --packed, without decoding an image per tile
+    import numpy as np
+
+    header = np.fromfile(packed_path, dtype=np.uint8, count=128)
+    if header[:8].tobytes() != b"CHSTILE\0":
+        raise ValueError(packed_path + " is not a packed tile file")
+    width, height, channels = np.frombuffer(header[12:24].tobytes(), dtype=np.uint32)
+    num_tiles = int(np.frombuffer(header[24:32].tobytes(), dtype=np.uint64)[0])
+    record_size, data_offset = np.frombuffer(header[32:40].tobytes(), dtype=np.uint32)
+    label_names = [header[40 + 3 * i:43 + 3 * i].tobytes().split(b"\0")[0].decode() for i in range(14)]
+
+    records = np.memmap(packed_path, dtype=np.uint8, mode="r", offset=int(data_offset),
+                        shape=(num_tiles, int(record_size)))
+    pieces = np.asarray(records[:, 0])
+    pixels = records[:, 16:].reshape(num_tiles, int(height), int(width), int(channels))
+
+    # every file numbers the 12 pieces the same way, in the sorted order of CLASSIFIER_PIECES on the C++ side, whichever
+    # of them it holds; the empty squares come last and are left out unless asked for
+    classes = sorted(name for name in label_names if name and name != "ee")
+    if include_empty:
+        classes.append("ee")
+    indices = np.array([i for i, piece in enumerate(pieces) if label_names[piece] in classes], dtype=np.int64)
+    targets = torch.tensor([classes.index(label_names[pieces[i]]) for i in indices])
+
+    class PackedTiles(data.Dataset):
+        def __init__(self):
+            self.classes = classes
+
+        def __len__(self):
+            return len(indices)
+
+        def __getitem__(self, index):
+            image = torch.from_numpy(np.array(pixels[indices[index]])).permute(2, 0, 1).float() / 255.0
+            if transform is not None:
+                image = transform(image)
+            return image, targets[index]
+
+    return PackedTiles()
+
+
+def get_transforms(flip=0.0, packed=False):
+    # the packed tiles are already float tensors, so they skip ToTensor and are resized as tensors
+    steps = [transforms.Resize((224, 224), antialias=True)]
+    if flip > 0:
+        steps += [transforms.RandomHorizontalFlip(flip), transforms.RandomVerticalFlip(flip)]
+    if not packed:
+        steps.append(transforms.ToTensor())
+    steps.append(transforms.Normalize([0.485, 0.456, 0.406], [0.229, 0.224, 0.225]))
+    return transforms.Compose(steps)
+
+
+def load_dataset(path, transform, packed=False):
+    # a class directory per label, or one packed tile file from ./chessCV export --packed
+    if packed:
+        return load_packed_tiles(path, transform)
+    return datasets.ImageFolder(path, transform=transform)
+
+
+def train_vgg16(train_dir, test_dir, packed=False):
     # Load pre-trained VGG16 model
     model = models.vgg16(weights='DEFAULT')
 
     # Print model summary
     # print(model)
 
-    train_transforms = transforms.Compose([
-        transforms.Resize((224, 224)),
-        transforms.RandomHorizontalFlip(0.3),
-        transforms.RandomVerticalFlip(0.3),
-        transforms.ToTensor(),
-        transforms.Normalize([0.485, 0.456, 0.406], [0.229, 0.224, 0.225])
-    ])
-
-    test_transforms = transforms.Compose([
-        transforms.Resize((224, 224)),
-        transforms.ToTensor(),
-        transforms.Normalize([0.485, 0.456, 0.406], [0.229, 0.224, 0.225])
-    ])
+    train_transforms = get_transforms(0.3, packed)
+    test_transforms = get_transforms(packed=packed)
 
     # Load the datasets
-    train_dataset = datasets.ImageFolder(train_dir, transform=train_transforms)
-    test_dataset = datasets.ImageFolder(test_dir, transform=test_transforms)
+    train_dataset = load_dataset(train_dir, train_transforms, packed)
+    test_dataset = load_dataset(test_dir, test_transforms, packed)
 
     # Define data loaders
     train_loader = torch.utils.data.DataLoader(train_dataset, batch_size=32, shuffle=True)
@@ -89,31 +137,23 @@ def train_vgg16(train_dir, test_dir):
 
     # Export the model to ONNX
     dummy_input = torch.randn(1, 3, 224, 224)
-    torch.onnx.export(model, dummy_input, "chess_piece_classifier_vgg16.onnx", verbose=True)
+    # dynamic batch axis so the C++ side can classify every occupied square in one forward pass
+    torch.onnx.export(model, dummy_input, "chess_piece_classifier_vgg16.onnx", verbose=True,
+                      input_names=["input"], output_names=["output"],
+                      dynamic_axes={"input": {0: "batch"}, "output": {0: "batch"}})
 
 
 
-def train_res_net(train_dir, test_dir):
+def train_res_net(train_dir, test_dir, packed=False):
     # Load pre-trained model
     model = models.resnet18()
 
-    train_transforms = transforms.Compose([
-        transforms.Resize((224, 224)),
-        transforms.RandomHorizontalFlip(0.3),
-        transforms.RandomVerticalFlip(0.3),
-        transforms.ToTensor(),
-        transforms.Normalize([0.485, 0.456, 0.406], [0.229, 0.224, 0.225])
-    ])
-
-    test_transforms = transforms.Compose([
-        transforms.Resize((224, 224)),
-        transforms.ToTensor(),
-        transforms.Normalize([0.485, 0.456, 0.406], [0.229, 0.224, 0.225])
-    ])
+    train_transforms = get_transforms(0.3, packed)
+    test_transforms = get_transforms(packed=packed)
 
     # Load the datasets
-    train_dataset = datasets.ImageFolder(train_dir, transform=train_transforms)
-    test_dataset = datasets.ImageFolder(test_dir, transform=test_transforms)
+    train_dataset = load_dataset(train_dir, train_transforms, packed)
+    test_dataset = load_dataset(test_dir, test_transforms, packed)
 
     # Define data loaders
     train_loader = torch.utils.data.DataLoader(train_dataset, batch_size=32, shuffle=True)
@@ -166,29 +206,20 @@ def train_res_net(train_dir, test_dir):
 
     # Export the model to ONNX
     dummy_input = torch.randn(1, 3, 224, 224)
-    torch.onnx.export(model, dummy_input, "chess_piece_classifier_res3.onnx", verbose=True)
+    torch.onnx.export(model, dummy_input, "chess_piece_classifier_res3.onnx", verbose=True,
+                      input_names=["input"], output_names=["output"],
+                      dynamic_axes={"input": {0: "batch"}, "output": {0: "batch"}})
 
 
-def train_alex_net(train_dir, test_dir):
+def train_alex_net(train_dir, test_dir, packed=False):
 
     # Define transforms for data augmentation and normalization
-    train_transforms = transforms.Compose([
-        transforms.Resize((224, 224)),
-        transforms.RandomHorizontalFlip(),
-        transforms.RandomVerticalFlip(),
-        transforms.ToTensor(),
-        transforms.Normalize([0.485, 0.456, 0.406], [0.229, 0.224, 0.225])
-    ])
-
-    test_transforms = transforms.Compose([
-        transforms.Resize((224, 224)),
-        transforms.ToTensor(),
-        transforms.Normalize([0.485, 0.456, 0.406], [0.229, 0.224, 0.225])
-    ])
+    train_transforms = get_transforms(0.5, packed)
+    test_transforms = get_transforms(packed=packed)
 
     # Load the datasets
-    train_dataset = datasets.ImageFolder(train_dir, transform=train_transforms)
-    test_dataset = datasets.ImageFolder(test_dir, transform=test_transforms)
+    train_dataset = load_dataset(train_dir, train_transforms, packed)
+    test_dataset = load_dataset(test_dir, test_transforms, packed)
 
     # Define data loaders
     train_loader = torch.utils.data.DataLoader(train_dataset, batch_size=32, shuffle=True)
@@ -246,15 +277,60 @@ def train_alex_net(train_dir, test_dir):
 
     # Export the model to ONNX
     dummy_input = torch.randn(1, 3, 224, 224)
-    torch.onnx.export(model, dummy_input, "chess_piece_classifier_alex.onnx", verbose=True)
+    torch.onnx.export(model, dummy_input, "chess_piece_classifier_alex.onnx", verbose=True,
+                      input_names=["input"], output_names=["output"],
+                      dynamic_axes={"input": {0: "batch"}, "output": {0: "batch"}})
+
+
+def export_float16(onnx_path):
+    # half precision weights, with float32 inputs and outputs so the C++ side feeds it the same blob
+    import onnx
+    from onnxconverter_common import float16
+
+    model = onnx.load(onnx_path)
+    model_fp16 = float16.convert_float_to_float16(model, keep_io_types=True)
+    fp16_path = onnx_path.replace(".onnx", "_fp16.onnx")
+    onnx.save(model_fp16, fp16_path)
+    return fp16_path
+
+
+def export_int8(onnx_path, calibration_dir, num_calibration=200, packed=False):
+    # static int8 quantization in the QDQ format, which OpenCV's dnn module can load
+    from onnxruntime.quantization import CalibrationDataReader, QuantFormat, QuantType, quantize_static
+
+    calibration_dataset = load_dataset(calibration_dir, get_transforms(packed=packed), packed)
+
+    class SquareReader(CalibrationDataReader):
+        def __init__(self):
+            count = min(num_calibration, len(calibration_dataset))
+            self.inputs = iter([{"input": calibration_dataset[i][0].unsqueeze(0).numpy()} for i in range(count)])
+
+        def get_next(self):
+            return next(self.inputs, None)
+
+    int8_path = onnx_path.replace(".onnx", "_int8.onnx")
+    quantize_static(onnx_path, int8_path, SquareReader(), quant_format=QuantFormat.QDQ,
+                    activation_type=QuantType.QInt8, weight_type=QuantType.QInt8)
+    return int8_path
 
 
 # Press the green button in the gutter to run the script.
 if __name__ == '__main__':
-    train_dir = 'Data/output_train'
-    test_dir = 'Data/output_test'
-    train_vgg16(train_dir, test_dir)
+    import argparse
+
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--train", default="Data/output_train", help="class directories, or a packed tile file with --packed")
+    parser.add_argument("--test", default="Data/output_test", help="class directories, or a packed tile file with --packed")
+    parser.add_argument("--packed", action="store_true", help="read --train and --test as packed tile files from ./chessCV export --packed")
+    args = parser.parse_args()
+
+    train_dir = args.train
+    test_dir = args.test
+    train_vgg16(train_dir, test_dir, args.packed)
     print("NOW ON TO AlexNet...")
-    train_alex_net(train_dir, test_dir)
+    train_alex_net(train_dir, test_dir, args.packed)
+    # lighter exports of the smaller models, to compare with ./bench --compare-models
+    export_float16("chess_piece_classifier_alex.onnx")
+    export_int8("chess_piece_classifier_alex.onnx", test_dir, packed=args.packed)
 
 # See PyCharm help at https://www.jetbrains.com/help/pycharm/